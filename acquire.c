@@ -0,0 +1,195 @@
+/*
+    ChibiOS - Copyright (C) 2006..2015 Giovanni Di Sirio
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+/**
+ * @file    acquire.c
+ * @brief   ADC acquisition engine code.
+ * @details ADC1 converts continuously into a circular DMA buffer of two
+ *          blocks. The half and full transfer callbacks hand the completed
+ *          block to a processing thread, there is no per-sample interrupt.
+ *          A block completing while the thread is still busy with the
+ *          previous one is counted as dropped.
+ *
+ * @addtogroup ACQUIRE
+ * @{
+ */
+
+#include <string.h>
+
+#include "ch.h"
+#include "hal.h"
+
+#include "acquire.h"
+
+/*===========================================================================*/
+/* Module local definitions.                                                 */
+/*===========================================================================*/
+
+#define ACQ_NUM_CHANNELS    1
+
+/*===========================================================================*/
+/* Module local variables.                                                   */
+/*===========================================================================*/
+
+static adcsample_t samples[2 * ACQ_BLOCK_SIZE];
+static acq_status_t acq;
+static thread_reference_t acq_trp;
+static thread_t *acq_tp;
+static THD_WORKING_AREA(waAcquire, 256);
+
+/*===========================================================================*/
+/* Module local functions.                                                   */
+/*===========================================================================*/
+
+/*
+ * Invoked at half and full buffer, the pointer is the block just filled.
+ */
+static void acq_cb(ADCDriver *adcp, adcsample_t *buffer, size_t n) {
+
+  (void)adcp;
+  (void)n;
+  chSysLockFromISR();
+  if (acq_trp != NULL)
+    chThdResumeI(&acq_trp, (msg_t)buffer);
+  else
+    acq.dropped++;
+  chSysUnlockFromISR();
+}
+
+static void acq_error_cb(ADCDriver *adcp, adcerror_t err) {
+
+  (void)adcp;
+  (void)err;
+  acq.errors++;
+}
+
+/*
+ * ADC1 converting channel IN1 (PA1) continuously.
+ */
+static const ADCConversionGroup acq_grpcfg = {
+  TRUE,
+  ACQ_NUM_CHANNELS,
+  acq_cb,
+  acq_error_cb,
+  0, 0,                         /* CR1, CR2 */
+  0,                            /* SMPR1 */
+  ADC_SMPR2_SMP_AN1(ACQ_SAMPLE_TIME),
+  ADC_SQR1_NUM_CH(ACQ_NUM_CHANNELS),
+  0,                            /* SQR2 */
+  ADC_SQR3_SQ1_N(ADC_CHANNEL_IN1)
+};
+
+static THD_FUNCTION(Acquire, arg) {
+  adcproc_stats_t stats;
+  uint16_t decimated[ACQ_BLOCK_SIZE / ACQ_DECIMATION];
+
+  (void)arg;
+  chRegSetThreadName("acquire");
+  while (!chThdShouldTerminateX()) {
+    const adcsample_t *block;
+    rtcnt_t start;
+    msg_t msg;
+
+    chSysLock();
+    msg = chThdSuspendTimeoutS(&acq_trp, MS2ST(100));
+    chSysUnlock();
+    if (msg == MSG_TIMEOUT)
+      continue;
+
+    block = (const adcsample_t *)msg;
+    start = chSysGetRealtimeCounterX();
+    adcprocStats(block, ACQ_BLOCK_SIZE, &stats);
+    adcprocDecimate(block, ACQ_BLOCK_SIZE, ACQ_DECIMATION, decimated);
+
+    chSysLock();
+    acq.stats = stats;
+    memcpy(acq.decimated, decimated, sizeof decimated);
+    acq.blocks++;
+    acq.cycles = chSysGetRealtimeCounterX() - start;
+    chSysUnlock();
+  }
+}
+
+/*===========================================================================*/
+/* Module exported functions.                                                */
+/*===========================================================================*/
+
+/**
+ * @brief   Starts the acquisition and the processing thread.
+ *
+ * @api
+ */
+void acqStart(void) {
+
+  if (acq_tp != NULL)
+    return;
+
+  memset(&acq, 0, sizeof acq);
+  acq_tp = chThdCreateStatic(waAcquire, sizeof(waAcquire), ACQ_THREAD_PRIO,
+                             Acquire, NULL);
+  adcStart(&ADCD1, NULL);
+  acq.start = chVTGetSystemTime();
+  adcStartConversion(&ADCD1, &acq_grpcfg, samples, 2 * ACQ_BLOCK_SIZE);
+}
+
+/**
+ * @brief   Stops the acquisition and the processing thread.
+ *
+ * @api
+ */
+void acqStop(void) {
+
+  if (acq_tp == NULL)
+    return;
+
+  adcStopConversion(&ADCD1);
+  adcStop(&ADCD1);
+  chThdTerminate(acq_tp);
+  chThdWait(acq_tp);
+  acq_tp = NULL;
+}
+
+/**
+ * @brief   Returns a consistent copy of the acquisition status.
+ *
+ * @param[out] asp      the status copy
+ *
+ * @api
+ */
+void acqGetStatus(acq_status_t *asp) {
+
+  chSysLock();
+  *asp = acq;
+  chSysUnlock();
+}
+
+/**
+ * @brief   Returns the cumulative error counters of the acquisition.
+ *
+ * @param[out] dropped  blocks completed while the thread was busy
+ * @param[out] errors   ADC/DMA errors
+ *
+ * @iclass
+ */
+void acqGetCountersI(uint32_t *dropped, uint32_t *errors) {
+
+  chDbgCheckClassI();
+
+  *dropped = acq.dropped;
+  *errors = acq.errors;
+}
+
+/** @} */
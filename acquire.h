@@ -0,0 +1,117 @@
+/*
+    ChibiOS - Copyright (C) 2006..2015 Giovanni Di Sirio
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+/**
+ * @file    acquire.h
+ * @brief   ADC acquisition engine header.
+ *
+ * @addtogroup ACQUIRE
+ * @{
+ */
+
+#ifndef _ACQUIRE_H_
+#define _ACQUIRE_H_
+
+#include "adcproc.h"
+
+/*===========================================================================*/
+/* Module pre-compile time settings.                                         */
+/*===========================================================================*/
+
+/**
+ * @brief   Samples per processing block.
+ * @details The DMA buffer holds two blocks, one is processed while the
+ *          other is being filled.
+ */
+#if !defined(ACQ_BLOCK_SIZE) || defined(__DOXYGEN__)
+#define ACQ_BLOCK_SIZE              256
+#endif
+
+/**
+ * @brief   Decimation factor of the output stream.
+ */
+#if !defined(ACQ_DECIMATION) || defined(__DOXYGEN__)
+#define ACQ_DECIMATION              8
+#endif
+
+/**
+ * @brief   ADC sampling time of the converted channel.
+ * @note    At the 9MHz ADC clock 239.5 cycles give 35.7kS/s, 47.6kS/s at
+ *          the 12MHz of the reduced clock profile and 15.9kS/s at the 4MHz
+ *          of the HSI profile.
+ */
+#if !defined(ACQ_SAMPLE_TIME) || defined(__DOXYGEN__)
+#define ACQ_SAMPLE_TIME             ADC_SAMPLE_239P5
+#endif
+
+/**
+ * @brief   Block processing thread priority.
+ */
+#if !defined(ACQ_THREAD_PRIO) || defined(__DOXYGEN__)
+#define ACQ_THREAD_PRIO             (NORMALPRIO + 1)
+#endif
+
+/*===========================================================================*/
+/* Derived constants and error checks.                                       */
+/*===========================================================================*/
+
+#if !HAL_USE_ADC
+#error "the acquisition engine requires HAL_USE_ADC"
+#endif
+
+#if (ACQ_BLOCK_SIZE % ACQ_DECIMATION) != 0
+#error "ACQ_BLOCK_SIZE must be a multiple of ACQ_DECIMATION"
+#endif
+
+/*===========================================================================*/
+/* Module data structures and types.                                         */
+/*===========================================================================*/
+
+/**
+ * @brief   Acquisition counters and last results.
+ */
+typedef struct {
+  uint32_t              blocks;             /**< @brief Blocks processed.   */
+  uint32_t              dropped;            /**< @brief Blocks completed while
+                                                 the thread was busy.       */
+  uint32_t              errors;             /**< @brief ADC/DMA errors.     */
+  systime_t             start;              /**< @brief Acquisition start
+                                                 time.                      */
+  rtcnt_t               cycles;             /**< @brief Cycles spent on the
+                                                 last block.                */
+  adcproc_stats_t       stats;              /**< @brief Last block
+                                                 statistics.                */
+  uint16_t              decimated[ACQ_BLOCK_SIZE / ACQ_DECIMATION];
+} acq_status_t;
+
+/*===========================================================================*/
+/* External declarations.                                                    */
+/*===========================================================================*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+  void acqStart(void);
+  void acqStop(void);
+  void acqGetStatus(acq_status_t *asp);
+  void acqGetCountersI(uint32_t *dropped, uint32_t *errors);
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _ACQUIRE_H_ */
+
+/** @} */
@@ -0,0 +1,119 @@
+/*
+    ChibiOS - Copyright (C) 2006..2015 Giovanni Di Sirio
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+/**
+ * @file    adcproc.c
+ * @brief   ADC block processing kernels code.
+ * @details Integer only kernels, the samples are processed in a single
+ *          pass per block.
+ *
+ * @addtogroup ADCPROC
+ * @{
+ */
+
+#include "adcproc.h"
+
+/*===========================================================================*/
+/* Module exported functions.                                                */
+/*===========================================================================*/
+
+/**
+ * @brief   Computes the statistics of a block of samples.
+ *
+ * @param[in] samples   the samples block
+ * @param[in] n         number of samples, at least one
+ * @param[out] sp       the block statistics
+ */
+void adcprocStats(const uint16_t *samples, size_t n, adcproc_stats_t *sp) {
+  uint32_t min = UINT16_MAX, max = 0;
+  uint32_t sum = 0;
+  uint64_t sumsq = 0;
+  size_t i;
+
+  for (i = 0; i < n; i++) {
+    uint32_t s = samples[i];
+
+    if (s < min)
+      min = s;
+    if (s > max)
+      max = s;
+    sum += s;
+    sumsq += s * s;
+  }
+  sp->min  = (uint16_t)min;
+  sp->max  = (uint16_t)max;
+  sp->mean = (uint16_t)((sum + n / 2) / n);
+  sp->rms  = (uint16_t)adcprocSqrt((sumsq + n / 2) / n);
+}
+
+/**
+ * @brief   Decimates a block of samples by averaging.
+ * @details Each output sample is the rounded mean of @p factor input
+ *          samples, an incomplete trailing group is discarded.
+ * @note    The output can overlap the input, it is never ahead of it.
+ *
+ * @param[in] samples   the samples block
+ * @param[in] n         number of samples
+ * @param[in] factor    decimation factor, at least one
+ * @param[out] out      the decimated samples
+ * @return              The number of output samples.
+ */
+size_t adcprocDecimate(const uint16_t *samples, size_t n,
+                       unsigned factor, uint16_t *out) {
+  size_t i, m;
+
+  m = n / factor;
+  for (i = 0; i < m; i++) {
+    uint32_t acc = 0;
+    unsigned j;
+
+    for (j = 0; j < factor; j++)
+      acc += *samples++;
+    out[i] = (uint16_t)((acc + factor / 2) / factor);
+  }
+  return m;
+}
+
+/**
+ * @brief   Integer square root.
+ *
+ * @param[in] x         the operand
+ * @return              The square root rounded to nearest, saturated to
+ *                      @p UINT32_MAX for the operands above
+ *                      (2^32 - 0.5)^2.
+ */
+uint32_t adcprocSqrt(uint64_t x) {
+  uint64_t r = 0, bit = (uint64_t)1 << 62;
+
+  while (bit > x)
+    bit >>= 2;
+  while (bit != 0) {
+    if (x >= r + bit) {
+      x -= r + bit;
+      r = (r >> 1) + bit;
+    }
+    else
+      r >>= 1;
+    bit >>= 2;
+  }
+  /* Rounding, x holds the remainder of the floor root. The floor root of
+     the largest operands is UINT32_MAX, rounding up would wrap to zero.*/
+  if ((x > r) && (r < UINT32_MAX))
+    r++;
+  return (uint32_t)r;
+}
+
+/** @} */
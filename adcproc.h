@@ -0,0 +1,63 @@
+/*
+    ChibiOS - Copyright (C) 2006..2015 Giovanni Di Sirio
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+/**
+ * @file    adcproc.h
+ * @brief   ADC block processing kernels header.
+ * @note    This module does not depend on the RTOS or the HAL.
+ *
+ * @addtogroup ADCPROC
+ * @{
+ */
+
+#ifndef _ADCPROC_H_
+#define _ADCPROC_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*===========================================================================*/
+/* Module data structures and types.                                         */
+/*===========================================================================*/
+
+/**
+ * @brief   Statistics of a block of samples.
+ */
+typedef struct {
+  uint16_t              min;                /**< @brief Minimum sample.     */
+  uint16_t              max;                /**< @brief Maximum sample.     */
+  uint16_t              mean;               /**< @brief Rounded mean.       */
+  uint16_t              rms;                /**< @brief Rounded RMS.        */
+} adcproc_stats_t;
+
+/*===========================================================================*/
+/* External declarations.                                                    */
+/*===========================================================================*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+  void adcprocStats(const uint16_t *samples, size_t n, adcproc_stats_t *sp);
+  size_t adcprocDecimate(const uint16_t *samples, size_t n,
+                         unsigned factor, uint16_t *out);
+  uint32_t adcprocSqrt(uint64_t x);
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _ADCPROC_H_ */
+
+/** @} */
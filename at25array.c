@@ -0,0 +1,216 @@
+/*
+    ChibiOS - Copyright (C) 2006..2015 Giovanni Di Sirio
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+
+/**
+ * @file    at25array.c
+ * @brief   Array of AT25xxx devices code.
+ * @details The devices of an array are seen as a single address space,
+ *          either one after the other or striped page by page. In striped
+ *          mode a multi page write starts the page programs of different
+ *          devices back to back, their write cycles overlap.
+ *
+ * @addtogroup AT25ARRAY
+ * @{
+ */
+
+#include "ch.h"
+#include "hal.h"
+
+#include "at25array.h"
+
+/*===========================================================================*/
+/* Driver local definitions.                                                 */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Driver local functions.                                                   */
+/*===========================================================================*/
+
+/*
+ * Device and device address of an array address, returns the number of
+ * bytes up to the end of the page or of the device.
+ */
+static size_t map(AT25Array *arrp, uint32_t addr,
+                  AT25Driver **eeppp, uint32_t *daddrp) {
+  const AT25ArrayConfig *cfg = arrp->config;
+  unsigned i;
+
+  if (cfg->mode == AT25_ARRAY_STRIPED) {
+    uint32_t page = addr / arrp->page_size;
+    uint32_t offset = addr % arrp->page_size;
+
+    *eeppp  = cfg->devices[page % cfg->n];
+    *daddrp = (page / cfg->n) * arrp->page_size + offset;
+    return arrp->page_size - offset;
+  }
+
+  for (i = 0; addr >= at25GetSize(cfg->devices[i]); i++)
+    addr -= at25GetSize(cfg->devices[i]);
+  *eeppp  = cfg->devices[i];
+  *daddrp = addr;
+  return at25GetSize(cfg->devices[i]) - addr;
+}
+
+/*===========================================================================*/
+/* Driver exported functions.                                                */
+/*===========================================================================*/
+
+/**
+ * @brief   Activates an array.
+ * @details The page size of a linear array is the smallest one of its
+ *          devices, the devices of a striped array must share the same
+ *          page size and only the capacity of the smallest one is used on
+ *          each of them.
+ * @pre     The devices have been started.
+ *
+ * @param[out] arrp     pointer to the @p AT25Array object
+ * @param[in] config    pointer to the @p AT25ArrayConfig object
+ * @return              The operation status.
+ * @retval MSG_OK       if the array is usable.
+ * @retval MSG_RESET    if the devices cannot form the array.
+ *
+ * @api
+ */
+msg_t at25arrayStart(AT25Array *arrp, const AT25ArrayConfig *config) {
+  uint32_t size, min_size, page_size;
+  unsigned i;
+
+  osalDbgCheck((arrp != NULL) && (config != NULL));
+
+  if (config->n == 0)
+    return MSG_RESET;
+  size      = 0;
+  min_size  = at25GetSize(config->devices[0]);
+  page_size = at25GetPageSize(config->devices[0]);
+  for (i = 0; i < config->n; i++) {
+    AT25Driver *eepp = config->devices[i];
+
+    if (eepp->state != AT25_READY)
+      return MSG_RESET;
+    if (at25GetPageSize(eepp) != page_size) {
+      if (config->mode == AT25_ARRAY_STRIPED)
+        return MSG_RESET;
+      if (at25GetPageSize(eepp) < page_size)
+        page_size = at25GetPageSize(eepp);
+    }
+    if (at25GetSize(eepp) < min_size)
+      min_size = at25GetSize(eepp);
+    size += at25GetSize(eepp);
+  }
+
+  arrp->config    = config;
+  arrp->page_size = page_size;
+  arrp->size      = config->mode == AT25_ARRAY_STRIPED ? min_size * config->n
+                                                       : size;
+  return MSG_OK;
+}
+
+/**
+ * @brief   Reads a block of data.
+ *
+ * @param[in] arrp      pointer to the @p AT25Array object
+ * @param[in] addr      start address
+ * @param[out] buf      destination buffer
+ * @param[in] n         number of bytes
+ * @return              The operation status, see @p at25Read().
+ *
+ * @api
+ */
+msg_t at25arrayRead(AT25Array *arrp, uint32_t addr, uint8_t *buf, size_t n) {
+  msg_t msg = MSG_OK;
+
+  osalDbgCheck((arrp != NULL) && (buf != NULL));
+
+  if ((addr > arrp->size) || (n > arrp->size - addr))
+    return MSG_RESET;
+
+  while ((n > 0) && (msg == MSG_OK)) {
+    AT25Driver *eepp;
+    uint32_t daddr;
+    size_t chunk = map(arrp, addr, &eepp, &daddr);
+
+    if (chunk > n)
+      chunk = n;
+    msg = at25Read(eepp, daddr, buf, chunk);
+    addr += chunk;
+    buf  += chunk;
+    n    -= chunk;
+  }
+  return msg;
+}
+
+/**
+ * @brief   Writes a block of data.
+ * @details The function returns once the last page programs are started,
+ *          use @p at25arraySync() to wait for their completion.
+ *
+ * @param[in] arrp      pointer to the @p AT25Array object
+ * @param[in] addr      start address
+ * @param[in] buf       source buffer
+ * @param[in] n         number of bytes
+ * @return              The operation status, see @p at25Write().
+ *
+ * @api
+ */
+msg_t at25arrayWrite(AT25Array *arrp, uint32_t addr,
+                     const uint8_t *buf, size_t n) {
+  msg_t msg = MSG_OK;
+
+  osalDbgCheck((arrp != NULL) && (buf != NULL));
+
+  if ((addr > arrp->size) || (n > arrp->size - addr))
+    return MSG_RESET;
+
+  while ((n > 0) && (msg == MSG_OK)) {
+    AT25Driver *eepp;
+    uint32_t daddr;
+    size_t chunk = map(arrp, addr, &eepp, &daddr);
+
+    if (chunk > n)
+      chunk = n;
+    msg = at25Write(eepp, daddr, buf, chunk);
+    addr += chunk;
+    buf  += chunk;
+    n    -= chunk;
+  }
+  return msg;
+}
+
+/**
+ * @brief   Waits for the completion of the write cycles of all devices.
+ *
+ * @param[in] arrp      pointer to the @p AT25Array object
+ * @return              The operation status.
+ * @retval MSG_OK       if no write cycle is pending.
+ * @retval MSG_TIMEOUT  if a write cycle did not complete.
+ *
+ * @api
+ */
+msg_t at25arraySync(AT25Array *arrp) {
+  msg_t msg = MSG_OK;
+  unsigned i;
+
+  osalDbgCheck(arrp != NULL);
+
+  for (i = 0; i < arrp->config->n; i++) {
+    if (at25Sync(arrp->config->devices[i]) != MSG_OK)
+      msg = MSG_TIMEOUT;
+  }
+  return msg;
+}
+
+/** @} */
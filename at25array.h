@@ -0,0 +1,130 @@
+/*
+    ChibiOS - Copyright (C) 2006..2015 Giovanni Di Sirio
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+
+/**
+ * @file    at25array.h
+ * @brief   Array of AT25xxx devices header.
+ *
+ * @addtogroup AT25ARRAY
+ * @{
+ */
+
+#ifndef _AT25ARRAY_H_
+#define _AT25ARRAY_H_
+
+#include "at25xxx.h"
+
+/*===========================================================================*/
+/* Driver constants.                                                         */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Driver pre-compile time settings.                                         */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Derived constants and error checks.                                       */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Driver data structures and types.                                         */
+/*===========================================================================*/
+
+/**
+ * @brief   Address mapping of an array.
+ */
+typedef enum {
+  AT25_ARRAY_LINEAR = 0,            /**< Devices one after the other.       */
+  AT25_ARRAY_STRIPED = 1            /**< Consecutive pages alternate
+                                         devices.                           */
+} at25arraymode_t;
+
+/**
+ * @brief   Array configuration structure.
+ */
+typedef struct {
+  /**
+   * @brief   Started devices of the array.
+   */
+  AT25Driver * const    *devices;
+  /**
+   * @brief   Number of devices.
+   */
+  unsigned              n;
+  /**
+   * @brief   Address mapping.
+   */
+  at25arraymode_t       mode;
+} AT25ArrayConfig;
+
+/**
+ * @brief   Array structure.
+ */
+typedef struct {
+  /**
+   * @brief   Current configuration data.
+   */
+  const AT25ArrayConfig *config;
+  /**
+   * @brief   Capacity in bytes.
+   */
+  uint32_t              size;
+  /**
+   * @brief   Page size, the stripe unit in striped mode.
+   */
+  uint32_t              page_size;
+} AT25Array;
+
+/*===========================================================================*/
+/* Driver macros.                                                            */
+/*===========================================================================*/
+
+/**
+ * @brief   Capacity of a started array.
+ *
+ * @param[in] arrp      pointer to the @p AT25Array object
+ */
+#define at25arrayGetSize(arrp) ((arrp)->size)
+
+/**
+ * @brief   Page size of a started array.
+ * @details Aligned blocks of this size are programmed with one page program
+ *          of a single device.
+ *
+ * @param[in] arrp      pointer to the @p AT25Array object
+ */
+#define at25arrayGetPageSize(arrp) ((arrp)->page_size)
+
+/*===========================================================================*/
+/* External declarations.                                                    */
+/*===========================================================================*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+  msg_t at25arrayStart(AT25Array *arrp, const AT25ArrayConfig *config);
+  msg_t at25arrayRead(AT25Array *arrp, uint32_t addr, uint8_t *buf, size_t n);
+  msg_t at25arrayWrite(AT25Array *arrp, uint32_t addr,
+                       const uint8_t *buf, size_t n);
+  msg_t at25arraySync(AT25Array *arrp);
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _AT25ARRAY_H_ */
+
+/** @} */
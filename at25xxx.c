@@ -0,0 +1,588 @@
+/*
+    ChibiOS - Copyright (C) 2006..2015 Giovanni Di Sirio
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+
+/**
+ * @file    at25xxx.c
+ * @brief   AT25xxx SPI serial EEPROM driver code.
+ * @details Reads are split in chunks of @p SPIBUS_CHUNK_SIZE bytes and
+ *          writes on page boundaries, the SPI bus is owned for one chunk at
+ *          a time. A write returns once its last page program is started,
+ *          the write cycle is waited for by the next access to the device,
+ *          so that the cycles of several devices overlap. The bus is free
+ *          during the write cycles. Short sequential reads are served from
+ *          a read-ahead window filled by a single READ instruction.
+ *          Writes to the blocks protected by BP1:BP0 are rejected without
+ *          accessing the bus, pages already holding the data are not
+ *          programmed.
+ *
+ * @addtogroup AT25XXX
+ * @{
+ */
+
+#include <string.h>
+
+#include "ch.h"
+#include "hal.h"
+
+#include "at25xxx.h"
+#include "ramfunc.h"
+#include "status.h"
+
+/*===========================================================================*/
+/* Driver local definitions.                                                 */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Driver exported variables.                                                */
+/*===========================================================================*/
+
+/**
+ * @brief   AT25320, 32 kbit.
+ */
+const AT25Geometry AT25320_GEOMETRY = {"AT25320", 4096, 32};
+
+/**
+ * @brief   AT25640, 64 kbit.
+ */
+const AT25Geometry AT25640_GEOMETRY = {"AT25640", 8192, 32};
+
+/**
+ * @brief   AT25256, 256 kbit.
+ */
+const AT25Geometry AT25256_GEOMETRY = {"AT25256", 32768, 64};
+
+/*===========================================================================*/
+/* Driver local functions.                                                   */
+/*===========================================================================*/
+
+/*
+ * Sends an instruction with an optional 16 bits address.
+ */
+static void send_command(SPIDriver *spip, uint8_t cmd, uint32_t addr,
+                         bool has_addr) {
+  uint8_t txbuf[3];
+
+  txbuf[0] = cmd;
+  txbuf[1] = (uint8_t)(addr >> 8);
+  txbuf[2] = (uint8_t)addr;
+  spiSend(spip, has_addr ? 3 : 1, txbuf);
+}
+
+static uint8_t read_status(SPIDriver *spip) {
+  uint8_t cmd = AT25_CMD_RDSR, sr;
+
+  spiSelect(spip);
+  spiSend(spip, 1, &cmd);
+  spiReceive(spip, 1, &sr);
+  spiUnselect(spip);
+  return sr;
+}
+
+static void write_enable(SPIDriver *spip) {
+
+  spiSelect(spip);
+  send_command(spip, AT25_CMD_WREN, 0, false);
+  spiUnselect(spip);
+}
+
+/*
+ * Waits for the pending write cycle, if any, with the device mutex held.
+ * The status register is polled once per tick, the bus is only owned for
+ * the polls.
+ */
+static msg_t wait_ready(AT25Driver *eepp) {
+  uint8_t sr;
+
+  while (eepp->busy) {
+    spibusAcquire(&eepp->client);
+    sr = read_status(spibusGetDriver(&eepp->client));
+    spibusRelease(&eepp->client);
+    if ((sr & AT25_SR_NRDY) == 0)
+      eepp->busy = false;
+    else if (chVTTimeElapsedSinceX(eepp->programmed) >=
+             MS2ST(AT25_WRITE_TIMEOUT_MS))
+      return MSG_TIMEOUT;
+    else
+      chThdSleepMilliseconds(1);
+  }
+  return MSG_OK;
+}
+
+/*
+ * Marks the start of a write cycle.
+ */
+static void start_cycle(AT25Driver *eepp) {
+
+  eepp->busy       = true;
+  eepp->programmed = chVTGetSystemTimeX();
+}
+
+/*
+ * Reads with a single READ instruction, the device mutex is held.
+ */
+static msg_t read_block(AT25Driver *eepp, uint32_t addr,
+                        uint8_t *buf, size_t n) {
+  SPIDriver *spip = spibusGetDriver(&eepp->client);
+  msg_t msg;
+
+  msg = wait_ready(eepp);
+  if (msg != MSG_OK)
+    return msg;
+  spibusAcquire(&eepp->client);
+  spiSelect(spip);
+  send_command(spip, AT25_CMD_READ, addr, true);
+  spiReceive(spip, n, buf);
+  spiUnselect(spip);
+  spibusRelease(&eepp->client);
+  return MSG_OK;
+}
+
+#if (AT25_READAHEAD_SIZE > 0) || defined(__DOXYGEN__)
+static bool ra_holds(AT25Driver *eepp, uint32_t addr) {
+
+  return (addr >= eepp->ra_addr) && (addr - eepp->ra_addr < eepp->ra_len);
+}
+
+/*
+ * Refills the window from an address, the device mutex is held.
+ */
+static msg_t ra_fill(AT25Driver *eepp, uint32_t addr) {
+  size_t n = at25GetSize(eepp) - addr;
+  msg_t msg;
+
+  if (n > AT25_READAHEAD_SIZE)
+    n = AT25_READAHEAD_SIZE;
+  eepp->ra_addr = addr;
+  eepp->ra_len  = 0;
+  msg = read_block(eepp, addr, eepp->ra_buf, n);
+  if (msg == MSG_OK)
+    eepp->ra_len = n;
+  return msg;
+}
+
+/*
+ * Drops the window if it overlaps a written range.
+ */
+static void ra_invalidate(AT25Driver *eepp, uint32_t addr, size_t n) {
+
+  if ((addr < eepp->ra_addr + eepp->ra_len) && (eepp->ra_addr < addr + n))
+    eepp->ra_len = 0;
+}
+#endif /* AT25_READAHEAD_SIZE > 0 */
+
+#if AT25_USE_WRITE_COMPARE || defined(__DOXYGEN__)
+/*
+ * True if the device already holds the data, the device mutex is held and
+ * no write cycle is pending.
+ */
+static bool holds_data(AT25Driver *eepp, uint32_t addr,
+                       const uint8_t *buf, size_t n, msg_t *msgp) {
+  uint8_t page[AT25_MAX_PAGE_SIZE];
+
+#if AT25_READAHEAD_SIZE > 0
+  if (ra_holds(eepp, addr) && (n <= eepp->ra_addr + eepp->ra_len - addr))
+    return memcmp(&eepp->ra_buf[addr - eepp->ra_addr], buf, n) == 0;
+#endif
+  *msgp = read_block(eepp, addr, page, n);
+  return (*msgp == MSG_OK) && (memcmp(page, buf, n) == 0);
+}
+#endif /* AT25_USE_WRITE_COMPARE */
+
+/*===========================================================================*/
+/* Driver exported functions.                                                */
+/*===========================================================================*/
+
+/**
+ * @brief   Initializes an instance.
+ *
+ * @param[out] eepp     pointer to the @p AT25Driver object
+ *
+ * @init
+ */
+void at25ObjectInit(AT25Driver *eepp) {
+
+  eepp->state    = AT25_STOP;
+  eepp->config   = NULL;
+  eepp->programs = 0;
+  eepp->skipped  = 0;
+  eepp->wear     = NULL;
+  eepp->sr       = 0;
+  eepp->busy     = false;
+  eepp->next     = 0;
+  eepp->hits     = 0;
+  eepp->misses   = 0;
+#if AT25_READAHEAD_SIZE > 0
+  eepp->ra_addr  = 0;
+  eepp->ra_len   = 0;
+#endif
+  chMtxObjectInit(&eepp->mutex);
+}
+
+/**
+ * @brief   Configures and activates the device driver.
+ * @note    The device is attached to the bus of the configuration and its
+ *          status register is read for the block protection state.
+ *
+ * @param[in] eepp      pointer to the @p AT25Driver object
+ * @param[in] config    pointer to the @p AT25Config object
+ *
+ * @api
+ */
+void at25Start(AT25Driver *eepp, const AT25Config *config) {
+
+  osalDbgCheck((eepp != NULL) && (config != NULL) &&
+               (config->geometry->page_size <= AT25_MAX_PAGE_SIZE));
+  osalDbgAssert((eepp->state == AT25_STOP) || (eepp->state == AT25_READY),
+                "invalid state");
+
+  eepp->config = config;
+  spibusClientInit(&eepp->client, config->busp, config->name,
+                   config->spicfg);
+  chMtxLock(&eepp->mutex);
+  spibusAcquire(&eepp->client);
+  eepp->sr = read_status(spibusGetDriver(&eepp->client));
+  spibusRelease(&eepp->client);
+  chMtxUnlock(&eepp->mutex);
+  eepp->state = AT25_READY;
+}
+
+/**
+ * @brief   Deactivates the device driver.
+ *
+ * @param[in] eepp      pointer to the @p AT25Driver object
+ *
+ * @api
+ */
+void at25Stop(AT25Driver *eepp) {
+
+  osalDbgCheck(eepp != NULL);
+  osalDbgAssert((eepp->state == AT25_STOP) || (eepp->state == AT25_READY),
+                "invalid state");
+
+  eepp->state = AT25_STOP;
+}
+
+/**
+ * @brief   Reads a block of data.
+ * @details Each chunk is a separate READ instruction, a concurrent write
+ *          may land between two chunks. A read shorter than the read-ahead
+ *          window and starting where the previous one ended refills the
+ *          window, the window is then used until the reads leave it.
+ *
+ * @param[in] eepp      pointer to the @p AT25Driver object
+ * @param[in] addr      start address
+ * @param[out] buf      destination buffer
+ * @param[in] n         number of bytes
+ * @return              The operation status.
+ * @retval MSG_OK       if the operation succeeded.
+ * @retval MSG_RESET    if the range is outside the device.
+ * @retval MSG_TIMEOUT  if a pending write cycle did not complete.
+ *
+ * @api
+ */
+msg_t at25Read(AT25Driver *eepp, uint32_t addr, uint8_t *buf, size_t n) {
+  bool accessed = false;
+  msg_t msg = MSG_OK;
+
+  osalDbgCheck((eepp != NULL) && (buf != NULL));
+  osalDbgAssert(eepp->state == AT25_READY, "not ready");
+
+  if ((addr > at25GetSize(eepp)) || (n > at25GetSize(eepp) - addr))
+    return MSG_RESET;
+
+  while ((n > 0) && (msg == MSG_OK)) {
+    size_t chunk = n < SPIBUS_CHUNK_SIZE ? n : SPIBUS_CHUNK_SIZE;
+    bool served = false;
+
+    chMtxLock(&eepp->mutex);
+#if AT25_READAHEAD_SIZE > 0
+    if (!ra_holds(eepp, addr) && (addr == eepp->next) &&
+        (n < AT25_READAHEAD_SIZE)) {
+      msg = ra_fill(eepp, addr);
+      accessed = true;
+    }
+    if (ra_holds(eepp, addr)) {
+      size_t avail = eepp->ra_addr + eepp->ra_len - addr;
+
+      if (chunk > avail)
+        chunk = avail;
+      memcpy(buf, &eepp->ra_buf[addr - eepp->ra_addr], chunk);
+      served = true;
+    }
+#endif
+    if (!served && (msg == MSG_OK)) {
+      msg = read_block(eepp, addr, buf, chunk);
+      accessed = true;
+    }
+    eepp->next = addr + chunk;
+    if ((chunk == n) || (msg != MSG_OK)) {
+      if (accessed)
+        eepp->misses++;
+      else
+        eepp->hits++;
+    }
+    chMtxUnlock(&eepp->mutex);
+    addr += chunk;
+    buf  += chunk;
+    n    -= chunk;
+  }
+  return msg;
+}
+
+/**
+ * @brief   Writes a block of data.
+ * @details The block is split on page boundaries, each page program waits
+ *          for the previous write cycle. The function returns once the
+ *          last page program is started, use @p at25Sync() to wait for its
+ *          completion. The page loop runs from RAM.
+ * @note    With @p AT25_USE_WRITE_COMPARE the pages already holding the
+ *          data are skipped.
+ *
+ * @param[in] eepp      pointer to the @p AT25Driver object
+ * @param[in] addr      start address
+ * @param[in] buf       source buffer
+ * @param[in] n         number of bytes
+ * @return              The operation status.
+ * @retval MSG_OK       if the operation succeeded.
+ * @retval MSG_RESET    if the range is outside the device or overlaps the
+ *                      protected blocks.
+ * @retval MSG_TIMEOUT  if a write cycle did not complete.
+ *
+ * @api
+ */
+RAMFUNC msg_t at25Write(AT25Driver *eepp, uint32_t addr,
+                        const uint8_t *buf, size_t n) {
+  SPIDriver *spip;
+  msg_t msg = MSG_OK;
+
+  osalDbgCheck((eepp != NULL) && (buf != NULL));
+  osalDbgAssert(eepp->state == AT25_READY, "not ready");
+
+  if ((addr > at25GetSize(eepp)) || (n > at25GetSize(eepp) - addr))
+    return MSG_RESET;
+  if ((n > 0) && (addr + n > at25GetProtectedBase(eepp)))
+    return MSG_RESET;
+
+  spip = spibusGetDriver(&eepp->client);
+  statusSet(STATUS_EEPROM_BUSY);
+  while ((n > 0) && (msg == MSG_OK)) {
+    size_t chunk = at25GetPageSize(eepp) - (addr % at25GetPageSize(eepp));
+    bool same = false;
+
+    if (chunk > n)
+      chunk = n;
+    chMtxLock(&eepp->mutex);
+    msg = wait_ready(eepp);
+#if AT25_USE_WRITE_COMPARE
+    if (msg == MSG_OK)
+      same = holds_data(eepp, addr, buf, chunk, &msg);
+#endif
+    if (same)
+      eepp->skipped++;
+    else if (msg == MSG_OK) {
+      spibusAcquire(&eepp->client);
+      write_enable(spip);
+      spiSelect(spip);
+      send_command(spip, AT25_CMD_WRITE, addr, true);
+      spiSend(spip, chunk, buf);
+      spiUnselect(spip);
+      spibusRelease(&eepp->client);
+      start_cycle(eepp);
+      eepp->programs++;
+      if (eepp->wear != NULL)
+        eepp->wear[addr / at25GetPageSize(eepp)]++;
+#if AT25_READAHEAD_SIZE > 0
+      ra_invalidate(eepp, addr, chunk);
+#endif
+    }
+    chMtxUnlock(&eepp->mutex);
+    addr += chunk;
+    buf  += chunk;
+    n    -= chunk;
+  }
+  statusClear(STATUS_EEPROM_BUSY);
+  return msg;
+}
+
+/**
+ * @brief   Reads the status register.
+ *
+ * @param[in] eepp      pointer to the @p AT25Driver object
+ * @param[out] srp      the status register value
+ * @return              The operation status.
+ * @retval MSG_OK       if the operation succeeded.
+ *
+ * @api
+ */
+msg_t at25ReadStatus(AT25Driver *eepp, uint8_t *srp) {
+
+  osalDbgCheck((eepp != NULL) && (srp != NULL));
+  osalDbgAssert(eepp->state == AT25_READY, "not ready");
+
+  chMtxLock(&eepp->mutex);
+  spibusAcquire(&eepp->client);
+  eepp->sr = read_status(spibusGetDriver(&eepp->client));
+  spibusRelease(&eepp->client);
+  *srp = eepp->sr;
+  chMtxUnlock(&eepp->mutex);
+  return MSG_OK;
+}
+
+/**
+ * @brief   Writes the status register.
+ * @note    Only the BP0, BP1 and WPEN bits are writable.
+ *
+ * @param[in] eepp      pointer to the @p AT25Driver object
+ * @param[in] sr        the new status register value
+ * @return              The operation status.
+ * @retval MSG_OK       if the operation succeeded.
+ * @retval MSG_TIMEOUT  if a write cycle did not complete.
+ *
+ * @api
+ */
+msg_t at25WriteStatus(AT25Driver *eepp, uint8_t sr) {
+  SPIDriver *spip;
+  uint8_t txbuf[2];
+  msg_t msg;
+
+  osalDbgCheck(eepp != NULL);
+  osalDbgAssert(eepp->state == AT25_READY, "not ready");
+
+  spip = spibusGetDriver(&eepp->client);
+  txbuf[0] = AT25_CMD_WRSR;
+  txbuf[1] = sr;
+  chMtxLock(&eepp->mutex);
+  msg = wait_ready(eepp);
+  if (msg == MSG_OK) {
+    spibusAcquire(&eepp->client);
+    write_enable(spip);
+    spiSelect(spip);
+    spiSend(spip, 2, txbuf);
+    spiUnselect(spip);
+    spibusRelease(&eepp->client);
+    start_cycle(eepp);
+    msg = wait_ready(eepp);
+    if (msg == MSG_OK)
+      eepp->sr = sr & (AT25_SR_WPEN | AT25_SR_BP1 | AT25_SR_BP0);
+  }
+  chMtxUnlock(&eepp->mutex);
+  return msg;
+}
+
+/**
+ * @brief   Waits for the completion of the last write cycle.
+ *
+ * @param[in] eepp      pointer to the @p AT25Driver object
+ * @return              The operation status.
+ * @retval MSG_OK       if no write cycle is pending.
+ * @retval MSG_TIMEOUT  if the write cycle did not complete.
+ *
+ * @api
+ */
+msg_t at25Sync(AT25Driver *eepp) {
+  msg_t msg;
+
+  osalDbgCheck(eepp != NULL);
+  osalDbgAssert(eepp->state == AT25_READY, "not ready");
+
+  chMtxLock(&eepp->mutex);
+  msg = wait_ready(eepp);
+  chMtxUnlock(&eepp->mutex);
+  return msg;
+}
+
+/**
+ * @brief   Sets the block protection level.
+ * @details The WPEN bit is preserved.
+ *
+ * @param[in] eepp      pointer to the @p AT25Driver object
+ * @param[in] level     the new protection level
+ * @return              The operation status, see @p at25WriteStatus().
+ *
+ * @api
+ */
+msg_t at25SetProtection(AT25Driver *eepp, at25protect_t level) {
+
+  osalDbgCheck((eepp != NULL) && (level <= AT25_PROTECT_ALL));
+
+  return at25WriteStatus(eepp, (uint8_t)((eepp->sr & AT25_SR_WPEN) |
+                                         ((unsigned)level << 2)));
+}
+
+/**
+ * @brief   First address of the protected blocks.
+ *
+ * @param[in] eepp      pointer to the @p AT25Driver object
+ * @return              The address, the device size if nothing is
+ *                      protected.
+ *
+ * @api
+ */
+uint32_t at25GetProtectedBase(AT25Driver *eepp) {
+  uint32_t size = at25GetSize(eepp);
+
+  switch (at25GetProtection(eepp)) {
+  case AT25_PROTECT_QUARTER:
+    return size - size / 4;
+  case AT25_PROTECT_HALF:
+    return size / 2;
+  case AT25_PROTECT_ALL:
+    return 0;
+  default:
+    return size;
+  }
+}
+
+/**
+ * @brief   Clears the page program and read-ahead counters.
+ *
+ * @param[in] eepp      pointer to the @p AT25Driver object
+ *
+ * @api
+ */
+void at25ResetStats(AT25Driver *eepp) {
+
+  osalDbgCheck(eepp != NULL);
+
+  chMtxLock(&eepp->mutex);
+  eepp->programs = 0;
+  eepp->skipped  = 0;
+  eepp->hits     = 0;
+  eepp->misses   = 0;
+  chMtxUnlock(&eepp->mutex);
+}
+
+/**
+ * @brief   Attaches the per page program counters.
+ * @details Each page program increments the counter of its page.
+ *
+ * @param[in] eepp      pointer to the @p AT25Driver object
+ * @param[in] counters  array of one counter per page, @p NULL to stop the
+ *                      tracking
+ *
+ * @api
+ */
+void at25SetWearCounters(AT25Driver *eepp, uint32_t *counters) {
+
+  osalDbgCheck(eepp != NULL);
+
+  chMtxLock(&eepp->mutex);
+  eepp->wear = counters;
+  chMtxUnlock(&eepp->mutex);
+}
+
+/** @} */
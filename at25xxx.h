@@ -0,0 +1,297 @@
+/*
+    ChibiOS - Copyright (C) 2006..2015 Giovanni Di Sirio
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+/**
+ * @file    at25xxx.h
+ * @brief   AT25xxx SPI serial EEPROM driver header.
+ *
+ * @addtogroup AT25XXX
+ * @{
+ */
+
+#ifndef _AT25XXX_H_
+#define _AT25XXX_H_
+
+#include "spibus.h"
+
+/*===========================================================================*/
+/* Driver constants.                                                         */
+/*===========================================================================*/
+
+/**
+ * @name    AT25xxx instruction set
+ * @{
+ */
+#define AT25_CMD_WREN               0x06    /**< Set write enable latch.    */
+#define AT25_CMD_WRDI               0x04    /**< Reset write enable latch.  */
+#define AT25_CMD_RDSR               0x05    /**< Read status register.      */
+#define AT25_CMD_WRSR               0x01    /**< Write status register.     */
+#define AT25_CMD_READ               0x03    /**< Read data.                 */
+#define AT25_CMD_WRITE              0x02    /**< Write data.                */
+/** @} */
+
+/**
+ * @name    AT25xxx status register bits
+ * @{
+ */
+#define AT25_SR_NRDY                0x01    /**< Write cycle in progress.   */
+#define AT25_SR_WEN                 0x02    /**< Write enable latch set.    */
+#define AT25_SR_BP0                 0x04    /**< Block protect bit 0.       */
+#define AT25_SR_BP1                 0x08    /**< Block protect bit 1.       */
+#define AT25_SR_WPEN                0x80    /**< Write protect pin enable.  */
+/** @} */
+
+/**
+ * @brief   Largest page size of the supported devices.
+ */
+#define AT25_MAX_PAGE_SIZE          64
+
+/*===========================================================================*/
+/* Driver pre-compile time settings.                                         */
+/*===========================================================================*/
+
+/**
+ * @brief   Maximum duration of a write cycle in milliseconds.
+ * @note    The datasheet tWC is 5ms.
+ */
+#if !defined(AT25_WRITE_TIMEOUT_MS) || defined(__DOXYGEN__)
+#define AT25_WRITE_TIMEOUT_MS       10
+#endif
+
+/**
+ * @brief   Compares the data with the device content before programming.
+ * @details A page already holding the data is not programmed, the compare
+ *          costs a READ of the page unless the read-ahead window holds it.
+ */
+#if !defined(AT25_USE_WRITE_COMPARE) || defined(__DOXYGEN__)
+#define AT25_USE_WRITE_COMPARE      TRUE
+#endif
+
+/**
+ * @brief   Read-ahead window size in bytes, zero disables the read-ahead.
+ * @details A read starting where the previous one ended and shorter than
+ *          the window fills the window with a single READ instruction, the
+ *          following sequential reads are served from RAM.
+ */
+#if !defined(AT25_READAHEAD_SIZE) || defined(__DOXYGEN__)
+#define AT25_READAHEAD_SIZE         64
+#endif
+
+/*===========================================================================*/
+/* Derived constants and error checks.                                       */
+/*===========================================================================*/
+
+#if !HAL_USE_SPI || !SPI_USE_WAIT
+#error "the AT25xxx driver requires HAL_USE_SPI and SPI_USE_WAIT"
+#endif
+
+#if AT25_READAHEAD_SIZE > SPIBUS_CHUNK_SIZE
+#error "AT25_READAHEAD_SIZE exceeds SPIBUS_CHUNK_SIZE"
+#endif
+
+/*===========================================================================*/
+/* Driver data structures and types.                                         */
+/*===========================================================================*/
+
+/**
+ * @brief   Driver state machine possible states.
+ */
+typedef enum {
+  AT25_UNINIT = 0,                  /**< Not initialized.                   */
+  AT25_STOP = 1,                    /**< Stopped.                           */
+  AT25_READY = 2                    /**< Ready.                             */
+} at25state_t;
+
+/**
+ * @brief   Block protection levels, the BP1:BP0 status register bits.
+ */
+typedef enum {
+  AT25_PROTECT_NONE = 0,            /**< No protected block.                */
+  AT25_PROTECT_QUARTER = 1,         /**< Upper quarter protected.           */
+  AT25_PROTECT_HALF = 2,            /**< Upper half protected.              */
+  AT25_PROTECT_ALL = 3              /**< Whole array protected.             */
+} at25protect_t;
+
+/**
+ * @brief   Device geometry descriptor.
+ * @note    All the supported devices take a 16 bits address.
+ */
+typedef struct {
+  /**
+   * @brief   Device name.
+   */
+  const char            *name;
+  /**
+   * @brief   Capacity in bytes.
+   */
+  uint32_t              size;
+  /**
+   * @brief   Page program size in bytes.
+   */
+  uint32_t              page_size;
+} AT25Geometry;
+
+/**
+ * @brief   AT25xxx configuration structure.
+ */
+typedef struct {
+  /**
+   * @brief   Device geometry.
+   */
+  const AT25Geometry    *geometry;
+  /**
+   * @brief   SPI bus the device is connected to.
+   */
+  SPIBus                *busp;
+  /**
+   * @brief   SPI configuration, it selects the device chip select.
+   */
+  const SPIConfig       *spicfg;
+  /**
+   * @brief   Device name in the bus statistics.
+   */
+  const char            *name;
+} AT25Config;
+
+/**
+ * @brief   AT25xxx driver structure.
+ */
+typedef struct {
+  /**
+   * @brief   Driver state.
+   */
+  at25state_t           state;
+  /**
+   * @brief   Current configuration data.
+   */
+  const AT25Config      *config;
+  /**
+   * @brief   Number of page programs issued.
+   */
+  uint32_t              programs;
+  /**
+   * @brief   Page programs avoided because the page held the data.
+   */
+  uint32_t              skipped;
+  /**
+   * @brief   Per page program counters, @p NULL if not tracked.
+   */
+  uint32_t              *wear;
+  /**
+   * @brief   Last known status register value.
+   */
+  uint8_t               sr;
+  /**
+   * @brief   Device access mutex.
+   */
+  mutex_t               mutex;
+  /**
+   * @brief   A write cycle has been started and not yet seen completed.
+   */
+  bool                  busy;
+  /**
+   * @brief   Start time of the last write cycle.
+   */
+  systime_t             programmed;
+  /**
+   * @brief   Bus client of the device.
+   */
+  SPIBusClient          client;
+  /**
+   * @brief   Address following the last read.
+   */
+  uint32_t              next;
+  /**
+   * @brief   Reads served from the read-ahead window.
+   */
+  uint32_t              hits;
+  /**
+   * @brief   Reads that accessed the device.
+   */
+  uint32_t              misses;
+#if (AT25_READAHEAD_SIZE > 0) || defined(__DOXYGEN__)
+  /**
+   * @brief   Device address of the read-ahead window.
+   */
+  uint32_t              ra_addr;
+  /**
+   * @brief   Valid bytes in the read-ahead window.
+   */
+  size_t                ra_len;
+  /**
+   * @brief   Read-ahead window.
+   */
+  uint8_t               ra_buf[AT25_READAHEAD_SIZE];
+#endif
+} AT25Driver;
+
+/*===========================================================================*/
+/* Driver macros.                                                            */
+/*===========================================================================*/
+
+/**
+ * @brief   Capacity of a started device.
+ *
+ * @param[in] eepp      pointer to the @p AT25Driver object
+ */
+#define at25GetSize(eepp) ((eepp)->config->geometry->size)
+
+/**
+ * @brief   Page size of a started device.
+ *
+ * @param[in] eepp      pointer to the @p AT25Driver object
+ */
+#define at25GetPageSize(eepp) ((eepp)->config->geometry->page_size)
+
+/**
+ * @brief   Block protection level of a started device.
+ *
+ * @param[in] eepp      pointer to the @p AT25Driver object
+ */
+#define at25GetProtection(eepp)                                             \
+  ((at25protect_t)(((eepp)->sr & (AT25_SR_BP1 | AT25_SR_BP0)) >> 2))
+
+/*===========================================================================*/
+/* External declarations.                                                    */
+/*===========================================================================*/
+
+extern const AT25Geometry AT25320_GEOMETRY;
+extern const AT25Geometry AT25640_GEOMETRY;
+extern const AT25Geometry AT25256_GEOMETRY;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+  void at25ObjectInit(AT25Driver *eepp);
+  void at25Start(AT25Driver *eepp, const AT25Config *config);
+  void at25Stop(AT25Driver *eepp);
+  msg_t at25Read(AT25Driver *eepp, uint32_t addr, uint8_t *buf, size_t n);
+  msg_t at25Write(AT25Driver *eepp, uint32_t addr,
+                  const uint8_t *buf, size_t n);
+  msg_t at25ReadStatus(AT25Driver *eepp, uint8_t *srp);
+  msg_t at25WriteStatus(AT25Driver *eepp, uint8_t sr);
+  msg_t at25Sync(AT25Driver *eepp);
+  msg_t at25SetProtection(AT25Driver *eepp, at25protect_t level);
+  uint32_t at25GetProtectedBase(AT25Driver *eepp);
+  void at25ResetStats(AT25Driver *eepp);
+  void at25SetWearCounters(AT25Driver *eepp, uint32_t *counters);
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _AT25XXX_H_ */
+
+/** @} */
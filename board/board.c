@@ -52,4 +52,9 @@ void boardInit(void) {
    * Remap USART2 to the PD5/PD6 pins.
    */
   AFIO->MAPR |= AFIO_MAPR_USART2_REMAP;
+
+  /*
+   * Remap SPI3 to the PC10/PC11/PC12 pins, the AT25320 is on this bus.
+   */
+  AFIO->MAPR |= AFIO_MAPR_SPI3_REMAP;
 }
@@ -48,10 +48,10 @@
  * IO pins assignments.
  */
 #define GPIOA_PA0	              0
-#define GPIOA_PA1			          1
+#define GPIOA_ADC_IN1           1
 #define GPIOA_PA2	              2
 #define GPIOA_PA3	              3
-#define GPIOA_PA4	              4
+#define GPIOA_EEPROM_CS         4
 #define GPIOA_PA5	              5
 #define GPIOA_PA6	              6
 #define GPIOA_PA7               7
@@ -91,9 +91,9 @@
 #define GPIOC_PC7               7
 #define GPIOC_PC8               8
 #define GPIOC_PC9               9
-#define GPIOC_PC10              10
-#define GPIOC_PC11              11
-#define GPIOC_PC12              12
+#define GPIOC_SPI3_SCK          10
+#define GPIOC_SPI3_MISO         11
+#define GPIOC_SPI3_MOSI         12
 #define GPIOC_PC13              13
 #define GPIOC_PC14              14
 #define GPIOC_PC15              15
@@ -160,18 +160,20 @@
 /*
  * Port A setup.
  * Everything input with pull-up except:
+ * PA1  - Analog input              (GPIOA_ADC_IN1).
  * PA2  - Alternate output          (GPIOA_USART_TX).
  * PA3  - Normal input              (GPIOA_USART_RX).
+ * PA4  - Push Pull output          (GPIOA_EEPROM_CS).
  * PA5  - Push Pull output          (GPIOA_LED_GREEN).
  * PA13 - Pull-up input             (GPIOA_SWDIO).
  * PA14 - Pull-down input           (GPIOA_SWCLK).
  */
 #define VAL_GPIOACR            (                                       \
                                 PIN_DIG_INPUT_FLOATING(GPIOA_PA0)  |  \
-                                PIN_DIG_INPUT_FLOATING(GPIOA_PA1)  |  \
+                                PIN_ANALOG_INPUT(GPIOA_ADC_IN1)    |  \
                                 PIN_DIG_INPUT_FLOATING(GPIOA_PA2)  |  \
                                 PIN_DIG_INPUT_FLOATING(GPIOA_PA3)  |  \
-                                PIN_DIG_INPUT_FLOATING(GPIOA_PA4)  |  \
+                                PIN_OUTPUT_PUSHPULL_50M(GPIOA_EEPROM_CS) |  \
                                 PIN_DIG_INPUT_FLOATING(GPIOA_PA5)  |  \
                                 PIN_DIG_INPUT_FLOATING(GPIOA_PA6)  |  \
                                 PIN_DIG_INPUT_FLOATING(GPIOA_PA7)  |  \
@@ -196,6 +198,7 @@
 #define VAL_GPIOAODR            (                      \
                                 /*SBIT( GPIOA_USB_DM    ) |*/ \
                                 /*SBIT( GPIOA_USB_DP    ) |*/ \
+                                SBIT( GPIOA_EEPROM_CS ) | \
                                 SBIT( GPIOA_SWDIO     ) | \
                                 SBIT( GPIOA_PA15      )   \
                                 )
@@ -237,6 +240,9 @@
 /*
  * Port C setup.
  * Everything input with pull-up except:
+ * PC10 - Alternate output          (GPIOC_SPI3_SCK).
+ * PC11 - Normal input              (GPIOC_SPI3_MISO).
+ * PC12 - Alternate output          (GPIOC_SPI3_MOSI).
  * PC13 - Normal input              (GPIOC_BUTTON).
  */
 #define VAL_GPIOCCR             (               \
@@ -250,9 +256,9 @@
                                  PIN_DIG_INPUT_FLOATING(GPIOC_PC7) |    \
                                  PIN_DIG_INPUT_PUPD(GPIOC_PC8)     |    \
                                  PIN_DIG_INPUT_PUPD(GPIOC_PC9)     |    \
-                                 PIN_DIG_INPUT_FLOATING(GPIOC_PC10) | \
-                                 PIN_DIG_INPUT_FLOATING(GPIOC_PC11)        | \
-                                 PIN_DIG_INPUT_FLOATING(GPIOC_PC12)      | \
+                                 PIN_OUT_ALTERNATE_PUSHPULL_50M(GPIOC_SPI3_SCK) | \
+                                 PIN_DIG_INPUT_FLOATING(GPIOC_SPI3_MISO)   | \
+                                 PIN_OUT_ALTERNATE_PUSHPULL_50M(GPIOC_SPI3_MOSI) | \
                                  PIN_DIG_INPUT_PUPD(GPIOC_PC13)               | \
                                  PIN_DIG_INPUT_FLOATING(GPIOC_PC14)           | \
                                  PIN_DIG_INPUT_FLOATING(GPIOC_PC15)             \
@@ -411,7 +411,10 @@
  * @details User fields added to the end of the @p thread_t structure.
  */
 #define CH_CFG_THREAD_EXTRA_FIELDS                                          \
-  /* Add threads custom fields here.*/
+  /* Profiling counter at the previous metrics sample.*/                    \
+  systime_t p_sampled;                                                      \
+  /* Scheduler trace slot, checked against the slot owner.*/                \
+  uint8_t p_traceid;
 
 /**
  * @brief   Threads initialization hook.
@@ -421,7 +424,8 @@
  *          the threads creation APIs.
  */
 #define CH_CFG_THREAD_INIT_HOOK(tp) {                                       \
-  /* Add threads initialization code here.*/                                \
+  (tp)->p_sampled = 0;                                                      \
+  (tp)->p_traceid = 0xFF;                                                   \
 }
 
 /**
@@ -436,12 +440,22 @@
   /* Add threads finalization code here.*/                                  \
 }
 
+#if !defined(_FROM_ASM_)
+/* Scheduler trace recorder, see schedtrace.h. The hook runs from the RAM
+   copy of the scheduler, the recorder is placed there as well.*/
+struct ch_thread;
+extern unsigned schedtrace_armed;
+void schedtraceSwitchHook(struct ch_thread *ntp, struct ch_thread *otp)
+    __attribute__((long_call));
+#endif
+
 /**
  * @brief   Context switch hook.
  * @details This hook is invoked just before switching between threads.
  */
 #define CH_CFG_CONTEXT_SWITCH_HOOK(ntp, otp) {                              \
-  /* Context switch code here.*/                                            \
+  if (schedtrace_armed)                                                     \
+    schedtraceSwitchHook(ntp, otp);                                         \
 }
 
 /**
@@ -0,0 +1,260 @@
+/*
+    ChibiOS - Copyright (C) 2006..2015 Giovanni Di Sirio
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+/**
+ * @file    clock.c
+ * @brief   Runtime clock profiles code.
+ * @details The HAL drivers derive their dividers from the compile time
+ *          clocks of mcuconf.h, which are those of the full profile. On
+ *          a profile switch the peripherals already running are rescaled
+ *          in place: the system tick, the USART baud rate registers, the
+ *          prescalers of the running APB1 timers and the ADC prescaler,
+ *          which keeps the ADC clock within its 14MHz limit but cannot
+ *          keep its frequency (see @p adcclk). SPI prescalers are
+ *          part of the SPI configurations, @p clockSpiBr() computes them
+ *          for the current profile.
+ *
+ * @addtogroup CLOCK
+ * @{
+ */
+
+#include "ch.h"
+#include "hal.h"
+
+#include "clock.h"
+
+/*===========================================================================*/
+/* Module local definitions.                                                 */
+/*===========================================================================*/
+
+#define CFGR_PLLMUL(n)              ((uint32_t)((n) - 2) << 18)
+
+#define CFGR_PROFILE_MASK           (RCC_CFGR_PLLMULL | RCC_CFGR_OTGFSPRE | \
+                                     RCC_CFGR_HPRE | RCC_CFGR_PPRE1 |       \
+                                     RCC_CFGR_PPRE2 | RCC_CFGR_ADCPRE)
+
+/*===========================================================================*/
+/* Module local variables.                                                   */
+/*===========================================================================*/
+
+/*
+ * The PLL input is PREDIV1 = 25MHz / 5 * 8 / 5 = 8MHz in all the profiles.
+ */
+static const clock_profile_t profiles[CLOCK_NUM_PROFILES] = {
+  {"full", 72000000, 36000000, 36000000, 9000000,
+   CFGR_PLLMUL(9) | STM32_OTGFSPRE_DIV3 | STM32_HPRE_DIV1 |
+   STM32_PPRE1_DIV2 | STM32_PPRE2_DIV2 | STM32_ADCPRE_DIV4,
+   2, true, true},
+  {"reduced", 48000000, 24000000, 24000000, 12000000,
+   CFGR_PLLMUL(6) | STM32_OTGFSPRE_DIV2 | STM32_HPRE_DIV1 |
+   STM32_PPRE1_DIV2 | STM32_PPRE2_DIV2 | STM32_ADCPRE_DIV2,
+   1, true, true},
+  {"hsi", 8000000, 8000000, 8000000, 4000000,
+   CFGR_PLLMUL(9) | STM32_OTGFSPRE_DIV3 | STM32_HPRE_DIV1 |
+   STM32_PPRE1_DIV1 | STM32_PPRE2_DIV1 | STM32_ADCPRE_DIV2,
+   0, false, false}
+};
+
+static clockprofile_t current = CLOCK_FULL;
+
+/*===========================================================================*/
+/* Module local functions.                                                   */
+/*===========================================================================*/
+
+/*
+ * Timers clock is twice the APB clock when the APB prescaler is not one.
+ */
+static uint32_t timclk1(const clock_profile_t *cp) {
+
+  return (cp->cfgr & RCC_CFGR_PPRE1) == STM32_PPRE1_DIV1 ?
+         cp->pclk1 : 2 * cp->pclk1;
+}
+
+static uint32_t scale(uint32_t v, uint32_t to, uint32_t from) {
+
+  return (uint32_t)(((uint64_t)v * to + from / 2) / from);
+}
+
+static void switch_rcc(const clock_profile_t *cp) {
+
+  /* Wait states raised before any frequency increase.*/
+  if (cp->latency > (FLASH->ACR & FLASH_ACR_LATENCY))
+    FLASH->ACR = (FLASH->ACR & ~FLASH_ACR_LATENCY) | cp->latency;
+
+  /* Running from HSI while the PLL is reconfigured.*/
+  RCC->CFGR = (RCC->CFGR & ~RCC_CFGR_SW) | STM32_SW_HSI;
+  while ((RCC->CFGR & RCC_CFGR_SWS) != RCC_CFGR_SWS_HSI)
+    ;
+  RCC->CR &= ~RCC_CR_PLLON;
+  while ((RCC->CR & RCC_CR_PLLRDY) != 0)
+    ;
+  RCC->CFGR = (RCC->CFGR & ~CFGR_PROFILE_MASK) | cp->cfgr;
+  if (cp->pll) {
+    RCC->CR |= RCC_CR_PLLON;
+    while ((RCC->CR & RCC_CR_PLLRDY) == 0)
+      ;
+    RCC->CFGR = (RCC->CFGR & ~RCC_CFGR_SW) | STM32_SW_PLL;
+    while ((RCC->CFGR & RCC_CFGR_SWS) != RCC_CFGR_SWS_PLL)
+      ;
+  }
+
+  /* Wait states lowered after any frequency decrease.*/
+  FLASH->ACR = (FLASH->ACR & ~FLASH_ACR_LATENCY) | cp->latency;
+}
+
+static void rescale_peripherals(const clock_profile_t *from,
+                                const clock_profile_t *to) {
+  static USART_TypeDef * const apb1_usarts[] = {USART2, USART3, UART4, UART5};
+  static TIM_TypeDef * const apb1_timers[] = {TIM2, TIM3, TIM4, TIM5, TIM6,
+                                              TIM7};
+  unsigned i;
+
+#if CH_CFG_ST_TIMEDELTA == 0
+  SysTick->LOAD = (to->hclk / CH_CFG_ST_FREQUENCY) - 1;
+  SysTick->VAL  = 0;
+#endif
+
+  if (USART1->CR1 & USART_CR1_UE)
+    USART1->BRR = scale(USART1->BRR, to->pclk2, from->pclk2);
+  for (i = 0; i < sizeof apb1_usarts / sizeof apb1_usarts[0]; i++) {
+    if (apb1_usarts[i]->CR1 & USART_CR1_UE)
+      apb1_usarts[i]->BRR = scale(apb1_usarts[i]->BRR,
+                                  to->pclk1, from->pclk1);
+  }
+
+  /* The new prescaler is loaded on the next update event, the period in
+     progress completes at the old rate.*/
+  for (i = 0; i < sizeof apb1_timers / sizeof apb1_timers[0]; i++) {
+    if (apb1_timers[i]->CR1 & TIM_CR1_CEN)
+      apb1_timers[i]->PSC = scale(apb1_timers[i]->PSC + 1,
+                                  timclk1(to), timclk1(from)) - 1;
+  }
+}
+
+/*===========================================================================*/
+/* Module exported functions.                                                */
+/*===========================================================================*/
+
+/**
+ * @brief   Returns a profile descriptor.
+ *
+ * @param[in] profile   the profile identifier
+ * @return              The profile descriptor.
+ *
+ * @api
+ */
+const clock_profile_t *clockGetProfile(clockprofile_t profile) {
+
+  osalDbgCheck(profile < CLOCK_NUM_PROFILES);
+
+  return &profiles[profile];
+}
+
+/**
+ * @brief   Returns the active profile identifier.
+ *
+ * @return              The profile identifier.
+ *
+ * @api
+ */
+clockprofile_t clockGetCurrent(void) {
+
+  return current;
+}
+
+/**
+ * @brief   Returns the active profile descriptor.
+ *
+ * @return              The profile descriptor.
+ *
+ * @api
+ */
+const clock_profile_t *clockGetCurrentProfile(void) {
+
+  return &profiles[current];
+}
+
+/**
+ * @brief   Switches to a clock profile.
+ * @details The switch is performed with the kernel locked, it lasts the PLL
+ *          lock time.
+ * @pre     The USB driver must be stopped before entering a profile without
+ *          USB clock.
+ * @note    Drivers started after the switch still use the compile time
+ *          clocks for their dividers.
+ *
+ * @param[in] profile   the profile identifier
+ *
+ * @api
+ */
+void clockSetProfile(clockprofile_t profile) {
+  const clock_profile_t *from, *to;
+
+  osalDbgCheck(profile < CLOCK_NUM_PROFILES);
+
+  chSysLock();
+  from = &profiles[current];
+  to   = &profiles[profile];
+  if (from != to) {
+    switch_rcc(to);
+    rescale_peripherals(from, to);
+    current = profile;
+  }
+  chSysUnlock();
+}
+
+/**
+ * @brief   Computes a SPI baud rate prescaler.
+ *
+ * @param[in] pclk      the SPI peripheral clock
+ * @param[in] frequency the maximum SCK frequency
+ * @return              The CR1 BR field value for the fastest SCK not above
+ *                      @p frequency, the slowest one if none is.
+ *
+ * @api
+ */
+uint32_t clockSpiBr(uint32_t pclk, uint32_t frequency) {
+  uint32_t br;
+
+  for (br = 0; br < 7; br++) {
+    if ((pclk >> (br + 1)) <= frequency)
+      break;
+  }
+  return br << 3;
+}
+
+/**
+ * @brief   Measures the core cycles per millisecond.
+ * @details The cycle counter is sampled across a number of system ticks,
+ *          the result checks the system tick rescaling against the core
+ *          clock.
+ *
+ * @return              The measured cycles per millisecond.
+ *
+ * @api
+ */
+uint32_t clockMeasure(void) {
+  rtcnt_t start;
+
+  /* Aligned on a tick boundary.*/
+  chThdSleep(1);
+  start = chSysGetRealtimeCounterX();
+  chThdSleep(CLOCK_MEASURE_TICKS);
+  return (chSysGetRealtimeCounterX() - start) /
+         ST2MS(CLOCK_MEASURE_TICKS);
+}
+
+/** @} */
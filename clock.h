@@ -0,0 +1,100 @@
+/*
+    ChibiOS - Copyright (C) 2006..2015 Giovanni Di Sirio
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+/**
+ * @file    clock.h
+ * @brief   Runtime clock profiles header.
+ *
+ * @addtogroup CLOCK
+ * @{
+ */
+
+#ifndef _CLOCK_H_
+#define _CLOCK_H_
+
+/*===========================================================================*/
+/* Module pre-compile time settings.                                         */
+/*===========================================================================*/
+
+/**
+ * @brief   Duration of the cycles/ms measurement in system ticks.
+ */
+#if !defined(CLOCK_MEASURE_TICKS) || defined(__DOXYGEN__)
+#define CLOCK_MEASURE_TICKS         100
+#endif
+
+/*===========================================================================*/
+/* Derived constants and error checks.                                       */
+/*===========================================================================*/
+
+#if (STM32_SYSCLK != 72000000) || (STM32_PCLK1 != 36000000) ||              \
+    (STM32_PCLK2 != 36000000) || (STM32_ADCCLK != 9000000)
+#error "mcuconf.h clock settings must match the full profile"
+#endif
+
+/*===========================================================================*/
+/* Module data structures and types.                                         */
+/*===========================================================================*/
+
+/**
+ * @brief   Clock profile identifiers.
+ */
+typedef enum {
+  CLOCK_FULL = 0,                   /**< 72MHz from PLL, USB clocked.       */
+  CLOCK_REDUCED = 1,                /**< 48MHz from PLL, USB clocked.       */
+  CLOCK_HSI = 2,                    /**< 8MHz from HSI, PLL and USB off.    */
+  CLOCK_NUM_PROFILES = 3
+} clockprofile_t;
+
+/**
+ * @brief   Clock profile descriptor.
+ */
+typedef struct {
+  const char            *name;
+  uint32_t              hclk;               /**< @brief AHB and core clock. */
+  uint32_t              pclk1;              /**< @brief APB1 clock.         */
+  uint32_t              pclk2;              /**< @brief APB2 clock.         */
+  uint32_t              adcclk;             /**< @brief ADC clock, the
+                                                 nearest to 9MHz within
+                                                 the 14MHz limit.           */
+  uint32_t              cfgr;               /**< @brief RCC CFGR PLL and
+                                                 prescaler fields.          */
+  uint32_t              latency;            /**< @brief Flash wait states.  */
+  bool                  pll;                /**< @brief Runs from PLL.      */
+  bool                  usb;                /**< @brief OTG 48MHz clock
+                                                 available.                 */
+} clock_profile_t;
+
+/*===========================================================================*/
+/* External declarations.                                                    */
+/*===========================================================================*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+  const clock_profile_t *clockGetProfile(clockprofile_t profile);
+  clockprofile_t clockGetCurrent(void);
+  const clock_profile_t *clockGetCurrentProfile(void);
+  void clockSetProfile(clockprofile_t profile);
+  uint32_t clockSpiBr(uint32_t pclk, uint32_t frequency);
+  uint32_t clockMeasure(void);
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _CLOCK_H_ */
+
+/** @} */
@@ -0,0 +1,143 @@
+/*
+    ChibiOS - Copyright (C) 2006..2015 Giovanni Di Sirio
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+/**
+ * @file    cppbench.cpp
+ * @brief   C++ wrappers benchmark code.
+ * @details The same transactions are written against the C drivers and
+ *          against the wrappers of halcpp.hpp: an EEPROM status register
+ *          read through @p AT25Driver (device mutex, bus client, chip
+ *          select, command, response) and, from the serial shell, a block
+ *          queued for transmission. The paths
+ *          are separate functions, their code sizes are compared with
+ *          "arm-none-eabi-nm -S build/ch.elf | grep bench_".
+ *
+ * @addtogroup HALCPP
+ * @{
+ */
+
+#include "ch.h"
+#include "hal.h"
+#include "chprintf.h"
+
+#include "halcpp.hpp"
+#include "cppbench.h"
+
+/*===========================================================================*/
+/* Module local definitions.                                                 */
+/*===========================================================================*/
+
+namespace {
+
+  typedef halcpp::SerialPort<SDD2, 38400> ShellSerial;
+
+  /*
+   * Serial block, one line.
+   */
+  const uint8_t serial_block[] = "serial block ok\r\n";
+
+  /*=========================================================================*/
+  /* Module local functions.                                                 */
+  /*=========================================================================*/
+
+  __attribute__((noinline)) uint8_t bench_rdsr_c(AT25Driver *eepp) {
+    uint8_t sr = 0;
+
+    (void)at25ReadStatus(eepp, &sr);
+    return sr;
+  }
+
+  __attribute__((noinline)) uint8_t bench_rdsr_cpp(AT25Driver *eepp) {
+    uint8_t sr = 0;
+
+    (void)halcpp::At25(*eepp).readStatus(sr);
+    return sr;
+  }
+
+  __attribute__((noinline)) size_t bench_write_c(void) {
+
+    return chnWriteTimeout((BaseChannel *)&SDD2, serial_block,
+                           sizeof serial_block - 1, TIME_IMMEDIATE);
+  }
+
+  __attribute__((noinline)) size_t bench_write_cpp(void) {
+
+    return ShellSerial::write(serial_block, sizeof serial_block - 1,
+                              TIME_IMMEDIATE);
+  }
+
+  /*
+   * Shortest of the timed runs, the transfers sleep and can be preempted.
+   */
+  rtcnt_t time_rdsr(uint8_t (*path)(AT25Driver *), AT25Driver *eepp,
+                    uint8_t *srp) {
+    rtcnt_t start, dt, min = (rtcnt_t)-1;
+    unsigned i;
+
+    for (i = 0; i < CPPBENCH_RUNS; i++) {
+      start = chSysGetRealtimeCounterX();
+      *srp = path(eepp);
+      dt = chSysGetRealtimeCounterX() - start;
+      if (dt < min)
+        min = dt;
+    }
+    return min;
+  }
+
+  /*
+   * The output queue is drained first so that the block is copied at once.
+   */
+  rtcnt_t time_write(size_t (*path)(void), size_t *np) {
+    rtcnt_t start;
+
+    chThdSleepMilliseconds(20);
+    start = chSysGetRealtimeCounterX();
+    *np = path();
+    return chSysGetRealtimeCounterX() - start;
+  }
+}
+
+/*===========================================================================*/
+/* Module exported functions.                                                */
+/*===========================================================================*/
+
+/**
+ * @brief   Runs the C versus C++ benchmark.
+ *
+ * @param[in] chp       stream where the results are printed
+ * @param[in] eepp      pointer to the @p AT25Driver object
+ */
+void cppbenchRun(BaseSequentialStream *chp, AT25Driver *eepp) {
+  rtcnt_t cycles;
+  uint8_t sr;
+  size_t n;
+
+  cycles = time_rdsr(bench_rdsr_c, eepp, &sr);
+  chprintf(chp, "eeprom rdsr C   : %lu cycles, sr %02x\r\n", cycles, sr);
+  cycles = time_rdsr(bench_rdsr_cpp, eepp, &sr);
+  chprintf(chp, "eeprom rdsr C++ : %lu cycles, sr %02x\r\n", cycles, sr);
+
+  if (chp != ShellSerial::stream()) {
+    chprintf(chp, "serial write    : run from the serial shell\r\n");
+    return;
+  }
+  cycles = time_write(bench_write_c, &n);
+  chprintf(chp, "serial write C  : %lu cycles, %u bytes\r\n", cycles, n);
+  cycles = time_write(bench_write_cpp, &n);
+  chprintf(chp, "serial write C++: %lu cycles, %u bytes\r\n", cycles, n);
+}
+
+/** @} */
@@ -0,0 +1,47 @@
+/*
+    ChibiOS - Copyright (C) 2006..2015 Giovanni Di Sirio
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+/**
+ * @file    cppbench.h
+ * @brief   C++ wrappers benchmark header.
+ *
+ * @addtogroup HALCPP
+ * @{
+ */
+
+#ifndef _CPPBENCH_H_
+#define _CPPBENCH_H_
+
+#include "at25xxx.h"
+
+/**
+ * @brief   Number of timed transactions of each path.
+ */
+#if !defined(CPPBENCH_RUNS) || defined(__DOXYGEN__)
+#define CPPBENCH_RUNS               16
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+  void cppbenchRun(BaseSequentialStream *chp, AT25Driver *eepp);
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _CPPBENCH_H_ */
+
+/** @} */
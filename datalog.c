@@ -0,0 +1,335 @@
+/*
+    ChibiOS - Copyright (C) 2006..2015 Giovanni Di Sirio
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+/**
+ * @file    datalog.c
+ * @brief   EEPROM data logger code.
+ * @details The block mean of the ADC acquisition is sampled periodically
+ *          and delta encoded into a RAM page, full pages are committed to
+ *          a circular region of the EEPROM with a single page program.
+ *          A data page sits at the position given by its sequence number,
+ *          the head is found at mount time by reading the whole region.
+ *          The first page of the region is a header holding the sequence
+ *          number of the oldest valid page, it is only programmed when
+ *          that number changes, so it wears no faster than the data pages.
+ *
+ * @addtogroup DATALOG
+ * @{
+ */
+
+#include <stddef.h>
+#include <string.h>
+
+#include "ch.h"
+#include "hal.h"
+#include "chprintf.h"
+
+#include "acquire.h"
+#include "datalog.h"
+#include "status.h"
+
+/*===========================================================================*/
+/* Module local definitions.                                                 */
+/*===========================================================================*/
+
+#define DATALOG_MAGIC               0x474F4C41      /* "ALOG" */
+
+#define HEADER_ADDR                 DATALOG_BASE
+#define PAGE_ADDR(n)                (DATALOG_BASE +                         \
+                                     ((n) + 1) * LOGCODEC_PAGE_SIZE)
+#define PAGE_OF(seq)                ((uint16_t)((seq) % DATALOG_NUM_PAGES))
+
+/*
+ * Pages less than SEQ_WINDOW sequence numbers after the oldest valid one
+ * are current. The oldest valid number is moved forward at half the window
+ * so that the stale pages never get back into it.
+ */
+#define SEQ_WINDOW                  0x8000U
+
+/**
+ * @brief   Header page layout.
+ */
+typedef struct {
+  uint32_t              magic;
+  uint16_t              first_seq;          /**< @brief Oldest valid page
+                                                 sequence number.           */
+  uint8_t               reserved[5];        /**< @brief Padding, zero.      */
+  uint8_t               crc;
+} datalog_header_t;
+
+/*===========================================================================*/
+/* Module local variables.                                                   */
+/*===========================================================================*/
+
+static AT25Array *dl_arrp;
+static MUTEX_DECL(dl_mtx);
+static logcodec_encoder_t dl_enc;
+static uint16_t dl_first_seq;
+static uint16_t dl_head_seq;
+static thread_t *dl_tp;
+static THD_WORKING_AREA(waDatalog, 384);
+
+/*===========================================================================*/
+/* Module local functions.                                                   */
+/*===========================================================================*/
+
+static msg_t write_header(void) {
+  datalog_header_t hdr;
+
+  memset(&hdr, 0, sizeof hdr);
+  hdr.magic     = DATALOG_MAGIC;
+  hdr.first_seq = dl_first_seq;
+  hdr.crc       = logcodecCrc8((const uint8_t *)&hdr,
+                               offsetof(datalog_header_t, crc));
+  return at25arrayWrite(dl_arrp, HEADER_ADDR,
+                        (const uint8_t *)&hdr, sizeof hdr);
+}
+
+/*
+ * Reads a data page and returns its sequence number if it is valid.
+ */
+static bool read_page(uint16_t n, uint8_t *page, uint16_t *seqp) {
+
+  if (at25arrayRead(dl_arrp, PAGE_ADDR(n), page, LOGCODEC_PAGE_SIZE) != MSG_OK)
+    return false;
+  return logcodecCheck(page, seqp);
+}
+
+/*
+ * Locates the head, the current page with the highest sequence number, a
+ * missing or corrupted header formats an empty log.
+ */
+static msg_t mount(void) {
+  datalog_header_t hdr;
+  uint8_t page[LOGCODEC_PAGE_SIZE];
+  uint16_t i, seq, last = 0;
+  bool found = false;
+  msg_t msg;
+
+  msg = at25arrayRead(dl_arrp, HEADER_ADDR, (uint8_t *)&hdr, sizeof hdr);
+  if (msg != MSG_OK)
+    return msg;
+  if ((hdr.magic != DATALOG_MAGIC) ||
+      (hdr.crc != logcodecCrc8((const uint8_t *)&hdr,
+                               offsetof(datalog_header_t, crc)))) {
+    dl_first_seq = 0;
+    dl_head_seq  = (uint16_t)(dl_first_seq - 1);
+    return write_header();
+  }
+
+  /* A page out of its position or stale is ignored, a damaged one ends
+     the chain of the valid pages when dumped.*/
+  dl_first_seq = hdr.first_seq;
+  for (i = 0; i < DATALOG_NUM_PAGES; i++) {
+    if (read_page(i, page, &seq) && (PAGE_OF(seq) == i) &&
+        ((uint16_t)(seq - dl_first_seq) < SEQ_WINDOW) &&
+        (!found || ((uint16_t)(seq - dl_first_seq) > last))) {
+      last  = (uint16_t)(seq - dl_first_seq);
+      found = true;
+    }
+  }
+  dl_head_seq = (uint16_t)(dl_first_seq + last - (found ? 0 : 1));
+  return MSG_OK;
+}
+
+/*
+ * Commits the encoder page after the head.
+ */
+static msg_t commit(void) {
+  uint16_t seq = (uint16_t)(dl_head_seq + 1);
+  msg_t msg;
+
+  msg = at25arrayWrite(dl_arrp, PAGE_ADDR(PAGE_OF(seq)),
+                       logcodecFinish(&dl_enc, seq), LOGCODEC_PAGE_SIZE);
+  if (msg != MSG_OK)
+    return msg;
+  dl_head_seq = seq;
+
+  /* Moving the window forward is the only header update besides clearing
+     the log, the pages in the region stay valid.*/
+  if ((uint16_t)(seq - dl_first_seq) >= SEQ_WINDOW / 2) {
+    dl_first_seq = (uint16_t)(seq + 1 - DATALOG_NUM_PAGES);
+    msg = write_header();
+  }
+  return msg;
+}
+
+/*
+ * Number of pages between the oldest valid one and the head.
+ */
+static unsigned stored_pages(void) {
+  unsigned n = (uint16_t)(dl_head_seq + 1 - dl_first_seq);
+
+  return n < DATALOG_NUM_PAGES ? n : DATALOG_NUM_PAGES;
+}
+
+static THD_FUNCTION(Datalog, arg) {
+  systime_t time;
+  uint32_t blocks = 0;
+
+  (void)arg;
+  chRegSetThreadName("datalog");
+  time = chVTGetSystemTime();
+  while (true) {
+    acq_status_t as;
+
+    time = chThdSleepUntilWindowed(time, time + MS2ST(DATALOG_PERIOD_MS));
+
+    acqGetStatus(&as);
+    if (as.blocks == blocks)
+      continue;
+    blocks = as.blocks;
+
+    chMtxLock(&dl_mtx);
+    if (!logcodecAppend(&dl_enc, as.stats.mean)) {
+      if (commit() != MSG_OK)
+        statusSet(STATUS_FAULT);
+      logcodecReset(&dl_enc);
+      (void)logcodecAppend(&dl_enc, as.stats.mean);
+    }
+    chMtxUnlock(&dl_mtx);
+  }
+}
+
+/*===========================================================================*/
+/* Module exported functions.                                                */
+/*===========================================================================*/
+
+/**
+ * @brief   Mounts the log and starts the logger thread.
+ * @pre     The EEPROM array has been started.
+ *
+ * @param[in] arrp      the EEPROM array holding the log region
+ * @return              The mount status, the logger is not started on
+ *                      failure.
+ * @retval MSG_RESET    if the log region does not fit the array pages or
+ *                      its capacity.
+ *
+ * @api
+ */
+msg_t datalogStart(AT25Array *arrp) {
+  msg_t msg;
+
+  if (dl_tp != NULL)
+    return MSG_OK;
+
+  if ((at25arrayGetPageSize(arrp) % LOGCODEC_PAGE_SIZE != 0) ||
+      (DATALOG_BASE % at25arrayGetPageSize(arrp) != 0) ||
+      (DATALOG_BASE + (DATALOG_NUM_PAGES + 1) * LOGCODEC_PAGE_SIZE >
+       at25arrayGetSize(arrp)))
+    return MSG_RESET;
+  dl_arrp = arrp;
+  logcodecReset(&dl_enc);
+  msg = mount();
+  if (msg != MSG_OK)
+    return msg;
+  dl_tp = chThdCreateStatic(waDatalog, sizeof(waDatalog),
+                            DATALOG_THREAD_PRIO, Datalog, NULL);
+  return MSG_OK;
+}
+
+/**
+ * @brief   Discards the logged data.
+ * @details Only the header page is programmed, the stale pages are
+ *          recognized by their sequence numbers.
+ *
+ * @return              The operation status.
+ * @retval MSG_RESET    if the log is not mounted.
+ *
+ * @api
+ */
+msg_t datalogClear(void) {
+  msg_t msg;
+
+  if (dl_tp == NULL)
+    return MSG_RESET;
+
+  chMtxLock(&dl_mtx);
+  logcodecReset(&dl_enc);
+  dl_first_seq = (uint16_t)(dl_head_seq + 1);
+  msg = write_header();
+  chMtxUnlock(&dl_mtx);
+  return msg;
+}
+
+/**
+ * @brief   Prints the decoded log, oldest sample first.
+ * @details The samples not yet committed are printed last, the summary
+ *          reports the compression ratio of the committed pages against
+ *          raw 16 bits samples.
+ *
+ * @param[in] chp       the output stream
+ *
+ * @api
+ */
+void datalogDump(BaseSequentialStream *chp) {
+  uint8_t page[LOGCODEC_PAGE_SIZE];
+  uint16_t out[LOGCODEC_MAX_SAMPLES];
+  unsigned npages, k, i, samples = 0, pages = 0;
+  size_t n;
+
+  if (dl_tp == NULL) {
+    chprintf(chp, "log not mounted\r\n");
+    return;
+  }
+
+  chMtxLock(&dl_mtx);
+
+  /* Pages are valid only if the whole chain back from the head is.*/
+  npages = stored_pages();
+  for (k = 0; k < npages; k++) {
+    uint16_t seq;
+
+    if (!read_page(PAGE_OF(dl_head_seq - k), page, &seq) ||
+        (seq != (uint16_t)(dl_head_seq - k)))
+      break;
+  }
+  npages = k;
+
+  for (k = npages; k > 0; k--) {
+    uint16_t seq;
+
+    (void)read_page(PAGE_OF(dl_head_seq + 1 - k), page, &seq);
+    n = logcodecDecode(page, out, LOGCODEC_MAX_SAMPLES);
+    chprintf(chp, "%5u:", seq);
+    for (i = 0; i < n; i++)
+      chprintf(chp, " %u", out[i]);
+    chprintf(chp, "\r\n");
+    samples += n;
+    pages++;
+  }
+
+  n = logcodecDecode(logcodecFinish(&dl_enc, (uint16_t)(dl_head_seq + 1)),
+                     out, LOGCODEC_MAX_SAMPLES);
+  if (dl_enc.count > 0) {
+    chprintf(chp, "  ram:");
+    for (i = 0; i < n; i++)
+      chprintf(chp, " %u", out[i]);
+    chprintf(chp, "\r\n");
+  }
+
+  chMtxUnlock(&dl_mtx);
+
+  chprintf(chp, "pages %u/%u, samples %u", pages, DATALOG_NUM_PAGES, samples);
+  if (pages > 0) {
+    unsigned ratio = (samples * 2 * 100) / (pages * LOGCODEC_PAGE_SIZE);
+
+    chprintf(chp, ", ratio %u.%02u", ratio / 100, ratio % 100);
+  }
+  chprintf(chp, "\r\n");
+}
+
+/** @} */
@@ -0,0 +1,91 @@
+/*
+    ChibiOS - Copyright (C) 2006..2015 Giovanni Di Sirio
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+/**
+ * @file    datalog.h
+ * @brief   EEPROM data logger header.
+ *
+ * @addtogroup DATALOG
+ * @{
+ */
+
+#ifndef _DATALOG_H_
+#define _DATALOG_H_
+
+#include "at25array.h"
+#include "logcodec.h"
+
+/*===========================================================================*/
+/* Module pre-compile time settings.                                         */
+/*===========================================================================*/
+
+/**
+ * @brief   EEPROM address of the log region, page aligned.
+ */
+#if !defined(DATALOG_BASE) || defined(__DOXYGEN__)
+#define DATALOG_BASE                0
+#endif
+
+/**
+ * @brief   Number of data pages in the log region.
+ * @details A power of two, the mount procedure reads all of them.
+ * @note    The region also includes the header page.
+ */
+#if !defined(DATALOG_NUM_PAGES) || defined(__DOXYGEN__)
+#define DATALOG_NUM_PAGES           64
+#endif
+
+/**
+ * @brief   Logging period in milliseconds.
+ */
+#if !defined(DATALOG_PERIOD_MS) || defined(__DOXYGEN__)
+#define DATALOG_PERIOD_MS           1000
+#endif
+
+/**
+ * @brief   Logger thread priority.
+ */
+#if !defined(DATALOG_THREAD_PRIO) || defined(__DOXYGEN__)
+#define DATALOG_THREAD_PRIO         (NORMALPRIO - 1)
+#endif
+
+/*===========================================================================*/
+/* Derived constants and error checks.                                       */
+/*===========================================================================*/
+
+/* The page of a sequence number must not change when the number wraps.*/
+#if (DATALOG_NUM_PAGES < 1) || (DATALOG_NUM_PAGES > 0x1000) ||              \
+    ((DATALOG_NUM_PAGES & (DATALOG_NUM_PAGES - 1)) != 0)
+#error "DATALOG_NUM_PAGES must be a power of two up to 0x1000"
+#endif
+
+/*===========================================================================*/
+/* External declarations.                                                    */
+/*===========================================================================*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+  msg_t datalogStart(AT25Array *arrp);
+  msg_t datalogClear(void);
+  void datalogDump(BaseSequentialStream *chp);
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _DATALOG_H_ */
+
+/** @} */
@@ -0,0 +1,306 @@
+/*
+    ChibiOS - Copyright (C) 2006..2015 Giovanni Di Sirio
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+/**
+ * @file    dsp.c
+ * @brief   Fixed point DSP kernels code.
+ *
+ * @addtogroup DSP
+ * @{
+ */
+
+#include <string.h>
+
+#include "dsp.h"
+
+/*===========================================================================*/
+/* Module local variables.                                                   */
+/*===========================================================================*/
+
+/*
+ * CRC-32 (IEEE 802.3, reflected) nibble table, 64 bytes instead of the 1KB
+ * byte table.
+ */
+static const uint32_t crc32_nibble[16] = {
+  0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC,
+  0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+  0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C,
+  0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+};
+
+/*===========================================================================*/
+/* Module exported functions.                                                */
+/*===========================================================================*/
+
+/**
+ * @brief   Initializes a Q15 FIR filter.
+ *
+ * @param[out] fp       the filter instance
+ * @param[in] coeffs    the taps
+ * @param[in] state     delay line buffer of @p 2*ntaps samples
+ * @param[in] ntaps     number of taps
+ */
+void dspFirInitQ15(dsp_fir_q15_t *fp, const q15_t *coeffs,
+                   q15_t *state, size_t ntaps) {
+
+  fp->coeffs = coeffs;
+  fp->state  = state;
+  fp->ntaps  = ntaps;
+  fp->index  = 0;
+  memset(state, 0, 2 * ntaps * sizeof (q15_t));
+}
+
+/**
+ * @brief   Q15 FIR filter.
+ * @details Each sample is written twice in the delay line so the taps
+ *          window is always contiguous, the inner loop has no wrap test.
+ *          The products are accumulated in Q2.30 without intermediate
+ *          rounding, the output is rounded and saturated.
+ *
+ * @param[in] fp        the filter instance
+ * @param[in] in        input samples
+ * @param[out] out      output samples, can be the input buffer
+ * @param[in] n         number of samples
+ */
+void dspFirQ15(dsp_fir_q15_t *fp, const q15_t *in, q15_t *out, size_t n) {
+  const size_t ntaps = fp->ntaps;
+  size_t index = fp->index;
+
+  while (n-- > 0) {
+    const q15_t *c = fp->coeffs;
+    const q15_t *s;
+    int64_t acc = 0;
+    size_t k;
+
+    index = (index == 0 ? ntaps : index) - 1;
+    fp->state[index] = fp->state[index + ntaps] = *in++;
+    s = &fp->state[index];
+    for (k = 0; k < ntaps; k++)
+      acc += (int32_t)*c++ * *s++;
+    *out++ = dspSatQ15((int32_t)dspSatQ31((acc + (1 << 14)) >> 15));
+  }
+  fp->index = index;
+}
+
+/**
+ * @brief   Initializes a Q31 FIR filter.
+ *
+ * @param[out] fp       the filter instance
+ * @param[in] coeffs    the taps
+ * @param[in] state     delay line buffer of @p 2*ntaps samples
+ * @param[in] ntaps     number of taps
+ */
+void dspFirInitQ31(dsp_fir_q31_t *fp, const q31_t *coeffs,
+                   q31_t *state, size_t ntaps) {
+
+  fp->coeffs = coeffs;
+  fp->state  = state;
+  fp->ntaps  = ntaps;
+  fp->index  = 0;
+  memset(state, 0, 2 * ntaps * sizeof (q31_t));
+}
+
+/**
+ * @brief   Q31 FIR filter.
+ * @details The products are accumulated in Q2.62 with @p SMLAL, the
+ *          accumulator can overflow only if the sum of the absolute taps
+ *          exceeds two.
+ *
+ * @param[in] fp        the filter instance
+ * @param[in] in        input samples
+ * @param[out] out      output samples, can be the input buffer
+ * @param[in] n         number of samples
+ */
+void dspFirQ31(dsp_fir_q31_t *fp, const q31_t *in, q31_t *out, size_t n) {
+  const size_t ntaps = fp->ntaps;
+  size_t index = fp->index;
+
+  while (n-- > 0) {
+    const q31_t *c = fp->coeffs;
+    const q31_t *s;
+    int64_t acc = 0;
+    size_t k;
+
+    index = (index == 0 ? ntaps : index) - 1;
+    fp->state[index] = fp->state[index + ntaps] = *in++;
+    s = &fp->state[index];
+    for (k = 0; k < ntaps; k++)
+      acc += (int64_t)*c++ * *s++;
+    *out++ = dspSatQ31((acc + (1LL << 30)) >> 31);
+  }
+  fp->index = index;
+}
+
+/**
+ * @brief   Initializes a Q31 biquad cascade.
+ *
+ * @param[out] bp       the filter instance
+ * @param[in] coeffs    five Q2.30 coefficients per stage
+ * @param[in] state     state buffer of @p 4*nstages samples
+ * @param[in] nstages   number of second order stages
+ */
+void dspBiquadInitQ31(dsp_biquad_q31_t *bp, const q31_t *coeffs,
+                      q31_t *state, size_t nstages) {
+
+  bp->coeffs  = coeffs;
+  bp->state   = state;
+  bp->nstages = nstages;
+  memset(state, 0, 4 * nstages * sizeof (q31_t));
+}
+
+/**
+ * @brief   Q31 biquad cascade, direct form I.
+ *
+ * @param[in] bp        the filter instance
+ * @param[in] in        input samples
+ * @param[out] out      output samples, can be the input buffer
+ * @param[in] n         number of samples
+ */
+void dspBiquadQ31(dsp_biquad_q31_t *bp, const q31_t *in, q31_t *out,
+                  size_t n) {
+  const q31_t *c = bp->coeffs;
+  q31_t *st = bp->state;
+  size_t stage;
+
+  for (stage = 0; stage < bp->nstages; stage++) {
+    const q31_t b0 = c[0], b1 = c[1], b2 = c[2], a1 = c[3], a2 = c[4];
+    q31_t x1 = st[0], x2 = st[1], y1 = st[2], y2 = st[3];
+    const q31_t *src = in;
+    q31_t *dst = out;
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+      q31_t x0 = *src++, y0;
+      int64_t acc;
+
+      acc  = (int64_t)b0 * x0;
+      acc += (int64_t)b1 * x1;
+      acc += (int64_t)b2 * x2;
+      acc += (int64_t)a1 * y1;
+      acc += (int64_t)a2 * y2;
+      y0 = dspSatQ31((acc + (1LL << 29)) >> 30);
+      x2 = x1;
+      x1 = x0;
+      y2 = y1;
+      y1 = y0;
+      *dst++ = y0;
+    }
+    st[0] = x1;
+    st[1] = x2;
+    st[2] = y1;
+    st[3] = y2;
+
+    /* The next stages filter the output of the previous one in place.*/
+    in = out;
+    c += 5;
+    st += 4;
+  }
+}
+
+/**
+ * @brief   Initializes a Q15 moving average.
+ *
+ * @param[out] mp       the filter instance
+ * @param[in] window    window buffer of @p 1<<log2len samples
+ * @param[in] log2len   log2 of the window length
+ */
+void dspMavgInitQ15(dsp_mavg_q15_t *mp, q15_t *window, unsigned log2len) {
+
+  mp->window  = window;
+  mp->log2len = log2len;
+  mp->index   = 0;
+  mp->sum     = 0;
+  memset(window, 0, ((size_t)1 << log2len) * sizeof (q15_t));
+}
+
+/**
+ * @brief   Q15 moving average.
+ * @details Running sum, two additions and a shift per sample whatever the
+ *          window length. The result is truncated toward minus infinity.
+ *
+ * @param[in] mp        the filter instance
+ * @param[in] in        input samples
+ * @param[out] out      output samples, can be the input buffer
+ * @param[in] n         number of samples
+ */
+void dspMavgQ15(dsp_mavg_q15_t *mp, const q15_t *in, q15_t *out, size_t n) {
+  const size_t mask = ((size_t)1 << mp->log2len) - 1;
+  size_t index = mp->index;
+  int32_t sum = mp->sum;
+
+  while (n-- > 0) {
+    q15_t x = *in++;
+
+    sum += x - mp->window[index];
+    mp->window[index] = x;
+    index = (index + 1) & mask;
+    *out++ = (q15_t)(sum >> mp->log2len);
+  }
+  mp->index = index;
+  mp->sum = sum;
+}
+
+/**
+ * @brief   CRC-32 (IEEE 802.3).
+ * @details Start with zero, pass the previous result to continue over
+ *          several buffers.
+ *
+ * @param[in] crc       previous CRC value
+ * @param[in] data      data buffer
+ * @param[in] n         number of bytes
+ * @return              The updated CRC value.
+ */
+uint32_t dspCrc32(uint32_t crc, const void *data, size_t n) {
+  const uint8_t *p = data;
+
+  crc = ~crc;
+  while (n-- > 0) {
+    crc ^= *p++;
+    crc = (crc >> 4) ^ crc32_nibble[crc & 15];
+    crc = (crc >> 4) ^ crc32_nibble[crc & 15];
+  }
+  return ~crc;
+}
+
+/**
+ * @brief   Finds the positions of the minimum and maximum of a Q15 vector.
+ * @details The first occurrence is returned for ties.
+ *
+ * @param[in] in        input samples
+ * @param[in] n         number of samples, at least one
+ * @param[out] imin     position of the minimum
+ * @param[out] imax     position of the maximum
+ */
+void dspMinMaxQ15(const q15_t *in, size_t n, size_t *imin, size_t *imax) {
+  q15_t min = in[0], max = in[0];
+  size_t i;
+
+  *imin = *imax = 0;
+  for (i = 1; i < n; i++) {
+    q15_t x = in[i];
+
+    if (x < min) {
+      min = x;
+      *imin = i;
+    }
+    else if (x > max) {
+      max = x;
+      *imax = i;
+    }
+  }
+}
+
+/** @} */
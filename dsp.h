@@ -0,0 +1,195 @@
+/*
+    ChibiOS - Copyright (C) 2006..2015 Giovanni Di Sirio
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+/**
+ * @file    dsp.h
+ * @brief   Fixed point DSP kernels header.
+ * @details Q15 and Q31 kernels for the Cortex-M3, which has no FPU. The
+ *          products are accumulated in 64 bits so the compiler emits
+ *          single cycle @p SMLAL instructions, the saturations use
+ *          @p SSAT when compiled for ARMv7-M and portable C otherwise.
+ * @note    This module does not depend on the RTOS or the HAL.
+ *
+ * @addtogroup DSP
+ * @{
+ */
+
+#ifndef _DSP_H_
+#define _DSP_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*===========================================================================*/
+/* Module data structures and types.                                         */
+/*===========================================================================*/
+
+/**
+ * @brief   Q1.15 fractional type.
+ */
+typedef int16_t q15_t;
+
+/**
+ * @brief   Q1.31 fractional type.
+ */
+typedef int32_t q31_t;
+
+/**
+ * @brief   Q15 FIR filter instance.
+ */
+typedef struct {
+  const q15_t           *coeffs;            /**< @brief Taps, coeffs[0]
+                                                 applies to the newest
+                                                 sample.                    */
+  q15_t                 *state;             /**< @brief Delay line, 2*ntaps
+                                                 samples.                   */
+  size_t                ntaps;              /**< @brief Number of taps.     */
+  size_t                index;              /**< @brief Newest sample
+                                                 position.                  */
+} dsp_fir_q15_t;
+
+/**
+ * @brief   Q31 FIR filter instance.
+ */
+typedef struct {
+  const q31_t           *coeffs;            /**< @brief Taps.               */
+  q31_t                 *state;             /**< @brief Delay line, 2*ntaps
+                                                 samples.                   */
+  size_t                ntaps;              /**< @brief Number of taps.     */
+  size_t                index;              /**< @brief Newest sample
+                                                 position.                  */
+} dsp_fir_q31_t;
+
+/**
+ * @brief   Q31 biquad cascade instance, direct form I.
+ * @details Each stage takes five Q2.30 coefficients {b0, b1, b2, a1, a2}
+ *          computing y = b0*x + b1*x1 + b2*x2 + a1*y1 + a2*y2, the
+ *          feedback coefficients are thus the negated textbook ones.
+ */
+typedef struct {
+  const q31_t           *coeffs;            /**< @brief 5 per stage.        */
+  q31_t                 *state;             /**< @brief {x1, x2, y1, y2}
+                                                 per stage.                 */
+  size_t                nstages;            /**< @brief Number of stages.   */
+} dsp_biquad_q31_t;
+
+/**
+ * @brief   Q15 moving average instance.
+ */
+typedef struct {
+  q15_t                 *window;            /**< @brief Last samples.       */
+  unsigned              log2len;            /**< @brief Log2 of the window
+                                                 length.                    */
+  size_t                index;              /**< @brief Oldest sample.      */
+  int32_t               sum;                /**< @brief Window sum.         */
+} dsp_mavg_q15_t;
+
+/*===========================================================================*/
+/* Module macros.                                                            */
+/*===========================================================================*/
+
+/**
+ * @brief   Converts a constant to Q15, for initializers.
+ */
+#define DSP_Q15(x)      ((q15_t)((x) * 32768.0 >= 32767.0 ? 32767 :          \
+                                 (x) * 32768.0 + ((x) < 0 ? -0.5 : 0.5)))
+
+/**
+ * @brief   Converts a constant to Q31, for initializers.
+ */
+#define DSP_Q31(x)      ((q31_t)((x) * 2147483648.0 >= 2147483647.0 ?       \
+                                 2147483647 :                               \
+                                 (x) * 2147483648.0 + ((x) < 0 ? -0.5 : 0.5)))
+
+/**
+ * @brief   Converts a biquad coefficient constant to Q2.30.
+ */
+#define DSP_Q30(x)      ((q31_t)((x) * 1073741824.0 + ((x) < 0 ? -0.5 : 0.5)))
+
+/*===========================================================================*/
+/* External declarations.                                                    */
+/*===========================================================================*/
+
+/**
+ * @brief   Saturates a 32 bits value to Q15.
+ */
+static inline q15_t dspSatQ15(int32_t x) {
+#if defined(__ARM_ARCH_7M__) || defined(__ARM_ARCH_7EM__)
+  int32_t r;
+
+  __asm__ ("ssat %0, #16, %1" : "=r" (r) : "r" (x));
+  return (q15_t)r;
+#else
+  if (x > INT16_MAX)
+    return INT16_MAX;
+  if (x < INT16_MIN)
+    return INT16_MIN;
+  return (q15_t)x;
+#endif
+}
+
+/**
+ * @brief   Saturates a 64 bits value to Q31.
+ */
+static inline q31_t dspSatQ31(int64_t x) {
+
+  /* The high word must be the sign extension of the low word.*/
+  if ((int32_t)(x >> 32) != ((int32_t)x >> 31))
+    return (x < 0) ? INT32_MIN : INT32_MAX;
+  return (q31_t)x;
+}
+
+/**
+ * @brief   Q15 multiplication with rounding and saturation.
+ */
+static inline q15_t dspMulQ15(q15_t a, q15_t b) {
+
+  return dspSatQ15(((int32_t)a * b + (1 << 14)) >> 15);
+}
+
+/**
+ * @brief   Q31 multiplication with rounding and saturation.
+ */
+static inline q31_t dspMulQ31(q31_t a, q31_t b) {
+
+  return dspSatQ31(((int64_t)a * b + (1LL << 30)) >> 31);
+}
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+  void dspFirInitQ15(dsp_fir_q15_t *fp, const q15_t *coeffs,
+                     q15_t *state, size_t ntaps);
+  void dspFirQ15(dsp_fir_q15_t *fp, const q15_t *in, q15_t *out, size_t n);
+  void dspFirInitQ31(dsp_fir_q31_t *fp, const q31_t *coeffs,
+                     q31_t *state, size_t ntaps);
+  void dspFirQ31(dsp_fir_q31_t *fp, const q31_t *in, q31_t *out, size_t n);
+  void dspBiquadInitQ31(dsp_biquad_q31_t *bp, const q31_t *coeffs,
+                        q31_t *state, size_t nstages);
+  void dspBiquadQ31(dsp_biquad_q31_t *bp, const q31_t *in, q31_t *out,
+                    size_t n);
+  void dspMavgInitQ15(dsp_mavg_q15_t *mp, q15_t *window, unsigned log2len);
+  void dspMavgQ15(dsp_mavg_q15_t *mp, const q15_t *in, q15_t *out, size_t n);
+  uint32_t dspCrc32(uint32_t crc, const void *data, size_t n);
+  void dspMinMaxQ15(const q15_t *in, size_t n,
+                    size_t *imin, size_t *imax);
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _DSP_H_ */
+
+/** @} */
@@ -0,0 +1,163 @@
+/*
+    ChibiOS - Copyright (C) 2006..2015 Giovanni Di Sirio
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+/**
+ * @file    dspbench.c
+ * @brief   DSP kernels benchmark code.
+ * @details Each kernel is timed with the DWT cycle counter over a block of
+ *          samples with the kernel locked against preemption, results are
+ *          in cycles per sample (per byte for the CRC).
+ *
+ * @addtogroup DSP
+ * @{
+ */
+
+#include "ch.h"
+#include "hal.h"
+#include "chprintf.h"
+
+#include "dsp.h"
+#include "dspbench.h"
+
+/*===========================================================================*/
+/* Module local definitions.                                                 */
+/*===========================================================================*/
+
+#define FIR_TAPS            16
+#define BIQUAD_STAGES       2
+#define MAVG_LOG2LEN        4
+
+/*===========================================================================*/
+/* Module local variables.                                                   */
+/*===========================================================================*/
+
+static union {
+  q15_t                 q15[DSPBENCH_SAMPLES];
+  q31_t                 q31[DSPBENCH_SAMPLES];
+} bench_in, bench_out;
+
+static union {
+  q15_t                 fir_q15[2 * FIR_TAPS];
+  q31_t                 fir_q31[2 * FIR_TAPS];
+  q31_t                 biquad[4 * BIQUAD_STAGES];
+  q15_t                 mavg[1 << MAVG_LOG2LEN];
+} bench_state;
+
+static const q15_t fir_q15_taps[FIR_TAPS] = {
+  DSP_Q15(0.0625), DSP_Q15(0.0625), DSP_Q15(0.0625), DSP_Q15(0.0625),
+  DSP_Q15(0.0625), DSP_Q15(0.0625), DSP_Q15(0.0625), DSP_Q15(0.0625),
+  DSP_Q15(0.0625), DSP_Q15(0.0625), DSP_Q15(0.0625), DSP_Q15(0.0625),
+  DSP_Q15(0.0625), DSP_Q15(0.0625), DSP_Q15(0.0625), DSP_Q15(0.0625)
+};
+
+static const q31_t fir_q31_taps[FIR_TAPS] = {
+  DSP_Q31(0.0625), DSP_Q31(0.0625), DSP_Q31(0.0625), DSP_Q31(0.0625),
+  DSP_Q31(0.0625), DSP_Q31(0.0625), DSP_Q31(0.0625), DSP_Q31(0.0625),
+  DSP_Q31(0.0625), DSP_Q31(0.0625), DSP_Q31(0.0625), DSP_Q31(0.0625),
+  DSP_Q31(0.0625), DSP_Q31(0.0625), DSP_Q31(0.0625), DSP_Q31(0.0625)
+};
+
+/* Two identical 2nd order lowpass sections, fc = fs/40.*/
+static const q31_t biquad_coeffs[5 * BIQUAD_STAGES] = {
+  DSP_Q30(0.0055), DSP_Q30(0.0110), DSP_Q30(0.0055),
+  DSP_Q30(1.7786), DSP_Q30(-0.8008),
+  DSP_Q30(0.0055), DSP_Q30(0.0110), DSP_Q30(0.0055),
+  DSP_Q30(1.7786), DSP_Q30(-0.8008)
+};
+
+/*===========================================================================*/
+/* Module local functions.                                                   */
+/*===========================================================================*/
+
+static void report(BaseSequentialStream *chp, const char *name,
+                   rtcnt_t cycles, size_t n) {
+
+  chprintf(chp, "%-16s: %lu.%02lu cycles/sample\r\n", name,
+           (uint32_t)(cycles / n), (uint32_t)(((cycles % n) * 100) / n));
+}
+
+/*===========================================================================*/
+/* Module exported functions.                                                */
+/*===========================================================================*/
+
+/**
+ * @brief   Runs the kernels benchmark.
+ *
+ * @param[in] chp       stream where the results are printed
+ */
+void dspbenchRun(BaseSequentialStream *chp) {
+  dsp_fir_q15_t fir15;
+  dsp_fir_q31_t fir31;
+  dsp_biquad_q31_t biquad;
+  dsp_mavg_q15_t mavg;
+  size_t i, imin, imax;
+  rtcnt_t start, cycles;
+
+  for (i = 0; i < DSPBENCH_SAMPLES; i++)
+    bench_in.q15[i] = (q15_t)((i * 2654435761U) >> 16);
+
+  dspFirInitQ15(&fir15, fir_q15_taps, bench_state.fir_q15, FIR_TAPS);
+  chSysLock();
+  start = chSysGetRealtimeCounterX();
+  dspFirQ15(&fir15, bench_in.q15, bench_out.q15, DSPBENCH_SAMPLES);
+  cycles = chSysGetRealtimeCounterX() - start;
+  chSysUnlock();
+  report(chp, "fir q15 16 taps", cycles, DSPBENCH_SAMPLES);
+
+  dspMavgInitQ15(&mavg, bench_state.mavg, MAVG_LOG2LEN);
+  chSysLock();
+  start = chSysGetRealtimeCounterX();
+  dspMavgQ15(&mavg, bench_in.q15, bench_out.q15, DSPBENCH_SAMPLES);
+  cycles = chSysGetRealtimeCounterX() - start;
+  chSysUnlock();
+  report(chp, "mavg q15 16", cycles, DSPBENCH_SAMPLES);
+
+  chSysLock();
+  start = chSysGetRealtimeCounterX();
+  dspMinMaxQ15(bench_in.q15, DSPBENCH_SAMPLES, &imin, &imax);
+  cycles = chSysGetRealtimeCounterX() - start;
+  chSysUnlock();
+  report(chp, "minmax q15", cycles, DSPBENCH_SAMPLES);
+
+  chSysLock();
+  start = chSysGetRealtimeCounterX();
+  (void)dspCrc32(0, bench_in.q15, sizeof bench_in.q15);
+  cycles = chSysGetRealtimeCounterX() - start;
+  chSysUnlock();
+  report(chp, "crc32 (per byte)", cycles, sizeof bench_in.q15);
+
+  for (i = 0; i < DSPBENCH_SAMPLES; i++)
+    bench_in.q31[i] = (q31_t)(i * 2654435761U);
+
+  dspFirInitQ31(&fir31, fir_q31_taps, bench_state.fir_q31, FIR_TAPS);
+  chSysLock();
+  start = chSysGetRealtimeCounterX();
+  dspFirQ31(&fir31, bench_in.q31, bench_out.q31, DSPBENCH_SAMPLES);
+  cycles = chSysGetRealtimeCounterX() - start;
+  chSysUnlock();
+  report(chp, "fir q31 16 taps", cycles, DSPBENCH_SAMPLES);
+
+  dspBiquadInitQ31(&biquad, biquad_coeffs, bench_state.biquad,
+                   BIQUAD_STAGES);
+  chSysLock();
+  start = chSysGetRealtimeCounterX();
+  dspBiquadQ31(&biquad, bench_in.q31, bench_out.q31, DSPBENCH_SAMPLES);
+  cycles = chSysGetRealtimeCounterX() - start;
+  chSysUnlock();
+  report(chp, "biquad q31 2 st", cycles, DSPBENCH_SAMPLES);
+}
+
+/** @} */
@@ -0,0 +1,45 @@
+/*
+    ChibiOS - Copyright (C) 2006..2015 Giovanni Di Sirio
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+/**
+ * @file    dspbench.h
+ * @brief   DSP kernels benchmark header.
+ *
+ * @addtogroup DSP
+ * @{
+ */
+
+#ifndef _DSPBENCH_H_
+#define _DSPBENCH_H_
+
+/**
+ * @brief   Samples processed per kernel run.
+ */
+#if !defined(DSPBENCH_SAMPLES) || defined(__DOXYGEN__)
+#define DSPBENCH_SAMPLES            256
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+  void dspbenchRun(BaseSequentialStream *chp);
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _DSPBENCH_H_ */
+
+/** @} */
@@ -0,0 +1,378 @@
+/*
+    ChibiOS - Copyright (C) 2006..2015 Giovanni Di Sirio
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+/**
+ * @file    eeimage.c
+ * @brief   EEPROM image transfer code.
+ * @details Windowed protocol moving a whole EEPROM image over a shell
+ *          channel. Each data frame carries one page:
+ *          @p EEIMAGE_SOH, sequence, length, payload, CRC-32 of the
+ *          sequence, length and payload. The host sends up to
+ *          @p EEIMAGE_WINDOW frames ahead, each accepted frame is
+ *          answered by @p EEIMAGE_ACK and its sequence, a missing or
+ *          damaged one by @p EEIMAGE_NAK and the sequence expected, the
+ *          host then resends from there. The NAK is repeated after
+ *          @p EEIMAGE_WINDOW further dropped frames, in case the resend
+ *          was damaged too. @p EEIMAGE_EOT followed by the CRC-32 of
+ *          the image ends the transfer, the image is read back and
+ *          checked before the final acknowledgement. Two @p EEIMAGE_CAN
+ *          at a frame boundary cancel it, while the receiver scans for
+ *          the next frame after a damaged one they may be payload bytes
+ *          and must be followed by the host silence. An
+ *          @p EEIMAGE_EOT is only taken at a frame boundary, the host
+ *          repeats it when answered by a NAK.
+ *          The receiver is a pipeline without a thread of its own: a page
+ *          program only waits for the previous write cycle, so the next
+ *          frames are received and checked while the previous page is
+ *          programmed, the window keeps the link busy meanwhile.
+ *
+ * @addtogroup EEIMAGE
+ * @{
+ */
+
+#include <string.h>
+
+#include "ch.h"
+#include "hal.h"
+#include "chprintf.h"
+
+#include "eeimage.h"
+#include "dsp.h"
+
+/*===========================================================================*/
+/* Module local definitions.                                                 */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Module exported variables.                                                */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Module local types.                                                       */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Module local variables.                                                   */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Module local functions.                                                   */
+/*===========================================================================*/
+
+static uint32_t get_le32(const uint8_t *p) {
+
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+         ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void put_le32(uint8_t *p, uint32_t v) {
+
+  p[0] = (uint8_t)v;
+  p[1] = (uint8_t)(v >> 8);
+  p[2] = (uint8_t)(v >> 16);
+  p[3] = (uint8_t)(v >> 24);
+}
+
+static void reply(BaseChannel *chp, uint8_t code, uint8_t arg) {
+  uint8_t msg[2] = {code, arg};
+
+  (void)chnWriteTimeout(chp, msg, sizeof msg, TIME_INFINITE);
+}
+
+static void nak(BaseChannel *chp, eeimage_stats_t *stp, uint8_t seq) {
+
+  reply(chp, EEIMAGE_NAK, seq);
+  stp->naks++;
+}
+
+/*
+ * Drops a frame, the first drop since the last progress asks for a resend
+ * and so does every EEIMAGE_WINDOW-th one: after that many dropped frames
+ * the resend itself was damaged or lost and no other NAK is coming.
+ */
+static void drop(BaseChannel *chp, eeimage_stats_t *stp, uint8_t seq,
+                 unsigned *droppedp) {
+
+  if ((*droppedp)++ % EEIMAGE_WINDOW == 0)
+    nak(chp, stp, seq);
+}
+
+static bool receive(BaseChannel *chp, uint8_t *buf, size_t n) {
+
+  return chnReadTimeout(chp, buf, n, EEIMAGE_TIMEOUT) == n;
+}
+
+static uint32_t frame_crc(uint8_t seq, uint8_t len, const uint8_t *data) {
+  uint8_t hdr[2] = {seq, len};
+
+  return dspCrc32(dspCrc32(0, hdr, sizeof hdr), data, len);
+}
+
+/*
+ * CRC-32 of a device range, read back one page at a time into the page
+ * buffer of the transfer.
+ */
+static msg_t image_crc(AT25Driver *eepp, uint32_t base, uint32_t size,
+                       uint8_t *buf, uint32_t *crcp) {
+  uint32_t page = at25GetPageSize(eepp);
+  uint32_t crc = 0;
+  msg_t msg = MSG_OK;
+
+  while ((size > 0) && (msg == MSG_OK)) {
+    uint32_t n = size < page ? size : page;
+
+    msg = at25Read(eepp, base, buf, n);
+    crc = dspCrc32(crc, buf, n);
+    base += n;
+    size -= n;
+  }
+  *crcp = crc;
+  return msg;
+}
+
+/*
+ * Receives the end of image frame and checks the written range against
+ * the image CRC.
+ */
+static uint8_t finish_load(BaseChannel *chp, AT25Driver *eepp,
+                           uint32_t base, uint32_t size, uint8_t *page) {
+  uint8_t buf[4];
+  uint32_t crc;
+
+  if (!receive(chp, buf, sizeof buf))
+    return EEIMAGE_ERR_TIMEOUT;
+  if ((at25Sync(eepp) != MSG_OK) ||
+      (image_crc(eepp, base, size, page, &crc) != MSG_OK))
+    return EEIMAGE_ERR_DEVICE;
+  if (crc != get_le32(buf))
+    return EEIMAGE_ERR_VERIFY;
+  return 0;
+}
+
+/*===========================================================================*/
+/* Module exported functions.                                                */
+/*===========================================================================*/
+
+/**
+ * @brief   Receives an image and programs it.
+ * @details A "LOAD <base> <size> <page> <window>" line announces the
+ *          transfer, then the frames are received until the end of image
+ *          or an abort. Frames out of sequence after a resend request are
+ *          dropped silently, duplicates are acknowledged again.
+ * @note    The page buffer is on the caller stack, transfers may run from
+ *          several sessions at once.
+ * @note    The data log and the wear counters keep running, an image
+ *          covering their regions should be followed by a reset.
+ *
+ * @param[in] chp       channel of the transfer
+ * @param[in] eepp      pointer to the @p AT25Driver object
+ * @param[in] base      first address, page aligned
+ * @param[in] size      image size
+ * @param[out] stp      transfer figures
+ * @return              The operation status.
+ * @retval MSG_OK       if the image was written and verified.
+ * @retval MSG_RESET    if the range is invalid, protected or the transfer
+ *                      was aborted, see the @p error field.
+ *
+ * @api
+ */
+msg_t eeimageLoad(BaseChannel *chp, AT25Driver *eepp,
+                  uint32_t base, uint32_t size, eeimage_stats_t *stp) {
+  uint32_t page = at25GetPageSize(eepp);
+  uint32_t frames = (size + page - 1) / page;
+  uint32_t index = 0;
+  unsigned errors = 0, dropped = 0, cans = 0;
+  bool resync = false;
+  uint8_t buf[AT25_MAX_PAGE_SIZE];
+  systime_t start, t;
+
+  memset(stp, 0, sizeof *stp);
+  if ((size == 0) || ((base % page) != 0) ||
+      (base > at25GetSize(eepp)) || (size > at25GetSize(eepp) - base) ||
+      (base + size > at25GetProtectedBase(eepp)))
+    return MSG_RESET;
+
+  chprintf((BaseSequentialStream *)chp, "LOAD %lu %lu %lu %u\r\n",
+           base, size, page, EEIMAGE_WINDOW);
+  start = chVTGetSystemTimeX();
+  while (stp->error == 0) {
+    uint8_t hdr[2], crc[4];
+    uint8_t expected = (uint8_t)index;
+    msg_t c;
+
+    if (errors > EEIMAGE_RETRIES) {
+      stp->error = EEIMAGE_ERR_RETRIES;
+      break;
+    }
+    t = chVTGetSystemTimeX();
+    c = chnGetTimeout(chp, EEIMAGE_TIMEOUT);
+    stp->wait_ms += ST2MS(chVTTimeElapsedSinceX(t));
+    if (c < Q_OK) {
+      /* A cancel scanned while resynchronizing is told from payload
+         bytes by the silence that follows it.*/
+      if (cans >= 2) {
+        stp->error = EEIMAGE_ERR_CANCEL;
+        break;
+      }
+      /* The acknowledgements may have been lost, the host resends from
+         the expected frame, the next byte starts a frame.*/
+      stp->timeouts++;
+      errors++;
+      resync = false;
+      cans = 0;
+      nak(chp, stp, expected);
+      continue;
+    }
+    /* The host cancels with two EEIMAGE_CAN. While resynchronizing after
+       a damaged frame the bytes scanned are those of the frames in
+       flight, a pair may be payload.*/
+    if (c == EEIMAGE_CAN) {
+      if ((++cans >= 2) && !resync) {
+        stp->error = EEIMAGE_ERR_CANCEL;
+        break;
+      }
+      continue;
+    }
+    cans = 0;
+    if (c == EEIMAGE_EOT) {
+      /* Likewise a payload byte while resynchronizing, the host repeats
+         the end of image on the NAK that follows its silence.*/
+      if (resync)
+        continue;
+      if (index < frames) {
+        nak(chp, stp, expected);
+        errors++;
+        continue;
+      }
+      stp->error = finish_load(chp, eepp, base, size, buf);
+      if (stp->error == 0)
+        reply(chp, EEIMAGE_ACK, (uint8_t)(index - 1));
+      break;
+    }
+    if (c != EEIMAGE_SOH) {
+      resync = true;
+      continue;
+    }
+
+    /* A damaged frame, or the expected one with a wrong length, asks for
+       a resend, the frames already in flight are then dropped.*/
+    if (!receive(chp, hdr, sizeof hdr) ||
+        (hdr[1] > page) || !receive(chp, buf, hdr[1]) ||
+        !receive(chp, crc, sizeof crc) ||
+        (frame_crc(hdr[0], hdr[1], buf) != get_le32(crc)) ||
+        ((hdr[0] == expected) &&
+         ((index >= frames) ||
+          (hdr[1] != (index + 1 < frames ? page : size - index * page))))) {
+      stp->bad_frames++;
+      errors++;
+      resync = true;
+      drop(chp, stp, expected, &dropped);
+      continue;
+    }
+    resync = false;
+    if (hdr[0] != expected) {
+      if ((uint8_t)(expected - hdr[0]) <= EEIMAGE_WINDOW)
+        reply(chp, EEIMAGE_ACK, (uint8_t)(expected - 1));
+      else
+        drop(chp, stp, expected, &dropped);
+      continue;
+    }
+
+    /* Returns once the program is started, the write cycle overlaps the
+       reception of the next frame.*/
+    t = chVTGetSystemTimeX();
+    if (at25Write(eepp, base + index * page, buf, hdr[1]) !=
+        MSG_OK)
+      stp->error = EEIMAGE_ERR_DEVICE;
+    stp->program_ms += ST2MS(chVTTimeElapsedSinceX(t));
+    if (stp->error != 0)
+      break;
+    reply(chp, EEIMAGE_ACK, expected);
+    index++;
+    stp->frames++;
+    stp->bytes += hdr[1];
+    errors = 0;
+    dropped = 0;
+  }
+  if (stp->error != 0)
+    reply(chp, EEIMAGE_CAN, stp->error);
+  stp->time_ms = ST2MS(chVTTimeElapsedSinceX(start));
+  return stp->error == 0 ? MSG_OK : MSG_RESET;
+}
+
+/**
+ * @brief   Sends an image.
+ * @details A "DUMP <base> <size> <page>" line announces the transfer,
+ *          the pages follow as data frames without acknowledgements and
+ *          @p EEIMAGE_EOT ends the image with its CRC-32.
+ *
+ * @param[in] chp       channel of the transfer
+ * @param[in] eepp      pointer to the @p AT25Driver object
+ * @param[in] base      first address
+ * @param[in] size      image size
+ * @param[out] stp      transfer figures
+ * @return              The operation status.
+ * @retval MSG_OK       if the image was sent.
+ * @retval MSG_RESET    if the range is invalid or a read failed.
+ *
+ * @api
+ */
+msg_t eeimageDump(BaseChannel *chp, AT25Driver *eepp,
+                  uint32_t base, uint32_t size, eeimage_stats_t *stp) {
+  uint32_t page = at25GetPageSize(eepp);
+  uint32_t crc = 0;
+  uint8_t seq = 0;
+  uint8_t trailer[5];
+  uint8_t buf[AT25_MAX_PAGE_SIZE];
+  systime_t start;
+
+  memset(stp, 0, sizeof *stp);
+  if ((size == 0) || (base > at25GetSize(eepp)) ||
+      (size > at25GetSize(eepp) - base))
+    return MSG_RESET;
+
+  chprintf((BaseSequentialStream *)chp, "DUMP %lu %lu %lu\r\n",
+           base, size, page);
+  start = chVTGetSystemTimeX();
+  while (stp->bytes < size) {
+    uint8_t hdr[3], tail[4];
+    uint32_t n = size - stp->bytes < page ? size - stp->bytes : page;
+
+    if (at25Read(eepp, base + stp->bytes, buf, n) != MSG_OK) {
+      stp->error = EEIMAGE_ERR_DEVICE;
+      reply(chp, EEIMAGE_CAN, stp->error);
+      return MSG_RESET;
+    }
+    hdr[0] = EEIMAGE_SOH;
+    hdr[1] = seq;
+    hdr[2] = (uint8_t)n;
+    put_le32(tail, frame_crc(seq, (uint8_t)n, buf));
+    (void)chnWriteTimeout(chp, hdr, sizeof hdr, TIME_INFINITE);
+    (void)chnWriteTimeout(chp, buf, n, TIME_INFINITE);
+    (void)chnWriteTimeout(chp, tail, sizeof tail, TIME_INFINITE);
+    crc = dspCrc32(crc, buf, n);
+    stp->bytes += n;
+    stp->frames++;
+    seq++;
+  }
+  trailer[0] = EEIMAGE_EOT;
+  put_le32(&trailer[1], crc);
+  (void)chnWriteTimeout(chp, trailer, sizeof trailer, TIME_INFINITE);
+  stp->time_ms = ST2MS(chVTTimeElapsedSinceX(start));
+  return MSG_OK;
+}
+
+/** @} */
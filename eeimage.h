@@ -0,0 +1,144 @@
+/*
+    ChibiOS - Copyright (C) 2006..2015 Giovanni Di Sirio
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+/**
+ * @file    eeimage.h
+ * @brief   EEPROM image transfer header.
+ *
+ * @addtogroup EEIMAGE
+ * @{
+ */
+
+#ifndef _EEIMAGE_H_
+#define _EEIMAGE_H_
+
+#include "at25xxx.h"
+
+/*===========================================================================*/
+/* Module constants.                                                         */
+/*===========================================================================*/
+
+/**
+ * @name    Protocol control bytes
+ * @{
+ */
+#define EEIMAGE_SOH                 0x01    /**< @brief Data frame.         */
+#define EEIMAGE_EOT                 0x04    /**< @brief End of image.       */
+#define EEIMAGE_ACK                 0x06    /**< @brief Frame accepted.     */
+#define EEIMAGE_NAK                 0x15    /**< @brief Resend from seq.    */
+#define EEIMAGE_CAN                 0x18    /**< @brief Transfer aborted,
+                                                 twice from the host.       */
+/** @} */
+
+/**
+ * @name    Abort reasons, sent after @p EEIMAGE_CAN
+ * @{
+ */
+#define EEIMAGE_ERR_TIMEOUT         1       /**< @brief Peer silent.        */
+#define EEIMAGE_ERR_DEVICE          2       /**< @brief EEPROM failure.    */
+#define EEIMAGE_ERR_VERIFY          3       /**< @brief Read back differs.  */
+#define EEIMAGE_ERR_CANCEL          4       /**< @brief Cancelled by host.  */
+#define EEIMAGE_ERR_RETRIES         5       /**< @brief Too many errors.    */
+/** @} */
+
+/**
+ * @brief   Frame bytes in addition to the payload: control, sequence,
+ *          length and CRC-32.
+ */
+#define EEIMAGE_FRAME_OVERHEAD      7
+
+/*===========================================================================*/
+/* Module pre-compile time settings.                                         */
+/*===========================================================================*/
+
+/**
+ * @brief   Frames the host may send ahead of the acknowledgements.
+ * @note    The window of frames must fit the input queue of the slowest
+ *          transport, one frame is one page.
+ */
+#if !defined(EEIMAGE_WINDOW) || defined(__DOXYGEN__)
+#define EEIMAGE_WINDOW              8
+#endif
+
+/**
+ * @brief   Longest silence of the host within a transfer.
+ * @details A timeout repeats the last acknowledgement, the transfer is
+ *          aborted after @p EEIMAGE_RETRIES consecutive errors.
+ */
+#if !defined(EEIMAGE_TIMEOUT) || defined(__DOXYGEN__)
+#define EEIMAGE_TIMEOUT             MS2ST(1000)
+#endif
+
+/**
+ * @brief   Consecutive timeouts or bad frames before aborting.
+ */
+#if !defined(EEIMAGE_RETRIES) || defined(__DOXYGEN__)
+#define EEIMAGE_RETRIES             10
+#endif
+
+/*===========================================================================*/
+/* Derived constants and error checks.                                       */
+/*===========================================================================*/
+
+#if (EEIMAGE_WINDOW < 1) || (EEIMAGE_WINDOW > 127)
+#error "invalid EEIMAGE_WINDOW value"
+#endif
+
+/*===========================================================================*/
+/* Module data structures and types.                                         */
+/*===========================================================================*/
+
+/**
+ * @brief   Transfer figures.
+ */
+typedef struct {
+  uint32_t              bytes;              /**< @brief Image bytes.        */
+  uint32_t              frames;             /**< @brief Frames accepted.    */
+  uint32_t              naks;               /**< @brief Resend requests.    */
+  uint32_t              bad_frames;         /**< @brief CRC or length
+                                                 errors.                    */
+  uint32_t              timeouts;           /**< @brief Host silences.      */
+  uint32_t              time_ms;            /**< @brief End to end time.    */
+  uint32_t              wait_ms;            /**< @brief Time blocked on the
+                                                 link.                      */
+  uint32_t              program_ms;         /**< @brief Time blocked on the
+                                                 EEPROM.                    */
+  uint8_t               error;              /**< @brief Abort reason, zero
+                                                 on success.                */
+} eeimage_stats_t;
+
+/*===========================================================================*/
+/* Module macros.                                                            */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* External declarations.                                                    */
+/*===========================================================================*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+  msg_t eeimageLoad(BaseChannel *chp, AT25Driver *eepp,
+                    uint32_t base, uint32_t size, eeimage_stats_t *stp);
+  msg_t eeimageDump(BaseChannel *chp, AT25Driver *eepp,
+                    uint32_t base, uint32_t size, eeimage_stats_t *stp);
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _EEIMAGE_H_ */
+
+/** @} */
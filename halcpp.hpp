@@ -0,0 +1,423 @@
+/*
+    ChibiOS - Copyright (C) 2006..2015 Giovanni Di Sirio
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+/**
+ * @file    halcpp.hpp
+ * @brief   C++ wrappers of the SPI bus, EEPROM and serial drivers.
+ * @details The driver, the bus client, the chip select pin and the
+ *          configuration are template parameters: the configurations are
+ *          built at compile time, the pin accesses are immediate stores
+ *          and the misuse is rejected by the compiler. The bus ownership
+ *          and the chip select are scopes, a transfer needs the selection
+ *          object and the selection needs the bus object, both are
+ *          released in reverse order when leaving the scope.
+ * @note    No heap, no exceptions, no virtual functions, all the members
+ *          are static or inline and compile to the C driver calls, even
+ *          at -O0.
+ *
+ * @addtogroup HALCPP
+ * @{
+ */
+
+#ifndef _HALCPP_HPP_
+#define _HALCPP_HPP_
+
+#include "ch.h"
+#include "hal.h"
+
+#include "spibus.h"
+#include "at25xxx.h"
+#include "serialdma.h"
+
+/*===========================================================================*/
+/* Module pre-compile time settings.                                         */
+/*===========================================================================*/
+
+/**
+ * @brief   Inlining of the wrapper members.
+ */
+#if !defined(HALCPP_INLINE) || defined(__DOXYGEN__)
+#define HALCPP_INLINE               inline __attribute__((always_inline))
+#endif
+
+/*===========================================================================*/
+/* Derived constants and error checks.                                       */
+/*===========================================================================*/
+
+#if !defined(__cplusplus) || (__cplusplus < 201103L)
+#error "halcpp.hpp requires C++11"
+#endif
+
+#if !HAL_USE_SPI || !SPI_USE_MUTUAL_EXCLUSION
+#error "halcpp.hpp requires HAL_USE_SPI and SPI_USE_MUTUAL_EXCLUSION"
+#endif
+
+namespace halcpp {
+
+  /*=========================================================================*/
+  /* Digital pins.                                                           */
+  /*=========================================================================*/
+
+  /**
+   * @brief   GPIO pin known at compile time.
+   *
+   * @tparam PortBase   base address of the port, @p GPIOA_BASE to
+   *                    @p GPIOE_BASE
+   * @tparam Pad        pad number within the port
+   */
+  template <uint32_t PortBase, unsigned Pad>
+  class Pin {
+    static_assert((PortBase == GPIOA_BASE) || (PortBase == GPIOB_BASE) ||
+                  (PortBase == GPIOC_BASE) || (PortBase == GPIOD_BASE) ||
+                  (PortBase == GPIOE_BASE), "not a GPIO port");
+    static_assert(Pad < 16, "pad out of range");
+
+  public:
+    static const uint32_t base = PortBase;
+    static const unsigned pad = Pad;
+
+    /**
+     * @brief   Port of the pin.
+     */
+    static HALCPP_INLINE ioportid_t port(void) {
+
+      return reinterpret_cast<ioportid_t>(PortBase);
+    }
+
+    /**
+     * @brief   Drives the pin high.
+     */
+    static HALCPP_INLINE void set(void) {
+
+      palSetPad(port(), Pad);
+    }
+
+    /**
+     * @brief   Drives the pin low.
+     */
+    static HALCPP_INLINE void clear(void) {
+
+      palClearPad(port(), Pad);
+    }
+
+    /**
+     * @brief   Reads the pin.
+     */
+    static HALCPP_INLINE bool read(void) {
+
+      return palReadPad(port(), Pad) != PAL_LOW;
+    }
+  };
+
+  /*=========================================================================*/
+  /* SPI devices.                                                            */
+  /*=========================================================================*/
+
+  /**
+   * @brief   SPI device on a bus of the @p SPIBus manager.
+   * @details The bus ownership is the @p SPIBusClient of the device: it is
+   *          serialized with the C clients of the same bus, counted in the
+   *          client statistics and in the bus busy time, and the device
+   *          configuration is applied on each ownership.
+   * @note    A transfer is at most @p SPIBUS_CHUNK_SIZE bytes, a longer
+   *          one is split into separate @p Bus scopes as the C drivers do.
+   * @note    The configuration is in RAM, @p setBaudRate() replaces its
+   *          baud rate bits with the @p clockSpiBr() value of a new clock
+   *          profile and the next @p Bus scope applies them.
+   * @note    A device driven by @p AT25Driver is accessed through @p At25,
+   *          a client of its own would bypass the device mutex, the write
+   *          cycles and the read-ahead window.
+   *
+   * @tparam Client     the bus client of the device
+   * @tparam Cr1        CR1 initialization, baud rate and clock mode bits
+   * @tparam Cs         chip select @p Pin, active low
+   */
+  template <SPIBusClient &Client, uint16_t Cr1, typename Cs>
+  class SpiDevice {
+    static_assert((Cr1 & ~(SPI_CR1_BR | SPI_CR1_CPOL | SPI_CR1_CPHA |
+                           SPI_CR1_LSBFIRST | SPI_CR1_DFF)) == 0,
+                  "CR1 bits managed by the driver");
+
+    static SPIConfig config;
+
+  public:
+    /**
+     * @brief   Attaches the device client to a bus.
+     *
+     * @param[in] bus       the bus of the device
+     * @param[in] name      client name in the bus statistics
+     */
+    static HALCPP_INLINE void start(SPIBus &bus, const char *name) {
+
+      spibusClientInit(&Client, &bus, name, &config);
+    }
+
+    /**
+     * @brief   Replaces the baud rate bits of the configuration.
+     *
+     * @param[in] br        the new baud rate bits, from @p clockSpiBr()
+     */
+    static HALCPP_INLINE void setBaudRate(uint32_t br) {
+
+      config.cr1 = (uint16_t)((config.cr1 & ~SPI_CR1_BR) |
+                              (br & SPI_CR1_BR));
+    }
+
+    /**
+     * @brief   Bus ownership scope.
+     * @details The constructor waits for the bus and applies the device
+     *          configuration, the destructor releases the bus.
+     */
+    class Bus {
+    public:
+      HALCPP_INLINE Bus(void) {
+
+        spibusAcquire(&Client);
+      }
+
+      HALCPP_INLINE ~Bus() {
+
+        spibusRelease(&Client);
+      }
+
+      Bus(const Bus &) = delete;
+      Bus &operator=(const Bus &) = delete;
+    };
+
+    /**
+     * @brief   Chip select scope.
+     * @details Only exists within a @p Bus scope, the transfers are its
+     *          members.
+     */
+    class Select {
+    public:
+      explicit HALCPP_INLINE Select(const Bus &) {
+
+        Cs::clear();
+      }
+
+      HALCPP_INLINE ~Select() {
+
+        Cs::set();
+      }
+
+      Select(const Select &) = delete;
+      Select &operator=(const Select &) = delete;
+
+      /**
+       * @brief   Full duplex transfer.
+       */
+      HALCPP_INLINE void exchange(size_t n, const void *txbuf,
+                                  void *rxbuf) const {
+
+        osalDbgCheck(n <= SPIBUS_CHUNK_SIZE);
+        spiExchange(spibusGetDriver(&Client), n, txbuf, rxbuf);
+      }
+
+      /**
+       * @brief   Transmit only transfer.
+       */
+      HALCPP_INLINE void send(size_t n, const void *txbuf) const {
+
+        osalDbgCheck(n <= SPIBUS_CHUNK_SIZE);
+        spiSend(spibusGetDriver(&Client), n, txbuf);
+      }
+
+      /**
+       * @brief   Receive only transfer.
+       */
+      HALCPP_INLINE void receive(size_t n, void *rxbuf) const {
+
+        osalDbgCheck(n <= SPIBUS_CHUNK_SIZE);
+        spiReceive(spibusGetDriver(&Client), n, rxbuf);
+      }
+
+      /**
+       * @brief   Exchanges one frame by polling.
+       */
+      HALCPP_INLINE uint16_t polledExchange(uint16_t frame) const {
+
+        return spiPolledExchange(spibusGetDriver(&Client), frame);
+      }
+    };
+  };
+
+  /*
+   * The chip select fields are only used by the C spiSelect(), they are
+   * filled for the drivers sharing the configuration. The port is cast
+   * from its address here, a function call would make the initialization
+   * dynamic at -O0.
+   */
+  template <SPIBusClient &Client, uint16_t Cr1, typename Cs>
+  SPIConfig SpiDevice<Client, Cr1, Cs>::config = {
+    NULL,
+    reinterpret_cast<ioportid_t>(Cs::base),
+    Cs::pad,
+    Cr1
+  };
+
+  /*=========================================================================*/
+  /* AT25 EEPROMs.                                                           */
+  /*=========================================================================*/
+
+  /**
+   * @brief   EEPROM driven by @p AT25Driver.
+   * @details The accesses are the C driver calls: they take the device
+   *          mutex, wait for the write cycle in progress, keep the
+   *          read-ahead window coherent and split the transfers into bus
+   *          chunks of the driver client.
+   */
+  class At25 {
+    AT25Driver &eep;
+
+  public:
+    explicit HALCPP_INLINE At25(AT25Driver &driver) : eep(driver) {
+    }
+
+    /**
+     * @brief   Reads the status register.
+     */
+    HALCPP_INLINE msg_t readStatus(uint8_t &sr) const {
+
+      return at25ReadStatus(&eep, &sr);
+    }
+
+    /**
+     * @brief   Reads a block of data.
+     */
+    HALCPP_INLINE msg_t read(uint32_t addr, uint8_t *buf, size_t n) const {
+
+      return at25Read(&eep, addr, buf, n);
+    }
+
+    /**
+     * @brief   Writes a block of data.
+     */
+    HALCPP_INLINE msg_t write(uint32_t addr, const uint8_t *buf,
+                              size_t n) const {
+
+      return at25Write(&eep, addr, buf, n);
+    }
+  };
+
+  /*=========================================================================*/
+  /* Serial ports.                                                           */
+  /*=========================================================================*/
+
+  /**
+   * @brief   USART with DMA reception.
+   * @note    The bit rate is checked against the startup APB1 clock, the
+   *          driver recomputes the divider for the current clock profile.
+   *
+   * @tparam Driver     the serial driver
+   * @tparam Speed      bit rate
+   * @tparam Cr2        CR2 initialization, stop bits
+   * @tparam Cr3        CR3 initialization, flow control
+   */
+  template <SerialDMADriver &Driver, uint32_t Speed,
+            uint16_t Cr2 = USART_CR2_STOP1_BITS, uint16_t Cr3 = 0>
+  class SerialPort {
+    static_assert((Speed > 0) && (STM32_PCLK1 / Speed >= 16) &&
+                  (STM32_PCLK1 / Speed <= 0xFFFF),
+                  "bit rate out of the USART range");
+    static_assert((Cr3 & (USART_CR3_DMAR | USART_CR3_DMAT |
+                          USART_CR3_EIE)) == 0,
+                  "CR3 bits managed by the driver");
+
+    static const SerialDMAConfig config;
+
+  public:
+    /**
+     * @brief   Starts the port with its configuration.
+     */
+    static HALCPP_INLINE void start(void) {
+
+      sdmaStart(&Driver, &config);
+    }
+
+    /**
+     * @brief   Stops the port.
+     */
+    static HALCPP_INLINE void stop(void) {
+
+      sdmaStop(&Driver);
+    }
+
+    /**
+     * @brief   Channel interface.
+     */
+    static HALCPP_INLINE BaseChannel *channel(void) {
+
+      return reinterpret_cast<BaseChannel *>(&Driver);
+    }
+
+    /**
+     * @brief   Stream interface, for chprintf() and the shell.
+     */
+    static HALCPP_INLINE BaseSequentialStream *stream(void) {
+
+      return reinterpret_cast<BaseSequentialStream *>(&Driver);
+    }
+
+    /**
+     * @brief   Queues a block for transmission.
+     */
+    static HALCPP_INLINE size_t write(const uint8_t *bp, size_t n,
+                                      systime_t timeout = TIME_INFINITE) {
+
+      return chnWriteTimeout(channel(), bp, n, timeout);
+    }
+
+    /**
+     * @brief   Reads a block from the receive ring.
+     */
+    static HALCPP_INLINE size_t read(uint8_t *bp, size_t n,
+                                     systime_t timeout = TIME_INFINITE) {
+
+      return chnReadTimeout(channel(), bp, n, timeout);
+    }
+
+    /**
+     * @brief   Queues a byte for transmission.
+     */
+    static HALCPP_INLINE msg_t put(uint8_t b,
+                                   systime_t timeout = TIME_INFINITE) {
+
+      return chnPutTimeout(channel(), b, timeout);
+    }
+
+    /**
+     * @brief   Reads a byte from the receive ring.
+     */
+    static HALCPP_INLINE msg_t get(systime_t timeout = TIME_INFINITE) {
+
+      return chnGetTimeout(channel(), timeout);
+    }
+  };
+
+  template <SerialDMADriver &Driver, uint32_t Speed, uint16_t Cr2,
+            uint16_t Cr3>
+  const SerialDMAConfig SerialPort<Driver, Speed, Cr2, Cr3>::config = {
+    Speed,
+    0,
+    Cr2,
+    Cr3
+  };
+}
+
+#endif /* _HALCPP_HPP_ */
+
+/** @} */
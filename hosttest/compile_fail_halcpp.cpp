@@ -0,0 +1,81 @@
+/*
+    ChibiOS - Copyright (C) 2006..2015 Giovanni Di Sirio
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+/**
+ * @file    compile_fail_halcpp.cpp
+ * @brief   Misuses of halcpp.hpp that must not compile.
+ * @details Built once per FAIL_CASE by the Makefile. Case 0 is the valid
+ *          use and must compile, every other case must fail with the
+ *          diagnostic quoted after "expect:" on its line.
+ */
+
+#include "ch.h"
+#include "hal.h"
+
+#include "halcpp.hpp"
+
+SPIDriver SPID3;
+SerialDMADriver SDD2;
+SPIBus spibus;
+SPIBusClient client;
+AT25Driver eeprom;
+
+typedef halcpp::Pin<GPIOB_BASE, 12> SensorCs;
+typedef halcpp::SpiDevice<client, SPI_CR1_BR_1, SensorCs> Device;
+
+void compile_fail(void);
+
+void compile_fail(void) {
+#if FAIL_CASE == 0
+  uint8_t b = 0;
+
+  Device::start(spibus, "sensor");
+  Device::setBaudRate(SPI_CR1_BR_2);
+  {
+    Device::Bus bus;
+    Device::Select cs(bus);
+
+    cs.send(1, &b);
+  }
+  (void)halcpp::At25(eeprom).readStatus(b);
+  halcpp::SerialPort<SDD2, 921600>::start();
+#elif FAIL_CASE == 1 /* expect: not a GPIO port */
+  halcpp::Pin<0x40000000U, 0>::set();
+#elif FAIL_CASE == 2 /* expect: pad out of range */
+  halcpp::Pin<GPIOA_BASE, 16>::set();
+#elif FAIL_CASE == 3 /* expect: CR1 bits managed by the driver */
+  halcpp::SpiDevice<client, SPI_CR1_SPE, SensorCs>::Bus bus;
+#elif FAIL_CASE == 4 /* expect: CR1 bits managed by the driver */
+  halcpp::SpiDevice<client, SPI_CR1_MSTR | SPI_CR1_BR_0, SensorCs>::Bus bus;
+#elif FAIL_CASE == 5 /* expect: bit rate out of the USART range */
+  halcpp::SerialPort<SDD2, 3000000>::start();
+#elif FAIL_CASE == 6 /* expect: bit rate out of the USART range */
+  halcpp::SerialPort<SDD2, 300>::start();
+#elif FAIL_CASE == 7 /* expect: CR3 bits managed by the driver */
+  halcpp::SerialPort<SDD2, 38400, 0, USART_CR3_DMAR>::start();
+#elif FAIL_CASE == 8 /* expect: no matching function */
+  Device::Select cs;
+#elif FAIL_CASE == 9 /* expect: use of deleted function */
+  Device::Bus bus;
+  Device::Bus other(bus);
+#elif FAIL_CASE == 10 /* expect: use of deleted function */
+  Device::Bus bus;
+  Device::Select cs(bus);
+  Device::Select other = cs;
+#elif FAIL_CASE == 11 /* expect: could not convert template argument */
+  halcpp::SpiDevice<SPID3, SPI_CR1_BR_1, SensorCs>::Bus bus;
+#endif
+}
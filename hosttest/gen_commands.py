@@ -0,0 +1,55 @@
+#!/usr/bin/env python3
+#
+# Generates a shell commands list for the hash tests, in the shellcmds.h
+# format read by shellhash.py.
+#
+# The names are built from syllables, 1 to 24 characters long, and include
+# chains of names prefixing each other. Every fifth command is a long
+# command. The list is the same on every run.
+#
+# Usage: gen_commands.py <number of commands>
+#
+
+import random
+import sys
+
+SYLLABLES = ['a', 'ad', 'c', 'ch', 'dsp', 'e', 'eep', 'get', 'i', 'log',
+             'm', 'o', 'par', 'r', 'set', 'sp', 'st', 'u', 'w', 'x', 'y',
+             '_', '0', '1', '9']
+
+
+def names(count):
+    rng = random.Random(27)
+    result = []
+    seen = set()
+
+    # Prefix chains: "a", "ad", "ada" ... and "s", "se", "set".
+    for word in ('adaptive_filter', 'setpoint'):
+        for n in range(1, len(word) + 1):
+            if len(result) < count // 4:
+                result.append(word[:n])
+                seen.add(word[:n])
+
+    while len(result) < count:
+        length = rng.randint(1, 24)
+        name = rng.choice(SYLLABLES[:21])
+        while len(name) < length:
+            name += rng.choice(SYLLABLES)
+        name = name[:length]
+        if name not in seen:
+            seen.add(name)
+            result.append(name)
+    return result
+
+
+def main():
+    if len(sys.argv) != 2:
+        sys.exit('usage: gen_commands.py <number of commands>')
+    print('/*\n * Generated by gen_commands.py, do not edit.\n */\n')
+    for i, name in enumerate(names(int(sys.argv[1]))):
+        macro = 'SHELL_LONG_COMMAND' if i % 5 == 4 else 'SHELL_COMMAND'
+        print('%s(%s, cmd_%s)' % (macro, name, name))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,118 @@
+/*
+    ChibiOS - Copyright (C) 2006..2015 Giovanni Di Sirio
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+/**
+ * @file    hosttest.h
+ * @brief   Host unit tests helpers.
+ * @details The portable modules are built with the native compiler and
+ *          checked against references computed in double precision or by
+ *          straightforward code. Each test program is a single translation
+ *          unit, it prints the failed checks and exits with status 1.
+ *
+ * @addtogroup HOSTTEST
+ * @{
+ */
+
+#ifndef _HOSTTEST_H_
+#define _HOSTTEST_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+/*===========================================================================*/
+/* Module pre-compile time settings.                                         */
+/*===========================================================================*/
+
+/**
+ * @brief   Failed checks printed, the following ones are only counted.
+ */
+#if !defined(HOSTTEST_MAX_REPORTS) || defined(__DOXYGEN__)
+#define HOSTTEST_MAX_REPORTS        20
+#endif
+
+/*===========================================================================*/
+/* Module macros.                                                            */
+/*===========================================================================*/
+
+/**
+ * @brief   Checks a condition, the message is printed if it is false.
+ *
+ * @param[in] cond      the checked condition
+ * @param[in] ...       printf format and arguments of the message
+ */
+#define CHECK(cond, ...) do {                                               \
+  hosttest_checks++;                                                        \
+  if (!(cond)) {                                                            \
+    if (hosttest_failures++ < HOSTTEST_MAX_REPORTS) {                       \
+      printf("%s:%d: ", __FILE__, __LINE__);                                \
+      printf(__VA_ARGS__);                                                  \
+      printf("\n");                                                         \
+    }                                                                       \
+  }                                                                         \
+} while (0)
+
+/*===========================================================================*/
+/* Module inline functions.                                                  */
+/*===========================================================================*/
+
+static unsigned hosttest_checks;
+static unsigned hosttest_failures;
+static uint32_t hosttest_seed = 1;
+
+/**
+ * @brief   Pseudo random numbers, the same sequence on every host.
+ *
+ * @return              The next 32 bits xorshift value.
+ */
+static inline uint32_t hosttestRand(void) {
+  uint32_t x = hosttest_seed;
+
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  hosttest_seed = x;
+  return x;
+}
+
+/**
+ * @brief   Monotonic time for the benchmarks.
+ *
+ * @return              The time in nanoseconds.
+ */
+static inline uint64_t hosttestNanoseconds(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000U + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * @brief   Prints the result of a test program.
+ *
+ * @param[in] name      the test program name
+ * @return              The exit status of the program.
+ */
+static inline int hosttestReport(const char *name) {
+
+  printf("%s: %u checks, %u failed\n", name, hosttest_checks,
+         hosttest_failures);
+  return hosttest_failures > 0 ? 1 : 0;
+}
+
+#endif /* _HOSTTEST_H_ */
+
+/** @} */
@@ -0,0 +1,186 @@
+/*
+    ChibiOS - Copyright (C) 2006..2015 Giovanni Di Sirio
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+/**
+ * @file    stubs/ch.h
+ * @brief   Kernel stubs of the host tests.
+ * @details The kernel types and calls used by the modules under test,
+ *          single threaded: the mutexes are never contended and the
+ *          critical sections are empty. The calls declared without a body
+ *          are defined by the tests using them.
+ */
+
+#ifndef _CH_H_
+#define _CH_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define TRUE                        1
+#define FALSE                       0
+
+#define CH_CFG_USE_MUTEXES          TRUE
+#define CH_CFG_USE_HEAP             TRUE
+#define CH_CFG_USE_DYNAMIC          TRUE
+
+#define CH_KERNEL_MAJOR             3
+#define CH_KERNEL_MINOR             0
+#define CH_KERNEL_PATCH             0
+#define CH_KERNEL_VERSION           "3.0.0"
+#define CH_CFG_ST_FREQUENCY         1000
+
+#define PORT_ARCHITECTURE_NAME      "host"
+
+#define MSG_OK                      (msg_t)0
+#define MSG_TIMEOUT                 (msg_t)-1
+#define MSG_RESET                   (msg_t)-2
+
+#define TIME_IMMEDIATE              ((systime_t)0)
+#define TIME_INFINITE               ((systime_t)-1)
+
+#define MS2ST(msec)                 ((systime_t)(msec))
+#define ST2MS(n)                    ((uint32_t)(n))
+
+#define chDbgCheck(c)               ((void)(c))
+#define chDbgAssert(c, remark)      ((void)(c))
+#define chDbgCheckClassI()
+
+typedef int32_t msg_t;
+typedef uint32_t systime_t;
+typedef uint32_t rtcnt_t;
+typedef uint32_t tprio_t;
+typedef uint32_t eventmask_t;
+typedef uint32_t eventflags_t;
+
+static inline void chSysLock(void) {
+}
+
+static inline void chSysUnlock(void) {
+}
+
+static inline void chSchRescheduleS(void) {
+}
+
+typedef struct {
+  unsigned              locked;
+} mutex_t;
+
+#define MUTEX_DECL(name) mutex_t name = {0}
+
+static inline void chMtxObjectInit(mutex_t *mp) {
+
+  mp->locked = 0;
+}
+
+static inline void chMtxLock(mutex_t *mp) {
+
+  mp->locked++;
+}
+
+static inline void chMtxUnlock(mutex_t *mp) {
+
+  mp->locked--;
+}
+
+typedef struct {
+  void                  *next;
+} event_source_t;
+
+typedef struct {
+  event_source_t        *source;
+  eventflags_t          flags;
+} event_listener_t;
+
+#define EVENT_MASK(eid)             ((eventmask_t)1 << (eventmask_t)(eid))
+#define ALL_EVENTS                  ((eventmask_t)-1)
+
+static inline void chEvtObjectInit(event_source_t *esp) {
+
+  esp->next = esp;
+}
+
+/*
+ * Virtual timers, fired by the tests using them.
+ */
+typedef void (*vtfunc_t)(void *p);
+
+typedef struct {
+  vtfunc_t              func;
+  void                  *par;
+  systime_t             delay;
+} virtual_timer_t;
+
+/*
+ * Threads and mailboxes, never run by the host tests.
+ */
+typedef struct thread thread_t;
+typedef void (*tfunc_t)(void *p);
+
+#define THD_WORKING_AREA_SIZE(n)    (n)
+#define THD_WORKING_AREA(s, n)      uint64_t s[(n) / sizeof(uint64_t)]
+#define THD_FUNCTION(tname, arg)    void tname(void *arg)
+
+typedef struct {
+  msg_t                 *buffer;
+  size_t                size;
+} mailbox_t;
+
+#define MAILBOX_DECL(name, buffer, size) mailbox_t name = {buffer, size}
+
+typedef struct BaseSequentialStream BaseSequentialStream;
+typedef struct BaseChannel BaseChannel;
+
+/*
+ * Defined by the test programs using them.
+ */
+#ifdef __cplusplus
+extern "C" {
+#endif
+  void chSysLockFromISR(void);
+  void chSysUnlockFromISR(void);
+  rtcnt_t chSysGetRealtimeCounterX(void);
+  systime_t chVTGetSystemTimeX(void);
+  systime_t chVTGetSystemTime(void);
+  systime_t chVTTimeElapsedSinceX(systime_t start);
+  void chThdSleepMilliseconds(uint32_t msec);
+  thread_t *chThdCreateStatic(void *wsp, size_t size, tprio_t prio,
+                              tfunc_t pf, void *arg);
+  thread_t *chThdCreateFromHeap(void *heapp, size_t size, tprio_t prio,
+                                tfunc_t pf, void *arg);
+  tprio_t chThdGetPriorityX(void);
+  msg_t chThdWait(thread_t *tp);
+  void chThdExitS(msg_t msg);
+  void chRegSetThreadName(const char *name);
+  eventmask_t chEvtWaitAny(eventmask_t events);
+  eventmask_t chEvtGetAndClearEvents(eventmask_t events);
+  eventflags_t chEvtGetAndClearFlags(event_listener_t *elp);
+  void chEvtRegisterMaskWithFlags(event_source_t *esp, event_listener_t *elp,
+                                  eventmask_t events, eventflags_t wflags);
+  void chEvtUnregister(event_source_t *esp, event_listener_t *elp);
+  void chEvtSignalI(thread_t *tp, eventmask_t events);
+  void chEvtBroadcastI(event_source_t *esp);
+  void chEvtBroadcastFlagsI(event_source_t *esp, eventflags_t flags);
+  void chVTObjectInit(virtual_timer_t *vtp);
+  void chVTSetI(virtual_timer_t *vtp, systime_t delay, vtfunc_t vtfunc,
+                void *par);
+  msg_t chMBPost(mailbox_t *mbp, msg_t msg, systime_t timeout);
+  msg_t chMBFetch(mailbox_t *mbp, msg_t *msgp, systime_t timeout);
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _CH_H_ */
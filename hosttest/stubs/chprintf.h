@@ -0,0 +1,37 @@
+/*
+    ChibiOS - Copyright (C) 2006..2015 Giovanni Di Sirio
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+/**
+ * @file    stubs/chprintf.h
+ * @brief   Formatted output stub of the host tests.
+ * @details Defined by the test program, with the ChibiOS conventions of a
+ *          32 bits target: the "l" modifier is a 32 bits argument.
+ */
+
+#ifndef _CHPRINTF_H_
+#define _CHPRINTF_H_
+
+#include "ch.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+  int chprintf(BaseSequentialStream *chp, const char *fmt, ...);
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _CHPRINTF_H_ */
@@ -0,0 +1,383 @@
+/*
+    ChibiOS - Copyright (C) 2006..2015 Giovanni Di Sirio
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+/**
+ * @file    stubs/hal.h
+ * @brief   HAL stubs of the host tests.
+ * @details The driver types and registers referenced by the headers of
+ *          the modules under test, with the layouts of the STM32F1 HAL.
+ *          The driver calls are defined by the tests using them, which
+ *          record or emulate them.
+ */
+
+#ifndef _HAL_H_
+#define _HAL_H_
+
+#include "ch.h"
+#include "board.h"
+
+#define HAL_USE_SPI                 TRUE
+#define HAL_USE_SERIAL              FALSE
+#define SPI_USE_WAIT                TRUE
+#define SPI_USE_MUTUAL_EXCLUSION    TRUE
+#define STM32_SERIAL_USE_USART2     FALSE
+#define HAL_USE_SERIAL_USB          TRUE
+
+#define SERIAL_USB_BUFFERS_SIZE     256
+
+#define STM32_SYSCLK                72000000
+#define STM32_PCLK1                 36000000
+#define STM32_PCLK2                 36000000
+#define STM32_ADCCLK                9000000
+#define STM32_HAS_DMA2              TRUE
+#define STM32_TIMCLK1               72000000
+
+/*
+ * PAL, the port is the address of its registers block.
+ */
+#define GPIOA_BASE                  0x40010800U
+#define GPIOB_BASE                  0x40010C00U
+#define GPIOC_BASE                  0x40011000U
+#define GPIOD_BASE                  0x40011400U
+#define GPIOE_BASE                  0x40011800U
+
+#define GPIOA                       ((GPIO_TypeDef *)GPIOA_BASE)
+#define GPIOC                       ((GPIO_TypeDef *)GPIOC_BASE)
+
+#define PAL_LOW                     0U
+
+typedef struct {
+  volatile uint32_t     CRL;
+  volatile uint32_t     CRH;
+  volatile uint32_t     IDR;
+  volatile uint32_t     ODR;
+  volatile uint32_t     BSRR;
+  volatile uint32_t     BRR;
+  volatile uint32_t     LCKR;
+} GPIO_TypeDef;
+
+typedef GPIO_TypeDef *ioportid_t;
+
+/*
+ * SPI, same configuration layout as the STM32 low level driver.
+ */
+#define SPI_CR1_CPHA                0x0001U
+#define SPI_CR1_CPOL                0x0002U
+#define SPI_CR1_MSTR                0x0004U
+#define SPI_CR1_BR_0                0x0008U
+#define SPI_CR1_BR_1                0x0010U
+#define SPI_CR1_BR_2                0x0020U
+#define SPI_CR1_BR                  0x0038U
+#define SPI_CR1_SPE                 0x0040U
+#define SPI_CR1_LSBFIRST            0x0080U
+#define SPI_CR1_SSI                 0x0100U
+#define SPI_CR1_SSM                 0x0200U
+#define SPI_CR1_DFF                 0x0800U
+
+typedef struct SPIDriver SPIDriver;
+typedef void (*spicallback_t)(SPIDriver *spip);
+
+typedef struct {
+  spicallback_t         end_cb;
+  ioportid_t            ssport;
+  uint16_t              sspad;
+  uint16_t              cr1;
+} SPIConfig;
+
+struct SPIDriver {
+  const SPIConfig       *config;
+};
+
+/*
+ * Serial channels and the USART registers used by the configurations.
+ */
+#define USART_CR2_STOP1_BITS        0x0000U
+#define USART_CR2_STOP2_BITS        0x2000U
+#define USART_CR3_EIE               0x0001U
+#define USART_CR3_DMAR              0x0040U
+#define USART_CR3_DMAT              0x0080U
+#define USART_CR3_RTSE              0x0100U
+#define USART_CR3_CTSE              0x0200U
+
+#define _base_asynchronous_channel_data
+#define _base_asynchronous_channel_methods  size_t instance_offset;
+
+typedef struct USART_TypeDef USART_TypeDef;
+typedef struct stm32_dma_stream_t stm32_dma_stream_t;
+
+/*
+ * DMA streams, the streams are only compared by the tests.
+ */
+#define STM32_DMA_CR_DIR_M2P        0x00000010U
+#define STM32_DMA_CR_CIRC           0x00000020U
+#define STM32_DMA_CR_MINC           0x00000080U
+#define STM32_DMA_CR_PSIZE_WORD     0x00000200U
+#define STM32_DMA_CR_MSIZE_WORD     0x00000800U
+#define STM32_DMA_CR_PL(n)          ((uint32_t)(n) << 12)
+
+#define STM32_DMA2_STREAM3          ((const stm32_dma_stream_t *)0x40020430U)
+
+typedef void (*stm32_dmaisr_t)(void *p, uint32_t flags);
+
+#define osalDbgAssert(c, remark)    ((void)(c))
+#define osalDbgCheck(c)             ((void)(c))
+
+/*
+ * Basic timers and clock gating, the registers are defined by the tests.
+ */
+#define RCC_APB1ENR_TIM6EN          0x00000010U
+#define TIM_CR1_CEN                 0x0001U
+#define TIM_DIER_UDE                0x0100U
+#define TIM_EGR_UG                  0x0001U
+
+typedef struct {
+  volatile uint32_t     CR1;
+  volatile uint32_t     CR2;
+  volatile uint32_t     SMCR;
+  volatile uint32_t     DIER;
+  volatile uint32_t     SR;
+  volatile uint32_t     EGR;
+  volatile uint32_t     CCMR1;
+  volatile uint32_t     CCMR2;
+  volatile uint32_t     CCER;
+  volatile uint32_t     CNT;
+  volatile uint32_t     PSC;
+  volatile uint32_t     ARR;
+} TIM_TypeDef;
+
+#define TIM6                        (&TIM6_regs)
+
+typedef struct {
+  size_t                q_counter;
+} input_queue_t;
+
+typedef input_queue_t output_queue_t;
+
+#define Q_OK                        MSG_OK
+#define Q_TIMEOUT                   MSG_TIMEOUT
+#define Q_RESET                     MSG_RESET
+
+#define CHN_CONNECTED               (eventflags_t)1
+#define CHN_DISCONNECTED            (eventflags_t)2
+#define CHN_INPUT_AVAILABLE         (eventflags_t)4
+
+typedef struct BaseAsynchronousChannel BaseAsynchronousChannel;
+
+/*
+ * USB, descriptor macros and configuration layouts of the ChibiOS 3.0
+ * driver.
+ */
+#define USB_DESCRIPTOR_DEVICE           1U
+#define USB_DESCRIPTOR_CONFIGURATION    2U
+#define USB_DESCRIPTOR_STRING           3U
+#define USB_DESCRIPTOR_INTERFACE        4U
+#define USB_DESCRIPTOR_ENDPOINT         5U
+
+#define USB_EP_MODE_TYPE                0x0003U
+#define USB_EP_MODE_TYPE_CTRL           0x0000U
+#define USB_EP_MODE_TYPE_ISOC           0x0001U
+#define USB_EP_MODE_TYPE_BULK           0x0002U
+#define USB_EP_MODE_TYPE_INTR           0x0003U
+
+#define USB_DESC_BYTE(b) ((uint8_t)(b))
+#define USB_DESC_WORD(w)                                                    \
+  (uint8_t)((w) & 255),                                                     \
+  (uint8_t)(((w) >> 8) & 255)
+#define USB_DESC_BCD(bcd)                                                   \
+  (uint8_t)((bcd) & 255),                                                   \
+  (uint8_t)(((bcd) >> 8) & 255)
+
+#define USB_DESC_DEVICE(bcdUSB, bDeviceClass, bDeviceSubClass,              \
+                        bDeviceProtocol, bMaxPacketSize, idVendor,          \
+                        idProduct, bcdDevice, iManufacturer,                \
+                        iProduct, iSerialNumber, bNumConfigurations)        \
+  USB_DESC_BYTE(18),                                                        \
+  USB_DESC_BYTE(USB_DESCRIPTOR_DEVICE),                                     \
+  USB_DESC_BCD(bcdUSB),                                                     \
+  USB_DESC_BYTE(bDeviceClass),                                              \
+  USB_DESC_BYTE(bDeviceSubClass),                                           \
+  USB_DESC_BYTE(bDeviceProtocol),                                           \
+  USB_DESC_BYTE(bMaxPacketSize),                                            \
+  USB_DESC_WORD(idVendor),                                                  \
+  USB_DESC_WORD(idProduct),                                                 \
+  USB_DESC_BCD(bcdDevice),                                                  \
+  USB_DESC_BYTE(iManufacturer),                                             \
+  USB_DESC_BYTE(iProduct),                                                  \
+  USB_DESC_BYTE(iSerialNumber),                                             \
+  USB_DESC_BYTE(bNumConfigurations)
+
+#define USB_DESC_CONFIGURATION(wTotalLength, bNumInterfaces,                \
+                               bConfigurationValue, iConfiguration,         \
+                               bmAttributes, bMaxPower)                     \
+  USB_DESC_BYTE(9),                                                         \
+  USB_DESC_BYTE(USB_DESCRIPTOR_CONFIGURATION),                              \
+  USB_DESC_WORD(wTotalLength),                                              \
+  USB_DESC_BYTE(bNumInterfaces),                                            \
+  USB_DESC_BYTE(bConfigurationValue),                                       \
+  USB_DESC_BYTE(iConfiguration),                                            \
+  USB_DESC_BYTE(bmAttributes),                                              \
+  USB_DESC_BYTE(bMaxPower)
+
+#define USB_DESC_INTERFACE(bInterfaceNumber, bAlternateSetting,             \
+                           bNumEndpoints, bInterfaceClass,                  \
+                           bInterfaceSubClass, bInterfaceProtocol,          \
+                           iInterface)                                      \
+  USB_DESC_BYTE(9),                                                         \
+  USB_DESC_BYTE(USB_DESCRIPTOR_INTERFACE),                                  \
+  USB_DESC_BYTE(bInterfaceNumber),                                          \
+  USB_DESC_BYTE(bAlternateSetting),                                         \
+  USB_DESC_BYTE(bNumEndpoints),                                             \
+  USB_DESC_BYTE(bInterfaceClass),                                           \
+  USB_DESC_BYTE(bInterfaceSubClass),                                        \
+  USB_DESC_BYTE(bInterfaceProtocol),                                        \
+  USB_DESC_BYTE(iInterface)
+
+#define USB_DESC_ENDPOINT(bEndpointAddress, bmAttributes, wMaxPacketSize,   \
+                          bInterval)                                        \
+  USB_DESC_BYTE(7),                                                         \
+  USB_DESC_BYTE(USB_DESCRIPTOR_ENDPOINT),                                   \
+  USB_DESC_BYTE(bEndpointAddress),                                          \
+  USB_DESC_BYTE(bmAttributes),                                              \
+  USB_DESC_WORD(wMaxPacketSize),                                            \
+  USB_DESC_BYTE(bInterval)
+
+typedef struct USBDriver USBDriver;
+typedef uint8_t usbep_t;
+typedef uint32_t usbepmode_t;
+
+typedef enum {
+  USB_EVENT_RESET = 0,
+  USB_EVENT_ADDRESS = 1,
+  USB_EVENT_CONFIGURED = 2,
+  USB_EVENT_SUSPEND = 3,
+  USB_EVENT_WAKEUP = 4,
+  USB_EVENT_STALLED = 5
+} usbevent_t;
+
+typedef struct {
+  size_t                ud_size;
+  const uint8_t         *ud_string;
+} USBDescriptor;
+
+typedef void (*usbcallback_t)(USBDriver *usbp);
+typedef void (*usbepcallback_t)(USBDriver *usbp, usbep_t ep);
+typedef void (*usbeventcb_t)(USBDriver *usbp, usbevent_t event);
+typedef bool (*usbreqhandler_t)(USBDriver *usbp);
+typedef const USBDescriptor * (*usbgetdescriptor_t)(USBDriver *usbp,
+                                                    uint8_t dtype,
+                                                    uint8_t dindex,
+                                                    uint16_t lang);
+
+typedef struct {
+  size_t                txsize;
+} USBInEndpointState;
+
+typedef struct {
+  size_t                rxsize;
+} USBOutEndpointState;
+
+typedef struct {
+  usbepmode_t           ep_mode;
+  usbepcallback_t       setup_cb;
+  usbepcallback_t       in_cb;
+  usbepcallback_t       out_cb;
+  uint16_t              in_maxsize;
+  uint16_t              out_maxsize;
+  USBInEndpointState    *in_state;
+  USBOutEndpointState   *out_state;
+  uint16_t              in_multiplier;
+  uint8_t               *setup_buf;
+} USBEndpointConfig;
+
+typedef struct {
+  usbeventcb_t          event_cb;
+  usbgetdescriptor_t    get_descriptor_cb;
+  usbreqhandler_t       requests_hook_cb;
+  usbcallback_t         sof_cb;
+} USBConfig;
+
+struct USBDriver {
+  const USBConfig       *config;
+};
+
+typedef struct {
+  USBDriver             *usbp;
+  usbep_t               bulk_in;
+  usbep_t               bulk_out;
+  usbep_t               int_in;
+} SerialUSBConfig;
+
+typedef struct {
+  const SerialUSBConfig *config;
+} SerialUSBDriver;
+
+/*
+ * Defined by the test programs using them.
+ */
+#ifdef __cplusplus
+extern "C" {
+#endif
+  extern SPIDriver SPID3;
+  extern USBDriver USBD1;
+  extern TIM_TypeDef TIM6_regs;
+  bool dmaStreamAllocate(const stm32_dma_stream_t *dmastp, uint32_t priority,
+                         stm32_dmaisr_t func, void *param);
+  void dmaStreamSetPeripheral(const stm32_dma_stream_t *dmastp,
+                              volatile void *addr);
+  void dmaStreamSetMemory0(const stm32_dma_stream_t *dmastp,
+                           const void *addr);
+  void dmaStreamSetTransactionSize(const stm32_dma_stream_t *dmastp,
+                                   size_t size);
+  void dmaStreamSetMode(const stm32_dma_stream_t *dmastp, uint32_t mode);
+  void dmaStreamEnable(const stm32_dma_stream_t *dmastp);
+  void rccEnableAPB1(uint32_t mask, bool lp);
+  void osalSysLockFromISR(void);
+  void osalSysUnlockFromISR(void);
+  void palSetPad(ioportid_t port, unsigned pad);
+  void palClearPad(ioportid_t port, unsigned pad);
+  unsigned palReadPad(ioportid_t port, unsigned pad);
+  void spiAcquireBus(SPIDriver *spip);
+  void spiReleaseBus(SPIDriver *spip);
+  void spiStart(SPIDriver *spip, const SPIConfig *config);
+  void spiSelect(SPIDriver *spip);
+  void spiUnselect(SPIDriver *spip);
+  void spiExchange(SPIDriver *spip, size_t n, const void *txbuf,
+                   void *rxbuf);
+  void spiSend(SPIDriver *spip, size_t n, const void *txbuf);
+  void spiReceive(SPIDriver *spip, size_t n, void *rxbuf);
+  uint16_t spiPolledExchange(SPIDriver *spip, uint16_t frame);
+  size_t chnWriteTimeout(BaseChannel *chp, const uint8_t *bp, size_t n,
+                         systime_t timeout);
+  size_t chnReadTimeout(BaseChannel *chp, uint8_t *bp, size_t n,
+                        systime_t timeout);
+  msg_t chnPutTimeout(BaseChannel *chp, uint8_t b, systime_t timeout);
+  msg_t chnGetTimeout(BaseChannel *chp, systime_t timeout);
+  event_source_t *chnGetEventSource(BaseAsynchronousChannel *acp);
+  size_t chSequentialStreamRead(BaseSequentialStream *chp, uint8_t *bp,
+                                size_t n);
+  void usbInitEndpointI(USBDriver *usbp, usbep_t ep,
+                        const USBEndpointConfig *epcp);
+  void sduConfigureHookI(SerialUSBDriver *sdup);
+  void sduSOFHookI(SerialUSBDriver *sdup);
+  bool sduRequestsHook(USBDriver *usbp);
+  void sduDataTransmitted(USBDriver *usbp, usbep_t ep);
+  void sduDataReceived(USBDriver *usbp, usbep_t ep);
+  void sduInterruptTransmitted(USBDriver *usbp, usbep_t ep);
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _HAL_H_ */
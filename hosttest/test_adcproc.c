@@ -0,0 +1,227 @@
+/*
+    ChibiOS - Copyright (C) 2006..2015 Giovanni Di Sirio
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+/**
+ * @file    test_adcproc.c
+ * @brief   ADC block processing kernels tests and benchmark.
+ * @details The statistics and the decimation are compared with references
+ *          computed in double precision, rounded the way the kernels round.
+ *          The benchmark runs the kernels on acquisition sized blocks.
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include "adcproc.h"
+#include "hosttest.h"
+
+/* Acquisition block, see acquire.h.*/
+#define BLOCK_SIZE          256
+#define DECIMATION          8
+#define BENCH_BLOCKS        20000
+
+/*
+ * Square root rounded to nearest and saturated, from 4x against the squares
+ * of the odd numbers 2r - 1 and 2r + 1.
+ */
+static void check_sqrt(uint64_t x) {
+  uint32_t r = adcprocSqrt(x);
+  unsigned __int128 x4 = (unsigned __int128)x * 4;
+  unsigned __int128 lo = (unsigned __int128)(2 * (uint64_t)r - 1) *
+                         (2 * (uint64_t)r - 1);
+  unsigned __int128 hi = (unsigned __int128)(2 * (uint64_t)r + 1) *
+                         (2 * (uint64_t)r + 1);
+
+  if (r == UINT32_MAX)
+    CHECK(x4 >= lo, "sqrt(%llu) = %lu", (unsigned long long)x,
+          (unsigned long)r);
+  else if (r == 0)
+    CHECK(x4 < 1, "sqrt(%llu) = 0", (unsigned long long)x);
+  else
+    CHECK((x4 >= lo) && (x4 < hi), "sqrt(%llu) = %lu",
+          (unsigned long long)x, (unsigned long)r);
+}
+
+static void test_sqrt(void) {
+  static const uint64_t edges[] = {
+    0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 0xFFFFFFFFU, 0x100000000U,
+    0xFFFFFFFE00000001U,                  /* (2^32 - 1)^2.                  */
+    0xFFFFFFFEFFFFFFFFU,                  /* Rounds down to 2^32 - 1.       */
+    0xFFFFFFFF00000000U,                  /* Rounds up, saturated.          */
+    UINT64_MAX - 1, UINT64_MAX
+  };
+  uint64_t x;
+  unsigned i;
+
+  for (i = 0; i < sizeof edges / sizeof edges[0]; i++)
+    check_sqrt(edges[i]);
+  CHECK(adcprocSqrt(UINT64_MAX) == UINT32_MAX, "sqrt(UINT64_MAX) = %lu",
+        (unsigned long)adcprocSqrt(UINT64_MAX));
+  for (x = 0; x < (1U << 20); x++)
+    check_sqrt(x);
+  for (i = 0; i < 1000000; i++)
+    check_sqrt(((uint64_t)hosttestRand() << 32 | hosttestRand()) >>
+               (hosttestRand() % 64));
+}
+
+/*
+ * Statistics of a block against the double precision reference.
+ */
+static void check_stats(const uint16_t *samples, size_t n) {
+  adcproc_stats_t st;
+  uint16_t min = UINT16_MAX, max = 0;
+  double sum = 0.0, sumsq = 0.0, q;
+  size_t i;
+
+  for (i = 0; i < n; i++) {
+    if (samples[i] < min)
+      min = samples[i];
+    if (samples[i] > max)
+      max = samples[i];
+    sum += samples[i];
+    sumsq += (double)samples[i] * samples[i];
+  }
+  adcprocStats(samples, n, &st);
+  CHECK(st.min == min, "n %zu: min %u, expected %u", n, st.min, min);
+  CHECK(st.max == max, "n %zu: max %u, expected %u", n, st.max, max);
+  CHECK(st.mean == (uint16_t)floor(sum / n + 0.5),
+        "n %zu: mean %u, expected %.1f", n, st.mean, sum / n);
+
+  /* The kernel rounds the mean square to an integer first, the root of an
+     integer is never halfway between two integers.*/
+  q = floor(sumsq / n + 0.5);
+  CHECK(st.rms == (uint16_t)floor(sqrt(q) + 0.5),
+        "n %zu: rms %u, expected %.3f", n, st.rms, sqrt(sumsq / n));
+  CHECK(fabs(st.rms - sqrt(sumsq / n)) <= 0.5 + 1e-9,
+        "n %zu: rms %u, exact %.3f", n, st.rms, sqrt(sumsq / n));
+}
+
+static void test_stats(void) {
+  static const size_t sizes[] = {1, 2, 3, 7, 64, BLOCK_SIZE, 4096, 65536};
+  static uint16_t block[65536];
+  unsigned i, k;
+  size_t j;
+
+  for (i = 0; i < sizeof sizes / sizeof sizes[0]; i++) {
+    size_t n = sizes[i];
+
+    for (k = 0; k < 50; k++) {
+      /* 12 bits noise around a random level.*/
+      uint32_t level = hosttestRand() % 4096;
+
+      for (j = 0; j < n; j++)
+        block[j] = (uint16_t)((level + hosttestRand() % 64) % 4096);
+      check_stats(block, n);
+    }
+
+    /* Full scale, the sums at their widest.*/
+    for (j = 0; j < n; j++)
+      block[j] = UINT16_MAX;
+    check_stats(block, n);
+    for (j = 0; j < n; j++)
+      block[j] = (j & 1) != 0 ? UINT16_MAX : 0;
+    check_stats(block, n);
+    memset(block, 0, n * sizeof block[0]);
+    check_stats(block, n);
+  }
+}
+
+/*
+ * Decimation against the reference, in a separate buffer and in place.
+ */
+static void check_decimate(const uint16_t *samples, size_t n,
+                           unsigned factor) {
+  static uint16_t out[BLOCK_SIZE * 4], inplace[BLOCK_SIZE * 4];
+  size_t m, i;
+  unsigned j;
+
+  m = adcprocDecimate(samples, n, factor, out);
+  CHECK(m == n / factor, "n %zu factor %u: %zu outputs", n, factor, m);
+  for (i = 0; i < m; i++) {
+    double acc = 0.0;
+
+    for (j = 0; j < factor; j++)
+      acc += samples[i * factor + j];
+    CHECK(out[i] == (uint16_t)floor(acc / factor + 0.5),
+          "n %zu factor %u: out[%zu] %u, expected %.3f", n, factor, i,
+          out[i], acc / factor);
+  }
+  memcpy(inplace, samples, n * sizeof samples[0]);
+  (void)adcprocDecimate(inplace, n, factor, inplace);
+  CHECK(memcmp(inplace, out, m * sizeof out[0]) == 0,
+        "n %zu factor %u: in place result differs", n, factor);
+}
+
+static void test_decimate(void) {
+  static const unsigned factors[] = {1, 2, 3, 5, DECIMATION, 16, 256};
+  static uint16_t block[BLOCK_SIZE * 4];
+  unsigned i, k;
+  size_t j;
+
+  for (i = 0; i < sizeof factors / sizeof factors[0]; i++) {
+    for (k = 0; k < 100; k++) {
+      size_t n = hosttestRand() % (sizeof block / sizeof block[0]);
+
+      for (j = 0; j < n; j++)
+        block[j] = (uint16_t)(k < 50 ? hosttestRand() % 4096 :
+                                       hosttestRand());
+      check_decimate(block, n, factors[i]);
+    }
+    for (j = 0; j < BLOCK_SIZE; j++)
+      block[j] = UINT16_MAX;
+    check_decimate(block, BLOCK_SIZE, factors[i]);
+  }
+}
+
+/*
+ * Host time of the kernels on acquisition blocks, the target figure is
+ * printed by the "adc" command.
+ */
+static void bench(void) {
+  static uint16_t block[BLOCK_SIZE], out[BLOCK_SIZE / DECIMATION];
+  volatile uint32_t sink = 0;
+  adcproc_stats_t st;
+  uint64_t t0, t1, t2;
+  unsigned i;
+
+  for (i = 0; i < BLOCK_SIZE; i++)
+    block[i] = (uint16_t)(hosttestRand() % 4096);
+  t0 = hosttestNanoseconds();
+  for (i = 0; i < BENCH_BLOCKS; i++) {
+    block[i % BLOCK_SIZE] ^= 1;
+    adcprocStats(block, BLOCK_SIZE, &st);
+    sink += st.rms;
+  }
+  t1 = hosttestNanoseconds();
+  for (i = 0; i < BENCH_BLOCKS; i++) {
+    block[i % BLOCK_SIZE] ^= 1;
+    sink += adcprocDecimate(block, BLOCK_SIZE, DECIMATION, out) + out[0];
+  }
+  t2 = hosttestNanoseconds();
+  printf("adcprocStats    %6.2f ns/sample\n",
+         (double)(t1 - t0) / BENCH_BLOCKS / BLOCK_SIZE);
+  printf("adcprocDecimate %6.2f ns/sample\n",
+         (double)(t2 - t1) / BENCH_BLOCKS / BLOCK_SIZE);
+}
+
+int main(void) {
+
+  test_sqrt();
+  test_stats();
+  test_decimate();
+  bench();
+  return hosttestReport("adcproc");
+}
@@ -0,0 +1,445 @@
+/*
+    ChibiOS - Copyright (C) 2006..2015 Giovanni Di Sirio
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+/**
+ * @file    test_dsp.c
+ * @brief   Fixed point DSP kernels tests and benchmark.
+ * @details The kernels are compared bit for bit with double precision
+ *          references rounded and saturated the same way. A double holds
+ *          the Q15 sums exactly. For the Q31 kernels the coefficients are
+ *          quantized to 16 or 17 significant bits, as designed filters are,
+ *          so that the products and their sums fit the 53 bits mantissa.
+ *          Full precision Q31 coefficients are checked within one LSB.
+ */
+
+#include <math.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "dsp.h"
+#include "hosttest.h"
+
+#define VECTOR_SIZE         1024
+#define MAX_TAPS            64
+#define MAX_STAGES          4
+#define BENCH_SAMPLES       (1U << 20)
+
+/*===========================================================================*/
+/* References.                                                               */
+/*===========================================================================*/
+
+static double sat(double x, double min, double max) {
+
+  return x < min ? min : x > max ? max : x;
+}
+
+/* Round half up, as the kernels add half an LSB before shifting.*/
+static double round_half_up(double x) {
+
+  return floor(x + 0.5);
+}
+
+static void ref_fir_q15(const q15_t *c, size_t ntaps, const q15_t *in,
+                        q15_t *out, size_t n) {
+  size_t i, k;
+
+  for (i = 0; i < n; i++) {
+    double acc = 0.0;
+
+    for (k = 0; k < ntaps && k <= i; k++)
+      acc += (double)c[k] * in[i - k];
+    out[i] = (q15_t)sat(round_half_up(acc / 32768.0), INT16_MIN, INT16_MAX);
+  }
+}
+
+static void ref_fir_q31(const q31_t *c, size_t ntaps, const q31_t *in,
+                        q31_t *out, size_t n) {
+  size_t i, k;
+
+  for (i = 0; i < n; i++) {
+    double acc = 0.0;
+
+    for (k = 0; k < ntaps && k <= i; k++)
+      acc += (double)c[k] * in[i - k];
+    out[i] = (q31_t)sat(round_half_up(acc / 2147483648.0),
+                        INT32_MIN, INT32_MAX);
+  }
+}
+
+static void ref_biquad_q31(const q31_t *c, size_t nstages, const q31_t *in,
+                           q31_t *out, size_t n) {
+  static q31_t tmp[VECTOR_SIZE];
+  size_t s, i;
+
+  memcpy(tmp, in, n * sizeof in[0]);
+  for (s = 0; s < nstages; s++, c += 5) {
+    double x1 = 0.0, x2 = 0.0, y1 = 0.0, y2 = 0.0;
+
+    for (i = 0; i < n; i++) {
+      double x0 = tmp[i], y0;
+
+      y0 = sat(round_half_up(((double)c[0] * x0 + (double)c[1] * x1 +
+                              (double)c[2] * x2 + (double)c[3] * y1 +
+                              (double)c[4] * y2) / 1073741824.0),
+               INT32_MIN, INT32_MAX);
+      x2 = x1;
+      x1 = x0;
+      y2 = y1;
+      y1 = y0;
+      tmp[i] = (q31_t)y0;
+    }
+  }
+  memcpy(out, tmp, n * sizeof out[0]);
+}
+
+static void ref_mavg_q15(unsigned log2len, const q15_t *in, q15_t *out,
+                         size_t n) {
+  size_t len = (size_t)1 << log2len, i, k;
+
+  for (i = 0; i < n; i++) {
+    double acc = 0.0;
+
+    for (k = 0; k < len && k <= i; k++)
+      acc += in[i - k];
+    out[i] = (q15_t)floor(acc / len);
+  }
+}
+
+static uint32_t ref_crc32(const uint8_t *p, size_t n) {
+  uint32_t crc = 0xFFFFFFFFU;
+  unsigned b;
+
+  while (n-- > 0) {
+    crc ^= *p++;
+    for (b = 0; b < 8; b++)
+      crc = (crc >> 1) ^ ((crc & 1) != 0 ? 0xEDB88320U : 0);
+  }
+  return ~crc;
+}
+
+/*===========================================================================*/
+/* Vectors.                                                                  */
+/*===========================================================================*/
+
+static q15_t q15_in[VECTOR_SIZE], q15_out[VECTOR_SIZE], q15_ref[VECTOR_SIZE];
+static q31_t q31_in[VECTOR_SIZE], q31_out[VECTOR_SIZE], q31_ref[VECTOR_SIZE];
+
+/*
+ * Impulse, full scale steps and square wave, sine and noise.
+ */
+static void make_q15(unsigned kind) {
+  unsigned i;
+
+  for (i = 0; i < VECTOR_SIZE; i++) {
+    switch (kind) {
+    case 0:
+      q15_in[i] = i == 0 ? INT16_MAX : 0;
+      break;
+    case 1:
+      q15_in[i] = i < VECTOR_SIZE / 2 ? INT16_MAX : INT16_MIN;
+      break;
+    case 2:
+      q15_in[i] = (i & 8) != 0 ? INT16_MAX : INT16_MIN;
+      break;
+    case 3:
+      q15_in[i] = (q15_t)floor(32767.0 * sin(i * 0.05) + 0.5);
+      break;
+    default:
+      q15_in[i] = (q15_t)hosttestRand();
+    }
+  }
+}
+
+static void make_q31(unsigned kind) {
+  unsigned i;
+
+  make_q15(kind);
+  for (i = 0; i < VECTOR_SIZE; i++) {
+    if (kind == 3)
+      q31_in[i] = (q31_t)floor(2147483647.0 * sin(i * 0.05) + 0.5);
+    else if (kind > 3)
+      q31_in[i] = (q31_t)hosttestRand();
+    else
+      q31_in[i] = q15_in[i] == INT16_MAX ? INT32_MAX :
+                                           (q31_t)q15_in[i] * 65536;
+  }
+}
+
+/* Position of the first difference, n if none.*/
+static size_t first_diff(const void *a, const void *b, size_t size,
+                         size_t n) {
+  size_t i;
+
+  for (i = 0; i < n; i++) {
+    if (memcmp((const uint8_t *)a + i * size,
+               (const uint8_t *)b + i * size, size) != 0)
+      break;
+  }
+  return i;
+}
+
+/* Random coefficient with 16 significant bits at the given scale.*/
+static q31_t coeff16(int shift) {
+
+  return (q31_t)((uint32_t)(int32_t)(int16_t)hosttestRand() << shift);
+}
+
+/*===========================================================================*/
+/* Tests.                                                                    */
+/*===========================================================================*/
+
+static void test_fir_q15(void) {
+  static q15_t coeffs[MAX_TAPS], state[2 * MAX_TAPS];
+  static const size_t taps[] = {1, 2, 7, 16, 31, MAX_TAPS};
+  dsp_fir_q15_t fir;
+  unsigned t, kind, gain;
+  size_t i;
+
+  for (t = 0; t < sizeof taps / sizeof taps[0]; t++) {
+    for (gain = 0; gain < 2; gain++) {
+      /* Normalized taps, then taps large enough to saturate.*/
+      for (i = 0; i < taps[t]; i++)
+        coeffs[i] = gain == 0 ? (q15_t)((int16_t)hosttestRand() /
+                                        (int)taps[t]) :
+                                (q15_t)hosttestRand();
+      for (kind = 0; kind < 5; kind++) {
+        make_q15(kind);
+        ref_fir_q15(coeffs, taps[t], q15_in, q15_ref, VECTOR_SIZE);
+
+        /* Uneven blocks, the state carries over.*/
+        dspFirInitQ15(&fir, coeffs, state, taps[t]);
+        dspFirQ15(&fir, q15_in, q15_out, 37);
+        dspFirQ15(&fir, q15_in + 37, q15_out + 37, VECTOR_SIZE - 37);
+        i = first_diff(q15_out, q15_ref, sizeof q15_out[0], VECTOR_SIZE);
+        CHECK(i == VECTOR_SIZE, "fir q15 %zu taps, vector %u: out[%zu] %d, "
+              "expected %d", taps[t], kind, i, q15_out[i], q15_ref[i]);
+
+        /* In place.*/
+        memcpy(q15_out, q15_in, sizeof q15_out);
+        dspFirInitQ15(&fir, coeffs, state, taps[t]);
+        dspFirQ15(&fir, q15_out, q15_out, VECTOR_SIZE);
+        CHECK(memcmp(q15_out, q15_ref, sizeof q15_out) == 0,
+              "fir q15 %zu taps, vector %u: in place differs", taps[t],
+              kind);
+      }
+    }
+  }
+}
+
+static void test_fir_q31(void) {
+  static q31_t coeffs[MAX_TAPS], state[2 * MAX_TAPS];
+  static const size_t taps[] = {1, 2, 7, 16, 31, MAX_TAPS};
+  dsp_fir_q31_t fir;
+  unsigned t, kind, full;
+  size_t i;
+
+  for (t = 0; t < sizeof taps / sizeof taps[0]; t++) {
+    for (full = 0; full < 2; full++) {
+      /* Taps with a sum of absolute values below two, the accumulator
+         limit of the kernel.*/
+      for (i = 0; i < taps[t]; i++)
+        coeffs[i] = full == 0 ? coeff16(15) / (q31_t)taps[t] :
+                                (q31_t)hosttestRand() / (q31_t)taps[t];
+      if (full == 0) {
+        for (i = 0; i < taps[t]; i++)
+          coeffs[i] &= (q31_t)0xFFFF0000U;
+      }
+      for (kind = 0; kind < 5; kind++) {
+        make_q31(kind);
+        ref_fir_q31(coeffs, taps[t], q31_in, q31_ref, VECTOR_SIZE);
+        dspFirInitQ31(&fir, coeffs, state, taps[t]);
+        dspFirQ31(&fir, q31_in, q31_out, 100);
+        dspFirQ31(&fir, q31_in + 100, q31_out + 100, VECTOR_SIZE - 100);
+        for (i = 0; i < VECTOR_SIZE; i++) {
+          int64_t d = (int64_t)q31_out[i] - q31_ref[i];
+
+          if (full == 0 ? d != 0 : (d < -1) || (d > 1))
+            break;
+        }
+        CHECK(i == VECTOR_SIZE, "fir q31 %zu taps%s, vector %u: out[%zu] "
+              "%ld, expected %ld", taps[t], full ? " full" : "", kind, i,
+              (long)q31_out[i], (long)q31_ref[i]);
+      }
+    }
+  }
+}
+
+static void test_biquad_q31(void) {
+  static q31_t coeffs[5 * MAX_STAGES], state[4 * MAX_STAGES];
+  dsp_biquad_q31_t bq;
+  unsigned stages, kind;
+  size_t i;
+  double w, alpha, a0;
+
+  for (stages = 1; stages <= MAX_STAGES; stages++) {
+    /* Low pass sections, the Q2.30 coefficients truncated to 17
+       significant bits. The last variant starts with a gain of 1.9 that
+       saturates, the gain is alone in its section so the 64 bits
+       accumulator of the kernel does not overflow.*/
+    for (i = 0; i < stages; i++) {
+      w = 0.05 + 0.1 * i;
+      alpha = sin(w) / (2.0 * (0.7 + 0.5 * i));
+      a0 = 1.0 + alpha;
+      coeffs[5 * i + 0] = DSP_Q30((1.0 - cos(w)) / 2.0 / a0);
+      coeffs[5 * i + 1] = DSP_Q30((1.0 - cos(w)) / a0);
+      coeffs[5 * i + 2] = DSP_Q30((1.0 - cos(w)) / 2.0 / a0);
+      coeffs[5 * i + 3] = DSP_Q30(2.0 * cos(w) / a0);
+      coeffs[5 * i + 4] = DSP_Q30(-(1.0 - alpha) / a0);
+    }
+    for (i = 0; i < 5 * stages; i++)
+      coeffs[i] = (q31_t)((uint32_t)coeffs[i] & 0xFFFFC000U);
+    if (stages == MAX_STAGES) {
+      coeffs[0] = DSP_Q30(1.9) & (q31_t)0xFFFFC000U;
+      coeffs[1] = coeffs[2] = coeffs[3] = coeffs[4] = 0;
+    }
+    for (kind = 0; kind < 5; kind++) {
+      make_q31(kind);
+      ref_biquad_q31(coeffs, stages, q31_in, q31_ref, VECTOR_SIZE);
+      dspBiquadInitQ31(&bq, coeffs, state, stages);
+      dspBiquadQ31(&bq, q31_in, q31_out, 300);
+      dspBiquadQ31(&bq, q31_in + 300, q31_out + 300, VECTOR_SIZE - 300);
+      i = first_diff(q31_out, q31_ref, sizeof q31_out[0], VECTOR_SIZE);
+      CHECK(i == VECTOR_SIZE, "biquad %u stages, vector %u: out[%zu] %ld, "
+            "expected %ld", stages, kind, i, (long)q31_out[i],
+            (long)q31_ref[i]);
+    }
+  }
+}
+
+static void test_mavg_q15(void) {
+  static q15_t window[256];
+  dsp_mavg_q15_t mavg;
+  unsigned log2len, kind;
+  size_t i;
+
+  for (log2len = 0; log2len <= 8; log2len++) {
+    for (kind = 0; kind < 5; kind++) {
+      make_q15(kind);
+      ref_mavg_q15(log2len, q15_in, q15_ref, VECTOR_SIZE);
+      dspMavgInitQ15(&mavg, window, log2len);
+      dspMavgQ15(&mavg, q15_in, q15_out, 5);
+      dspMavgQ15(&mavg, q15_in + 5, q15_out + 5, VECTOR_SIZE - 5);
+      i = first_diff(q15_out, q15_ref, sizeof q15_out[0], VECTOR_SIZE);
+      CHECK(i == VECTOR_SIZE, "mavg 2^%u, vector %u: out[%zu] %d, "
+            "expected %d", log2len, kind, i, q15_out[i], q15_ref[i]);
+    }
+  }
+}
+
+static void test_minmax_q15(void) {
+  size_t n, i, imin, imax, rmin, rmax;
+  unsigned kind;
+
+  for (kind = 0; kind < 5; kind++) {
+    make_q15(kind);
+    for (n = 1; n <= VECTOR_SIZE; n = n * 3 + 1) {
+      rmin = rmax = 0;
+      for (i = 1; i < n; i++) {
+        if (q15_in[i] < q15_in[rmin])
+          rmin = i;
+        if (q15_in[i] > q15_in[rmax])
+          rmax = i;
+      }
+      dspMinMaxQ15(q15_in, n, &imin, &imax);
+      CHECK((imin == rmin) && (imax == rmax),
+            "minmax vector %u n %zu: %zu %zu, expected %zu %zu", kind, n,
+            imin, imax, rmin, rmax);
+    }
+  }
+
+  /* Ties and a maximum at the start.*/
+  q15_in[0] = 5;
+  q15_in[1] = 5;
+  q15_in[2] = -3;
+  q15_in[3] = -3;
+  dspMinMaxQ15(q15_in, 4, &imin, &imax);
+  CHECK((imin == 2) && (imax == 0), "minmax ties: %zu %zu", imin, imax);
+}
+
+static void test_crc32(void) {
+  static uint8_t buf[4096];
+  unsigned i;
+
+  CHECK(dspCrc32(0, "123456789", 9) == 0xCBF43926U,
+        "crc32 check value %08lx", (unsigned long)dspCrc32(0, "123456789",
+                                                           9));
+  CHECK(dspCrc32(0, buf, 0) == 0, "crc32 of nothing");
+  for (i = 0; i < sizeof buf; i++)
+    buf[i] = (uint8_t)hosttestRand();
+  for (i = 1; i <= sizeof buf; i = i * 2 + 1)
+    CHECK(dspCrc32(0, buf, i) == ref_crc32(buf, i), "crc32 %u bytes", i);
+  CHECK(dspCrc32(dspCrc32(0, buf, 1000), buf + 1000, sizeof buf - 1000) ==
+        ref_crc32(buf, sizeof buf), "crc32 continued");
+}
+
+/*
+ * Host time of the kernels, the target figures are printed by the "dsp"
+ * command.
+ */
+static void bench(void) {
+  static q15_t c15[16], s15[32], win[16];
+  static q31_t c31[16], s31[32], sbq[8];
+  dsp_fir_q15_t f15;
+  dsp_fir_q31_t f31;
+  dsp_biquad_q31_t bq;
+  dsp_mavg_q15_t mavg;
+  uint64_t t[5];
+  unsigned i;
+
+  make_q15(4);
+  make_q31(4);
+  for (i = 0; i < 16; i++) {
+    c15[i] = (q15_t)(hosttestRand() % 2048);
+    c31[i] = (q31_t)(hosttestRand() % (1U << 27));
+  }
+  dspFirInitQ15(&f15, c15, s15, 16);
+  dspFirInitQ31(&f31, c31, s31, 16);
+  dspBiquadInitQ31(&bq, c31, sbq, 2);
+  dspMavgInitQ15(&mavg, win, 4);
+  t[0] = hosttestNanoseconds();
+  for (i = 0; i < BENCH_SAMPLES / VECTOR_SIZE; i++)
+    dspFirQ15(&f15, q15_in, q15_out, VECTOR_SIZE);
+  t[1] = hosttestNanoseconds();
+  for (i = 0; i < BENCH_SAMPLES / VECTOR_SIZE; i++)
+    dspFirQ31(&f31, q31_in, q31_out, VECTOR_SIZE);
+  t[2] = hosttestNanoseconds();
+  for (i = 0; i < BENCH_SAMPLES / VECTOR_SIZE; i++)
+    dspBiquadQ31(&bq, q31_in, q31_out, VECTOR_SIZE);
+  t[3] = hosttestNanoseconds();
+  for (i = 0; i < BENCH_SAMPLES / VECTOR_SIZE; i++)
+    dspMavgQ15(&mavg, q15_in, q15_out, VECTOR_SIZE);
+  t[4] = hosttestNanoseconds();
+  printf("fir q15 16 taps   %6.2f ns/sample\n",
+         (double)(t[1] - t[0]) / BENCH_SAMPLES);
+  printf("fir q31 16 taps   %6.2f ns/sample\n",
+         (double)(t[2] - t[1]) / BENCH_SAMPLES);
+  printf("biquad q31 2 st.  %6.2f ns/sample\n",
+         (double)(t[3] - t[2]) / BENCH_SAMPLES);
+  printf("mavg q15 16       %6.2f ns/sample\n",
+         (double)(t[4] - t[3]) / BENCH_SAMPLES);
+}
+
+int main(void) {
+
+  test_fir_q15();
+  test_fir_q31();
+  test_biquad_q31();
+  test_mavg_q15();
+  test_minmax_q15();
+  test_crc32();
+  bench();
+  return hosttestReport("dsp");
+}
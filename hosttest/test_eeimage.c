@@ -0,0 +1,666 @@
+/*
+    ChibiOS - Copyright (C) 2006..2015 Giovanni Di Sirio
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+/**
+ * @file    test_eeimage.c
+ * @brief   EEPROM image transfer tests.
+ * @details eeimage.c runs on an in-memory AT25 device and a simulated
+ *          link. The host side is the Go-back-N sender of
+ *          tools/eeimage.py: it is run before each read of the board,
+ *          consumes the acknowledgements and keeps the window of frames
+ *          queued on the link. Scheduled faults drop, damage or cut the
+ *          length of a frame transmission or replace it with a cancel,
+ *          the images hold @p EEIMAGE_CAN pairs that the receiver scans
+ *          while resynchronizing.
+ */
+
+#include <stdarg.h>
+#include <string.h>
+
+#include "ch.h"
+#include "hal.h"
+#include "chprintf.h"
+
+#include "eeimage.h"
+#include "dsp.h"
+#include "hosttest.h"
+
+#define MEM_SIZE            8192
+#define PAGE_SIZE           64
+#define LINE_SIZE           8192
+#define OUT_SIZE            16384
+#define MAX_FAULTS          8
+
+/* Frame transmission faults.*/
+#define FAULT_NONE          0
+#define FAULT_DROP          1       /* Not sent.                            */
+#define FAULT_CORRUPT       2       /* A byte damaged.                      */
+#define FAULT_LENGTH        3       /* Length above the page size.          */
+#define FAULT_CANCEL        4       /* Two CAN sent instead, then silence.  */
+
+/*===========================================================================*/
+/* In-memory AT25 device.                                                    */
+/*===========================================================================*/
+
+static const AT25Geometry geometry = {"AT25640", MEM_SIZE, PAGE_SIZE};
+static const AT25Config eecfg = {&geometry, NULL, NULL, "eeprom"};
+
+static AT25Driver eed;
+static uint8_t mem[MEM_SIZE];
+static uint32_t fail_addr;
+static unsigned writes;
+
+uint32_t at25GetProtectedBase(AT25Driver *eepp) {
+  uint32_t size = at25GetSize(eepp);
+
+  return at25GetProtection(eepp) == AT25_PROTECT_QUARTER ?
+         size - size / 4 : size;
+}
+
+msg_t at25Read(AT25Driver *eepp, uint32_t addr, uint8_t *buf, size_t n) {
+
+  if (addr + n > at25GetSize(eepp))
+    return MSG_RESET;
+  memcpy(buf, &mem[addr], n);
+  return MSG_OK;
+}
+
+msg_t at25Write(AT25Driver *eepp, uint32_t addr,
+                const uint8_t *buf, size_t n) {
+
+  if ((addr + n > at25GetProtectedBase(eepp)) || (addr == fail_addr))
+    return MSG_RESET;
+  memcpy(&mem[addr], buf, n);
+  writes++;
+  return MSG_OK;
+}
+
+msg_t at25Sync(AT25Driver *eepp) {
+
+  (void)eepp;
+  return MSG_OK;
+}
+
+static void device_reset(void) {
+
+  memset(&eed, 0, sizeof eed);
+  eed.config = &eecfg;
+  memset(mem, 0xFF, sizeof mem);
+  fail_addr = UINT32_MAX;
+  writes = 0;
+}
+
+/*===========================================================================*/
+/* Simulated link and host.                                                  */
+/*===========================================================================*/
+
+struct BaseChannel {
+  int                   unused;
+};
+
+struct BaseSequentialStream {
+  int                   unused;
+};
+
+static BaseChannel link;
+
+/* Host to board bytes not read yet.*/
+static uint8_t line[LINE_SIZE];
+static unsigned line_rd, line_wr;
+static bool line_overflow;
+
+/* Board to host bytes, the announce line excluded.*/
+static uint8_t out[OUT_SIZE];
+static unsigned out_len;
+static unsigned announces;
+
+static systime_t now;
+
+typedef struct {
+  unsigned              transmission;
+  unsigned              kind;
+  unsigned              offset;
+} fault_t;
+
+static struct {
+  const uint8_t         *image;
+  uint32_t              size;
+  uint32_t              frames;
+  uint32_t              acked;
+  uint32_t              sent;
+  unsigned              out_rd;
+  unsigned              transmissions;
+  unsigned              random_faults;      /* Per 1000 transmissions.     */
+  fault_t               faults[MAX_FAULTS];
+  unsigned              nfaults;
+  bool                  started;
+  bool                  eot_sent;
+  bool                  silent;
+  bool                  bad_image_crc;
+} host;
+
+static void line_put(uint8_t b) {
+
+  if (line_wr - line_rd >= LINE_SIZE) {
+    line_overflow = true;
+    return;
+  }
+  line[line_wr++ % LINE_SIZE] = b;
+}
+
+/*
+ * Damages a byte, never into EEIMAGE_CAN: a cancel at a frame boundary
+ * is not a transmission error the protocol recovers from.
+ */
+static uint8_t damage(uint8_t b) {
+
+  b ^= 0x20;
+  return b == EEIMAGE_CAN ? (uint8_t)(b ^ 0x60) : b;
+}
+
+static unsigned fault_of(unsigned transmission, unsigned *offsetp) {
+  unsigned i;
+
+  for (i = 0; i < host.nfaults; i++) {
+    if (host.faults[i].transmission == transmission) {
+      *offsetp = host.faults[i].offset;
+      return host.faults[i].kind;
+    }
+  }
+  if ((host.random_faults > 0) &&
+      (hosttestRand() % 1000 < host.random_faults)) {
+    *offsetp = hosttestRand();
+    return FAULT_DROP + hosttestRand() % 3;
+  }
+  return FAULT_NONE;
+}
+
+static void transmit(uint32_t index) {
+  uint8_t frame[PAGE_SIZE + EEIMAGE_FRAME_OVERHEAD];
+  uint32_t n = host.size - index * PAGE_SIZE < PAGE_SIZE ?
+               host.size - index * PAGE_SIZE : PAGE_SIZE;
+  uint32_t crc;
+  unsigned i, offset = 0;
+
+  frame[0] = EEIMAGE_SOH;
+  frame[1] = (uint8_t)index;
+  frame[2] = (uint8_t)n;
+  memcpy(&frame[3], &host.image[index * PAGE_SIZE], n);
+  crc = dspCrc32(0, &frame[1], n + 2);
+  for (i = 0; i < 4; i++)
+    frame[3 + n + i] = (uint8_t)(crc >> (8 * i));
+
+  switch (fault_of(host.transmissions++, &offset)) {
+  case FAULT_DROP:
+    return;
+  case FAULT_CORRUPT:
+    offset %= n + EEIMAGE_FRAME_OVERHEAD;
+    frame[offset] = damage(frame[offset]);
+    break;
+  case FAULT_LENGTH:
+    frame[2] = PAGE_SIZE + 1 + offset % (255 - PAGE_SIZE);
+    break;
+  case FAULT_CANCEL:
+    line_put(EEIMAGE_CAN);
+    line_put(EEIMAGE_CAN);
+    host.silent = true;
+    return;
+  default:
+    break;
+  }
+  for (i = 0; i < n + EEIMAGE_FRAME_OVERHEAD; i++)
+    line_put(frame[i]);
+}
+
+/*
+ * The sender of tools/eeimage.py: the replies move the window or rewind
+ * it to the sequence of a NAK, then the window is filled again and the
+ * end of image is sent once all the frames are acknowledged, again after
+ * each NAK.
+ */
+static void host_run(void) {
+
+  if (!host.started)
+    return;
+  while (host.out_rd + 2 <= out_len) {
+    uint8_t code = out[host.out_rd], seq = out[host.out_rd + 1];
+    uint32_t delta = (uint8_t)(seq - host.acked);
+
+    host.out_rd += 2;
+    if ((code == EEIMAGE_ACK) && (delta < host.sent - host.acked))
+      host.acked += delta + 1;
+    else if ((code == EEIMAGE_NAK) && (delta <= host.sent - host.acked)) {
+      host.acked += delta;
+      host.sent = host.acked;
+      host.eot_sent = false;
+    }
+    else if (code == EEIMAGE_CAN)
+      host.silent = true;
+  }
+  while (!host.silent && (host.sent < host.frames) &&
+         (host.sent - host.acked < EEIMAGE_WINDOW))
+    transmit(host.sent++);
+  if (!host.silent && !host.eot_sent && (host.acked == host.frames)) {
+    uint32_t crc = dspCrc32(0, host.image, host.size);
+    unsigned i;
+
+    if (host.bad_image_crc)
+      crc ^= 1;
+    line_put(EEIMAGE_EOT);
+    for (i = 0; i < 4; i++)
+      line_put((uint8_t)(crc >> (8 * i)));
+    host.eot_sent = true;
+  }
+}
+
+static void link_reset(const uint8_t *image, uint32_t size) {
+
+  memset(&host, 0, sizeof host);
+  host.image = image;
+  host.size = size;
+  host.frames = (size + PAGE_SIZE - 1) / PAGE_SIZE;
+  line_rd = line_wr = 0;
+  line_overflow = false;
+  out_len = 0;
+  announces = 0;
+}
+
+static void add_fault(unsigned transmission, unsigned kind,
+                      unsigned offset) {
+
+  host.faults[host.nfaults].transmission = transmission;
+  host.faults[host.nfaults].kind = kind;
+  host.faults[host.nfaults].offset = offset;
+  host.nfaults++;
+}
+
+/*
+ * The announce line starts the host, its fields are not checked.
+ */
+int chprintf(BaseSequentialStream *chp, const char *fmt, ...) {
+
+  (void)chp;
+  (void)fmt;
+  announces++;
+  host.started = true;
+  return 0;
+}
+
+size_t chnWriteTimeout(BaseChannel *chp, const uint8_t *bp, size_t n,
+                       systime_t timeout) {
+
+  (void)chp;
+  (void)timeout;
+  if (out_len + n <= OUT_SIZE) {
+    memcpy(&out[out_len], bp, n);
+    out_len += n;
+  }
+  return n;
+}
+
+/*
+ * A read of an empty link lasts the whole timeout.
+ */
+size_t chnReadTimeout(BaseChannel *chp, uint8_t *bp, size_t n,
+                      systime_t timeout) {
+  size_t i = 0;
+
+  (void)chp;
+  host_run();
+  while ((i < n) && (line_rd != line_wr))
+    bp[i++] = line[line_rd++ % LINE_SIZE];
+  now += i < n ? timeout : 1;
+  return i;
+}
+
+msg_t chnGetTimeout(BaseChannel *chp, systime_t timeout) {
+  uint8_t b;
+
+  return chnReadTimeout(chp, &b, 1, timeout) == 1 ? b : Q_TIMEOUT;
+}
+
+systime_t chVTGetSystemTimeX(void) {
+
+  return now;
+}
+
+systime_t chVTTimeElapsedSinceX(systime_t start) {
+
+  return now - start;
+}
+
+/*===========================================================================*/
+/* Tests.                                                                    */
+/*===========================================================================*/
+
+#define BASE                (2 * PAGE_SIZE)
+#define IMAGE_SIZE          (24 * PAGE_SIZE - 10)
+
+static uint8_t image[MEM_SIZE];
+
+/*
+ * Random bytes, with an EEIMAGE_CAN pair at the start of each page and
+ * more pairs and lone CAN bytes scattered, or without control bytes.
+ */
+static void make_image(uint32_t size, bool can_pairs) {
+  uint32_t i;
+
+  for (i = 0; i < size; i++) {
+    image[i] = (uint8_t)hosttestRand();
+    if (!can_pairs && (image[i] < 0x20))
+      image[i] |= 0x40;
+  }
+  if (!can_pairs)
+    return;
+  for (i = 0; i + 1 < size; i += PAGE_SIZE) {
+    image[i] = EEIMAGE_CAN;
+    image[i + 1] = EEIMAGE_CAN;
+  }
+  for (i = 0; i < size / 16; i++) {
+    uint32_t at = hosttestRand() % (size - 1);
+
+    image[at] = EEIMAGE_CAN;
+    if (i % 2 == 0)
+      image[at + 1] = EEIMAGE_CAN;
+  }
+}
+
+static msg_t run_load(uint32_t base, uint32_t size, eeimage_stats_t *stp) {
+
+  return eeimageLoad(&link, &eed, base, size, stp);
+}
+
+static bool replied(uint8_t code, uint8_t arg) {
+
+  return (out_len >= 2) && (out[out_len - 2] == code) &&
+         (out[out_len - 1] == arg);
+}
+
+static bool image_stored(uint32_t base, uint32_t size) {
+
+  return memcmp(&mem[base], image, size) == 0;
+}
+
+static void test_clean(void) {
+  eeimage_stats_t st;
+  msg_t msg;
+
+  device_reset();
+  make_image(IMAGE_SIZE, true);
+  link_reset(image, IMAGE_SIZE);
+  msg = run_load(BASE, IMAGE_SIZE, &st);
+  CHECK((msg == MSG_OK) && (st.error == 0), "clean load: %d, error %u",
+        (int)msg, st.error);
+  CHECK(image_stored(BASE, IMAGE_SIZE), "clean load: image differs");
+  CHECK((st.frames == host.frames) && (st.bytes == IMAGE_SIZE) &&
+        (st.naks == 0) && (st.bad_frames == 0) && (st.timeouts == 0) &&
+        (writes == host.frames),
+        "clean load: %u frames, %u naks, %u bad, %u timeouts, %u writes",
+        st.frames, st.naks, st.bad_frames, st.timeouts, writes);
+  CHECK(replied(EEIMAGE_ACK, (uint8_t)(host.frames - 1)) &&
+        (announces == 1) && !line_overflow,
+        "clean load: final reply %02x %02x", out[out_len - 2],
+        out[out_len - 1]);
+}
+
+/*
+ * Each fault costs one NAK, the frames in flight behind it are dropped
+ * without another one.
+ */
+static void test_faults(void) {
+  static const struct {
+    const char          *name;
+    unsigned            kind;
+    unsigned            offset;
+  } cases[] = {
+    {"dropped frame", FAULT_DROP, 0},
+    {"damaged payload", FAULT_CORRUPT, 20},
+    {"damaged start", FAULT_CORRUPT, 0},
+    {"damaged sequence", FAULT_CORRUPT, 1},
+    {"damaged CRC", FAULT_CORRUPT, PAGE_SIZE + EEIMAGE_FRAME_OVERHEAD - 1},
+    {"long length", FAULT_LENGTH, 0}
+  };
+  eeimage_stats_t st;
+  unsigned i;
+  msg_t msg;
+
+  for (i = 0; i < sizeof cases / sizeof cases[0]; i++) {
+    device_reset();
+    make_image(IMAGE_SIZE, true);
+    link_reset(image, IMAGE_SIZE);
+    add_fault(5, cases[i].kind, cases[i].offset);
+    msg = run_load(BASE, IMAGE_SIZE, &st);
+    CHECK((msg == MSG_OK) && image_stored(BASE, IMAGE_SIZE),
+          "%s: %d, error %u", cases[i].name, (int)msg, st.error);
+    CHECK((st.naks == 1) && (st.timeouts == 0) &&
+          (st.frames == host.frames) && (writes == host.frames),
+          "%s: %u naks, %u timeouts, %u frames, %u writes", cases[i].name,
+          st.naks, st.timeouts, st.frames, writes);
+    CHECK(replied(EEIMAGE_ACK, (uint8_t)(host.frames - 1)),
+          "%s: final reply %02x %02x", cases[i].name, out[out_len - 2],
+          out[out_len - 1]);
+  }
+
+  /* The resend of a damaged frame damaged as well, the NAK is repeated
+     after a window of dropped frames.*/
+  device_reset();
+  make_image(IMAGE_SIZE, true);
+  link_reset(image, IMAGE_SIZE);
+  add_fault(5, FAULT_CORRUPT, 30);
+  add_fault(5 + EEIMAGE_WINDOW, FAULT_CORRUPT, 30);
+  msg = run_load(BASE, IMAGE_SIZE, &st);
+  CHECK((msg == MSG_OK) && image_stored(BASE, IMAGE_SIZE) &&
+        (st.naks >= 2) && (st.timeouts == 0),
+        "damaged resend: %d, error %u, %u naks, %u timeouts", (int)msg,
+        st.error, st.naks, st.timeouts);
+}
+
+/*
+ * The length of a frame is cut above the page size, the receiver scans
+ * its payload byte by byte for the next frame start, through the CAN
+ * pair opening each page.
+ */
+static void test_resync_can(void) {
+  eeimage_stats_t st;
+  unsigned i;
+  msg_t msg;
+
+  for (i = 0; i < EEIMAGE_WINDOW; i++) {
+    device_reset();
+    make_image(IMAGE_SIZE, true);
+    link_reset(image, IMAGE_SIZE);
+    add_fault(3 + i, FAULT_LENGTH, i);
+    add_fault(3 + i + 1, FAULT_CORRUPT, 2 + i);
+    msg = run_load(BASE, IMAGE_SIZE, &st);
+    CHECK((msg == MSG_OK) && (st.error == 0) &&
+          image_stored(BASE, IMAGE_SIZE),
+          "CAN pair while resynchronizing at %u: %d, error %u", 3 + i,
+          (int)msg, st.error);
+  }
+}
+
+/*
+ * Random drops, damaged bytes and lengths in 2.5 to 10% of the frame
+ * transmissions, over images full of CAN pairs.
+ */
+static void test_random(void) {
+  eeimage_stats_t st;
+  unsigned run, failed = 0, naks = 0;
+  msg_t msg;
+
+  for (run = 0; run < 200; run++) {
+    hosttest_seed = run + 1;
+    device_reset();
+    make_image(IMAGE_SIZE, true);
+    link_reset(image, IMAGE_SIZE);
+    host.random_faults = 25 + run % 4 * 25;
+    msg = run_load(BASE, IMAGE_SIZE, &st);
+    naks += st.naks;
+    if ((msg != MSG_OK) || !image_stored(BASE, IMAGE_SIZE) ||
+        line_overflow) {
+      if (failed++ == 0)
+        CHECK(false, "random faults, seed %u: %d, error %u, %u naks",
+              run + 1, (int)msg, st.error, st.naks);
+    }
+  }
+  CHECK(failed == 0, "random faults: %u of 200 loads failed", failed);
+  CHECK(naks > 200, "random faults: only %u naks", naks);
+}
+
+static void test_cancel(void) {
+  eeimage_stats_t st;
+  msg_t msg;
+
+  /* At a frame boundary the cancel is immediate.*/
+  device_reset();
+  make_image(IMAGE_SIZE, false);
+  link_reset(image, IMAGE_SIZE);
+  add_fault(4, FAULT_CANCEL, 0);
+  msg = run_load(BASE, IMAGE_SIZE, &st);
+  CHECK((msg == MSG_RESET) && (st.error == EEIMAGE_ERR_CANCEL) &&
+        (st.frames == 4) && (st.timeouts == 0),
+        "cancel: %d, error %u, %u frames, %u timeouts", (int)msg, st.error,
+        st.frames, st.timeouts);
+  CHECK(replied(EEIMAGE_CAN, EEIMAGE_ERR_CANCEL), "cancel: reply %02x %02x",
+        out[out_len - 2], out[out_len - 1]);
+
+  /* While resynchronizing it needs the host silence that follows.*/
+  device_reset();
+  make_image(IMAGE_SIZE, false);
+  link_reset(image, IMAGE_SIZE);
+  add_fault(2, FAULT_LENGTH, 0);
+  add_fault(3, FAULT_LENGTH, 0);
+  add_fault(4, FAULT_CANCEL, 0);
+  msg = run_load(BASE, IMAGE_SIZE, &st);
+  CHECK((msg == MSG_RESET) && (st.error == EEIMAGE_ERR_CANCEL) &&
+        (st.frames == 2) && (st.timeouts == 0),
+        "cancel while resynchronizing: %d, error %u, %u frames, "
+        "%u timeouts", (int)msg, st.error, st.frames, st.timeouts);
+  CHECK(replied(EEIMAGE_CAN, EEIMAGE_ERR_CANCEL),
+        "cancel while resynchronizing: reply %02x %02x", out[out_len - 2],
+        out[out_len - 1]);
+}
+
+static void test_errors(void) {
+  eeimage_stats_t st;
+  unsigned i;
+  msg_t msg;
+
+  /* A silent host, each timeout asks again for the first frame.*/
+  device_reset();
+  make_image(IMAGE_SIZE, true);
+  link_reset(image, IMAGE_SIZE);
+  host.silent = true;
+  msg = run_load(BASE, IMAGE_SIZE, &st);
+  CHECK((msg == MSG_RESET) && (st.error == EEIMAGE_ERR_RETRIES) &&
+        (st.timeouts == EEIMAGE_RETRIES + 1) &&
+        (st.naks == EEIMAGE_RETRIES + 1) &&
+        (out_len == 2 * (EEIMAGE_RETRIES + 2)),
+        "silent host: %d, error %u, %u timeouts, %u naks, %u bytes",
+        (int)msg, st.error, st.timeouts, st.naks, out_len);
+  for (i = 0; i < EEIMAGE_RETRIES + 1; i++)
+    CHECK((out[2 * i] == EEIMAGE_NAK) && (out[2 * i + 1] == 0),
+          "silent host: reply %u %02x %02x", i, out[2 * i],
+          out[2 * i + 1]);
+  CHECK(replied(EEIMAGE_CAN, EEIMAGE_ERR_RETRIES), "silent host: reply");
+
+  /* A failed page program.*/
+  device_reset();
+  make_image(IMAGE_SIZE, true);
+  link_reset(image, IMAGE_SIZE);
+  fail_addr = BASE + 3 * PAGE_SIZE;
+  msg = run_load(BASE, IMAGE_SIZE, &st);
+  CHECK((msg == MSG_RESET) && (st.error == EEIMAGE_ERR_DEVICE) &&
+        (st.frames == 3) && replied(EEIMAGE_CAN, EEIMAGE_ERR_DEVICE),
+        "device error: %d, error %u, %u frames", (int)msg, st.error,
+        st.frames);
+
+  /* An image CRC not matching the read back.*/
+  device_reset();
+  make_image(IMAGE_SIZE, true);
+  link_reset(image, IMAGE_SIZE);
+  host.bad_image_crc = true;
+  msg = run_load(BASE, IMAGE_SIZE, &st);
+  CHECK((msg == MSG_RESET) && (st.error == EEIMAGE_ERR_VERIFY) &&
+        (st.frames == host.frames) &&
+        replied(EEIMAGE_CAN, EEIMAGE_ERR_VERIFY),
+        "verify: %d, error %u, %u frames", (int)msg, st.error, st.frames);
+
+  /* Invalid ranges are refused before the announce.*/
+  device_reset();
+  link_reset(image, IMAGE_SIZE);
+  CHECK(run_load(BASE + 1, IMAGE_SIZE, &st) == MSG_RESET,
+        "unaligned base accepted");
+  CHECK(run_load(0, 0, &st) == MSG_RESET, "empty image accepted");
+  CHECK(run_load(MEM_SIZE - PAGE_SIZE, 2 * PAGE_SIZE, &st) == MSG_RESET,
+        "image past the end accepted");
+  eed.sr = AT25_SR_BP0;
+  CHECK(run_load(MEM_SIZE - MEM_SIZE / 4 - PAGE_SIZE, 2 * PAGE_SIZE,
+                 &st) == MSG_RESET, "protected range accepted");
+  CHECK((announces == 0) && (out_len == 0) && (writes == 0),
+        "refused ranges: %u announces, %u bytes, %u writes", announces,
+        out_len, writes);
+}
+
+/*
+ * The dump frames carry the pages in sequence, the end of image their
+ * CRC.
+ */
+static void test_dump(void) {
+  eeimage_stats_t st;
+  uint32_t crc = 0, got = 0, size = IMAGE_SIZE;
+  unsigned pos = 0, seq = 0;
+  bool framed = true;
+  msg_t msg;
+
+  device_reset();
+  make_image(size, true);
+  memcpy(&mem[BASE + 5], image, size);
+  link_reset(image, size);
+  msg = eeimageDump(&link, &eed, BASE + 5, size, &st);
+  CHECK((msg == MSG_OK) && (st.bytes == size) && (announces == 1),
+        "dump: %d, %u bytes", (int)msg, st.bytes);
+  while (framed && (pos < out_len) && (out[pos] == EEIMAGE_SOH)) {
+    uint8_t n = out[pos + 2];
+    uint32_t fcrc = dspCrc32(0, &out[pos + 1], n + 2u);
+
+    framed = (out[pos + 1] == (uint8_t)seq) && (n <= PAGE_SIZE) &&
+             (memcmp(&out[pos + 3 + n], &fcrc, 4) == 0) &&
+             (memcmp(&out[pos + 3], &image[got], n) == 0);
+    crc = dspCrc32(crc, &out[pos + 3], n);
+    got += n;
+    pos += n + EEIMAGE_FRAME_OVERHEAD;
+    seq++;
+  }
+  CHECK(framed && (got == size) && (seq == st.frames),
+        "dump: frame %u bad, %u bytes", seq, got);
+  CHECK((pos + 5 == out_len) && (out[pos] == EEIMAGE_EOT) &&
+        (memcmp(&out[pos + 1], &crc, 4) == 0), "dump: end of image");
+  CHECK(eeimageDump(&link, &eed, MEM_SIZE - 4, 8, &st) == MSG_RESET,
+        "dump past the end accepted");
+}
+
+int main(void) {
+
+  test_clean();
+  test_faults();
+  test_resync_can();
+  test_random();
+  test_cancel();
+  test_errors();
+  test_dump();
+  return hosttestReport("eeimage");
+}
@@ -0,0 +1,455 @@
+/*
+    ChibiOS - Copyright (C) 2006..2015 Giovanni Di Sirio
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+/**
+ * @file    test_halcpp.cpp
+ * @brief   C++ wrappers tests.
+ * @details The SPI, PAL and channel calls are recorded by stubs, the
+ *          SPI bus manager and the AT25 driver are the real ones. The
+ *          scopes of halcpp.hpp must produce the calls in acquisition
+ *          order through the bus client and release them in reverse
+ *          order, and cppbench.cpp, run as is, must issue the same calls
+ *          from its C and C++ paths through the AT25 driver. The rejected
+ *          uses are checked by compile_fail_halcpp.cpp.
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "ch.h"
+#include "hal.h"
+#include "chprintf.h"
+
+#include "halcpp.hpp"
+#include "cppbench.h"
+#include "clock.h"
+#include "status.h"
+#include "hosttest.h"
+
+#define TRACE_SIZE          512
+#define EVENT_SIZE          40
+
+/*===========================================================================*/
+/* Recorded driver calls.                                                    */
+/*===========================================================================*/
+
+static char trace[TRACE_SIZE][EVENT_SIZE];
+static unsigned trace_len;
+static unsigned trace_lost;
+static unsigned bus_owned;
+static rtcnt_t counter;
+
+static void record(const char *fmt, ...) {
+  va_list ap;
+
+  if (trace_len >= TRACE_SIZE) {
+    trace_lost++;
+    return;
+  }
+  va_start(ap, fmt);
+  vsnprintf(trace[trace_len++], EVENT_SIZE, fmt, ap);
+  va_end(ap);
+}
+
+static void trace_reset(void) {
+
+  trace_len = 0;
+  trace_lost = 0;
+}
+
+static char port_name(ioportid_t port) {
+
+  return (char)('A' + ((uintptr_t)port - GPIOA_BASE) / 0x400);
+}
+
+SPIDriver SPID3;
+SerialDMADriver SDD2;
+
+static const clock_profile_t profile = {
+  "full", 72000000, 36000000, 72000000, 12000000, 0, 2, true, true
+};
+
+struct BaseSequentialStream {
+  int                   unused;
+};
+
+extern "C" {
+
+  rtcnt_t chSysGetRealtimeCounterX(void) {
+
+    return counter += 100;
+  }
+
+  void chThdSleepMilliseconds(uint32_t msec) {
+
+    (void)msec;
+  }
+
+  systime_t chVTGetSystemTimeX(void) {
+
+    return 0;
+  }
+
+  systime_t chVTTimeElapsedSinceX(systime_t start) {
+
+    (void)start;
+    return 0;
+  }
+
+  const clock_profile_t *clockGetCurrentProfile(void) {
+
+    return &profile;
+  }
+
+  void statusSet(statusflags_t flags) {
+
+    (void)flags;
+  }
+
+  void statusClear(statusflags_t flags) {
+
+    (void)flags;
+  }
+
+  int chprintf(BaseSequentialStream *chp, const char *fmt, ...) {
+
+    (void)chp;
+    (void)fmt;
+    return 0;
+  }
+
+  void palSetPad(ioportid_t port, unsigned pad) {
+
+    record("set P%c%u", port_name(port), pad);
+  }
+
+  void palClearPad(ioportid_t port, unsigned pad) {
+
+    record("clear P%c%u", port_name(port), pad);
+  }
+
+  unsigned palReadPad(ioportid_t port, unsigned pad) {
+
+    record("read P%c%u", port_name(port), pad);
+    return 1;
+  }
+
+  void spiAcquireBus(SPIDriver *spip) {
+
+    (void)spip;
+    bus_owned++;
+    record("acquire");
+  }
+
+  void spiReleaseBus(SPIDriver *spip) {
+
+    (void)spip;
+    bus_owned--;
+    record("release");
+  }
+
+  void spiStart(SPIDriver *spip, const SPIConfig *config) {
+
+    spip->config = config;
+    record("start cr1 %04x cs P%c%u", config->cr1,
+           port_name(config->ssport), config->sspad);
+  }
+
+  /* As the low level driver, the chip select of the configuration.*/
+  void spiSelect(SPIDriver *spip) {
+
+    palClearPad(spip->config->ssport, spip->config->sspad);
+  }
+
+  void spiUnselect(SPIDriver *spip) {
+
+    palSetPad(spip->config->ssport, spip->config->sspad);
+  }
+
+  void spiExchange(SPIDriver *spip, size_t n, const void *txbuf,
+                   void *rxbuf) {
+
+    (void)spip;
+    memcpy(rxbuf, txbuf, n);
+    record("exchange %zu %02x", n, *(const uint8_t *)txbuf);
+  }
+
+  void spiSend(SPIDriver *spip, size_t n, const void *txbuf) {
+
+    (void)spip;
+    record("send %zu %02x", n, *(const uint8_t *)txbuf);
+  }
+
+  void spiReceive(SPIDriver *spip, size_t n, void *rxbuf) {
+
+    (void)spip;
+    memset(rxbuf, 0x5A, n);
+    record("receive %zu", n);
+  }
+
+  uint16_t spiPolledExchange(SPIDriver *spip, uint16_t frame) {
+
+    (void)spip;
+    record("polled %04x", frame);
+    return (uint16_t)~frame;
+  }
+
+  size_t chnWriteTimeout(BaseChannel *chp, const uint8_t *bp, size_t n,
+                         systime_t timeout) {
+
+    record("write %p %zu %.4s %u", (void *)chp, n, bp, timeout);
+    return n;
+  }
+
+  size_t chnReadTimeout(BaseChannel *chp, uint8_t *bp, size_t n,
+                        systime_t timeout) {
+
+    memset(bp, 'r', n);
+    record("read %p %zu %u", (void *)chp, n, timeout);
+    return n;
+  }
+
+  msg_t chnPutTimeout(BaseChannel *chp, uint8_t b, systime_t timeout) {
+
+    record("put %p %02x %u", (void *)chp, b, timeout);
+    return MSG_OK;
+  }
+
+  msg_t chnGetTimeout(BaseChannel *chp, systime_t timeout) {
+
+    record("get %p %u", (void *)chp, timeout);
+    return 'g';
+  }
+}
+
+void sdmaStart(SerialDMADriver *sdp, const SerialDMAConfig *config) {
+
+  record("sdma start %p %u %04x %04x", (void *)sdp, config->speed,
+         config->cr2, config->cr3);
+}
+
+void sdmaStop(SerialDMADriver *sdp) {
+
+  record("sdma stop %p", (void *)sdp);
+}
+
+/*
+ * Compares the recorded calls from "first" with the expected sequence.
+ */
+static bool trace_is(unsigned first, const char * const *expected,
+                     unsigned n) {
+  unsigned i;
+
+  if ((trace_lost > 0) || (first + n > trace_len))
+    return false;
+  for (i = 0; i < n; i++) {
+    if (strcmp(trace[first + i], expected[i]) != 0) {
+      printf("event %u: \"%s\", expected \"%s\"\n", first + i,
+             trace[first + i], expected[i]);
+      return false;
+    }
+  }
+  return true;
+}
+
+#define TRACE_IS(expected)                                                  \
+  ((trace_len == sizeof expected / sizeof expected[0]) &&                   \
+   trace_is(0, expected, sizeof expected / sizeof expected[0]))
+
+/*===========================================================================*/
+/* Tests.                                                                    */
+/*===========================================================================*/
+
+static SPIBus bus3;
+SPIBusClient sensor_client;
+
+static const SPIConfig eeprom_spicfg = {
+  NULL,
+  GPIOA,
+  GPIOA_EEPROM_CS,
+  SPI_CR1_BR_1 | SPI_CR1_BR_0
+};
+
+static const AT25Geometry geometry = {"AT25320", 4096, 32};
+static const AT25Config eeprom_cfg = {&geometry, &bus3, &eeprom_spicfg,
+                                      "eeprom"};
+static AT25Driver eeprom;
+
+namespace {
+
+  typedef halcpp::Pin<GPIOA_BASE, GPIOA_EEPROM_CS> EepromCs;
+  typedef halcpp::Pin<GPIOC_BASE, 0> Led;
+  typedef halcpp::Pin<GPIOB_BASE, 12> SensorCs;
+  typedef halcpp::SpiDevice<sensor_client, SPI_CR1_BR_1 | SPI_CR1_CPOL,
+                            SensorCs> Device;
+  typedef halcpp::SerialPort<SDD2, 115200, USART_CR2_STOP2_BITS,
+                             USART_CR3_RTSE | USART_CR3_CTSE> Port;
+}
+
+static void test_pin(void) {
+  static const char * const expected[] = {
+    "set PC0", "clear PC0", "read PA4"
+  };
+
+  trace_reset();
+  Led::set();
+  Led::clear();
+  CHECK(EepromCs::read(), "pin read");
+  CHECK(TRACE_IS(expected), "pin calls");
+  CHECK((Led::base == GPIOC_BASE) && (Led::pad == 0) &&
+        (Led::port() == reinterpret_cast<ioportid_t>(GPIOC_BASE)),
+        "pin constants");
+}
+
+static void test_scopes(void) {
+  static const char * const expected[] = {
+    "acquire", "start cr1 0012 cs PB12",
+    "clear PB12", "exchange 2 03", "set PB12",
+    "clear PB12", "send 1 05", "receive 1", "polled 00ff", "set PB12",
+    "release"
+  };
+  static const char * const rescaled[] = {
+    "acquire", "start cr1 0022 cs PB12", "release"
+  };
+  uint8_t tx[2] = {0x03, 0x00}, rx[2] = {0, 0}, sr = 0;
+  uint16_t frame = 0;
+
+  Device::start(bus3, "sensor");
+  CHECK((sensor_client.busp == &bus3) && (bus_owned == 0),
+        "client attached");
+  trace_reset();
+  {
+    Device::Bus bus;
+
+    CHECK(bus_owned == 1, "bus not owned in its scope");
+    {
+      Device::Select cs(bus);
+
+      cs.exchange(sizeof tx, tx, rx);
+    }
+    {
+      const Device::Select cs(bus);
+      uint8_t cmd = 0x05;
+
+      cs.send(1, &cmd);
+      cs.receive(1, &sr);
+      frame = cs.polledExchange(0x00FF);
+    }
+  }
+  CHECK(bus_owned == 0, "bus not released at the end of its scope");
+  CHECK(TRACE_IS(expected), "scope calls");
+  CHECK((rx[0] == 0x03) && (sr == 0x5A) && (frame == 0xFF00),
+        "transfer data %02x %02x %04x", rx[0], sr, frame);
+  CHECK(sensor_client.transactions == 1, "client transactions %u",
+        sensor_client.transactions);
+  CHECK(bus3.busy_us > 0, "bus busy time not accounted");
+
+  /* A clock switch replaces the baud rate bits, the clock mode stays.*/
+  Device::setBaudRate(SPI_CR1_BR_2);
+  trace_reset();
+  {
+    Device::Bus bus;
+  }
+  CHECK(TRACE_IS(rescaled), "baud rate applied on the next ownership");
+  CHECK(sensor_client.transactions == 2, "client transactions %u",
+        sensor_client.transactions);
+}
+
+static void test_serial(void) {
+  static char expected[6][EVENT_SIZE];
+  static const char * const order[6] = {
+    expected[0], expected[1], expected[2], expected[3], expected[4],
+    expected[5]
+  };
+  const uint8_t block[] = "line\r\n";
+  uint8_t in[3];
+  void *sdp = &SDD2;
+
+  snprintf(expected[0], EVENT_SIZE, "sdma start %p 115200 2000 0300", sdp);
+  snprintf(expected[1], EVENT_SIZE, "write %p 6 line %u", sdp,
+           TIME_INFINITE);
+  snprintf(expected[2], EVENT_SIZE, "read %p 3 10", sdp);
+  snprintf(expected[3], EVENT_SIZE, "put %p 2a 0", sdp);
+  snprintf(expected[4], EVENT_SIZE, "get %p %u", sdp, TIME_INFINITE);
+  snprintf(expected[5], EVENT_SIZE, "sdma stop %p", sdp);
+
+  trace_reset();
+  Port::start();
+  CHECK(Port::write(block, sizeof block - 1) == sizeof block - 1,
+        "write count");
+  CHECK(Port::read(in, sizeof in, 10) == sizeof in, "read count");
+  CHECK(Port::put('*', TIME_IMMEDIATE) == MSG_OK, "put status");
+  CHECK(Port::get() == 'g', "get value");
+  Port::stop();
+  CHECK(TRACE_IS(order), "serial calls");
+  CHECK((Port::channel() == reinterpret_cast<BaseChannel *>(&SDD2)) &&
+        (Port::stream() == reinterpret_cast<BaseSequentialStream *>(&SDD2)),
+        "serial interfaces");
+}
+
+/*
+ * cppbenchRun() times each EEPROM path CPPBENCH_RUNS times, C first, then
+ * the serial writes from the serial stream. Both halves must match and
+ * each status read must be a transaction of the AT25 driver client.
+ */
+static void test_bench_paths(void) {
+  const unsigned rdsr = 7;
+  uint32_t transactions = eeprom.client.transactions;
+  unsigned i;
+
+  trace_reset();
+  cppbenchRun(reinterpret_cast<BaseSequentialStream *>(&SDD2), &eeprom);
+  CHECK((trace_lost == 0) && (trace_len == 2 * CPPBENCH_RUNS * rdsr + 2),
+        "bench calls %u, lost %u", trace_len, trace_lost);
+  CHECK((strcmp(trace[0], "acquire") == 0) &&
+        (strcmp(trace[1], "start cr1 0018 cs PA4") == 0),
+        "bench starts with %s, %s", trace[0], trace[1]);
+  for (i = 0; i < CPPBENCH_RUNS * rdsr; i++) {
+    if (strcmp(trace[i], trace[CPPBENCH_RUNS * rdsr + i]) != 0) {
+      CHECK(false, "rdsr event %u: C \"%s\", C++ \"%s\"", i, trace[i],
+            trace[CPPBENCH_RUNS * rdsr + i]);
+      break;
+    }
+  }
+  CHECK(strcmp(trace[trace_len - 2], trace[trace_len - 1]) == 0,
+        "serial write: C \"%s\", C++ \"%s\"", trace[trace_len - 2],
+        trace[trace_len - 1]);
+  CHECK((bus_owned == 0) && (eeprom.mutex.locked == 0),
+        "bench left the bus or the device owned");
+  CHECK(eeprom.client.transactions == transactions + 2 * CPPBENCH_RUNS,
+        "client transactions %u",
+        eeprom.client.transactions - transactions);
+
+  /* From another stream only the EEPROM paths run.*/
+  trace_reset();
+  cppbenchRun(NULL, &eeprom);
+  CHECK(trace_len == 2 * CPPBENCH_RUNS * rdsr, "bench calls %u",
+        trace_len);
+}
+
+int main(void) {
+
+  spibusObjectInit(&bus3, &SPID3);
+  at25ObjectInit(&eeprom);
+  at25Start(&eeprom, &eeprom_cfg);
+
+  test_pin();
+  test_scopes();
+  test_serial();
+  test_bench_paths();
+  return hosttestReport("halcpp");
+}
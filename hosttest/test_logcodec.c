@@ -0,0 +1,252 @@
+/*
+    ChibiOS - Copyright (C) 2006..2015 Giovanni Di Sirio
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+/**
+ * @file    test_logcodec.c
+ * @brief   Log page codec tests.
+ * @details Pages of several sample streams are encoded, validated and
+ *          decoded back, the decoded samples must be the appended ones.
+ *          The samples per page of each stream are checked against a
+ *          minimum, the compression the data logger relies on.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "logcodec.h"
+#include "hosttest.h"
+
+#define STREAM_SIZE         (LOGCODEC_MAX_SAMPLES + 16)
+#define FUZZ_PAGES          200000
+#define RATIO_PAGES         20000
+
+/*
+ * Streams, the first sample of a page is random.
+ */
+typedef enum {
+  STREAM_LOGGER = 0,          /* Block mean, 5 of 8 unchanged, small steps.*/
+  STREAM_WALK31,              /* Steps within one byte tokens.              */
+  STREAM_WALK4096,            /* Steps around the two bytes tokens limit.   */
+  STREAM_RANDOM,              /* Full scale jumps.                          */
+  STREAM_SQUARE,              /* 0 and 65535 alternated.                    */
+  STREAM_RUNS,                /* Constant runs of 1 to 100 samples.         */
+  STREAM_EDGES,               /* Deltas at the varint and zigzag limits.    */
+  STREAM_NUM
+} stream_t;
+
+static const char *stream_names[STREAM_NUM] = {
+  "logger", "walk31", "walk4096", "random", "square", "runs", "edges"
+};
+
+/* Minimum average samples per page, the raw encoding holds 14.*/
+static const double stream_min_ratio[STREAM_NUM] = {
+  40.0, 25.0, 12.5, 9.0, 9.0, 200.0, 12.5
+};
+
+static const int32_t edge_deltas[] = {
+  0, 1, -1, 31, -31, 32, -32, 33, -33, 63, -64, 64, 4095, -4095, 4096,
+  -4096, 4097, -4097, 32767, -32767, 32768, -32768, 65535, -65535
+};
+
+static uint16_t step(uint16_t last, int32_t d) {
+  int32_t v = (int32_t)last + d;
+
+  if ((v < 0) || (v > UINT16_MAX))
+    v = (int32_t)last - d;
+  return (uint16_t)v;
+}
+
+static int32_t rand_range(int32_t lim) {
+
+  return (int32_t)(hosttestRand() % (2 * (uint32_t)lim + 1)) - lim;
+}
+
+static void make_stream(stream_t kind, uint16_t *s, size_t n) {
+  unsigned run = 0;
+  size_t i;
+
+  s[0] = (uint16_t)hosttestRand();
+  for (i = 1; i < n; i++) {
+    switch (kind) {
+    case STREAM_LOGGER:
+      switch (hosttestRand() % 8) {
+      case 5:
+        s[i] = step(s[i - 1], 1);
+        break;
+      case 6:
+        s[i] = step(s[i - 1], -1);
+        break;
+      case 7:
+        s[i] = step(s[i - 1], rand_range(3));
+        break;
+      default:
+        s[i] = s[i - 1];
+      }
+      break;
+    case STREAM_WALK31:
+      s[i] = step(s[i - 1], rand_range(31));
+      break;
+    case STREAM_WALK4096:
+      s[i] = step(s[i - 1], rand_range(4097));
+      break;
+    case STREAM_RANDOM:
+      s[i] = (uint16_t)hosttestRand();
+      break;
+    case STREAM_SQUARE:
+      s[i] = s[i - 1] == 0 ? UINT16_MAX : 0;
+      break;
+    case STREAM_RUNS:
+      if (run == 0) {
+        run = 1 + hosttestRand() % 100;
+        s[i] = step(s[i - 1], rand_range(40));
+      }
+      else
+        s[i] = s[i - 1];
+      run--;
+      break;
+    default:
+      s[i] = step(s[i - 1], edge_deltas[hosttestRand() %
+                                        (sizeof edge_deltas /
+                                         sizeof edge_deltas[0])]);
+    }
+  }
+}
+
+/*
+ * Encodes the stream into a page until full, checks the page and decodes
+ * it back. Returns the number of samples stored.
+ */
+static size_t roundtrip(const uint16_t *s, size_t n, uint16_t seq) {
+  static uint16_t out[LOGCODEC_MAX_SAMPLES + 1];
+  logcodec_encoder_t enc;
+  const uint8_t *page;
+  uint16_t seq2 = 0;
+  size_t count = 0, m;
+
+  logcodecReset(&enc);
+  while ((count < n) && logcodecAppend(&enc, s[count]))
+    count++;
+  page = logcodecFinish(&enc, seq);
+  CHECK(logcodecCheck(page, &seq2) && (seq2 == seq),
+        "page of %zu samples, seq %u: invalid", count, seq);
+  m = logcodecDecode(page, out, sizeof out / sizeof out[0]);
+  CHECK((m == count) && (memcmp(out, s, count * sizeof s[0]) == 0),
+        "page of %zu samples from %u: decoded %zu differ", count, s[0], m);
+  return count;
+}
+
+static void test_fuzz(void) {
+  static uint16_t s[STREAM_SIZE];
+  unsigned i;
+
+  for (i = 0; i < FUZZ_PAGES; i++) {
+    make_stream((stream_t)(hosttestRand() % STREAM_NUM), s,
+                1 + hosttestRand() % STREAM_SIZE);
+    (void)roundtrip(s, 1 + hosttestRand() % STREAM_SIZE, (uint16_t)i);
+  }
+}
+
+static void test_ratio(void) {
+  static uint16_t s[STREAM_SIZE];
+  unsigned kind, i;
+
+  for (kind = 0; kind < STREAM_NUM; kind++) {
+    unsigned long total = 0;
+    double ratio;
+
+    for (i = 0; i < RATIO_PAGES; i++) {
+      make_stream((stream_t)kind, s, STREAM_SIZE);
+      total += roundtrip(s, STREAM_SIZE, (uint16_t)i);
+    }
+    ratio = (double)total / RATIO_PAGES;
+    printf("%-9s %6.1f samples/page\n", stream_names[kind], ratio);
+    CHECK(ratio >= stream_min_ratio[kind],
+          "%s: %.1f samples/page, expected %.1f at least",
+          stream_names[kind], ratio, stream_min_ratio[kind]);
+  }
+}
+
+static void test_edges(void) {
+  static const uint16_t firsts[] = {
+    0, 1, 127, 128, 16383, 16384, 32767, 32768, 65534, 65535
+  };
+  uint16_t s[STREAM_SIZE], out[LOGCODEC_MAX_SAMPLES];
+  logcodec_encoder_t enc;
+  const uint8_t *page;
+  uint8_t copy[LOGCODEC_PAGE_SIZE];
+  unsigned i, j, bit;
+  size_t n;
+
+  /* First sample varint limits, followed by every edge delta.*/
+  for (i = 0; i < sizeof firsts / sizeof firsts[0]; i++) {
+    for (j = 0; j < sizeof edge_deltas / sizeof edge_deltas[0]; j++) {
+      s[0] = firsts[i];
+      s[1] = step(s[0], edge_deltas[j]);
+      s[2] = step(s[1], -edge_deltas[j]);
+      s[3] = s[2];
+      (void)roundtrip(s, 4, 0);
+    }
+  }
+
+  /* Constant pages, runs across the one byte token limit of 64.*/
+  for (n = 1; n <= STREAM_SIZE; n++) {
+    for (i = 0; i < n; i++)
+      s[i] = 0x8000;
+    CHECK(roundtrip(s, n, 1) == (n < LOGCODEC_MAX_SAMPLES ?
+                                 n : LOGCODEC_MAX_SAMPLES),
+          "constant page of %zu samples", n);
+  }
+
+  /* Appending after the header is filled, then refilling it.*/
+  logcodecReset(&enc);
+  for (i = 0; i < 10; i++)
+    (void)logcodecAppend(&enc, (uint16_t)(i / 3));
+  (void)logcodecFinish(&enc, 7);
+  for (i = 10; i < 20; i++)
+    (void)logcodecAppend(&enc, (uint16_t)(i / 3));
+  page = logcodecFinish(&enc, 8);
+  n = logcodecDecode(page, out, LOGCODEC_MAX_SAMPLES);
+  for (i = 0; (i < 20) && (i < n); i++) {
+    if (out[i] != i / 3)
+      break;
+  }
+  CHECK((n == 20) && (i == 20), "append after finish: %zu samples", n);
+
+  /* Truncated decoding keeps the head of the page and stops there, even
+     within a run.*/
+  out[5] = 0xAAAA;
+  CHECK((logcodecDecode(page, out, 5) == 5) && (out[4] == 1) &&
+        (out[5] == 0xAAAA), "decode limited to 5 samples");
+
+  /* Every single bit error is detected, an erased page is invalid.*/
+  for (bit = 0; bit < 8 * LOGCODEC_PAGE_SIZE; bit++) {
+    memcpy(copy, page, sizeof copy);
+    copy[bit / 8] ^= (uint8_t)(1U << (bit % 8));
+    CHECK(!logcodecCheck(copy, NULL), "bit %u flip not detected", bit);
+  }
+  memset(copy, 0xFF, sizeof copy);
+  CHECK(!logcodecCheck(copy, NULL), "erased page valid");
+  memset(copy, 0x00, sizeof copy);
+  CHECK(!logcodecCheck(copy, NULL), "blank page valid");
+}
+
+int main(void) {
+
+  test_edges();
+  test_fuzz();
+  test_ratio();
+  return hosttestReport("logcodec");
+}
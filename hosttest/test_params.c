@@ -0,0 +1,529 @@
+/*
+    ChibiOS - Copyright (C) 2006..2015 Giovanni Di Sirio
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+/**
+ * @file    test_params.c
+ * @brief   EEPROM parameters tests.
+ * @details params.c runs on an in-memory AT25320 replacing the driver:
+ *          block protection, page program counters and injected write
+ *          failures. The records are stored blank, damaged, shorter,
+ *          newer and through commits, then loaded back by
+ *          @p paramsStart(), the values, the dirty bits and the outcome
+ *          printed by @p paramsDump() are checked.
+ */
+
+#include <stdarg.h>
+#include <string.h>
+
+#include "ch.h"
+#include "hal.h"
+#include "chprintf.h"
+
+#include "params.h"
+#include "dsp.h"
+#include "hosttest.h"
+
+#define MEM_SIZE            4096
+#define PAGE_SIZE           32
+#define DUMP_SIZE           1024
+
+#define ALL_DIRTY           ((1U << PARAMS_NUM_RECORDS) - 1)
+#define REC_BIT(rec)        (1U << PARAMS_REC_##rec)
+
+/*===========================================================================*/
+/* In-memory AT25 device.                                                    */
+/*===========================================================================*/
+
+const AT25Geometry AT25320_GEOMETRY = {"AT25320", MEM_SIZE, PAGE_SIZE};
+static const AT25Geometry small_geometry = {"small", MEM_SIZE / 2,
+                                            PAGE_SIZE};
+
+static const AT25Config eecfg = {&AT25320_GEOMETRY, NULL, NULL, "eeprom"};
+static const AT25Config smallcfg = {&small_geometry, NULL, NULL, "small"};
+
+static AT25Driver eed;
+static uint8_t mem[MEM_SIZE];
+static unsigned programs[MEM_SIZE / PAGE_SIZE];
+static uint32_t fail_addr = UINT32_MAX;
+
+uint32_t at25GetProtectedBase(AT25Driver *eepp) {
+  uint32_t size = at25GetSize(eepp);
+
+  switch (at25GetProtection(eepp)) {
+  case AT25_PROTECT_QUARTER:
+    return size - size / 4;
+  case AT25_PROTECT_HALF:
+    return size / 2;
+  case AT25_PROTECT_ALL:
+    return 0;
+  default:
+    return size;
+  }
+}
+
+msg_t at25Read(AT25Driver *eepp, uint32_t addr, uint8_t *buf, size_t n) {
+
+  if (addr + n > at25GetSize(eepp))
+    return MSG_RESET;
+  memcpy(buf, &mem[addr], n);
+  return MSG_OK;
+}
+
+/*
+ * Same checks as the driver, a write at fail_addr times out before its
+ * first page program.
+ */
+msg_t at25Write(AT25Driver *eepp, uint32_t addr,
+                const uint8_t *buf, size_t n) {
+  size_t i;
+
+  if (addr + n > at25GetSize(eepp))
+    return MSG_RESET;
+  if ((n > 0) && (addr + n > at25GetProtectedBase(eepp)))
+    return MSG_RESET;
+  if (addr == fail_addr)
+    return MSG_TIMEOUT;
+  for (i = 0; i < n; i++) {
+    if ((i == 0) || ((addr + i) % PAGE_SIZE == 0))
+      programs[(addr + i) / PAGE_SIZE]++;
+    mem[addr + i] = buf[i];
+  }
+  return MSG_OK;
+}
+
+static void device_reset(const AT25Config *cfgp, uint8_t fill) {
+
+  memset(&eed, 0, sizeof eed);
+  eed.config = cfgp;
+  memset(mem, fill, sizeof mem);
+  memset(programs, 0, sizeof programs);
+  fail_addr = UINT32_MAX;
+}
+
+static unsigned record_programs(uint32_t addr) {
+
+  return programs[addr / PAGE_SIZE];
+}
+
+/*===========================================================================*/
+/* Formatted output, 32 bits target conventions.                             */
+/*===========================================================================*/
+
+struct BaseSequentialStream {
+  char                  buf[DUMP_SIZE];
+  size_t                len;
+};
+
+static BaseSequentialStream dump;
+
+int chprintf(BaseSequentialStream *chp, const char *fmt, ...) {
+  char spec[16], out[64];
+  va_list ap;
+  size_t n;
+
+  va_start(ap, fmt);
+  while (*fmt != '\0') {
+    if (*fmt != '%') {
+      out[0] = *fmt++;
+      out[1] = '\0';
+    }
+    else {
+      n = 0;
+      while ((n < sizeof spec - 2) && (strchr("sudxc", *fmt) == NULL))
+        spec[n++] = *fmt++;
+      spec[n++] = *fmt++;
+      spec[n] = '\0';
+      /* "l" is dropped, a long is 32 bits on the target.*/
+      if (spec[n - 2] == 'l') {
+        spec[n - 2] = spec[n - 1];
+        spec[n - 1] = '\0';
+      }
+      if (spec[strlen(spec) - 1] == 's')
+        snprintf(out, sizeof out, spec, va_arg(ap, const char *));
+      else
+        snprintf(out, sizeof out, spec, va_arg(ap, int));
+    }
+    n = strlen(out);
+    if (chp->len + n < sizeof chp->buf) {
+      memcpy(chp->buf + chp->len, out, n + 1);
+      chp->len += n;
+    }
+  }
+  va_end(ap);
+  return 0;
+}
+
+/*
+ * Outcome line of a record in the dump, NULL if missing.
+ */
+static const char *dump_record(const char *name) {
+  static char line[128];
+  const char *p, *end;
+
+  dump.len = 0;
+  dump.buf[0] = '\0';
+  paramsDump(&dump);
+  for (p = dump.buf; p != NULL && *p != '\0'; p = end + 2) {
+    end = strstr(p, "\r\n");
+    if (end == NULL)
+      break;
+    if ((strncmp(p, name, strlen(name)) == 0) && (p[strlen(name)] == ' ')) {
+      snprintf(line, sizeof line, "%.*s", (int)(end - p), p);
+      return line;
+    }
+  }
+  return NULL;
+}
+
+static bool outcome_is(const char *name, const char *outcome) {
+  const char *line = dump_record(name);
+
+  return (line != NULL) && (strstr(line, outcome) != NULL);
+}
+
+/*===========================================================================*/
+/* Stored records.                                                           */
+/*===========================================================================*/
+
+/*
+ * Stores a record as a former firmware would have, with any version and
+ * payload size.
+ */
+static void store_record(uint32_t addr, uint16_t version,
+                         const void *payload, uint16_t size) {
+  params_header_t h;
+
+  h.version = version;
+  h.size = size;
+  h.crc = dspCrc32(dspCrc32(0, &h, offsetof(params_header_t, crc)),
+                   payload, size);
+  memcpy(&mem[addr], &h, sizeof h);
+  memcpy(&mem[addr + sizeof h], payload, size);
+}
+
+static void set_calib(int16_t offset, uint16_t gain, uint16_t vref) {
+
+  param_set_adc_offset(offset);
+  param_set_adc_gain(gain);
+  param_set_vref_mv(vref);
+}
+
+static bool calib_is(int16_t offset, uint16_t gain, uint16_t vref) {
+
+  return (param_get_adc_offset() == offset) &&
+         (param_get_adc_gain() == gain) && (param_get_vref_mv() == vref);
+}
+
+static bool calib_defaults(void) {
+
+  return calib_is(0, 4096, 3300);
+}
+
+/*===========================================================================*/
+/* Tests.                                                                    */
+/*===========================================================================*/
+
+static void test_not_started(void) {
+
+  CHECK(paramsCommit() == MSG_RESET, "commit before start accepted");
+}
+
+static void test_blank(void) {
+  static const uint8_t fills[] = {0xFF, 0x00};
+  unsigned i;
+
+  for (i = 0; i < sizeof fills; i++) {
+    device_reset(&eecfg, fills[i]);
+    set_calib(1, 2, 3);
+    param_set_serial_baud(4);
+    CHECK(paramsStart(&eed) == MSG_OK, "fill %02x: start failed", fills[i]);
+    CHECK(calib_defaults() && (param_get_serial_baud() == 38400),
+          "fill %02x: defaults not loaded", fills[i]);
+    CHECK(params_dirty == ALL_DIRTY, "fill %02x: dirty %08x", fills[i],
+          params_dirty);
+    CHECK(outcome_is("calib", "defaults") && outcome_is("comm", "defaults"),
+          "fill %02x: outcome %s", fills[i], dump_record("calib"));
+  }
+
+  /* A device smaller than the region gets the defaults, nothing to
+     commit.*/
+  device_reset(&smallcfg, 0xFF);
+  CHECK(paramsStart(&eed) == MSG_RESET, "region beyond the device");
+  CHECK(calib_defaults() && (params_dirty == 0),
+        "small device: defaults or dirty %08x", params_dirty);
+}
+
+static void test_commit_reload(void) {
+
+  device_reset(&eecfg, 0xFF);
+  paramsStart(&eed);
+  set_calib(-12, 4100, 3290);
+  param_set_serial_baud(115200);
+  CHECK(paramsCommit() == MSG_OK, "commit failed");
+  CHECK(params_dirty == 0, "dirty %08x after commit", params_dirty);
+  CHECK(record_programs(PARAMS_ADDR(calib)) == 1 &&
+        record_programs(PARAMS_ADDR(comm)) == 1,
+        "programs %u %u", record_programs(PARAMS_ADDR(calib)),
+        record_programs(PARAMS_ADDR(comm)));
+
+  set_calib(0, 0, 0);
+  CHECK(paramsStart(&eed) == MSG_OK, "restart failed");
+  CHECK(calib_is(-12, 4100, 3290) && (param_get_serial_baud() == 115200),
+        "values not loaded back");
+  CHECK(params_dirty == 0, "dirty %08x after reload", params_dirty);
+  CHECK(outcome_is("calib", "loaded") && outcome_is("comm", "loaded") &&
+        (strstr(dump_record("calib"), "not committed") == NULL),
+        "outcome %s", dump_record("calib"));
+
+  /* Nothing dirty, nothing programmed.*/
+  CHECK(paramsCommit() == MSG_OK, "empty commit failed");
+  CHECK(record_programs(PARAMS_ADDR(calib)) == 1, "clean record written");
+}
+
+static void test_damaged(void) {
+  static const size_t offsets[] = {
+    0, 2, 4, 8, 9, 13
+  };
+  params_header_t h;
+  unsigned i;
+
+  /* Every header and payload byte is covered by the CRC, the damaged
+     record gets its defaults and the other one is untouched.*/
+  for (i = 0; i < sizeof offsets / sizeof offsets[0]; i++) {
+    device_reset(&eecfg, 0xFF);
+    paramsStart(&eed);
+    set_calib(5, 6, 7);
+    param_set_serial_baud(9600);
+    paramsCommit();
+    mem[PARAMS_ADDR(calib) + offsets[i]] ^= 0x10;
+    CHECK(paramsStart(&eed) == MSG_OK, "offset %zu: start failed",
+          offsets[i]);
+    CHECK(calib_defaults(), "offset %zu: damage not detected", offsets[i]);
+    CHECK(param_get_serial_baud() == 9600, "offset %zu: comm lost",
+          offsets[i]);
+    CHECK(params_dirty == REC_BIT(calib), "offset %zu: dirty %08x",
+          offsets[i], params_dirty);
+    CHECK(outcome_is("calib", "defaults") && outcome_is("comm", "loaded"),
+          "offset %zu: outcome %s", offsets[i], dump_record("calib"));
+  }
+
+  /* A size beyond the record pages is rejected before the CRC.*/
+  device_reset(&eecfg, 0xFF);
+  memset(&h, 0, sizeof h);
+  h.version = PARAMS_VERSION;
+  h.size = PAGE_SIZE;
+  memcpy(&mem[PARAMS_ADDR(calib)], &h, sizeof h);
+  paramsStart(&eed);
+  CHECK(calib_defaults() && outcome_is("calib", "defaults"),
+        "oversized record loaded");
+}
+
+static void test_migration(void) {
+  int16_t offset = -300;
+
+  /* A layout storing adc_offset only: the stored field is kept, the
+     fields the record did not cover get their defaults and the record is
+     marked for rewrite.*/
+  device_reset(&eecfg, 0xFF);
+  store_record(PARAMS_ADDR(calib), PARAMS_VERSION, &offset, sizeof offset);
+  set_calib(1, 2, 3);
+  CHECK(paramsStart(&eed) == MSG_OK, "start failed");
+  CHECK(calib_is(-300, 4096, 3300), "migration %d %u %u",
+        param_get_adc_offset(), param_get_adc_gain(), param_get_vref_mv());
+  CHECK(params_dirty & REC_BIT(calib), "migrated record not dirty");
+  CHECK(outcome_is("calib", "migrated"), "outcome %s", dump_record("calib"));
+
+  /* The commit stores the current layout, loaded as is afterwards.*/
+  CHECK(paramsCommit() == MSG_OK, "commit failed");
+  paramsStart(&eed);
+  CHECK(calib_is(-300, 4096, 3300) && outcome_is("calib", "loaded") &&
+        (params_dirty == 0), "migrated record not stored");
+
+  /* A partial field is not kept.*/
+  device_reset(&eecfg, 0xFF);
+  {
+    uint8_t partial[3] = {0x34, 0x12, 0x55};
+
+    store_record(PARAMS_ADDR(calib), PARAMS_VERSION, partial,
+                 sizeof partial);
+  }
+  paramsStart(&eed);
+  CHECK(calib_is(0x1234, 4096, 3300), "partial field %d %u",
+        param_get_adc_offset(), param_get_adc_gain());
+}
+
+static void test_newer(void) {
+  struct {
+    params_calib_t      calib;
+    uint32_t            future;
+  } newer;
+  uint16_t version = PARAMS_VERSION + 1;
+
+  /* A newer layout is used as is, its unknown fields are ignored and the
+     record is not rewritten behind the user's back.*/
+  memset(&newer, 0, sizeof newer);
+  newer.calib.adc_offset = 17;
+  newer.calib.adc_gain = 4000;
+  newer.calib.vref_mv = 3000;
+  newer.future = 0xDEADBEEF;
+  device_reset(&eecfg, 0xFF);
+  store_record(PARAMS_ADDR(calib), version, &newer, sizeof newer);
+  CHECK(paramsStart(&eed) == MSG_OK, "start failed");
+  CHECK(calib_is(17, 4000, 3000), "newer values not kept");
+  CHECK((params_dirty & REC_BIT(calib)) == 0, "newer record dirty");
+  CHECK(outcome_is("calib", "newer layout"), "outcome %s",
+        dump_record("calib"));
+  CHECK(record_programs(PARAMS_ADDR(calib)) == 0, "newer record written");
+
+  /* Once changed it is stored with the current layout.*/
+  param_set_vref_mv(3100);
+  CHECK(paramsCommit() == MSG_OK, "commit failed");
+  paramsStart(&eed);
+  CHECK(calib_is(17, 4000, 3100) && outcome_is("calib", "loaded"),
+        "newer record not rewritten");
+}
+
+static void test_partial_commit(void) {
+
+  /* Only the dirty records are programmed.*/
+  device_reset(&eecfg, 0xFF);
+  paramsStart(&eed);
+  paramsCommit();
+  param_set_serial_baud(57600);
+  CHECK(params_dirty == REC_BIT(comm), "set marked %08x", params_dirty);
+  CHECK(paramsCommit() == MSG_OK, "commit failed");
+  CHECK((record_programs(PARAMS_ADDR(calib)) == 1) &&
+        (record_programs(PARAMS_ADDR(comm)) == 2),
+        "programs %u %u", record_programs(PARAMS_ADDR(calib)),
+        record_programs(PARAMS_ADDR(comm)));
+
+  /* A failed write keeps its bit, the records written before it are
+     cleared.*/
+  set_calib(1, 1, 1);
+  param_set_serial_baud(1200);
+  fail_addr = PARAMS_ADDR(comm);
+  CHECK(paramsCommit() == MSG_TIMEOUT, "comm failure not returned");
+  CHECK(params_dirty == REC_BIT(comm), "after comm failure %08x",
+        params_dirty);
+  CHECK(strstr(dump_record("comm"), "not committed") != NULL,
+        "outcome %s", dump_record("comm"));
+
+  /* The commit stops at the first failure, the following records are not
+     attempted and stay marked.*/
+  set_calib(2, 2, 2);
+  fail_addr = PARAMS_ADDR(calib);
+  CHECK(paramsCommit() == MSG_TIMEOUT, "calib failure not returned");
+  CHECK(params_dirty == ALL_DIRTY, "after calib failure %08x",
+        params_dirty);
+  CHECK(record_programs(PARAMS_ADDR(comm)) == 2, "comm attempted");
+
+  fail_addr = UINT32_MAX;
+  CHECK(paramsCommit() == MSG_OK, "retry failed");
+  CHECK(params_dirty == 0, "after retry %08x", params_dirty);
+  paramsStart(&eed);
+  CHECK(calib_is(2, 2, 2) && (param_get_serial_baud() == 1200),
+        "retried values not stored");
+}
+
+static void test_protected(void) {
+  static const uint8_t levels[] = {
+    AT25_SR_BP0, AT25_SR_BP1, AT25_SR_BP1 | AT25_SR_BP0
+  };
+  unsigned i;
+
+  /* The region is the upper quarter, rejected by the driver at any
+     protection level without a program, the records stay marked.*/
+  for (i = 0; i < sizeof levels; i++) {
+    device_reset(&eecfg, 0xFF);
+    paramsStart(&eed);
+    eed.sr = levels[i];
+    CHECK(paramsCommit() == MSG_RESET, "sr %02x: commit accepted",
+          levels[i]);
+    CHECK(params_dirty == ALL_DIRTY, "sr %02x: dirty %08x", levels[i],
+          params_dirty);
+    CHECK(record_programs(PARAMS_ADDR(calib)) == 0, "sr %02x: programmed",
+          levels[i]);
+    eed.sr = 0;
+    CHECK(paramsCommit() == MSG_OK, "sr %02x: unprotected commit failed",
+          levels[i]);
+    CHECK(params_dirty == 0, "sr %02x: dirty after unprotected commit",
+          levels[i]);
+  }
+}
+
+static void test_by_name(void) {
+  static const struct {
+    const char          *name;
+    const char          *value;
+    bool                ok;
+  } cases[] = {
+    {"adc_offset", "-32768", true},
+    {"adc_offset", "32767", true},
+    {"adc_offset", "-32769", false},
+    {"adc_offset", "32768", false},
+    {"adc_gain", "65535", true},
+    {"adc_gain", "0x10000", false},
+    {"adc_gain", "-1", false},
+    {"vref_mv", "3300x", false},
+    {"vref_mv", "", false},
+    {"serial_baud", "0xFFFFFFFF", true},
+    {"serial_baud", "921600", true},
+    {"serial_baud", "0x100000000", false},
+    {"serial_baud", "99999999999999999999", false},
+    {"serial_baud", " -1", false},
+    {"adc_offset", "-99999999999999999999", false},
+    {"adc_offset", "99999999999999999999", false},
+    {"serial_bauds", "9600", false}
+  };
+  unsigned i;
+
+  device_reset(&eecfg, 0xFF);
+  paramsStart(&eed);
+  paramsCommit();
+  for (i = 0; i < sizeof cases / sizeof cases[0]; i++) {
+    CHECK(paramsSetByName(cases[i].name, cases[i].value) == cases[i].ok,
+          "%s = \"%s\"", cases[i].name, cases[i].value);
+  }
+  CHECK(param_get_adc_offset() == 32767, "adc_offset %d",
+        param_get_adc_offset());
+  CHECK(param_get_adc_gain() == 65535, "adc_gain %u", param_get_adc_gain());
+  CHECK(param_get_serial_baud() == 921600, "serial_baud %u",
+        param_get_serial_baud());
+
+  /* A set marks its own record only.*/
+  params_dirty = 0;
+  paramsSetByName("vref_mv", "3000");
+  CHECK(params_dirty == REC_BIT(calib), "vref_mv marked %08x",
+        params_dirty);
+  params_dirty = 0;
+  paramsSetByName("serial_baud", "9600");
+  CHECK(params_dirty == REC_BIT(comm), "serial_baud marked %08x",
+        params_dirty);
+}
+
+int main(void) {
+
+  test_not_started();
+  test_blank();
+  test_commit_reload();
+  test_damaged();
+  test_migration();
+  test_newer();
+  test_partial_commit();
+  test_protected();
+  test_by_name();
+  return hosttestReport("params");
+}
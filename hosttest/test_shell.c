@@ -0,0 +1,546 @@
+/*
+    ChibiOS - Copyright (C) 2006..2015 Giovanni Di Sirio
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+/**
+ * @file    test_shell.c
+ * @brief   Shell dispatch and line editor tests.
+ * @details shell.c runs on a recording terminal. The commands table is
+ *          generated by gen_commands.py and indexed by shellhash.py as the
+ *          application table is: every name must be found through the
+ *          hash, the misses must agree with a linear scan. Batches check
+ *          the quoting and splitting of the tokenizer, the line editor the
+ *          line length limit, the history and the escape sequences.
+ */
+
+#include <stdarg.h>
+#include <string.h>
+
+#include "ch.h"
+#include "hal.h"
+#include "chprintf.h"
+
+#include "shell.h"
+#include "hosttest.h"
+
+#define OUT_SIZE            1024
+#define RANDOM_PROBES       200000
+
+/*===========================================================================*/
+/* Recording terminal and commands.                                          */
+/*===========================================================================*/
+
+struct BaseSequentialStream {
+  int                   unused;
+};
+
+static BaseSequentialStream term;
+static const char *input;
+static char out[OUT_SIZE];
+static size_t out_len;
+
+/* Last command called.*/
+static const char *called;
+static unsigned calls;
+static int called_argc;
+static char called_argv[SHELL_MAX_ARGUMENTS][SHELL_MAX_LINE_LENGTH];
+
+static msg_t record(const char *name, int argc, char *argv[]) {
+  int i;
+
+  called = name;
+  calls++;
+  called_argc = argc;
+  for (i = 0; (i < argc) && (i < SHELL_MAX_ARGUMENTS); i++) {
+    strncpy(called_argv[i], argv[i], SHELL_MAX_LINE_LENGTH - 1);
+    called_argv[i][SHELL_MAX_LINE_LENGTH - 1] = '\0';
+  }
+  return (argc > 0) && (strcmp(argv[0], "fail") == 0) ? MSG_RESET : MSG_OK;
+}
+
+#define SHELL_COMMAND(name, function)                                       \
+  static msg_t function(BaseSequentialStream *chp, int argc,               \
+                        char *argv[]) {                                     \
+    (void)chp;                                                              \
+    return record(#name, argc, argv);                                      \
+  }
+#define SHELL_LONG_COMMAND(name, function) SHELL_COMMAND(name, function)
+#include "commands.h"
+#undef SHELL_COMMAND
+#undef SHELL_LONG_COMMAND
+
+static const ShellCommand commands[] = {
+#define SHELL_COMMAND(name, function) {#name, function, 0},
+#define SHELL_LONG_COMMAND(name, function) {#name, function, SHELL_FLAG_LONG},
+#include "commands.h"
+#undef SHELL_COMMAND
+#undef SHELL_LONG_COMMAND
+  {NULL, NULL, 0}
+};
+
+#define NUM_COMMANDS        (sizeof commands / sizeof commands[0] - 1)
+
+#include "commands_hash.h"
+
+SHELL_HASH_TABLE(commands_hash, commands);
+
+static const ShellConfig hashed_cfg = {&term, commands, &commands_hash};
+static const ShellConfig linear_cfg = {&term, commands, NULL};
+
+static void out_char(char c) {
+
+  if (out_len < OUT_SIZE - 1) {
+    out[out_len++] = c;
+    out[out_len] = '\0';
+  }
+}
+
+static void out_reset(void) {
+
+  out_len = 0;
+  out[0] = '\0';
+}
+
+/* Strings and decimal numbers, all the shell prints here.*/
+int chprintf(BaseSequentialStream *chp, const char *fmt, ...) {
+  char num[16];
+  const char *s;
+  va_list ap;
+
+  (void)chp;
+  va_start(ap, fmt);
+  while (*fmt != '\0') {
+    if (*fmt != '%') {
+      out_char(*fmt++);
+      continue;
+    }
+    while (strchr("sud", *fmt) == NULL)
+      fmt++;
+    if (*fmt++ == 's')
+      s = va_arg(ap, const char *);
+    else {
+      snprintf(num, sizeof num, "%d", va_arg(ap, int));
+      s = num;
+    }
+    while (*s != '\0')
+      out_char(*s++);
+  }
+  va_end(ap);
+  return 0;
+}
+
+msg_t chnPutTimeout(BaseChannel *chp, uint8_t b, systime_t timeout) {
+
+  (void)chp;
+  (void)timeout;
+  out_char((char)b);
+  return MSG_OK;
+}
+
+msg_t chnGetTimeout(BaseChannel *chp, systime_t timeout) {
+
+  (void)chp;
+  (void)timeout;
+  if (*input == '\0')
+    return Q_TIMEOUT;
+  return (uint8_t)*input++;
+}
+
+/*
+ * The server, the workers and the shell threads are not run, the tests
+ * call the session functions directly.
+ */
+systime_t chVTGetSystemTimeX(void) {
+
+  return 0;
+}
+
+systime_t chVTGetSystemTime(void) {
+
+  return 0;
+}
+
+systime_t chVTTimeElapsedSinceX(systime_t start) {
+
+  return start;
+}
+
+thread_t *chThdCreateStatic(void *wsp, size_t size, tprio_t prio,
+                            tfunc_t pf, void *arg) {
+
+  (void)wsp;
+  (void)size;
+  (void)prio;
+  (void)pf;
+  (void)arg;
+  return NULL;
+}
+
+thread_t *chThdCreateFromHeap(void *heapp, size_t size, tprio_t prio,
+                              tfunc_t pf, void *arg) {
+
+  return chThdCreateStatic(heapp, size, prio, pf, arg);
+}
+
+tprio_t chThdGetPriorityX(void) {
+
+  return 0;
+}
+
+msg_t chThdWait(thread_t *tp) {
+
+  (void)tp;
+  return MSG_OK;
+}
+
+void chThdExitS(msg_t msg) {
+
+  (void)msg;
+}
+
+void chRegSetThreadName(const char *name) {
+
+  (void)name;
+}
+
+eventmask_t chEvtWaitAny(eventmask_t events) {
+
+  return events;
+}
+
+eventmask_t chEvtGetAndClearEvents(eventmask_t events) {
+
+  (void)events;
+  return 0;
+}
+
+eventflags_t chEvtGetAndClearFlags(event_listener_t *elp) {
+
+  (void)elp;
+  return 0;
+}
+
+void chEvtRegisterMaskWithFlags(event_source_t *esp, event_listener_t *elp,
+                                eventmask_t events, eventflags_t wflags) {
+
+  (void)events;
+  elp->source = esp;
+  elp->flags = wflags;
+}
+
+void chEvtUnregister(event_source_t *esp, event_listener_t *elp) {
+
+  (void)esp;
+  elp->source = NULL;
+}
+
+void chEvtSignalI(thread_t *tp, eventmask_t events) {
+
+  (void)tp;
+  (void)events;
+}
+
+void chEvtBroadcastI(event_source_t *esp) {
+
+  (void)esp;
+}
+
+msg_t chMBPost(mailbox_t *mbp, msg_t msg, systime_t timeout) {
+
+  (void)mbp;
+  (void)msg;
+  (void)timeout;
+  return MSG_OK;
+}
+
+msg_t chMBFetch(mailbox_t *mbp, msg_t *msgp, systime_t timeout) {
+
+  (void)mbp;
+  (void)msgp;
+  (void)timeout;
+  return MSG_RESET;
+}
+
+event_source_t *chnGetEventSource(BaseAsynchronousChannel *acp) {
+
+  (void)acp;
+  return NULL;
+}
+
+size_t chSequentialStreamRead(BaseSequentialStream *chp, uint8_t *bp,
+                              size_t n) {
+
+  (void)chp;
+  (void)bp;
+  (void)n;
+  return 0;
+}
+
+/*===========================================================================*/
+/* Tests.                                                                    */
+/*===========================================================================*/
+
+static bool is_command(const char *name) {
+  unsigned i;
+
+  for (i = 0; i < NUM_COMMANDS; i++) {
+    if (strcmp(commands[i].sc_name, name) == 0)
+      return true;
+  }
+  return false;
+}
+
+/*
+ * Every name of the generated table is found through the hash, and calls
+ * its own handler.
+ */
+static void test_lookup(void) {
+  unsigned i;
+
+  CHECK(NUM_COMMANDS >= 100, "only %u commands", (unsigned)NUM_COMMANDS);
+  CHECK(SHELL_HASH_SLOTS >= NUM_COMMANDS, "%u slots for %u commands",
+        SHELL_HASH_SLOTS, (unsigned)NUM_COMMANDS);
+  for (i = 0; i < NUM_COMMANDS; i++) {
+    shellcmd_t fn = shellFindCommand(&hashed_cfg, commands[i].sc_name);
+
+    CHECK(fn == commands[i].sc_function, "%s not found",
+          commands[i].sc_name);
+    if (fn == NULL)
+      continue;
+    called = NULL;
+    (void)fn(&term, 0, NULL);
+    CHECK((called != NULL) && (strcmp(called, commands[i].sc_name) == 0),
+          "%s ran %s", commands[i].sc_name, called);
+  }
+
+  /* The built-in commands are found before the table.*/
+  CHECK(shellFindCommand(&hashed_cfg, "info") != NULL, "info not found");
+  CHECK(shellFindCommand(&hashed_cfg, "systime") ==
+        shellFindCommand(&linear_cfg, "systime"), "systime differs");
+}
+
+/*
+ * Names close to the known ones and random strings land on occupied slots,
+ * the hash must agree with the linear scan on all of them.
+ */
+static void test_misses(void) {
+  char name[SHELL_MAX_LINE_LENGTH + 2];
+  unsigned i, j, n, misses = 0, differ = 0;
+  size_t len;
+
+  CHECK(shellFindCommand(&hashed_cfg, "") == NULL, "empty name found");
+  for (i = 0; i < NUM_COMMANDS; i++) {
+    static const char *suffixes[] = {"x", "_", "0", "a"};
+
+    len = strlen(commands[i].sc_name);
+    for (j = 0; j < 4; j++) {
+      snprintf(name, sizeof name, "%s%s", commands[i].sc_name, suffixes[j]);
+      if (is_command(name))
+        continue;
+      misses++;
+      if (shellFindCommand(&hashed_cfg, name) != NULL)
+        differ++;
+    }
+
+    /* Shortened and upper cased.*/
+    memcpy(name, commands[i].sc_name, len + 1);
+    name[len - 1] = '\0';
+    if ((len > 1) && !is_command(name)) {
+      misses++;
+      if (shellFindCommand(&hashed_cfg, name) != NULL)
+        differ++;
+    }
+    memcpy(name, commands[i].sc_name, len + 1);
+    name[0] = (char)(name[0] - 'a' + 'A');
+    misses++;
+    if (shellFindCommand(&hashed_cfg, name) != NULL)
+      differ++;
+  }
+  CHECK(differ == 0, "%u of %u near misses found", differ, misses);
+
+  differ = 0;
+  for (i = 0; i < RANDOM_PROBES; i++) {
+    n = 1 + hosttestRand() % 12;
+    for (j = 0; j < n; j++)
+      name[j] = "adceghilmoprstuwxy_019"[hosttestRand() % 22];
+    name[n] = '\0';
+    if (shellFindCommand(&hashed_cfg, name) !=
+        shellFindCommand(&linear_cfg, name))
+      differ++;
+  }
+  CHECK(differ == 0, "%u of %u random names differ from the scan", differ,
+        RANDOM_PROBES);
+}
+
+/*
+ * Runs a batch, returns the number of commands and failures as "n/f".
+ */
+static const char *batch(ShellSession *ssp, const char *script) {
+  static char result[16];
+  char line[SHELL_MAX_LINE_LENGTH];
+  ShellBatchStatus status;
+
+  strncpy(line, script, sizeof line - 1);
+  line[sizeof line - 1] = '\0';
+  called = NULL;
+  calls = 0;
+  called_argc = -1;
+  out_reset();
+  shellExecScript(ssp, line, &status);
+  snprintf(result, sizeof result, "%u/%u%s", status.sb_commands,
+           status.sb_failed, status.sb_exit ? " exit" : "");
+  return result;
+}
+
+static bool args_are(int argc, const char * const *argv) {
+  int i;
+
+  if (called_argc != argc)
+    return false;
+  for (i = 0; i < argc; i++) {
+    if (strcmp(called_argv[i], argv[i]) != 0)
+      return false;
+  }
+  return true;
+}
+
+#define ARGS_ARE(...)                                                       \
+  args_are(sizeof (const char *[]){__VA_ARGS__} / sizeof(const char *),     \
+           (const char *[]){__VA_ARGS__})
+
+static void test_tokenizer(void) {
+  ShellSession session;
+  const char *r;
+
+  memset(&session, 0, sizeof session);
+  session.ss_config = &hashed_cfg;
+
+  r = batch(&session, "a x \"b c\" 'd\"e' \"\"");
+  CHECK((strcmp(r, "1/0") == 0) && ARGS_ARE("x", "b c", "d\"e", ""),
+        "quoted arguments %s, %d arguments", r, called_argc);
+  r = batch(&session, "ad f'g h'i\t\t'' ");
+  CHECK((strcmp(r, "1/0") == 0) && ARGS_ARE("fg hi", ""),
+        "joined quotes %s, %d arguments", r, called_argc);
+  r = batch(&session, "\ta\t\"unterminated  quote");
+  CHECK((strcmp(r, "1/0") == 0) && ARGS_ARE("unterminated  quote"),
+        "unterminated quote %s, %d arguments", r, called_argc);
+
+  /* Separators inside quotes do not split the batch.*/
+  r = batch(&session, "a \"x;y\"; ad 'p;q'");
+  CHECK((strcmp(r, "2/0") == 0) && (strcmp(called, "ad") == 0) &&
+        ARGS_ARE("p;q"), "quoted separators %s", r);
+  r = batch(&session, " ; ;\t;");
+  CHECK((strcmp(r, "0/0") == 0) && (calls == 0), "empty commands %s", r);
+
+  r = batch(&session, "a 1 2 3 4 5");
+  CHECK((strcmp(r, "1/1") == 0) && (calls == 0) &&
+        (strcmp(out, "too many arguments\r\n") == 0),
+        "too many arguments %s \"%s\"", r, out);
+  r = batch(&session, "a 1 2 3 4");
+  CHECK((strcmp(r, "1/0") == 0) && ARGS_ARE("1", "2", "3", "4"),
+        "four arguments %s", r);
+  r = batch(&session, "zz;a fail;ad");
+  CHECK((strcmp(r, "3/2") == 0) && (calls == 2) &&
+        (strcmp(out, "zz ?\r\n") == 0), "failures %s \"%s\"", r, out);
+  r = batch(&session, "a;exit;ad");
+  CHECK((strcmp(r, "1/0 exit") == 0) && (calls == 1),
+        "exit %s, %u calls", r, calls);
+}
+
+/*
+ * Feeds the terminal input to a new line of the session editor, returns the
+ * input status.
+ */
+static int feed(ShellSession *ssp, const char *chars) {
+
+  input = chars;
+  out_reset();
+  ssp->ss_editor.se_line = ssp->ss_line;
+  ssp->ss_editor.se_size = sizeof ssp->ss_line;
+  ssp->ss_editor.se_pos = 0;
+  ssp->ss_editor.se_escape = 0;
+  ssp->ss_editor.se_overflow = false;
+#if SHELL_HISTORY_DEPTH > 0
+  ssp->ss_editor.se_age = 0;
+#endif
+  return shellFeedInput(ssp);
+}
+
+static void test_editor(void) {
+  char longline[2 * SHELL_MAX_LINE_LENGTH + 2];
+  ShellSession session;
+
+  memset(&session, 0, sizeof session);
+  session.ss_config = &hashed_cfg;
+
+  CHECK((feed(&session, "abc") == SHELL_INPUT_PENDING) &&
+        (strcmp(out, "abc") == 0), "incomplete line");
+  CHECK((feed(&session, "ab\bc\r") == SHELL_INPUT_LINE) &&
+        (strcmp(session.ss_line, "ac") == 0), "backspace \"%s\"",
+        session.ss_line);
+
+  /* A full line is accepted, a longer one rejected whole.*/
+  memset(longline, 'x', SHELL_MAX_LINE_LENGTH - 1);
+  strcpy(longline + SHELL_MAX_LINE_LENGTH - 1, "\r");
+  CHECK((feed(&session, longline) == SHELL_INPUT_LINE) &&
+        (strlen(session.ss_line) == SHELL_MAX_LINE_LENGTH - 1) &&
+        !session.ss_editor.se_overflow,
+        "full line of %zu", strlen(session.ss_line));
+  memset(longline, 'x', sizeof longline - 2);
+  strcpy(longline + sizeof longline - 2, "\r");
+  CHECK((feed(&session, longline) == SHELL_INPUT_LINE) &&
+        (session.ss_line[0] == '\0') && session.ss_editor.se_overflow,
+        "long line of %zu", strlen(session.ss_line));
+  strcpy(longline + SHELL_MAX_LINE_LENGTH, "\b\b\r");
+  CHECK((feed(&session, longline) == SHELL_INPUT_LINE) &&
+        (session.ss_line[0] == '\0') && session.ss_editor.se_overflow,
+        "erased overflow \"%s\"", session.ss_line);
+
+  /* Escape sequences are swallowed whole, a control character ends
+     them.*/
+  CHECK((feed(&session, "ab\033[1;5Dcd\033[3~\033OP\033xe\r") ==
+         SHELL_INPUT_LINE) && (strcmp(session.ss_line, "abcde") == 0) &&
+        (strcmp(out, "abcde\r\n") == 0),
+        "escape sequences \"%s\", echo \"%s\"", session.ss_line, out);
+  CHECK((feed(&session, "f\033[12\r") == SHELL_INPUT_LINE) &&
+        (strcmp(session.ss_line, "f") == 0),
+        "escape ended by CR \"%s\"", session.ss_line);
+  CHECK((feed(&session, "\033[\033[Ch\r") == SHELL_INPUT_LINE) &&
+        (strcmp(session.ss_line, "h") == 0),
+        "escape restarted \"%s\"", session.ss_line);
+
+#if SHELL_HISTORY_DEPTH > 0
+  /* Up arrow, CSI and SS3 forms, then down.*/
+  session.ss_history.sh_count = 0;
+  session.ss_history.sh_head = 0;
+  (void)feed(&session, "one\r");
+  (void)feed(&session, "two\r");
+  CHECK((feed(&session, "\033[A\033[A\r") == SHELL_INPUT_LINE) &&
+        (strcmp(session.ss_line, "one") == 0), "history up \"%s\"",
+        session.ss_line);
+  CHECK((feed(&session, "\033OA\033[B!\r") == SHELL_INPUT_LINE) &&
+        (strcmp(session.ss_line, "!") == 0), "history down \"%s\"",
+        session.ss_line);
+#endif
+}
+
+int main(void) {
+
+  test_lookup();
+  test_misses();
+  test_tokenizer();
+  test_editor();
+  return hosttestReport("shell");
+}
@@ -0,0 +1,386 @@
+/*
+    ChibiOS - Copyright (C) 2006..2015 Giovanni Di Sirio
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+/**
+ * @file    test_status.c
+ * @brief   Status LED tests.
+ * @details status.c runs on a simulated millisecond clock firing its
+ *          virtual timer. The LED level is traced at the middle of every
+ *          pattern step and must follow the pattern of the highest flag
+ *          raised, with one CPU wakeup per run of identical steps. The
+ *          flag changes must be broadcast and must not restart a pattern
+ *          left unchanged.
+ *          Built with @p STATUS_USE_DMA the clock instead runs TIM6 as
+ *          programmed, each update event moves the next word of the DMA
+ *          table to GPIOC BSRR. The LED must then follow the pattern from
+ *          the step in progress, the CPU only waking up on changes.
+ */
+
+#include <string.h>
+
+#include "ch.h"
+#include "hal.h"
+
+#include "status.h"
+#include "hosttest.h"
+
+#define STEPS               16
+#define PERIOD_MS           (STEPS * STATUS_STEP_MS)
+
+/* The documented patterns, by increasing priority.*/
+static const uint16_t expected_patterns[] = {
+  0x0F0F,                               /* Heartbeat, 500 ms.               */
+  0x00FF,                               /* CAN link, 1 s.                   */
+  0x3333,                               /* USB active, 250 ms.              */
+  0x5555,                               /* EEPROM busy, 125 ms flicker.     */
+  0x0015                                /* Fault, three blinks and pause.   */
+};
+
+/*===========================================================================*/
+/* Simulated clock, LED and kernel calls.                                    */
+/*===========================================================================*/
+
+static systime_t now;
+static virtual_timer_t *armed_vt;
+static systime_t armed_due;
+static bool led_lit;
+static unsigned led_writes;
+static eventflags_t broadcast;
+static unsigned broadcasts;
+#if STATUS_USE_DMA
+TIM_TypeDef TIM6_regs;
+static volatile void *dma_periph;
+static const uint32_t *dma_memory;
+static size_t dma_size;
+static uint32_t dma_mode;
+static bool dma_enabled;
+static unsigned dma_step;
+static unsigned dma_foreign;
+static uint32_t tim_ticks;
+static uint32_t rcc_apb1;
+#endif
+
+void palSetPad(ioportid_t port, unsigned pad) {
+
+  CHECK((port == GPIOC) && (pad == GPIOC_LED_STATUS1), "LED pad");
+  led_lit = false;
+  led_writes++;
+}
+
+/* The LED is lit by driving the pad low.*/
+void palClearPad(ioportid_t port, unsigned pad) {
+
+  CHECK((port == GPIOC) && (pad == GPIOC_LED_STATUS1), "LED pad");
+  led_lit = true;
+  led_writes++;
+}
+
+void chSysLockFromISR(void) {
+}
+
+void chSysUnlockFromISR(void) {
+}
+
+void chEvtBroadcastFlagsI(event_source_t *esp, eventflags_t flags) {
+
+  CHECK(esp == &status_changed, "broadcast source");
+  broadcast |= flags;
+  broadcasts++;
+}
+
+void chVTObjectInit(virtual_timer_t *vtp) {
+
+  memset(vtp, 0, sizeof *vtp);
+}
+
+/* As the kernel, an armed timer is reset first.*/
+void chVTSetI(virtual_timer_t *vtp, systime_t delay, vtfunc_t vtfunc,
+              void *par) {
+
+  CHECK(delay > 0, "timer armed for 0 ticks");
+  vtp->func = vtfunc;
+  vtp->par = par;
+  vtp->delay = delay;
+  armed_vt = vtp;
+  armed_due = now + delay;
+}
+
+#if STATUS_USE_DMA
+bool dmaStreamAllocate(const stm32_dma_stream_t *dmastp, uint32_t priority,
+                       stm32_dmaisr_t func, void *param) {
+
+  (void)priority;
+  (void)param;
+  CHECK((dmastp == STM32_DMA2_STREAM3) && (func == NULL), "DMA stream");
+  return false;
+}
+
+void dmaStreamSetPeripheral(const stm32_dma_stream_t *dmastp,
+                            volatile void *addr) {
+
+  (void)dmastp;
+  dma_periph = addr;
+}
+
+void dmaStreamSetMemory0(const stm32_dma_stream_t *dmastp,
+                         const void *addr) {
+
+  (void)dmastp;
+  dma_memory = addr;
+}
+
+void dmaStreamSetTransactionSize(const stm32_dma_stream_t *dmastp,
+                                 size_t size) {
+
+  (void)dmastp;
+  dma_size = size;
+}
+
+void dmaStreamSetMode(const stm32_dma_stream_t *dmastp, uint32_t mode) {
+
+  (void)dmastp;
+  dma_mode = mode;
+}
+
+void dmaStreamEnable(const stm32_dma_stream_t *dmastp) {
+
+  (void)dmastp;
+  dma_enabled = true;
+  dma_step = 0;
+}
+
+void rccEnableAPB1(uint32_t mask, bool lp) {
+
+  (void)lp;
+  rcc_apb1 |= mask;
+}
+
+/*
+ * One TIM6 tick in milliseconds. An update event transfers the next table
+ * word to BSRR, the reset half lights the LED.
+ */
+static void tim6_tick(void) {
+  uint32_t word;
+
+  if (((TIM6->CR1 & TIM_CR1_CEN) == 0) || !dma_enabled)
+    return;
+  tim_ticks += STM32_TIMCLK1 / 1000;
+  if (tim_ticks < (TIM6->PSC + 1) * (TIM6->ARR + 1))
+    return;
+  tim_ticks = 0;
+  if ((TIM6->DIER & TIM_DIER_UDE) == 0)
+    return;
+  word = dma_memory[dma_step];
+  if ((word & ~((1U << GPIOC_LED_STATUS1) |
+                (1U << (GPIOC_LED_STATUS1 + 16)))) != 0)
+    dma_foreign++;
+  if ((word & (1U << (GPIOC_LED_STATUS1 + 16))) != 0)
+    led_lit = true;
+  else if ((word & (1U << GPIOC_LED_STATUS1)) != 0)
+    led_lit = false;
+  dma_step = (dma_step + 1) % dma_size;
+}
+
+/* Pattern step shown by the LED, the last word transferred.*/
+static unsigned led_step(unsigned i) {
+
+  (void)i;
+  return (dma_step + STEPS - 1) % STEPS;
+}
+#else /* !STATUS_USE_DMA */
+static unsigned led_step(unsigned i) {
+
+  return i % STEPS;
+}
+#endif /* !STATUS_USE_DMA */
+
+/*
+ * Advances the clock, the timer callbacks run on their tick.
+ */
+static void run_ms(unsigned ms) {
+
+  while (ms-- > 0) {
+    now++;
+    if ((armed_vt != NULL) && (armed_due == now)) {
+      virtual_timer_t *vtp = armed_vt;
+
+      armed_vt = NULL;
+      vtp->func(vtp->par);
+    }
+#if STATUS_USE_DMA
+    tim6_tick();
+#endif
+  }
+}
+
+/*===========================================================================*/
+/* Tests.                                                                    */
+/*===========================================================================*/
+
+static uint16_t pattern_of(statusflags_t flags) {
+  unsigned i = 0;
+
+  while (flags != 0) {
+    flags >>= 1;
+    i++;
+  }
+  return expected_patterns[i];
+}
+
+#if !STATUS_USE_DMA
+/* Runs of identical steps in the cyclic pattern, at least one.*/
+static unsigned runs_of(uint16_t pattern) {
+  unsigned i, runs = 0;
+
+  for (i = 0; i < STEPS; i++) {
+    if (((pattern >> i) & 1U) != ((pattern >> ((i + 1) % STEPS)) & 1U))
+      runs++;
+  }
+  return runs > 0 ? runs : 1;
+}
+#endif
+
+/*
+ * Traces the LED over two periods from the start of the pattern, just
+ * started, at the middle of each step. The wakeup starting the pattern is
+ * counted with the following ones.
+ */
+static void check_trace(uint16_t pattern, const char *what) {
+  uint32_t wakeups = statusGetWakeups() - 1;
+  uint32_t trace = 0, shown = 0;
+  unsigned i, step;
+
+  for (i = 0; i < 2 * STEPS; i++) {
+    run_ms(i == 0 ? STATUS_STEP_MS / 2 : STATUS_STEP_MS);
+    step = led_step(i);
+    if (led_lit)
+      trace |= 1U << i;
+    if (((pattern >> step) & 1U) != 0)
+      shown |= 1U << i;
+  }
+  run_ms(STATUS_STEP_MS - STATUS_STEP_MS / 2 - 1);
+  wakeups = statusGetWakeups() - wakeups;
+  CHECK(trace == shown, "%s: LED %08x, pattern %04x gives %08x", what,
+        trace, pattern, shown);
+#if STATUS_USE_DMA
+  CHECK(wakeups == 1, "%s: %u wakeups in two periods", what, wakeups);
+#else
+  CHECK(wakeups == 2 * runs_of(pattern),
+        "%s: %u wakeups in two periods, %u runs", what, wakeups,
+        runs_of(pattern));
+#endif
+  run_ms(1);
+}
+
+static void test_init(void) {
+
+  statusInit();
+  CHECK((statusGetFlags() == 0) &&
+        (statusGetPattern() == expected_patterns[0]) &&
+        (statusGetWakeups() == 1), "initial state");
+#if STATUS_USE_DMA
+  /* One word per step, circular, to the LED port only.*/
+  CHECK((dma_periph == &GPIOC->BSRR) && (dma_size == STEPS) &&
+        (dma_mode == (STM32_DMA_CR_PL(STATUS_DMA_PRIORITY) |
+                      STM32_DMA_CR_DIR_M2P | STM32_DMA_CR_MINC |
+                      STM32_DMA_CR_PSIZE_WORD | STM32_DMA_CR_MSIZE_WORD |
+                      STM32_DMA_CR_CIRC)) && dma_enabled,
+        "DMA setup: size %zu, mode %08x", dma_size, dma_mode);
+  CHECK(((rcc_apb1 & RCC_APB1ENR_TIM6EN) != 0) &&
+        ((uint64_t)(TIM6->PSC + 1) * (TIM6->ARR + 1) * 1000 ==
+         (uint64_t)STATUS_STEP_MS * STM32_TIMCLK1),
+        "TIM6 period %u x %u", TIM6->PSC + 1, TIM6->ARR + 1);
+
+  /* The first word is transferred on the first update event.*/
+  run_ms(STATUS_STEP_MS);
+  CHECK(dma_step == 1, "first transfer");
+#endif
+  CHECK(led_lit, "LED off at step 0");
+  check_trace(expected_patterns[0], "heartbeat");
+}
+
+/*
+ * Every combination of the flags, raised and cleared one at a time, shows
+ * the pattern of its highest flag.
+ */
+static void test_flags(void) {
+  statusflags_t flags, bit;
+  char what[32];
+
+  for (flags = 1; flags < 16; flags++) {
+    bit = flags & (~flags + 1);
+    broadcast = 0;
+    statusSet(flags);
+    CHECK((statusGetFlags() == flags) && (broadcast == flags),
+          "set %x: flags %x, broadcast %x", (unsigned)flags,
+          (unsigned)statusGetFlags(), (unsigned)broadcast);
+    CHECK(statusGetPattern() == pattern_of(flags), "set %x: pattern %04x",
+          (unsigned)flags, statusGetPattern());
+    snprintf(what, sizeof what, "flags %x", (unsigned)flags);
+    check_trace(pattern_of(flags), what);
+
+    broadcast = 0;
+    statusClear(bit);
+    CHECK((statusGetFlags() == (flags & ~bit)) && (broadcast == bit),
+          "clear %x of %x: broadcast %x", (unsigned)bit, (unsigned)flags,
+          (unsigned)broadcast);
+    statusClear(flags);
+    CHECK(statusGetPattern() == expected_patterns[0], "heartbeat back");
+  }
+  run_ms(PERIOD_MS);
+}
+
+/*
+ * Raising a flag below the one shown, or one already raised, keeps the
+ * pattern running without a wakeup.
+ */
+static void test_unchanged(void) {
+  unsigned writes, count;
+  uint32_t wakeups;
+
+  statusSet(STATUS_FAULT);
+  run_ms(3 * STATUS_STEP_MS + 10);
+  wakeups = statusGetWakeups();
+  writes = led_writes;
+  count = broadcasts;
+
+  statusSet(STATUS_USB_ACTIVE);
+  CHECK((statusGetWakeups() == wakeups) && (led_writes == writes) &&
+        (broadcasts == count + 1), "lower flag restarted the pattern");
+  statusSet(STATUS_FAULT);
+  statusClear(STATUS_EEPROM_BUSY);
+  CHECK((statusGetWakeups() == wakeups) && (broadcasts == count + 1),
+        "unchanged flags broadcast");
+
+  statusClear(STATUS_FAULT);
+  CHECK((statusGetPattern() == expected_patterns[2]) &&
+        (statusGetWakeups() == wakeups + 1), "restart on a new pattern");
+  check_trace(expected_patterns[2], "flag below cleared");
+  statusClear(STATUS_USB_ACTIVE);
+}
+
+int main(void) {
+
+  test_init();
+  test_flags();
+  test_unchanged();
+#if STATUS_USE_DMA
+  CHECK(dma_foreign == 0, "%u words writing other pads", dma_foreign);
+  return hosttestReport("status dma");
+#else
+  return hosttestReport("status");
+#endif
+}
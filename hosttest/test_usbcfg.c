@@ -0,0 +1,376 @@
+/*
+    ChibiOS - Copyright (C) 2006..2015 Giovanni Di Sirio
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+/**
+ * @file    test_usbcfg.c
+ * @brief   USB CDC configuration tests.
+ * @details usbcfg.c runs on recording stubs of the USB and serial over USB
+ *          drivers. The descriptors returned by the GET_DESCRIPTOR callback
+ *          are parsed as the host does, the endpoints they declare must be
+ *          the ones initialized on the CONFIGURED event with the double
+ *          buffered bulk IN pipe, and the events must raise and clear
+ *          @p STATUS_USB_ACTIVE, the flag reopening the USB shell session.
+ */
+
+#include <string.h>
+
+#include "ch.h"
+#include "hal.h"
+
+#include "usbcfg.h"
+#include "status.h"
+#include "hosttest.h"
+
+#define MAX_ENDPOINTS       4
+
+/*===========================================================================*/
+/* Recorded driver calls.                                                    */
+/*===========================================================================*/
+
+USBDriver USBD1;
+
+static statusflags_t flags;
+static int lock_depth;
+static unsigned lock_errors;
+static unsigned configure_hooks;
+static unsigned sof_hooks;
+static const USBEndpointConfig *endpoints[MAX_ENDPOINTS];
+
+void chSysLockFromISR(void) {
+
+  lock_depth++;
+}
+
+void chSysUnlockFromISR(void) {
+
+  if (--lock_depth < 0)
+    lock_errors++;
+}
+
+void osalSysLockFromISR(void) {
+
+  chSysLockFromISR();
+}
+
+void osalSysUnlockFromISR(void) {
+
+  chSysUnlockFromISR();
+}
+
+void statusSetI(statusflags_t set) {
+
+  if (lock_depth != 1)
+    lock_errors++;
+  flags |= set;
+}
+
+void statusClearI(statusflags_t clear) {
+
+  if (lock_depth != 1)
+    lock_errors++;
+  flags &= ~clear;
+}
+
+void usbInitEndpointI(USBDriver *usbp, usbep_t ep,
+                      const USBEndpointConfig *epcp) {
+
+  (void)usbp;
+  if ((lock_depth != 1) || (ep >= MAX_ENDPOINTS))
+    lock_errors++;
+  else
+    endpoints[ep] = epcp;
+}
+
+void sduConfigureHookI(SerialUSBDriver *sdup) {
+
+  if ((lock_depth != 1) || (sdup != &SDU1))
+    lock_errors++;
+  configure_hooks++;
+}
+
+void sduSOFHookI(SerialUSBDriver *sdup) {
+
+  if ((lock_depth != 1) || (sdup != &SDU1))
+    lock_errors++;
+  sof_hooks++;
+}
+
+bool sduRequestsHook(USBDriver *usbp) {
+
+  (void)usbp;
+  return false;
+}
+
+void sduDataTransmitted(USBDriver *usbp, usbep_t ep) {
+
+  (void)usbp;
+  (void)ep;
+}
+
+void sduDataReceived(USBDriver *usbp, usbep_t ep) {
+
+  (void)usbp;
+  (void)ep;
+}
+
+void sduInterruptTransmitted(USBDriver *usbp, usbep_t ep) {
+
+  (void)usbp;
+  (void)ep;
+}
+
+/*===========================================================================*/
+/* Descriptors parsing.                                                      */
+/*===========================================================================*/
+
+static unsigned word(const uint8_t *p) {
+
+  return p[0] | ((unsigned)p[1] << 8);
+}
+
+static const USBDescriptor *get(uint8_t dtype, uint8_t dindex) {
+
+  return usbcfg.get_descriptor_cb(&USBD1, dtype, dindex, 0x0409);
+}
+
+/* Endpoint declared by the configuration descriptor.*/
+typedef struct {
+  uint8_t               address;
+  uint8_t               type;
+  unsigned              size;
+} endpoint_t;
+
+static void test_device(void) {
+  const USBDescriptor *dp = get(USB_DESCRIPTOR_DEVICE, 0);
+  const uint8_t *d;
+
+  CHECK((dp != NULL) && (dp->ud_size == 18), "device descriptor size");
+  if (dp == NULL)
+    return;
+  d = dp->ud_string;
+  CHECK((d[0] == 18) && (d[1] == USB_DESCRIPTOR_DEVICE),
+        "device descriptor header %u %u", d[0], d[1]);
+  CHECK((word(d + 2) == 0x0110) && (d[4] == 0x02),
+        "bcdUSB %04x, class %02x", word(d + 2), d[4]);
+  CHECK(d[7] == 0x40, "EP0 packet size %u", d[7]);
+  CHECK(d[17] == 1, "%u configurations", d[17]);
+
+  /* The string indexes must be served.*/
+  CHECK((get(USB_DESCRIPTOR_STRING, d[14]) != NULL) &&
+        (get(USB_DESCRIPTOR_STRING, d[15]) != NULL) &&
+        (get(USB_DESCRIPTOR_STRING, d[16]) != NULL), "device strings");
+}
+
+/*
+ * Walks the configuration descriptor as the host enumerates it and returns
+ * the endpoints declared.
+ */
+static unsigned walk_configuration(endpoint_t *eps, unsigned max) {
+  const USBDescriptor *dp = get(USB_DESCRIPTOR_CONFIGURATION, 0);
+  const uint8_t *d;
+  unsigned pos, interfaces = 0, declared = 0, listed = 0, n = 0;
+
+  CHECK(dp != NULL, "no configuration descriptor");
+  if (dp == NULL)
+    return 0;
+  d = dp->ud_string;
+  CHECK((d[0] == 9) && (d[1] == USB_DESCRIPTOR_CONFIGURATION),
+        "configuration header %u %u", d[0], d[1]);
+  CHECK(word(d + 2) == dp->ud_size, "wTotalLength %u, descriptor %zu",
+        word(d + 2), dp->ud_size);
+
+  for (pos = 0; pos < dp->ud_size; pos += d[pos]) {
+    if ((d[pos] < 2) || (pos + d[pos] > dp->ud_size)) {
+      CHECK(false, "descriptor at %u, length %u", pos, d[pos]);
+      return n;
+    }
+    switch (d[pos + 1]) {
+    case USB_DESCRIPTOR_INTERFACE:
+      CHECK(listed == declared, "interface %u: %u endpoints, %u listed",
+            interfaces - 1, declared, listed);
+      CHECK(d[pos + 2] == interfaces, "interface number %u", d[pos + 2]);
+      interfaces++;
+      declared = d[pos + 4];
+      listed = 0;
+      break;
+    case USB_DESCRIPTOR_ENDPOINT:
+      CHECK((d[pos] == 7) && (interfaces > 0), "endpoint at %u", pos);
+      listed++;
+      if (n < max) {
+        eps[n].address = d[pos + 2];
+        eps[n].type = d[pos + 3] & 3;
+        eps[n].size = word(d + pos + 4);
+        n++;
+      }
+      break;
+    }
+  }
+  CHECK(pos == dp->ud_size, "descriptors end at %u of %zu", pos,
+        dp->ud_size);
+  CHECK(listed == declared, "last interface: %u endpoints, %u listed",
+        declared, listed);
+  CHECK(interfaces == d[4], "%u interfaces, bNumInterfaces %u",
+        interfaces, d[4]);
+  return n;
+}
+
+static void test_strings(void) {
+  const USBDescriptor *dp;
+  unsigned i;
+
+  for (i = 0; i < 4; i++) {
+    dp = get(USB_DESCRIPTOR_STRING, i);
+    CHECK(dp != NULL, "string %u missing", i);
+    if (dp == NULL)
+      continue;
+    CHECK((dp->ud_string[0] == dp->ud_size) &&
+          (dp->ud_string[1] == USB_DESCRIPTOR_STRING) &&
+          ((dp->ud_size & 1) == 0), "string %u: length %u of %zu", i,
+          dp->ud_string[0], dp->ud_size);
+  }
+  CHECK(word(get(USB_DESCRIPTOR_STRING, 0)->ud_string + 2) == 0x0409,
+        "language identifier");
+
+  /* The misses answer a STALL, not a stale descriptor.*/
+  CHECK(get(USB_DESCRIPTOR_STRING, 4) == NULL, "string 4 served");
+  CHECK(get(USB_DESCRIPTOR_STRING, 255) == NULL, "string 255 served");
+  CHECK(get(USB_DESCRIPTOR_INTERFACE, 0) == NULL, "interface served");
+  CHECK(get(6, 0) == NULL, "device qualifier served");
+}
+
+/*
+ * The endpoints initialized on CONFIGURED must be the declared ones, with
+ * the serial over USB hooks, the declared transfer types and packet sizes.
+ */
+static void test_endpoints(void) {
+  endpoint_t eps[MAX_ENDPOINTS];
+  const USBEndpointConfig *epcp;
+  unsigned i, n;
+
+  memset(endpoints, 0, sizeof endpoints);
+  usbcfg.event_cb(&USBD1, USB_EVENT_CONFIGURED);
+  n = walk_configuration(eps, MAX_ENDPOINTS);
+  CHECK(n == 3, "%u endpoints declared", n);
+
+  for (i = 0; i < n; i++) {
+    unsigned num = eps[i].address & 0x7F;
+    bool in = (eps[i].address & 0x80) != 0;
+
+    epcp = num < MAX_ENDPOINTS ? endpoints[num] : NULL;
+    CHECK(epcp != NULL, "endpoint %02x not initialized", eps[i].address);
+    if (epcp == NULL)
+      continue;
+    CHECK((epcp->ep_mode & USB_EP_MODE_TYPE) == eps[i].type,
+          "endpoint %02x: type %u, declared %u", eps[i].address,
+          (unsigned)(epcp->ep_mode & USB_EP_MODE_TYPE), eps[i].type);
+    if (in)
+      CHECK((epcp->in_cb != NULL) && (epcp->in_state != NULL) &&
+            (epcp->in_maxsize >= eps[i].size),
+            "endpoint %02x: IN size %u, declared %u", eps[i].address,
+            epcp->in_maxsize, eps[i].size);
+    else
+      CHECK((epcp->out_cb == sduDataReceived) &&
+            (epcp->out_state != NULL) &&
+            (epcp->out_maxsize == eps[i].size),
+            "endpoint %02x: OUT size %u, declared %u", eps[i].address,
+            epcp->out_maxsize, eps[i].size);
+    if (eps[i].type == USB_EP_MODE_TYPE_BULK)
+      CHECK(eps[i].size == 0x40, "bulk endpoint %02x: packet size %u",
+            eps[i].address, eps[i].size);
+  }
+
+  /* Double buffered bulk IN, the serial buffers hold whole FIFO loads.*/
+  epcp = endpoints[USBD1_DATA_REQUEST_EP];
+  if (epcp != NULL) {
+    CHECK((epcp->in_cb == sduDataTransmitted) &&
+          (epcp->in_multiplier == USBD1_DATA_IN_MULTIPLIER) &&
+          (USBD1_DATA_IN_MULTIPLIER == 2), "bulk IN multiplier %u",
+          epcp->in_multiplier);
+    CHECK(SERIAL_USB_BUFFERS_SIZE %
+          (epcp->in_maxsize * epcp->in_multiplier) == 0,
+          "buffers of %u bytes, FIFO of %u", SERIAL_USB_BUFFERS_SIZE,
+          epcp->in_maxsize * epcp->in_multiplier);
+  }
+  epcp = endpoints[USBD1_INTERRUPT_REQUEST_EP];
+  CHECK((epcp != NULL) && (epcp->in_cb == sduInterruptTransmitted) &&
+        (epcp->out_cb == NULL), "interrupt endpoint callbacks");
+
+  /* The serial over USB endpoints, as declared.*/
+  CHECK((serusbcfg.usbp == &USBD1) &&
+        (serusbcfg.bulk_in == USBD1_DATA_REQUEST_EP) &&
+        (serusbcfg.bulk_out == USBD1_DATA_AVAILABLE_EP) &&
+        (serusbcfg.int_in == USBD1_INTERRUPT_REQUEST_EP),
+        "serial over USB endpoints");
+  for (i = 0; i < n; i++) {
+    if (eps[i].type == USB_EP_MODE_TYPE_BULK)
+      CHECK((eps[i].address == (serusbcfg.bulk_in | 0x80)) ||
+            (eps[i].address == serusbcfg.bulk_out),
+            "bulk endpoint %02x unknown to the driver", eps[i].address);
+    else
+      CHECK(eps[i].address == (serusbcfg.int_in | 0x80),
+            "endpoint %02x unknown to the driver", eps[i].address);
+  }
+}
+
+/*
+ * Every (re)configuration raises STATUS_USB_ACTIVE and resets the CDC
+ * state, a reset or a suspend clears it. The shell server reopens the USB
+ * session on the flag.
+ */
+static void test_events(void) {
+  static const struct {
+    usbevent_t          event;
+    statusflags_t       flags;
+    unsigned            configures;
+  } steps[] = {
+    {USB_EVENT_RESET,      0,                 0},
+    {USB_EVENT_ADDRESS,    0,                 0},
+    {USB_EVENT_CONFIGURED, STATUS_USB_ACTIVE, 1},
+    {USB_EVENT_STALLED,    STATUS_USB_ACTIVE, 1},
+    {USB_EVENT_SUSPEND,    0,                 1},
+    {USB_EVENT_WAKEUP,     0,                 1},
+    {USB_EVENT_CONFIGURED, STATUS_USB_ACTIVE, 2},
+    {USB_EVENT_RESET,      0,                 2},
+    {USB_EVENT_ADDRESS,    0,                 2},
+    {USB_EVENT_CONFIGURED, STATUS_USB_ACTIVE, 3}
+  };
+  unsigned i;
+
+  flags = STATUS_CAN_LINK | STATUS_USB_ACTIVE;
+  configure_hooks = 0;
+  for (i = 0; i < sizeof steps / sizeof steps[0]; i++) {
+    usbcfg.event_cb(&USBD1, steps[i].event);
+    CHECK(flags == (STATUS_CAN_LINK | steps[i].flags),
+          "step %u: flags %x", i, (unsigned)flags);
+    CHECK(configure_hooks == steps[i].configures,
+          "step %u: %u configure hooks", i, configure_hooks);
+  }
+
+  sof_hooks = 0;
+  usbcfg.sof_cb(&USBD1);
+  CHECK(sof_hooks == 1, "SOF hook");
+  CHECK((lock_errors == 0) && (lock_depth == 0),
+        "I-class calls outside the lock: %u", lock_errors);
+}
+
+int main(void) {
+
+  test_device();
+  test_strings();
+  test_endpoints();
+  test_events();
+  return hosttestReport("usbcfg");
+}
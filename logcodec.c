@@ -0,0 +1,285 @@
+/*
+    ChibiOS - Copyright (C) 2006..2015 Giovanni Di Sirio
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+/**
+ * @file    logcodec.c
+ * @brief   Log page codec code.
+ * @details Deltas within +/-31 encode in one byte and a run of up to 64
+ *          unchanged samples in one byte, a page of slowly varying samples
+ *          holds several times the 14 samples of a raw 16 bits encoding.
+ *
+ * @addtogroup LOGCODEC
+ * @{
+ */
+
+#include <string.h>
+
+#include "logcodec.h"
+
+/*===========================================================================*/
+/* Module local definitions.                                                 */
+/*===========================================================================*/
+
+/*
+ * Header fields offsets.
+ */
+#define HDR_SEQ                     0
+#define HDR_COUNT                   2
+#define HDR_CRC                     3
+
+/*
+ * A 16 bits varint or an 18 bits delta token never exceeds 3 bytes.
+ */
+#define VARINT_MAX                  3
+
+#define DELTA_TOKEN(d)              (zigzag(d) << 1)
+#define RUN_TOKEN(r)                ((((uint32_t)(r) - 1) << 1) | 1)
+
+/*===========================================================================*/
+/* Module local functions.                                                   */
+/*===========================================================================*/
+
+static size_t put_varint(uint8_t *p, uint32_t v) {
+  size_t n = 0;
+
+  while (v >= 0x80) {
+    p[n++] = (uint8_t)(v | 0x80);
+    v >>= 7;
+  }
+  p[n++] = (uint8_t)v;
+  return n;
+}
+
+static size_t varint_len(uint32_t v) {
+  size_t n = 1;
+
+  while (v >= 0x80) {
+    v >>= 7;
+    n++;
+  }
+  return n;
+}
+
+/*
+ * Returns the number of bytes consumed or zero if the varint is truncated
+ * or overlong.
+ */
+static size_t get_varint(const uint8_t *p, size_t avail, uint32_t *vp) {
+  uint32_t v = 0;
+  size_t n = 0;
+
+  while ((n < avail) && (n < VARINT_MAX)) {
+    uint8_t b = p[n];
+
+    v |= (uint32_t)(b & 0x7F) << (7 * n);
+    n++;
+    if ((b & 0x80) == 0) {
+      *vp = v;
+      return n;
+    }
+  }
+  return 0;
+}
+
+static uint32_t zigzag(int32_t d) {
+
+  return ((uint32_t)d << 1) ^ (uint32_t)(d >> 31);
+}
+
+static int32_t unzigzag(uint32_t z) {
+
+  return (int32_t)(z >> 1) ^ -(int32_t)(z & 1);
+}
+
+/*
+ * Writes the pending run token, it stays pending and is rewritten in place
+ * if the run grows.
+ */
+static void put_run(logcodec_encoder_t *ep) {
+
+  if (ep->run > 0)
+    put_varint(&ep->page[LOGCODEC_HEADER_SIZE + ep->used -
+                         varint_len(RUN_TOKEN(ep->run))],
+               RUN_TOKEN(ep->run));
+}
+
+/*===========================================================================*/
+/* Module exported functions.                                                */
+/*===========================================================================*/
+
+/**
+ * @brief   Empties the encoder page.
+ *
+ * @param[out] ep       the encoder state
+ */
+void logcodecReset(logcodec_encoder_t *ep) {
+
+  memset(ep->page, 0, sizeof ep->page);
+  ep->used  = 0;
+  ep->count = 0;
+  ep->run   = 0;
+  ep->last  = 0;
+}
+
+/**
+ * @brief   Appends a sample to the encoder page.
+ *
+ * @param[in,out] ep    the encoder state
+ * @param[in] sample    the sample
+ * @return              The operation status.
+ * @retval true         if the sample has been appended.
+ * @retval false        if the page is full, the sample is not appended.
+ */
+bool logcodecAppend(logcodec_encoder_t *ep, uint16_t sample) {
+  uint32_t v;
+  size_t n;
+
+  if (ep->count >= LOGCODEC_MAX_SAMPLES)
+    return false;
+
+  if ((ep->count > 0) && (sample == ep->last)) {
+    n = varint_len(RUN_TOKEN(ep->run + 1));
+    if (ep->run > 0)
+      n -= varint_len(RUN_TOKEN(ep->run));
+    if (n > LOGCODEC_PAYLOAD_SIZE - ep->used)
+      return false;
+    ep->used += n;
+    ep->run++;
+    ep->count++;
+    return true;
+  }
+
+  if (ep->count == 0)
+    v = sample;
+  else
+    v = DELTA_TOKEN((int32_t)sample - (int32_t)ep->last);
+  n = varint_len(v);
+  if (n > LOGCODEC_PAYLOAD_SIZE - ep->used)
+    return false;
+  put_run(ep);
+  ep->run = 0;
+  put_varint(&ep->page[LOGCODEC_HEADER_SIZE + ep->used], v);
+  ep->used += n;
+  ep->count++;
+  ep->last = sample;
+  return true;
+}
+
+/**
+ * @brief   Fills the page header.
+ * @details The unused payload tail stays zero, appending after this call
+ *          is allowed.
+ *
+ * @param[in,out] ep    the encoder state
+ * @param[in] seq       the page sequence number
+ * @return              The page image, @p LOGCODEC_PAGE_SIZE bytes.
+ */
+const uint8_t *logcodecFinish(logcodec_encoder_t *ep, uint16_t seq) {
+
+  put_run(ep);
+  ep->page[HDR_SEQ]     = (uint8_t)seq;
+  ep->page[HDR_SEQ + 1] = (uint8_t)(seq >> 8);
+  ep->page[HDR_COUNT]   = ep->count;
+  ep->page[HDR_CRC]     = 0;
+  ep->page[HDR_CRC]     = logcodecCrc8(ep->page, LOGCODEC_PAGE_SIZE);
+  return ep->page;
+}
+
+/**
+ * @brief   Validates a page image.
+ * @note    An erased page, all 0xFF, never validates because its count
+ *          exceeds @p LOGCODEC_MAX_SAMPLES.
+ *
+ * @param[in] page      the page image
+ * @param[out] seqp     the page sequence number, can be @p NULL
+ * @return              The page validity.
+ */
+bool logcodecCheck(const uint8_t *page, uint16_t *seqp) {
+  uint8_t tmp[LOGCODEC_PAGE_SIZE];
+
+  if ((page[HDR_COUNT] == 0) || (page[HDR_COUNT] > LOGCODEC_MAX_SAMPLES))
+    return false;
+  memcpy(tmp, page, sizeof tmp);
+  tmp[HDR_CRC] = 0;
+  if (logcodecCrc8(tmp, sizeof tmp) != page[HDR_CRC])
+    return false;
+  if (seqp != NULL)
+    *seqp = (uint16_t)(page[HDR_SEQ] | (page[HDR_SEQ + 1] << 8));
+  return true;
+}
+
+/**
+ * @brief   Decodes a page image.
+ * @pre     The page has been validated with @p logcodecCheck().
+ *
+ * @param[in] page      the page image
+ * @param[out] out      the decoded samples
+ * @param[in] max       capacity of @p out
+ * @return              The number of decoded samples, zero if the payload
+ *                      is malformed.
+ */
+size_t logcodecDecode(const uint8_t *page, uint16_t *out, size_t max) {
+  const uint8_t *p = &page[LOGCODEC_HEADER_SIZE];
+  size_t avail = LOGCODEC_PAYLOAD_SIZE;
+  size_t i = 0, count = page[HDR_COUNT];
+  uint32_t v;
+  int32_t last = 0;
+
+  if (count > max)
+    count = max;
+  while (i < count) {
+    size_t n = get_varint(p, avail, &v);
+
+    if (n == 0)
+      return 0;
+    p += n;
+    avail -= n;
+    if (i == 0)
+      last = (int32_t)v;
+    else if ((v & 1) == 0)
+      last += unzigzag(v >> 1);
+    else {
+      size_t r = v >> 1;
+
+      while ((r-- > 0) && (i < count - 1))
+        out[i++] = (uint16_t)last;
+    }
+    out[i++] = (uint16_t)last;
+  }
+  return count;
+}
+
+/**
+ * @brief   CRC-8 with the 0x07 polynomial and zero initial value.
+ *
+ * @param[in] data      the data
+ * @param[in] n         number of bytes
+ * @return              The CRC value.
+ */
+uint8_t logcodecCrc8(const uint8_t *data, size_t n) {
+  uint8_t crc = 0;
+
+  while (n-- > 0) {
+    unsigned i;
+
+    crc ^= *data++;
+    for (i = 0; i < 8; i++)
+      crc = (uint8_t)((crc & 0x80) ? (crc << 1) ^ 0x07 : crc << 1);
+  }
+  return crc;
+}
+
+/** @} */
@@ -0,0 +1,95 @@
+/*
+    ChibiOS - Copyright (C) 2006..2015 Giovanni Di Sirio
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+/**
+ * @file    logcodec.h
+ * @brief   Log page codec header.
+ * @note    This module does not depend on the RTOS or the HAL.
+ *
+ * @addtogroup LOGCODEC
+ * @{
+ */
+
+#ifndef _LOGCODEC_H_
+#define _LOGCODEC_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*===========================================================================*/
+/* Module constants.                                                         */
+/*===========================================================================*/
+
+/**
+ * @name    Page layout
+ * @details A page is a 4 bytes header followed by the payload, the header
+ *          is the little endian sequence number, the samples count and a
+ *          CRC-8 of the whole page with the CRC byte taken as zero.
+ *          The payload is the first sample as a varint followed by varint
+ *          tokens, an even token is a zigzag delta shifted left by one, an
+ *          odd token is a run of zero deltas, its length minus one shifted
+ *          left by one.
+ * @{
+ */
+#define LOGCODEC_PAGE_SIZE          32
+#define LOGCODEC_HEADER_SIZE        4
+#define LOGCODEC_PAYLOAD_SIZE       (LOGCODEC_PAGE_SIZE - LOGCODEC_HEADER_SIZE)
+/** @} */
+
+/**
+ * @brief   Maximum number of samples in a page.
+ * @note    An erased page count, 0xFF, is out of range.
+ */
+#define LOGCODEC_MAX_SAMPLES        254
+
+/*===========================================================================*/
+/* Module data structures and types.                                         */
+/*===========================================================================*/
+
+/**
+ * @brief   Page encoder state.
+ */
+typedef struct {
+  uint8_t               page[LOGCODEC_PAGE_SIZE];   /**< @brief Page image. */
+  size_t                used;               /**< @brief Payload bytes used,
+                                                 pending run included.      */
+  uint8_t               count;              /**< @brief Samples in page.    */
+  uint8_t               run;                /**< @brief Pending run of zero
+                                                 deltas.                    */
+  uint16_t              last;               /**< @brief Last sample.        */
+} logcodec_encoder_t;
+
+/*===========================================================================*/
+/* External declarations.                                                    */
+/*===========================================================================*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+  void logcodecReset(logcodec_encoder_t *ep);
+  bool logcodecAppend(logcodec_encoder_t *ep, uint16_t sample);
+  const uint8_t *logcodecFinish(logcodec_encoder_t *ep, uint16_t seq);
+  bool logcodecCheck(const uint8_t *page, uint16_t *seqp);
+  size_t logcodecDecode(const uint8_t *page, uint16_t *out, size_t max);
+  uint8_t logcodecCrc8(const uint8_t *data, size_t n);
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _LOGCODEC_H_ */
+
+/** @} */
@@ -15,6 +15,7 @@
 */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "ch.h"
@@ -23,67 +24,212 @@
 
 #include "shell.h"
 #include "chprintf.h"
+#include "shellcmds_hash.h"
 
+#include "usbcfg.h"
+#include "serialdma.h"
+#include "status.h"
+#include "acquire.h"
+#include "dspbench.h"
+#include "datalog.h"
+#include "wear.h"
+#include "params.h"
+#include "eeimage.h"
+#include "metrics.h"
+#include "schedtrace.h"
+#include "clock.h"
+#include "dsp.h"
+#include "rambench.h"
+#include "cppbench.h"
+
+
+/*===========================================================================*/
+/* EEPROM related.                                                           */
+/*===========================================================================*/
+
+/*
+ * Maximum AT25320 SCK frequency, the prescaler is recomputed on clock
+ * profile switches.
+ */
+#define AT25_SPI_FREQUENCY      2250000
+
+/*
+ * SPI3 bus, shared by the devices on PC10-PC12.
+ */
+static SPIBus SPIBUS3;
+
+/*
+ * AT25320 on SPI3, mode 0 at PCLK1/16 (2.25MHz), chip select on PA4.
+ */
+static SPIConfig at25_spicfg = {
+  NULL,
+  GPIOA,
+  GPIOA_EEPROM_CS,
+  SPI_CR1_BR_1 | SPI_CR1_BR_0
+};
+
+static const AT25Config at25_cfg = {
+  &AT25320_GEOMETRY,
+  &SPIBUS3,
+  &at25_spicfg,
+  "eeprom"
+};
+
+static AT25Driver AT25D1;
+
+/*
+ * The upper quarter of the AT25320 (0C00-0FFF) holds the calibration data,
+ * the parameters records of params.h, it is protected at every startup and
+ * can be unlocked with "eeprom protect none" for an update.
+ */
+#define AT25_CALIBRATION_PROTECTION AT25_PROTECT_QUARTER
+
+/*
+ * Interval of the wear counters store checks made by the main thread.
+ */
+#define WEAR_POLL_INTERVAL      S2ST(10)
+
+#if WEAR_BASE < DATALOG_BASE + (DATALOG_NUM_PAGES + 1) * LOGCODEC_PAGE_SIZE
+#error "the wear counters region overlaps the data log"
+#endif
+
+/*
+ * Storage seen by the data logger. More devices are added with their own
+ * AT25Config, a chip select on a free pin (e.g. GPIOA_PA15, set as push-pull
+ * output high in board.h) and an entry here, AT25_ARRAY_STRIPED overlaps
+ * the write cycles of devices sharing the same page size.
+ */
+static AT25Driver * const at25_devices[] = {&AT25D1};
+
+static const AT25ArrayConfig at25_arraycfg = {
+  at25_devices,
+  sizeof at25_devices / sizeof at25_devices[0],
+  AT25_ARRAY_LINEAR
+};
+
+static AT25Array AT25A1;
+
+/*===========================================================================*/
+/* Clock profiles related.                                                   */
+/*===========================================================================*/
+
+/*
+ * Waits for the serial shell output to be fully transmitted, a baud rate
+ * change would garble the characters in flight.
+ */
+static void serial_drain(BaseSequentialStream *chp) {
+
+  if (chp != (BaseSequentialStream *)&SDD2)
+    return;
+  while (!oqIsEmptyI(&SDD2.oqueue))
+    chThdSleepMilliseconds(1);
+  while ((USART2->SR & USART_SR_TC) == 0)
+    ;
+}
+
+/*
+ * Switches clock profile, the USB driver is stopped while the profile has
+ * no USB clock and the EEPROM SCK is kept at its frequency. The ADC clock
+ * changes with the profile, a running acquisition is stopped across the
+ * switch and restarted so its counters and rate refer to the new clock.
+ */
+static void clock_switch(clockprofile_t profile) {
+  const clock_profile_t *cp = clockGetProfile(profile);
+  bool acquiring = ADCD1.state != ADC_STOP;
+
+  if (acquiring)
+    acqStop();
+  if (!cp->usb && (serusbcfg.usbp->state != USB_STOP)) {
+    usbDisconnectBus(serusbcfg.usbp);
+    usbStop(serusbcfg.usbp);
+    statusClear(STATUS_USB_ACTIVE);
+  }
+  spiAcquireBus(&SPID3);
+  clockSetProfile(profile);
+  at25_spicfg.cr1 = (uint16_t)clockSpiBr(cp->pclk1, AT25_SPI_FREQUENCY);
+  spiReleaseBus(&SPID3);
+  if (cp->usb && (serusbcfg.usbp->state == USB_STOP)) {
+    usbStart(serusbcfg.usbp, &usbcfg);
+    usbConnectBus(serusbcfg.usbp);
+  }
+  if (acquiring)
+    acqStart();
+}
 
 /*===========================================================================*/
 /* Command line related.                                                     */
 /*===========================================================================*/
 
-#define SHELL_WA_SIZE   THD_WORKING_AREA_SIZE(2048)
 #define TEST_WA_SIZE    THD_WORKING_AREA_SIZE(256)
+#define SPIBULK_WA_SIZE THD_WORKING_AREA_SIZE(256)
+
+/*
+ * Number of urgent reads of the SPI bench and their interval.
+ */
+#define SPI_BENCH_PROBES        50
+#define SPI_BENCH_INTERVAL_MS   7
 
-static void cmd_mem(BaseSequentialStream *chp, int argc, char *argv[]) {
+static msg_t cmd_mem(BaseSequentialStream *chp, int argc, char *argv[]) {
   size_t n, size;
 
   (void)argv;
   if (argc > 0) {
     chprintf(chp, "Usage: mem\r\n");
-    return;
+    return MSG_RESET;
   }
   n = chHeapStatus(NULL, &size);
   chprintf(chp, "core free memory : %u bytes\r\n", chCoreGetStatusX());
   chprintf(chp, "heap fragments   : %u\r\n", n);
   chprintf(chp, "heap free total  : %u bytes\r\n", size);
+  return MSG_OK;
 }
 
-static void cmd_threads(BaseSequentialStream *chp, int argc, char *argv[]) {
+static msg_t cmd_threads(BaseSequentialStream *chp, int argc, char *argv[]) {
   static const char *states[] = {CH_STATE_NAMES};
   thread_t *tp;
 
   (void)argv;
   if (argc > 0) {
     chprintf(chp, "Usage: threads\r\n");
-    return;
+    return MSG_RESET;
   }
-  chprintf(chp, "    addr    stack prio refs     state\r\n");
+  chprintf(chp, "    addr    stack prio refs     state  ticks name\r\n");
   tp = chRegFirstThread();
   do {
-    chprintf(chp, "%08lx %08lx %4lu %4lu %9s\r\n",
+    chprintf(chp, "%08lx %08lx %4lu %4lu %9s %6lu %s\r\n",
             (uint32_t)tp, (uint32_t)tp->p_ctx.r13,
             (uint32_t)tp->p_prio, (uint32_t)(tp->p_refs - 1),
-            states[tp->p_state]);
+            states[tp->p_state], (uint32_t)tp->p_time,
+            tp->p_name != NULL ? tp->p_name : "");
     tp = chRegNextThread(tp);
   } while (tp != NULL);
+  return MSG_OK;
 }
 
-static void cmd_test(BaseSequentialStream *chp, int argc, char *argv[]) {
+static msg_t cmd_test(BaseSequentialStream *chp, int argc, char *argv[]) {
   thread_t *tp;
 
   (void)argv;
   if (argc > 0) {
     chprintf(chp, "Usage: test\r\n");
-    return;
+    return MSG_RESET;
   }
   tp = chThdCreateFromHeap(NULL, TEST_WA_SIZE, chThdGetPriorityX(),
                            TestThread, chp);
   if (tp == NULL) {
     chprintf(chp, "out of memory\r\n");
-    return;
+    return MSG_RESET;
   }
-  chThdWait(tp);
+  /* The test thread exits with the global failure flag.*/
+  return chThdWait(tp) == 0 ? MSG_OK : MSG_RESET;
 }
 
-static void cmd_write(BaseSequentialStream *chp, int argc, char *argv[]) {
+/*
+ * Bytes written between two key checks by "write", 32 ms at 38400 baud.
+ */
+#define WRITE_CHUNK_SIZE 128
+
+static msg_t cmd_write(BaseSequentialStream *chp, int argc, char *argv[]) {
   static uint8_t buf[] =
       "0123456789abcdef0123456789abcdef0123456789abcdef0123456789abcdef"
       "0123456789abcdef0123456789abcdef0123456789abcdef0123456789abcdef"
@@ -102,34 +248,592 @@ static void cmd_write(BaseSequentialStream *chp, int argc, char *argv[]) {
       "0123456789abcdef0123456789abcdef0123456789abcdef0123456789abcdef"
       "0123456789abcdef0123456789abcdef0123456789abcdef0123456789abcdef";
 
+  uint32_t total, ms;
+  systime_t start;
+  size_t offset;
+
   (void)argv;
   if (argc > 0) {
     chprintf(chp, "Usage: write\r\n");
-    return;
+    return MSG_RESET;
   }
 
-  while (chnGetTimeout((BaseChannel *)chp, TIME_IMMEDIATE) == Q_TIMEOUT) {
-    chSequentialStreamWrite(chp, buf, sizeof buf - 1);
+  /* The pattern goes out in WRITE_CHUNK_SIZE pieces, a key press stops the
+     stream after the piece being written.*/
+  total = 0;
+  offset = 0;
+  start = chVTGetSystemTimeX();
+  while (!shellInterrupted(chp)) {
+    total += chSequentialStreamWrite(chp, buf + offset, WRITE_CHUNK_SIZE);
+    offset = (offset + WRITE_CHUNK_SIZE) % (sizeof buf - 1);
   }
+  ms = ST2MS(chVTTimeElapsedSinceX(start));
   chprintf(chp, "\r\n\nstopped\r\n");
+  chprintf(chp, "%s: %lu bytes in %lu ms, %lu bytes/s\r\n",
+           chp == (BaseSequentialStream *)&SDU1 ? "usb" : "serial",
+           total, ms, ms > 0 ? (uint32_t)(((uint64_t)total * 1000) / ms) : 0);
+  return MSG_OK;
+}
+
+static msg_t cmd_status(BaseSequentialStream *chp, int argc, char *argv[]) {
+  uint32_t w0, w1;
+
+  (void)argv;
+  if (argc > 0) {
+    chprintf(chp, "Usage: status\r\n");
+    return MSG_RESET;
+  }
+  w0 = statusGetWakeups();
+  chThdSleepMilliseconds(2000);
+  w1 = statusGetWakeups();
+  chprintf(chp, "flags            : %08lx\r\n", (uint32_t)statusGetFlags());
+  chprintf(chp, "pattern          : %04x, %u ms steps\r\n",
+           statusGetPattern(), STATUS_STEP_MS);
+  chprintf(chp, "led wakeups/s    : %lu.%lu\r\n",
+           (w1 - w0) / 2, ((w1 - w0) % 2) * 5);
+  return MSG_OK;
+}
+
+static msg_t cmd_adc(BaseSequentialStream *chp, int argc, char *argv[]) {
+  acq_status_t st;
+  uint32_t ms, rate, mv;
+  int32_t counts;
+
+  if (argc == 1) {
+    if (strcmp(argv[0], "start") == 0) {
+      acqStart();
+      return MSG_OK;
+    }
+    if (strcmp(argv[0], "stop") == 0) {
+      acqStop();
+      return MSG_OK;
+    }
+  }
+  if (argc > 0) {
+    chprintf(chp, "Usage: adc [start|stop]\r\n");
+    return MSG_RESET;
+  }
+  acqGetStatus(&st);
+  ms = ST2MS(chVTTimeElapsedSinceX(st.start));
+  rate = ms > 0 ? (uint32_t)(((uint64_t)(st.blocks + st.dropped) *
+                              ACQ_BLOCK_SIZE * 1000) / ms) : 0;
+  chprintf(chp, "sample rate      : %lu S/s\r\n", rate);
+  chprintf(chp, "blocks           : %lu\r\n", st.blocks);
+  chprintf(chp, "dropped blocks   : %lu\r\n", st.dropped);
+  chprintf(chp, "errors           : %lu\r\n", st.errors);
+  chprintf(chp, "cycles/sample    : %lu\r\n",
+           (uint32_t)st.cycles / ACQ_BLOCK_SIZE);
+  chprintf(chp, "min/max/mean/rms : %u %u %u %u\r\n",
+           st.stats.min, st.stats.max, st.stats.mean, st.stats.rms);
+
+  /* Mean converted with the calibration parameters, gain in 1/4096.*/
+  counts = (int32_t)st.stats.mean - param_get_adc_offset();
+  if (counts < 0)
+    counts = 0;
+  mv = (((uint32_t)counts * param_get_adc_gain()) / 4096) *
+       param_get_vref_mv() / 4096;
+  chprintf(chp, "mean voltage     : %lu mV\r\n", mv);
+  return MSG_OK;
+}
+
+static msg_t cmd_dsp(BaseSequentialStream *chp, int argc, char *argv[]) {
+
+  (void)argv;
+  if (argc > 0) {
+    chprintf(chp, "Usage: dsp\r\n");
+    return MSG_RESET;
+  }
+  dspbenchRun(chp);
+  return MSG_OK;
+}
+
+static msg_t cmd_ram(BaseSequentialStream *chp, int argc, char *argv[]) {
+
+  (void)argv;
+  if (argc > 0) {
+    chprintf(chp, "Usage: ram\r\n");
+    return MSG_RESET;
+  }
+  rambenchRun(chp);
+  return MSG_OK;
+}
+
+static msg_t cmd_cpp(BaseSequentialStream *chp, int argc, char *argv[]) {
+
+  (void)argv;
+  if (argc > 0) {
+    chprintf(chp, "Usage: cpp\r\n");
+    return MSG_RESET;
+  }
+  cppbenchRun(chp, &AT25D1);
+  return MSG_OK;
+}
+
+static msg_t cmd_log(BaseSequentialStream *chp, int argc, char *argv[]) {
+
+  if ((argc == 1) && (strcmp(argv[0], "clear") == 0)) {
+    if (datalogClear() != MSG_OK) {
+      chprintf(chp, "clear failed\r\n");
+      return MSG_RESET;
+    }
+    return MSG_OK;
+  }
+  if (argc > 0) {
+    chprintf(chp, "Usage: log [clear]\r\n");
+    return MSG_RESET;
+  }
+  datalogDump(chp);
+  return MSG_OK;
+}
+
+/*
+ * Bulk reader of the SPI bench, it dumps the whole EEPROM below the shell
+ * priority until terminated.
+ */
+static uint32_t spi_bulk_dumps;
+static rtcnt_t spi_bulk_cycles;
+
+static THD_FUNCTION(SpiBulk, arg) {
+  uint8_t *buf = arg;
+
+  chRegSetThreadName("spibulk");
+  while (!chThdShouldTerminateX()) {
+    rtcnt_t start = chSysGetRealtimeCounterX();
+
+    (void)at25Read(&AT25D1, 0, buf, at25GetSize(&AT25D1));
+    spi_bulk_cycles = chSysGetRealtimeCounterX() - start;
+    spi_bulk_dumps++;
+  }
+}
+
+/*
+ * Latency of short reads issued by the shell while a lower priority thread
+ * keeps the EEPROM busy with full dumps, a read waits for one chunk at
+ * most instead of a whole dump.
+ */
+static msg_t spi_bench(BaseSequentialStream *chp) {
+  uint32_t mhz = clockGetCurrentProfile()->hclk / 1000000;
+  rtcnt_t start, cycles, worst = 0, total = 0;
+  uint8_t record[8], *buf;
+  thread_t *tp;
+  unsigned i;
+
+  buf = chHeapAlloc(NULL, at25GetSize(&AT25D1));
+  if (buf == NULL) {
+    chprintf(chp, "out of memory\r\n");
+    return MSG_RESET;
+  }
+  spi_bulk_dumps = 0;
+  tp = chThdCreateFromHeap(NULL, SPIBULK_WA_SIZE, chThdGetPriorityX() - 2,
+                           SpiBulk, buf);
+  if (tp == NULL) {
+    chHeapFree(buf);
+    chprintf(chp, "out of memory\r\n");
+    return MSG_RESET;
+  }
+  for (i = 0; i < SPI_BENCH_PROBES; i++) {
+    chThdSleepMilliseconds(SPI_BENCH_INTERVAL_MS);
+    start = chSysGetRealtimeCounterX();
+    (void)at25Read(&AT25D1, at25GetSize(&AT25D1) / 2, record, sizeof record);
+    cycles = chSysGetRealtimeCounterX() - start;
+    total += cycles;
+    if (cycles > worst)
+      worst = cycles;
+  }
+  chThdTerminate(tp);
+  chThdWait(tp);
+  chHeapFree(buf);
+
+  chprintf(chp, "bulk %lu bytes: %lu dumps, %lu us each\r\n",
+           at25GetSize(&AT25D1), spi_bulk_dumps, spi_bulk_cycles / mhz);
+  chprintf(chp, "urgent %u bytes: %u reads, %lu us average, %lu us worst "
+                "(chunk %u bytes)\r\n",
+           sizeof record, SPI_BENCH_PROBES,
+           total / SPI_BENCH_PROBES / mhz, worst / mhz, SPIBUS_CHUNK_SIZE);
+  return MSG_OK;
+}
+
+static msg_t cmd_spi(BaseSequentialStream *chp, int argc, char *argv[]) {
+
+  if ((argc == 1) && (strcmp(argv[0], "reset") == 0)) {
+    spibusResetStats(&SPIBUS3);
+    at25ResetStats(&AT25D1);
+    return MSG_OK;
+  }
+  if ((argc == 1) && (strcmp(argv[0], "bench") == 0)) {
+    return spi_bench(chp);
+  }
+  if (argc > 0) {
+    chprintf(chp, "Usage: spi [reset|bench]\r\n");
+    return MSG_RESET;
+  }
+  spibusDump(chp, &SPIBUS3);
+  chprintf(chp, "eeprom read-ahead %u bytes: %lu hits, %lu misses\r\n",
+           AT25_READAHEAD_SIZE, AT25D1.hits, AT25D1.misses);
+  return MSG_OK;
+}
+
+static msg_t cmd_wear(BaseSequentialStream *chp, int argc, char *argv[]) {
+
+  if ((argc == 1) && (strcmp(argv[0], "flush") == 0)) {
+    if (wearFlush() != MSG_OK) {
+      chprintf(chp, "store failed\r\n");
+      return MSG_RESET;
+    }
+    return MSG_OK;
+  }
+  if (argc > 0) {
+    chprintf(chp, "Usage: wear [flush]\r\n");
+    return MSG_RESET;
+  }
+  wearDump(chp);
+  return MSG_OK;
+}
+
+static msg_t cmd_param(BaseSequentialStream *chp, int argc, char *argv[]) {
+
+  if ((argc == 3) && (strcmp(argv[0], "set") == 0)) {
+    if (!paramsSetByName(argv[1], argv[2])) {
+      chprintf(chp, "unknown parameter or value out of range\r\n");
+      return MSG_RESET;
+    }
+    return MSG_OK;
+  }
+  if ((argc == 1) && (strcmp(argv[0], "commit") == 0)) {
+    if (paramsCommit() != MSG_OK) {
+      chprintf(chp, "commit failed, unlock with \"eeprom protect none\"\r\n");
+      return MSG_RESET;
+    }
+    return MSG_OK;
+  }
+  if ((argc == 1) && (strcmp(argv[0], "defaults") == 0)) {
+    paramsLoadDefaults();
+    return MSG_OK;
+  }
+  if (argc > 0) {
+    chprintf(chp, "Usage: param [set <name> <value>|commit|defaults]\r\n");
+    return MSG_RESET;
+  }
+  paramsDump(chp);
+  return MSG_OK;
+}
+
+static msg_t cmd_metrics(BaseSequentialStream *chp, int argc, char *argv[]) {
+
+  if ((argc == 1) && (strcmp(argv[0], "export") == 0)) {
+    metricsExport(chp);
+    return MSG_OK;
+  }
+  if ((argc > 1) || ((argc == 1) && (atoi(argv[0]) <= 0))) {
+    chprintf(chp, "Usage: metrics [seconds|export]\r\n");
+    return MSG_RESET;
+  }
+  metricsDump(chp, argc == 1 ? (unsigned)atoi(argv[0]) : 0);
+  return MSG_OK;
+}
+
+static msg_t cmd_trace(BaseSequentialStream *chp, int argc, char *argv[]) {
+  schedtrace_status_t st;
+
+  if ((argc == 1) && (strcmp(argv[0], "start") == 0)) {
+    schedtraceStart();
+    return MSG_OK;
+  }
+  if ((argc == 1) && (strcmp(argv[0], "stop") == 0)) {
+    schedtraceStop();
+    return MSG_OK;
+  }
+  if ((argc == 1) && (strcmp(argv[0], "export") == 0)) {
+    schedtraceExport(chp);
+    return MSG_OK;
+  }
+  if (argc > 0) {
+    chprintf(chp, "Usage: trace [start|stop|export]\r\n");
+    return MSG_RESET;
+  }
+  schedtraceGetStatus(&st);
+  chprintf(chp, "%u/%u switches, %u threads, %lu us, %s\r\n",
+           st.events, SCHEDTRACE_SIZE, st.threads,
+           st.span / (clockGetCurrentProfile()->hclk / 1000000),
+           st.running ? "recording" : "stopped");
+  return MSG_OK;
+}
+
+/*
+ * Pattern of "serial sink", a byte counter with its high byte folded in so
+ * that the loss of a multiple of 256 bytes is detected too.
+ */
+#define SINK_BYTE(i)            ((uint8_t)((i) ^ ((i) >> 8)))
+#define SINK_TIMEOUT            MS2ST(2000)
+
+static void serial_stats(BaseSequentialStream *chp) {
+  sdma_stats_t st;
+
+  sdmaGetStats(&SDD2, &st);
+  chprintf(chp, "received         : %lu bytes, %lu bursts\r\n",
+           st.rx_bytes, st.rx_idle);
+  chprintf(chp, "queue peak       : %u/%u bytes\r\n",
+           st.rx_peak, SERIALDMA_RX_BUFFER_SIZE);
+  chprintf(chp, "lost             : %lu bytes\r\n", st.rx_lost);
+  chprintf(chp, "overrun/framing  : %lu/%lu\r\n", st.overruns, st.framing);
+  chprintf(chp, "noise/parity     : %lu/%lu\r\n", st.noise, st.parity);
+}
+
+/*
+ * Receives a pattern stream from the host and checks it, the time runs
+ * from the first byte. A stream stalled for SINK_TIMEOUT ends the test.
+ */
+static msg_t serial_sink(BaseSequentialStream *chp, uint32_t total) {
+  static uint8_t buf[128];
+  sdma_stats_t st0, st1;
+  uint32_t i, bad, first_bad, ms;
+  systime_t start;
+  msg_t b;
+  size_t k, n;
+
+  sdmaGetStats(&SDD2, &st0);
+  chprintf(chp, "ready\r\n");
+  b = chnGetTimeout((BaseChannel *)chp, SINK_TIMEOUT * 5);
+  if (b < Q_OK) {
+    chprintf(chp, "no data\r\n");
+    return MSG_RESET;
+  }
+  start = chVTGetSystemTimeX();
+  bad = (uint8_t)b != SINK_BYTE(0U) ? 1 : 0;
+  first_bad = bad ? 0 : total;
+  i = 1;
+  while (i < total) {
+    n = chnReadTimeout((BaseChannel *)chp, buf,
+                       total - i < sizeof buf ? total - i : sizeof buf,
+                       SINK_TIMEOUT);
+    if (n == 0)
+      break;
+    for (k = 0; k < n; k++) {
+      if (buf[k] != SINK_BYTE(i + k)) {
+        if (bad++ == 0)
+          first_bad = i + k;
+      }
+    }
+    i += n;
+  }
+  ms = ST2MS(chVTTimeElapsedSinceX(start));
+  sdmaGetStats(&SDD2, &st1);
+  chprintf(chp, "%lu/%lu bytes in %lu ms, %lu bytes/s\r\n", i, total, ms,
+           ms > 0 ? (uint32_t)(((uint64_t)i * 1000) / ms) : 0);
+  if (bad > 0)
+    chprintf(chp, "%lu bytes differ, first at %lu\r\n", bad, first_bad);
+  if (chp == (BaseSequentialStream *)&SDD2)
+    chprintf(chp, "lost %lu, overruns %lu, framing %lu\r\n",
+             st1.rx_lost - st0.rx_lost, st1.overruns - st0.overruns,
+             st1.framing - st0.framing);
+  return (i < total) || (bad > 0) ? MSG_RESET : MSG_OK;
+}
+
+static msg_t cmd_serial(BaseSequentialStream *chp, int argc, char *argv[]) {
+  uint32_t n;
+
+  if ((argc == 1) && (strcmp(argv[0], "reset") == 0)) {
+    sdmaResetStats(&SDD2);
+    return MSG_OK;
+  }
+  if ((argc == 2) && (strcmp(argv[0], "sink") == 0)) {
+    n = strtoul(argv[1], NULL, 0);
+    if (n > 0) {
+      return serial_sink(chp, n);
+    }
+  }
+  if ((argc == 2) && (strcmp(argv[0], "baud") == 0)) {
+    n = strtoul(argv[1], NULL, 0);
+    if (chp != (BaseSequentialStream *)&SDD2) {
+      chprintf(chp, "use the serial shell\r\n");
+      return MSG_RESET;
+    }
+    if ((n >= 1200) && (n <= clockGetCurrentProfile()->pclk1 / 16)) {
+      chprintf(chp, "%lu baud\r\n", n);
+      serial_drain(chp);
+      sdmaSetSpeed(&SDD2, n);
+      return MSG_OK;
+    }
+  }
+  if (argc > 0) {
+    chprintf(chp, "Usage: serial [reset|sink <bytes>|baud <rate>]\r\n");
+    return MSG_RESET;
+  }
+  serial_stats(chp);
+  return MSG_OK;
+}
+
+/*
+ * Image transfer of "eeprom load|dump [<base> <size>]", the whole device
+ * by default. The report follows the binary exchange.
+ */
+static msg_t eeprom_image(BaseSequentialStream *chp, bool load,
+                         int argc, char *argv[]) {
+  static const char *reasons[] = {"", "timeout", "device error",
+                                  "verify failed", "cancelled",
+                                  "too many errors"};
+  eeimage_stats_t st;
+  uint32_t base = 0, size = at25GetSize(&AT25D1);
+  msg_t msg;
+
+  if (argc == 2) {
+    base = strtoul(argv[0], NULL, 0);
+    size = strtoul(argv[1], NULL, 0);
+  }
+  if (load)
+    msg = eeimageLoad((BaseChannel *)chp, &AT25D1, base, size, &st);
+  else
+    msg = eeimageDump((BaseChannel *)chp, &AT25D1, base, size, &st);
+  if (st.error != 0) {
+    chprintf(chp, "\r\naborted, %s\r\n", reasons[st.error]);
+    return MSG_RESET;
+  }
+  if (msg != MSG_OK) {
+    chprintf(chp, "invalid or protected range\r\n");
+    return MSG_RESET;
+  }
+  chprintf(chp, "\r\n%s %lu bytes in %lu ms, %lu bytes/s\r\n",
+           load ? "loaded" : "dumped", st.bytes, st.time_ms,
+           st.time_ms > 0 ? (st.bytes * 1000) / st.time_ms : 0);
+  if (load)
+    chprintf(chp, "link wait %lu ms, programs %lu ms, naks %lu, "
+                  "bad frames %lu, timeouts %lu\r\n",
+             st.wait_ms, st.program_ms, st.naks, st.bad_frames,
+             st.timeouts);
+  return MSG_OK;
+}
+
+static msg_t cmd_eeprom(BaseSequentialStream *chp, int argc, char *argv[]) {
+  static const char *levels[] = {"none", "quarter", "half", "all"};
+  at25protect_t level;
+  uint8_t sr;
+
+  if (((argc == 1) || (argc == 3)) &&
+      ((strcmp(argv[0], "load") == 0) || (strcmp(argv[0], "dump") == 0))) {
+    return eeprom_image(chp, argv[0][0] == 'l', argc - 1, argv + 1);
+  }
+  if ((argc == 2) && (strcmp(argv[0], "protect") == 0)) {
+    for (level = AT25_PROTECT_NONE; level <= AT25_PROTECT_ALL; level++) {
+      if (strcmp(argv[1], levels[level]) == 0)
+        break;
+    }
+    if (level <= AT25_PROTECT_ALL) {
+      if (at25SetProtection(&AT25D1, level) != MSG_OK) {
+        chprintf(chp, "status write failed\r\n");
+        return MSG_RESET;
+      }
+      return MSG_OK;
+    }
+  }
+  if (argc > 0) {
+    chprintf(chp, "Usage: eeprom [protect none|quarter|half|all]\r\n"
+                  "       eeprom load|dump [<base> <size>]\r\n");
+    return MSG_RESET;
+  }
+  (void)at25ReadStatus(&AT25D1, &sr);
+  chprintf(chp, "%s %lu bytes, page %lu, status %02x\r\n",
+           at25_cfg.geometry->name, at25GetSize(&AT25D1),
+           at25GetPageSize(&AT25D1), sr);
+  chprintf(chp, "protected %s from %04lx\r\n",
+           levels[at25GetProtection(&AT25D1)],
+           at25GetProtectedBase(&AT25D1));
+  chprintf(chp, "page programs %lu, skipped %lu\r\n",
+           AT25D1.programs, AT25D1.skipped);
+  return MSG_OK;
+}
+
+/*
+ * Cycles spent on a CRC32 of 1KB of flash, the flash wait states of the
+ * profile show in the cycle count.
+ */
+static rtcnt_t clock_workload(void) {
+  rtcnt_t start = chSysGetRealtimeCounterX();
+
+  (void)dspCrc32(0, (const void *)0x08000000, 1024);
+  return chSysGetRealtimeCounterX() - start;
+}
+
+static void clock_report(BaseSequentialStream *chp, clockprofile_t profile) {
+  const clock_profile_t *cp = clockGetProfile(profile);
+  uint32_t cpms = clockMeasure();
+  rtcnt_t cycles = clock_workload();
+
+  chprintf(chp, "%-8s %2lu MHz  %6lu cycles/ms  crc32 1KB %6lu cycles "
+                "%5lu us\r\n",
+           cp->name, cp->hclk / 1000000, cpms, cycles,
+           cpms > 0 ? (cycles * 1000) / cpms : 0);
+}
+
+static msg_t cmd_clock(BaseSequentialStream *chp, int argc, char *argv[]) {
+  bool usb_shell = chp == (BaseSequentialStream *)&SDU1;
+  clockprofile_t p, saved;
+
+  if (argc == 0) {
+    clock_report(chp, clockGetCurrent());
+    return MSG_OK;
+  }
+  if ((argc == 1) && (strcmp(argv[0], "bench") == 0)) {
+    saved = clockGetCurrent();
+    for (p = CLOCK_FULL; p < CLOCK_NUM_PROFILES; p++) {
+      if (usb_shell && !clockGetProfile(p)->usb)
+        continue;
+      serial_drain(chp);
+      clock_switch(p);
+      clock_report(chp, p);
+    }
+    serial_drain(chp);
+    clock_switch(saved);
+    return MSG_OK;
+  }
+  if (argc == 1) {
+    for (p = CLOCK_FULL; p < CLOCK_NUM_PROFILES; p++) {
+      if (strcmp(argv[0], clockGetProfile(p)->name) == 0)
+        break;
+    }
+    if (p < CLOCK_NUM_PROFILES) {
+      if (usb_shell && !clockGetProfile(p)->usb) {
+        chprintf(chp, "no USB clock in this profile, use the serial "
+                      "shell\r\n");
+        return MSG_RESET;
+      }
+      serial_drain(chp);
+      clock_switch(p);
+      return MSG_OK;
+    }
+  }
+  chprintf(chp, "Usage: clock [full|reduced|hsi|bench]\r\n");
+  return MSG_RESET;
 }
 
 static const ShellCommand commands[] = {
-  {"mem", cmd_mem},
-  {"threads", cmd_threads},
-  {"test", cmd_test},
-  {"write", cmd_write},
-  {NULL, NULL}
+#define SHELL_COMMAND(name, function) {#name, function, 0},
+#define SHELL_LONG_COMMAND(name, function) {#name, function, SHELL_FLAG_LONG},
+#include "shellcmds.h"
+#undef SHELL_COMMAND
+#undef SHELL_LONG_COMMAND
+  {NULL, NULL, 0}
 };
 
+SHELL_HASH_TABLE(commands_hash, commands);
+
 static const ShellConfig shell_cfg1 = {
-  (BaseSequentialStream *)&SD2,
-  commands
+  (BaseSequentialStream *)&SDD2,
+  commands,
+  &commands_hash
+};
+
+static const ShellConfig shell_cfg2 = {
+  (BaseSequentialStream *)&SDU1,
+  commands,
+  &commands_hash
 };
 
-SerialConfig    Shell_SerialCfg = {
+static ShellSession serial_session;
+static ShellSession usb_session;
+
+SerialDMAConfig Shell_SerialCfg = {
     /*speed*/ 38400,
-    /*cr1*/   USART_CR1_UE | USART_CR1_RE,
+    /*cr1*/   0,
     /*cr2*/   USART_CR2_STOP1_BITS,
     /*cr3*/   0 /*USART_CR3_CTSE | USART_CR3_RTSE*/
 };
@@ -138,29 +842,11 @@ SerialConfig    Shell_SerialCfg = {
 /* Generic code.                                                             */
 /*===========================================================================*/
 
-/*
- * Red LED blinker thread, times are in milliseconds.
- */
-static THD_WORKING_AREA(waThread1, 128);
-static THD_FUNCTION(Thread1, arg) {
-
-  (void)arg;
-  chRegSetThreadName("blinker");
-  while (true) {
-    //systime_t time = serusbcfg.usbp->state == USB_ACTIVE ? 250 : 500;
-    systime_t time = 500;
-    palClearPad(GPIOC, GPIOC_LED_STATUS1);
-    chThdSleepMilliseconds(time);
-    palSetPad(GPIOC, GPIOC_LED_STATUS1);
-    chThdSleepMilliseconds(time);
-  }
-}
-
 /*
  * Application entry point.
  */
 int main(void) {
-  thread_t *shelltp = NULL;
+  event_listener_t el0, el1, el2;
 
   /*
    * System initializations.
@@ -173,34 +859,96 @@ int main(void) {
   chSysInit();
 
   /*
-  * Initializes a serial driver for SIM900.
-  */
-  sdStart((SerialDriver *)shell_cfg1.sc_channel,&Shell_SerialCfg);
+   * Status LED, the heartbeat is shown until a state flag is raised.
+   */
+  statusInit();
 
   /*
-   * Shell manager initialization.
+   * Shell manager initialization, a single server thread serves the
+   * sessions of all the transports.
    */
   shellInit();
+  shellServerStart(NORMALPRIO);
 
   /*
-   * Creates the blinker thread.
+   * The main thread only wakes up when a session closes, the USB link
+   * changes state or a metrics sample is taken.
    */
-  chThdCreateStatic(waThread1, sizeof(waThread1), NORMALPRIO, Thread1, NULL);
+  chEvtRegister(&shell_terminated, &el0, 0);
+  chEvtRegisterMaskWithFlags(&status_changed, &el1, EVENT_MASK(1),
+                             STATUS_USB_ACTIVE);
 
-  shelltp = shellCreate(&shell_cfg1, SHELL_WA_SIZE, NORMALPRIO);
   /*
-   * Normal main() thread activity, in this demo it does nothing except
-   * sleeping in a loop and check the button state.
+   * Initializes the USART2 serial driver, the reception is made by DMA.
+   */
+  sdmaInit();
+  sdmaStart(&SDD2, &Shell_SerialCfg);
+
+  /*
+   * Initializes a serial-over-USB CDC driver.
+   */
+  sduObjectInit(&SDU1);
+  sduStart(&SDU1, &serusbcfg);
+
+  /*
+   * System metrics sampling, the heap figures are filled in by this thread.
+   */
+  metricsStart(&SDD2, &SDU1);
+  chEvtRegister(&metrics_sampled, &el2, 2);
+
+  /*
+   * Activates the USB driver and then the USB bus pull-up on D+.
+   * Note, a delay is inserted in order to not have to disconnect the cable
+   * after a reset.
+   */
+  usbDisconnectBus(serusbcfg.usbp);
+  chThdSleepMilliseconds(1500);
+  usbStart(serusbcfg.usbp, &usbcfg);
+  usbConnectBus(serusbcfg.usbp);
+
+  /*
+   * Analog acquisition.
+   */
+  acqStart();
+
+  /*
+   * EEPROM and data logger, a log that cannot be mounted raises the fault
+   * pattern.
+   */
+  spibusObjectInit(&SPIBUS3, &SPID3);
+  at25ObjectInit(&AT25D1);
+  at25Start(&AT25D1, &at25_cfg);
+  if (at25GetProtection(&AT25D1) != AT25_CALIBRATION_PROTECTION)
+    (void)at25SetProtection(&AT25D1, AT25_CALIBRATION_PROTECTION);
+  if (wearStart(&AT25D1) != MSG_OK)
+    statusSet(STATUS_FAULT);
+  if (paramsStart(&AT25D1) != MSG_OK)
+    statusSet(STATUS_FAULT);
+  if ((at25arrayStart(&AT25A1, &at25_arraycfg) != MSG_OK) ||
+      (datalogStart(&AT25A1) != MSG_OK))
+    statusSet(STATUS_FAULT);
+
+  /*
+   * The serial shell runs at the stored rate.
+   */
+  if (param_get_serial_baud() != 0)
+    sdmaSetSpeed(&SDD2, param_get_serial_baud());
+
+  (void)shellOpen(&serial_session, &shell_cfg1);
+  /*
+   * Normal main() thread activity, it reopens the shell sessions when they
+   * close, the USB one only while the host has the device configured,
+   * completes the metrics samples and periodically stores the EEPROM wear
+   * counters when due.
    */
   while (true) {
-#if 0
-    if (!shelltp && (SDU1.config->usbp->state == USB_ACTIVE))
-      shelltp = shellCreate(&shell_cfg1, SHELL_WA_SIZE, NORMALPRIO);
-    else if (chThdTerminatedX(shelltp)) {
-      chThdRelease(shelltp);    /* Recovers memory of the previous shell.   */
-      shelltp = NULL;           /* Triggers spawning of a new shell.        */
-    }
-#endif
-    chThdSleepMilliseconds(1000);
+    chEvtWaitAnyTimeout(ALL_EVENTS, WEAR_POLL_INTERVAL);
+    metricsPoll();
+    wearPoll();
+    if (shellIsClosed(&usb_session) &&
+        (statusGetFlags() & STATUS_USB_ACTIVE))
+      (void)shellOpen(&usb_session, &shell_cfg2);
+    if (shellIsClosed(&serial_session))
+      (void)shellOpen(&serial_session, &shell_cfg1);
   }
 }
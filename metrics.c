@@ -0,0 +1,430 @@
+/*
+    ChibiOS - Copyright (C) 2006..2015 Giovanni Di Sirio
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+/**
+ * @file    metrics.c
+ * @brief   System metrics sampler code.
+ * @details A virtual timer samples the CPU share of the threads, the queue
+ *          depths of the shell channels and the error counters into a RAM
+ *          ring, no thread is involved. The heap cannot be walked from the
+ *          timer callback, its fields are filled by @p metricsPoll() called
+ *          from a thread on the @p metrics_sampled event.
+ *          The timer callback and the heap walks are timed with the DWT
+ *          cycle counter, read by @p chSysGetRealtimeCounterX().
+ *
+ * @addtogroup METRICS
+ * @{
+ */
+
+#include <string.h>
+
+#include "ch.h"
+#include "hal.h"
+#include "chprintf.h"
+
+#include "serialdma.h"
+#include "metrics.h"
+#include "acquire.h"
+#include "clock.h"
+#include "dsp.h"
+
+/*===========================================================================*/
+/* Module local definitions.                                                 */
+/*===========================================================================*/
+
+/* Fields summarized by metricsDump().*/
+#define FIELD_LOAD                  0
+#define FIELD_CORE_FREE             1
+#define FIELD_HEAP_FREE             2
+#define FIELD_HEAP_FRAGS            3
+#define FIELD_SD_IN                 4
+#define FIELD_SD_OUT                5
+#define FIELD_USB_IN                6
+#define FIELD_USB_OUT               7
+#define FIELD_ACQ_DROPPED           8
+#define FIELD_ACQ_ERRORS            9
+#define FIELDS                      10
+
+/*===========================================================================*/
+/* Module exported variables.                                                */
+/*===========================================================================*/
+
+/**
+ * @brief   Broadcast after each sample, the listener calls
+ *          @p metricsPoll().
+ */
+event_source_t metrics_sampled;
+
+/*===========================================================================*/
+/* Module local variables.                                                   */
+/*===========================================================================*/
+
+static SerialDMADriver *metrics_sdp;
+static SerialUSBDriver *metrics_sdup;
+static virtual_timer_t metrics_vt;
+static metrics_sample_t metrics_ring[METRICS_RING_SIZE];
+static unsigned metrics_head;
+static unsigned metrics_count;
+static uint32_t metrics_seq;
+static uint32_t metrics_heap_seq;
+
+/* Thread names owning the CPU slots, NULL for a free slot.*/
+static const char *metrics_names[METRICS_THREADS];
+
+/* Previous values of the cumulative acquisition counters.*/
+static uint32_t metrics_acq_dropped;
+static uint32_t metrics_acq_errors;
+
+/* Sampler cost, cycles spent in the timer callback and in the heap walks.*/
+static uint32_t metrics_cb_cycles;
+static uint32_t metrics_cb_last;
+static uint32_t metrics_cb_max;
+static uint32_t metrics_poll_cycles;
+static uint32_t metrics_polls;
+
+/*===========================================================================*/
+/* Module local functions.                                                   */
+/*===========================================================================*/
+
+static uint8_t sat8(uint32_t n) {
+
+  return n > 0xFFU ? 0xFFU : (uint8_t)n;
+}
+
+static uint16_t sat16(uint32_t n) {
+
+  return n > 0xFFFFU ? 0xFFFFU : (uint16_t)n;
+}
+
+/*
+ * CPU slot of a thread name, the last slot is shared by the unnamed
+ * threads and those arriving once the slots are taken.
+ */
+static unsigned slot_of(const char *name) {
+  unsigned i;
+
+  if (name == NULL)
+    return METRICS_THREADS - 1;
+  for (i = 0; i < METRICS_THREADS - 1; i++) {
+    if (metrics_names[i] == name)
+      return i;
+    if (metrics_names[i] == NULL) {
+      metrics_names[i] = name;
+      return i;
+    }
+  }
+  return METRICS_THREADS - 1;
+}
+
+static void sample_i(void) {
+  metrics_sample_t *msp = &metrics_ring[metrics_head];
+  uint32_t ticks[METRICS_THREADS];
+  uint32_t total = 0, idle = 0, dropped, errors;
+  thread_t *tp;
+  unsigned i;
+
+  /* The registry is walked directly, chRegFirstThread() cannot be called
+     from the timer callback. Each thread keeps its profiling counter at
+     the previous sample in the p_sampled extra field.*/
+  memset(ticks, 0, sizeof ticks);
+  tp = ch.rlist.r_newer;
+  do {
+    uint32_t d = (uint32_t)(tp->p_time - tp->p_sampled);
+
+    tp->p_sampled = tp->p_time;
+    total += d;
+    if (tp == chSysGetIdleThreadX())
+      idle += d;
+    ticks[slot_of(tp->p_name)] += d;
+    tp = tp->p_newer;
+  } while (tp != (thread_t *)&ch.rlist);
+
+  msp->time = chVTGetSystemTimeX();
+  msp->load = total > 0 ? (uint16_t)(1000 - (idle * 1000) / total) : 0;
+  for (i = 0; i < METRICS_THREADS; i++)
+    msp->cpu[i] = total > 0 ? (uint8_t)((ticks[i] * 100) / total) : 0;
+
+  msp->core_free = sat16(chCoreGetStatusX());
+  msp->heap_free = 0;
+  msp->heap_frags = 0;
+  msp->flags = 0;
+  msp->sd_in = sat8(iqGetFullI(&metrics_sdp->iqueue));
+  msp->sd_out = sat8(oqGetFullI(&metrics_sdp->oqueue));
+  msp->usb_in = sat16(iqGetFullI(&metrics_sdup->iqueue));
+  msp->usb_out = sat16(oqGetFullI(&metrics_sdup->oqueue));
+
+  acqGetCountersI(&dropped, &errors);
+  msp->acq_dropped = sat8(dropped - metrics_acq_dropped);
+  msp->acq_errors = sat8(errors - metrics_acq_errors);
+  metrics_acq_dropped = dropped;
+  metrics_acq_errors = errors;
+
+  metrics_head = (metrics_head + 1) % METRICS_RING_SIZE;
+  if (metrics_count < METRICS_RING_SIZE)
+    metrics_count++;
+  metrics_seq++;
+}
+
+static void metrics_cb(void *p) {
+  rtcnt_t start = chSysGetRealtimeCounterX();
+  uint32_t cycles;
+
+  (void)p;
+  chSysLockFromISR();
+  sample_i();
+  chVTSetI(&metrics_vt, MS2ST(METRICS_PERIOD_MS), metrics_cb, NULL);
+  chEvtBroadcastI(&metrics_sampled);
+  cycles = chSysGetRealtimeCounterX() - start;
+  metrics_cb_cycles += cycles;
+  metrics_cb_last = cycles;
+  if (cycles > metrics_cb_max)
+    metrics_cb_max = cycles;
+  chSysUnlockFromISR();
+}
+
+/*
+ * Copy of the sample @p age samples back, zero being the latest.
+ */
+static void get_sample(unsigned age, metrics_sample_t *msp) {
+
+  chSysLock();
+  *msp = metrics_ring[(metrics_head + METRICS_RING_SIZE - 1 - age) %
+                      METRICS_RING_SIZE];
+  chSysUnlock();
+}
+
+static uint32_t field_value(const metrics_sample_t *msp, unsigned field) {
+
+  switch (field) {
+  case FIELD_LOAD:
+    return msp->load;
+  case FIELD_CORE_FREE:
+    return msp->core_free;
+  case FIELD_HEAP_FREE:
+    return msp->heap_free;
+  case FIELD_HEAP_FRAGS:
+    return msp->heap_frags;
+  case FIELD_SD_IN:
+    return msp->sd_in;
+  case FIELD_SD_OUT:
+    return msp->sd_out;
+  case FIELD_USB_IN:
+    return msp->usb_in;
+  case FIELD_USB_OUT:
+    return msp->usb_out;
+  case FIELD_ACQ_DROPPED:
+    return msp->acq_dropped;
+  default:
+    return msp->acq_errors;
+  }
+}
+
+/*===========================================================================*/
+/* Module exported functions.                                                */
+/*===========================================================================*/
+
+/**
+ * @brief   Starts the periodic sampling.
+ *
+ * @param[in] sdp       serial driver of the shell
+ * @param[in] sdup      serial over USB driver of the shell
+ *
+ * @api
+ */
+void metricsStart(SerialDMADriver *sdp, SerialUSBDriver *sdup) {
+
+  chEvtObjectInit(&metrics_sampled);
+  metrics_sdp = sdp;
+  metrics_sdup = sdup;
+  chVTSet(&metrics_vt, MS2ST(METRICS_PERIOD_MS), metrics_cb, NULL);
+}
+
+/**
+ * @brief   Fills the heap fields of the latest sample.
+ * @details The heap walk takes the heap mutex, it is done here rather than
+ *          in the timer callback. A sample overwritten in the meantime is
+ *          left without @p METRICS_HEAP_VALID.
+ *
+ * @api
+ */
+void metricsPoll(void) {
+  rtcnt_t start;
+  size_t frags, size;
+  uint32_t seq;
+
+  chSysLock();
+  seq = metrics_seq;
+  chSysUnlock();
+  if ((metrics_sdp == NULL) || (seq == metrics_heap_seq))
+    return;
+
+  start = chSysGetRealtimeCounterX();
+  frags = chHeapStatus(NULL, &size);
+  chSysLock();
+  if (metrics_seq == seq) {
+    metrics_sample_t *msp = &metrics_ring[(metrics_head +
+                                           METRICS_RING_SIZE - 1) %
+                                          METRICS_RING_SIZE];
+    msp->heap_free = sat16(size);
+    msp->heap_frags = sat16(frags);
+    msp->flags |= METRICS_HEAP_VALID;
+  }
+  chSysUnlock();
+  metrics_heap_seq = seq;
+  metrics_poll_cycles += chSysGetRealtimeCounterX() - start;
+  metrics_polls++;
+}
+
+/**
+ * @brief   Prints the minimum, average and maximum of the metrics.
+ *
+ * @param[in] chp       the output stream
+ * @param[in] seconds   window back from the latest sample, zero for the
+ *                      whole ring
+ *
+ * @api
+ */
+void metricsDump(BaseSequentialStream *chp, unsigned seconds) {
+  static const char *names[FIELDS] = {
+    "load 0.1%", "core free", "heap free", "heap fragments",
+    "serial in", "serial out", "usb in", "usb out",
+    "acq dropped", "acq errors"
+  };
+  uint32_t min[FIELDS], max[FIELDS], sum[FIELDS], n[FIELDS];
+  uint32_t cpu_sum[METRICS_THREADS], cpu_max[METRICS_THREADS];
+  uint32_t cycles, cb_last, cb_max, poll_cycles, polls, samples, hz;
+  metrics_sample_t sample;
+  unsigned count, i, f;
+
+  chSysLock();
+  count = metrics_count;
+  samples = metrics_seq;
+  cycles = metrics_cb_cycles;
+  cb_last = metrics_cb_last;
+  cb_max = metrics_cb_max;
+  poll_cycles = metrics_poll_cycles;
+  polls = metrics_polls;
+  chSysUnlock();
+  if (count == 0) {
+    chprintf(chp, "no samples\r\n");
+    return;
+  }
+  if ((seconds > 0) && ((seconds * 1000) / METRICS_PERIOD_MS < count))
+    count = (seconds * 1000) / METRICS_PERIOD_MS > 0 ?
+            (seconds * 1000) / METRICS_PERIOD_MS : 1;
+
+  for (f = 0; f < FIELDS; f++) {
+    min[f] = 0xFFFFFFFFU;
+    max[f] = 0;
+    sum[f] = 0;
+    n[f] = 0;
+  }
+  memset(cpu_sum, 0, sizeof cpu_sum);
+  memset(cpu_max, 0, sizeof cpu_max);
+  for (i = 0; i < count; i++) {
+    get_sample(i, &sample);
+    for (f = 0; f < FIELDS; f++) {
+      uint32_t v = field_value(&sample, f);
+
+      /* Heap fields not filled yet are left out.*/
+      if (((f == FIELD_HEAP_FREE) || (f == FIELD_HEAP_FRAGS)) &&
+          ((sample.flags & METRICS_HEAP_VALID) == 0))
+        continue;
+      if (v < min[f])
+        min[f] = v;
+      if (v > max[f])
+        max[f] = v;
+      sum[f] += v;
+      n[f]++;
+    }
+    for (f = 0; f < METRICS_THREADS; f++) {
+      cpu_sum[f] += sample.cpu[f];
+      if (sample.cpu[f] > cpu_max[f])
+        cpu_max[f] = sample.cpu[f];
+    }
+  }
+
+  chprintf(chp, "%u samples, %u ms period, last %lu s\r\n", count,
+           METRICS_PERIOD_MS, (uint32_t)count * METRICS_PERIOD_MS / 1000);
+  chprintf(chp, "                    min      avg      max\r\n");
+  for (f = 0; f < FIELDS; f++) {
+    if (n[f] == 0)
+      chprintf(chp, "%-14s        -        -        -\r\n", names[f]);
+    else
+      chprintf(chp, "%-14s %8lu %8lu %8lu\r\n", names[f], min[f],
+               sum[f] / n[f], max[f]);
+  }
+  chprintf(chp, "thread         avg %%    max %%\r\n");
+  for (f = 0; f < METRICS_THREADS; f++) {
+    const char *name = f < METRICS_THREADS - 1 ? metrics_names[f] : "other";
+
+    if ((name != NULL) && (cpu_max[f] > 0))
+      chprintf(chp, "%-14s %5lu    %5lu\r\n", name, cpu_sum[f] / count,
+               cpu_max[f]);
+  }
+
+  /* Overhead against the CPU cycles elapsed over the same samples.*/
+  hz = clockGetCurrentProfile()->hclk;
+  chprintf(chp, "sampler %lu cycles/sample (last %lu, max %lu), heap walk "
+           "%lu cycles, %lu ppm cpu\r\n",
+           samples > 0 ? cycles / samples : 0, cb_last, cb_max,
+           polls > 0 ? poll_cycles / polls : 0,
+           samples > 0 ?
+           (uint32_t)((((uint64_t)cycles + poll_cycles) * 1000000) /
+                      ((uint64_t)samples * (hz / 1000) * METRICS_PERIOD_MS)) :
+           0);
+}
+
+/**
+ * @brief   Writes the ring in binary, oldest sample first.
+ * @details A text header line "METRICS <version> <samples> <record size>
+ *          <period ms>" and a line listing the CPU slot names are followed
+ *          by the raw little endian records and by an "END <crc>" line, the
+ *          CRC-32 covers the records. tools/metrics_decode.py converts a
+ *          capture to CSV.
+ * @note    The export outpaces the sampling, a sample taken meanwhile only
+ *          overwrites records already sent.
+ *
+ * @param[in] chp       the output stream
+ *
+ * @api
+ */
+void metricsExport(BaseSequentialStream *chp) {
+  metrics_sample_t sample;
+  unsigned count, first, i;
+  uint32_t crc = 0;
+
+  chSysLock();
+  count = metrics_count;
+  first = (metrics_head + METRICS_RING_SIZE - count) % METRICS_RING_SIZE;
+  chSysUnlock();
+
+  chprintf(chp, "METRICS %u %u %u %u\r\nTHREADS", METRICS_EXPORT_VERSION,
+           count, (unsigned)sizeof sample, METRICS_PERIOD_MS);
+  for (i = 0; i < METRICS_THREADS - 1; i++)
+    chprintf(chp, " %s", metrics_names[i] != NULL ? metrics_names[i] : "-");
+  chprintf(chp, " other\r\n");
+  for (i = 0; i < count; i++) {
+    chSysLock();
+    sample = metrics_ring[(first + i) % METRICS_RING_SIZE];
+    chSysUnlock();
+    crc = dspCrc32(crc, &sample, sizeof sample);
+    chSequentialStreamWrite(chp, (const uint8_t *)&sample, sizeof sample);
+  }
+  chprintf(chp, "\r\nEND %08lx\r\n", crc);
+}
+
+/** @} */
@@ -0,0 +1,143 @@
+/*
+    ChibiOS - Copyright (C) 2006..2015 Giovanni Di Sirio
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+/**
+ * @file    metrics.h
+ * @brief   System metrics sampler header.
+ *
+ * @addtogroup METRICS
+ * @{
+ */
+
+#ifndef _METRICS_H_
+#define _METRICS_H_
+
+/*===========================================================================*/
+/* Module constants.                                                         */
+/*===========================================================================*/
+
+/**
+ * @brief   Sample flag, the heap fields are filled.
+ */
+#define METRICS_HEAP_VALID          0x01U
+
+/**
+ * @brief   Version of the binary export format.
+ */
+#define METRICS_EXPORT_VERSION      2
+
+/*===========================================================================*/
+/* Module pre-compile time settings.                                         */
+/*===========================================================================*/
+
+/**
+ * @brief   Sampling period in milliseconds.
+ */
+#if !defined(METRICS_PERIOD_MS) || defined(__DOXYGEN__)
+#define METRICS_PERIOD_MS           1000
+#endif
+
+/**
+ * @brief   Number of samples kept in the ring.
+ */
+#if !defined(METRICS_RING_SIZE) || defined(__DOXYGEN__)
+#define METRICS_RING_SIZE           64
+#endif
+
+/**
+ * @brief   Number of per-thread CPU slots in a sample.
+ * @details Threads are given a slot by name on their first sample, the
+ *          last slot accounts the threads left without one.
+ */
+#if !defined(METRICS_THREADS) || defined(__DOXYGEN__)
+#define METRICS_THREADS             8
+#endif
+
+/*===========================================================================*/
+/* Derived constants and error checks.                                       */
+/*===========================================================================*/
+
+#if !CH_DBG_THREADS_PROFILING || !CH_CFG_USE_REGISTRY
+#error "the metrics sampler requires the registry and threads profiling"
+#endif
+
+#if METRICS_RING_SIZE < 2
+#error "invalid METRICS_RING_SIZE value"
+#endif
+
+#if (METRICS_THREADS < 2) || (METRICS_THREADS > 32)
+#error "invalid METRICS_THREADS value"
+#endif
+
+/*===========================================================================*/
+/* Module data structures and types.                                         */
+/*===========================================================================*/
+
+/**
+ * @brief   Metrics sample, also the record of the binary export.
+ * @note    Counters are saturated to their field size.
+ */
+typedef struct {
+  systime_t             time;               /**< @brief Sampling time.      */
+  uint16_t              core_free;          /**< @brief Core allocator free
+                                                 bytes.                     */
+  uint16_t              heap_free;          /**< @brief Heap free bytes.    */
+  uint16_t              heap_frags;         /**< @brief Heap free fragments.*/
+  uint16_t              load;               /**< @brief CPU busy, permille. */
+  uint8_t               acq_dropped;        /**< @brief Acquisition blocks
+                                                 dropped since the previous
+                                                 sample.                    */
+  uint8_t               acq_errors;         /**< @brief ADC/DMA errors since
+                                                 the previous sample.       */
+  uint8_t               sd_in;              /**< @brief Serial input queue
+                                                 bytes, saturated at 255.   */
+  uint8_t               sd_out;             /**< @brief Serial output queue
+                                                 bytes.                     */
+  uint16_t              usb_in;             /**< @brief USB input queue
+                                                 bytes.                     */
+  uint16_t              usb_out;            /**< @brief USB output queue
+                                                 bytes.                     */
+  uint8_t               flags;              /**< @brief Sample flags.       */
+  uint8_t               cpu[METRICS_THREADS]; /**< @brief CPU share of each
+                                                 thread slot, percent.      */
+} metrics_sample_t;
+
+/*===========================================================================*/
+/* Module macros.                                                            */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* External declarations.                                                    */
+/*===========================================================================*/
+
+#if !defined(__DOXYGEN__)
+extern event_source_t metrics_sampled;
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+  void metricsStart(SerialDMADriver *sdp, SerialUSBDriver *sdup);
+  void metricsPoll(void);
+  void metricsDump(BaseSequentialStream *chp, unsigned seconds);
+  void metricsExport(BaseSequentialStream *chp);
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _METRICS_H_ */
+
+/** @} */
@@ -0,0 +1,437 @@
+/*
+    ChibiOS - Copyright (C) 2006..2015 Giovanni Di Sirio
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+/**
+ * @file    params.c
+ * @brief   EEPROM parameters code.
+ * @details Each record of paramsdef.h is stored as a header followed by
+ *          the record structure in its own EEPROM pages. The records are
+ *          loaded into RAM at startup, a damaged or blank record gets its
+ *          defaults, a record stored by an older layout keeps its fields
+ *          and gets the defaults of the newer ones. The records changed
+ *          since the last commit are written back by @p paramsCommit().
+ *
+ * @addtogroup PARAMS
+ * @{
+ */
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ch.h"
+#include "hal.h"
+#include "chprintf.h"
+
+#include "params.h"
+#include "dsp.h"
+
+/*===========================================================================*/
+/* Module local definitions.                                                 */
+/*===========================================================================*/
+
+/*
+ * Compile time check, a false condition declares an array of negative size.
+ */
+#define PARAMS_CHECK(name, cond)                                            \
+  typedef char params_check_##name[(cond) ? 1 : -1]
+
+/*
+ * Each record fits its pages, each field has a valid version and a default
+ * representable by its type.
+ */
+#define PARAM_RECORD_BEGIN(rec, pages)                                      \
+  PARAMS_CHECK(rec##_pages, (pages) >= 1);                                  \
+  PARAMS_CHECK(rec##_fits, sizeof (params_header_t) +                       \
+                           sizeof (params_##rec##_t) <=                     \
+                           (pages) * PARAMS_PAGE_SIZE);
+#define PARAM_FIELD(rec, name, type, def, since)                            \
+  PARAMS_CHECK(name##_version, ((since) >= 1) &&                            \
+                               ((since) <= PARAMS_VERSION));                \
+  PARAMS_CHECK(name##_default, (type)(def) == (def));
+#define PARAM_RECORD_END(rec)
+#include "paramsdef.h"
+#undef PARAM_RECORD_BEGIN
+#undef PARAM_FIELD
+#undef PARAM_RECORD_END
+
+PARAMS_CHECK(region, PARAMS_NUM_PAGES * PARAMS_PAGE_SIZE <= PARAMS_SIZE);
+PARAMS_CHECK(records, PARAMS_NUM_RECORDS <= 32);
+
+/**
+ * @brief   Record descriptor.
+ */
+typedef struct {
+  const char            *name;
+  uint32_t              addr;               /**< @brief EEPROM address.     */
+  size_t                area;               /**< @brief Reserved bytes.     */
+  size_t                size;               /**< @brief Record structure.    */
+  void                  *data;              /**< @brief RAM copy.           */
+  void                  (*defaults)(void *data, unsigned from, size_t size);
+} param_record_t;
+
+/**
+ * @brief   Field descriptor, used for the access by name.
+ */
+typedef struct {
+  const char            *name;
+  uint8_t               rec;
+  uint8_t               size;
+  bool                  is_signed;
+  uint16_t              offset;             /**< @brief In @p params_t.     */
+} param_field_t;
+
+/*
+ * Commit and load buffer, as large as the largest record area.
+ */
+typedef union {
+#define PARAM_RECORD_BEGIN(rec, pages)                                      \
+  uint8_t rec[(pages) * PARAMS_PAGE_SIZE];
+#define PARAM_FIELD(rec, name, type, def, since)
+#define PARAM_RECORD_END(rec)
+#include "paramsdef.h"
+#undef PARAM_RECORD_BEGIN
+#undef PARAM_FIELD
+#undef PARAM_RECORD_END
+  params_header_t       header;
+} params_buffer_t;
+
+/*
+ * Default values of the fields introduced after the layout version "from"
+ * or not covered by the "size" stored bytes.
+ */
+#define PARAM_RECORD_BEGIN(rec, pages)                                      \
+  static void defaults_##rec(void *data, unsigned from, size_t size) {      \
+    params_##rec##_t *rp = data;                                            \
+    (void)rp;
+#define PARAM_FIELD(rec, name, type, def, since)                            \
+    if (((since) > from) ||                                                 \
+        (offsetof(params_##rec##_t, name) + sizeof (type) > size))          \
+      rp->name = (type)(def);
+#define PARAM_RECORD_END(rec)                                               \
+  }
+#include "paramsdef.h"
+#undef PARAM_RECORD_BEGIN
+#undef PARAM_FIELD
+#undef PARAM_RECORD_END
+
+/*===========================================================================*/
+/* Module exported variables.                                                */
+/*===========================================================================*/
+
+/**
+ * @brief   RAM copy of the parameters.
+ */
+params_t params;
+
+/**
+ * @brief   Records changed since the last commit, one bit per record.
+ */
+uint32_t params_dirty;
+
+/*===========================================================================*/
+/* Module local variables.                                                   */
+/*===========================================================================*/
+
+static const param_record_t param_records[PARAMS_NUM_RECORDS] = {
+#define PARAM_RECORD_BEGIN(rec, pages)                                      \
+  {#rec, PARAMS_ADDR(rec), (pages) * PARAMS_PAGE_SIZE,                      \
+   sizeof (params_##rec##_t), &params.rec, defaults_##rec},
+#define PARAM_FIELD(rec, name, type, def, since)
+#define PARAM_RECORD_END(rec)
+#include "paramsdef.h"
+#undef PARAM_RECORD_BEGIN
+#undef PARAM_FIELD
+#undef PARAM_RECORD_END
+};
+
+static const param_field_t param_fields[] = {
+#define PARAM_RECORD_BEGIN(rec, pages)
+#define PARAM_FIELD(rec, name, type, def, since)                            \
+  {#name, PARAMS_REC_##rec, sizeof (type), (type)-1 < (type)1,              \
+   offsetof(params_t, rec.name)},
+#define PARAM_RECORD_END(rec)
+#include "paramsdef.h"
+#undef PARAM_RECORD_BEGIN
+#undef PARAM_FIELD
+#undef PARAM_RECORD_END
+};
+
+static const char * const outcomes[] = {
+  "loaded", "defaults", "migrated", "newer layout"
+};
+
+static AT25Driver *params_eepp;
+static MUTEX_DECL(params_mtx);
+static params_buffer_t params_buf;
+static uint8_t params_outcome[PARAMS_NUM_RECORDS];
+
+/*===========================================================================*/
+/* Module local functions.                                                   */
+/*===========================================================================*/
+
+static uint32_t record_crc(const params_header_t *hp, const void *data) {
+
+  return dspCrc32(dspCrc32(0, hp, offsetof(params_header_t, crc)),
+                  data, hp->size);
+}
+
+/*
+ * Loads a record into its RAM copy, returns the load outcome.
+ */
+static unsigned load_record(const param_record_t *rp) {
+  const params_header_t *hp = &params_buf.header;
+  const uint8_t *payload = (const uint8_t *)(hp + 1);
+
+  memset(rp->data, 0, rp->size);
+  if ((at25Read(params_eepp, rp->addr, (uint8_t *)&params_buf,
+                rp->area) != MSG_OK) ||
+      (hp->version == 0) ||
+      (hp->size > rp->area - sizeof (params_header_t)) ||
+      (hp->crc != record_crc(hp, payload))) {
+    rp->defaults(rp->data, 0, 0);
+    return PARAMS_DEFAULTS;
+  }
+
+  memcpy(rp->data, payload, hp->size < rp->size ? hp->size : rp->size);
+  if (hp->version > PARAMS_VERSION)
+    return PARAMS_NEWER;
+  if ((hp->version < PARAMS_VERSION) || (hp->size < rp->size)) {
+    rp->defaults(rp->data, hp->version, hp->size);
+    return PARAMS_MIGRATED;
+  }
+  return PARAMS_LOADED;
+}
+
+static const param_field_t *find_field(const char *name) {
+  unsigned i;
+
+  for (i = 0; i < sizeof param_fields / sizeof param_fields[0]; i++) {
+    if (strcmp(param_fields[i].name, name) == 0)
+      return &param_fields[i];
+  }
+  return NULL;
+}
+
+static int32_t field_value(const param_field_t *fp) {
+  const uint8_t *p = (const uint8_t *)&params + fp->offset;
+
+  switch (fp->size) {
+  case 1:
+    return fp->is_signed ? *(const int8_t *)p : *p;
+  case 2:
+    return fp->is_signed ? *(const int16_t *)p : *(const uint16_t *)p;
+  default:
+    return *(const int32_t *)p;
+  }
+}
+
+/*===========================================================================*/
+/* Module exported functions.                                                */
+/*===========================================================================*/
+
+/**
+ * @brief   Loads the parameters from a device.
+ * @details The damaged or blank records and the records stored by an older
+ *          layout are marked for the next commit. A record stored by a
+ *          newer layout is used as is, its unknown fields are lost if it
+ *          is changed and committed.
+ * @pre     The device has been started.
+ *
+ * @param[in] eepp      the EEPROM driver
+ * @return              The operation status.
+ * @retval MSG_OK       if the records are loaded.
+ * @retval MSG_RESET    if the layout does not fit the device, all the
+ *                      parameters have their default values.
+ *
+ * @api
+ */
+msg_t paramsStart(AT25Driver *eepp) {
+  unsigned i;
+
+  params_dirty = 0;
+  if ((PARAMS_PAGE_SIZE % at25GetPageSize(eepp) != 0) ||
+      (PARAMS_BASE + PARAMS_SIZE > at25GetSize(eepp))) {
+    paramsLoadDefaults();
+    params_dirty = 0;
+    return MSG_RESET;
+  }
+
+  params_eepp = eepp;
+  for (i = 0; i < PARAMS_NUM_RECORDS; i++) {
+    params_outcome[i] = (uint8_t)load_record(&param_records[i]);
+    if ((params_outcome[i] == PARAMS_DEFAULTS) ||
+        (params_outcome[i] == PARAMS_MIGRATED))
+      params_dirty |= 1U << i;
+  }
+  return MSG_OK;
+}
+
+/**
+ * @brief   Writes back the changed records.
+ * @details Each record is written by a single block write, a record
+ *          interrupted by a reset is found damaged at the next startup
+ *          and gets its defaults.
+ *
+ * @return              The operation status.
+ * @retval MSG_OK       if all the changed records are stored.
+ * @retval MSG_RESET    if the parameters are not started or the region is
+ *                      write protected, the records stay marked.
+ * @retval MSG_TIMEOUT  if a write cycle did not complete.
+ *
+ * @api
+ */
+msg_t paramsCommit(void) {
+  params_header_t *hp = &params_buf.header;
+  unsigned i;
+  msg_t msg = MSG_OK;
+
+  if (params_eepp == NULL)
+    return MSG_RESET;
+
+  chMtxLock(&params_mtx);
+  for (i = 0; (i < PARAMS_NUM_RECORDS) && (msg == MSG_OK); i++) {
+    const param_record_t *rp = &param_records[i];
+
+    if ((params_dirty & (1U << i)) == 0)
+      continue;
+    hp->version = PARAMS_VERSION;
+    hp->size    = (uint16_t)rp->size;
+    memcpy(hp + 1, rp->data, rp->size);
+    hp->crc     = record_crc(hp, hp + 1);
+    msg = at25Write(params_eepp, rp->addr, (const uint8_t *)&params_buf,
+                    sizeof (params_header_t) + rp->size);
+    if (msg == MSG_OK) {
+      params_dirty &= ~(1U << i);
+      params_outcome[i] = PARAMS_LOADED;
+    }
+  }
+  chMtxUnlock(&params_mtx);
+  return msg;
+}
+
+/**
+ * @brief   Sets all the parameters to their default values.
+ * @note    The records are written back by the next commit.
+ *
+ * @api
+ */
+void paramsLoadDefaults(void) {
+  unsigned i;
+
+  for (i = 0; i < PARAMS_NUM_RECORDS; i++) {
+    memset(param_records[i].data, 0, param_records[i].size);
+    param_records[i].defaults(param_records[i].data, 0, 0);
+    params_dirty |= 1U << i;
+  }
+}
+
+/**
+ * @brief   Sets a parameter by name.
+ * @note    Meant for the shell, the firmware uses the typed accessors.
+ *
+ * @param[in] name      the field name
+ * @param[in] value     the decimal or 0x prefixed hexadecimal value
+ * @return              The operation status.
+ * @retval true         if the value is set.
+ * @retval false        if the field is unknown or the value out of the
+ *                      range of its type.
+ *
+ * @api
+ */
+bool paramsSetByName(const char *name, const char *value) {
+  const param_field_t *fp = find_field(name);
+  uint8_t *p;
+  char *end;
+  long v;
+  unsigned long u;
+  unsigned bits;
+
+  if (fp == NULL)
+    return false;
+  /* The conversions saturate on overflow and set ERANGE, the field
+     range is checked on top for a long wider than the field.*/
+  bits = fp->size * 8;
+  errno = 0;
+  if (fp->is_signed) {
+    v = strtol(value, &end, 0);
+    if ((errno == ERANGE) || ((long long)v < -(1LL << (bits - 1))) ||
+        ((long long)v > (1LL << (bits - 1)) - 1))
+      return false;
+    u = (unsigned long)v;
+  }
+  else {
+    /* strtoul() negates a minus sign after blanks instead of failing.*/
+    if (strchr(value, '-') != NULL)
+      return false;
+    u = strtoul(value, &end, 0);
+    if ((errno == ERANGE) ||
+        ((unsigned long long)u > (1ULL << bits) - 1))
+      return false;
+  }
+  if ((end == value) || (*end != '\0'))
+    return false;
+
+  p = (uint8_t *)&params + fp->offset;
+  switch (fp->size) {
+  case 1:
+    *p = (uint8_t)u;
+    break;
+  case 2:
+    *(uint16_t *)p = (uint16_t)u;
+    break;
+  default:
+    *(uint32_t *)p = (uint32_t)u;
+    break;
+  }
+  params_dirty |= 1U << fp->rec;
+  return true;
+}
+
+/**
+ * @brief   Prints the records and their fields.
+ *
+ * @param[in] chp       the output stream
+ *
+ * @api
+ */
+void paramsDump(BaseSequentialStream *chp) {
+  unsigned i, j;
+
+  chprintf(chp, "layout version %u, %u records at %04lx\r\n",
+           PARAMS_VERSION, PARAMS_NUM_RECORDS, (uint32_t)PARAMS_BASE);
+  for (i = 0; i < PARAMS_NUM_RECORDS; i++) {
+    const param_record_t *rp = &param_records[i];
+
+    chprintf(chp, "%s at %04lx, %u/%u bytes, %s%s\r\n",
+             rp->name, rp->addr, sizeof (params_header_t) + rp->size,
+             rp->area, outcomes[params_outcome[i]],
+             params_dirty & (1U << i) ? ", not committed" : "");
+    for (j = 0; j < sizeof param_fields / sizeof param_fields[0]; j++) {
+      const param_field_t *fp = &param_fields[j];
+
+      if (fp->rec != i)
+        continue;
+      if (fp->is_signed)
+        chprintf(chp, "  %-16s %ld\r\n", fp->name, field_value(fp));
+      else
+        chprintf(chp, "  %-16s %lu\r\n", fp->name, (uint32_t)field_value(fp));
+    }
+  }
+}
+
+/** @} */
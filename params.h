@@ -0,0 +1,223 @@
+/*
+    ChibiOS - Copyright (C) 2006..2015 Giovanni Di Sirio
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+/**
+ * @file    params.h
+ * @brief   EEPROM parameters header.
+ * @details The layout is declared in paramsdef.h, the record types, the
+ *          RAM copy and the typed accessors are generated from it here:
+ *          @p param_get_<name>() and @p param_set_<name>() read and write
+ *          the RAM copy with no lookup, a set marks the record for the
+ *          next @p paramsCommit().
+ *
+ * @addtogroup PARAMS
+ * @{
+ */
+
+#ifndef _PARAMS_H_
+#define _PARAMS_H_
+
+#include "at25xxx.h"
+
+/*===========================================================================*/
+/* Module constants.                                                         */
+/*===========================================================================*/
+
+/**
+ * @brief   Current layout version.
+ * @note    Increase it when fields are appended to a record.
+ */
+#define PARAMS_VERSION              1
+
+/**
+ * @name    Record load outcomes
+ * @{
+ */
+#define PARAMS_LOADED               0   /**< @brief Stored record used.     */
+#define PARAMS_DEFAULTS             1   /**< @brief Blank or damaged.       */
+#define PARAMS_MIGRATED             2   /**< @brief Older layout, new fields
+                                             set to their defaults.         */
+#define PARAMS_NEWER                3   /**< @brief Newer layout, unknown
+                                             fields ignored.                */
+/** @} */
+
+/*===========================================================================*/
+/* Module pre-compile time settings.                                         */
+/*===========================================================================*/
+
+/**
+ * @brief   EEPROM address of the parameters region.
+ * @details The default is the calibration quarter of the AT25320, it is
+ *          write protected at startup, "eeprom protect none" unlocks it
+ *          for a commit.
+ */
+#if !defined(PARAMS_BASE) || defined(__DOXYGEN__)
+#define PARAMS_BASE                 0x0C00
+#endif
+
+/**
+ * @brief   Size of the parameters region.
+ */
+#if !defined(PARAMS_SIZE) || defined(__DOXYGEN__)
+#define PARAMS_SIZE                 0x0400
+#endif
+
+/**
+ * @brief   Page size of the layout.
+ * @note    A multiple of the device page size, so that a record is only
+ *          written by its own page programs.
+ */
+#if !defined(PARAMS_PAGE_SIZE) || defined(__DOXYGEN__)
+#define PARAMS_PAGE_SIZE            32
+#endif
+
+/*===========================================================================*/
+/* Derived constants and error checks.                                       */
+/*===========================================================================*/
+
+#if (PARAMS_BASE % PARAMS_PAGE_SIZE) != 0
+#error "PARAMS_BASE must be page aligned"
+#endif
+
+#if (PARAMS_SIZE % PARAMS_PAGE_SIZE) != 0
+#error "PARAMS_SIZE must be a multiple of PARAMS_PAGE_SIZE"
+#endif
+
+/*===========================================================================*/
+/* Module data structures and types.                                         */
+/*===========================================================================*/
+
+/**
+ * @brief   Header stored in front of each record.
+ */
+typedef struct {
+  uint16_t              version;            /**< @brief Layout version.     */
+  uint16_t              size;               /**< @brief Record bytes.       */
+  uint32_t              crc;                /**< @brief CRC-32 of version,
+                                                 size and record.           */
+} params_header_t;
+
+/*
+ * Record types, params_<record>_t.
+ */
+#define PARAM_RECORD_BEGIN(rec, pages) typedef struct {
+#define PARAM_FIELD(rec, name, type, def, since) type name;
+#define PARAM_RECORD_END(rec) } params_##rec##_t;
+#include "paramsdef.h"
+#undef PARAM_RECORD_BEGIN
+#undef PARAM_FIELD
+#undef PARAM_RECORD_END
+
+/**
+ * @brief   Record identifiers, PARAMS_REC_<record>.
+ */
+typedef enum {
+#define PARAM_RECORD_BEGIN(rec, pages) PARAMS_REC_##rec,
+#define PARAM_FIELD(rec, name, type, def, since)
+#define PARAM_RECORD_END(rec)
+#include "paramsdef.h"
+#undef PARAM_RECORD_BEGIN
+#undef PARAM_FIELD
+#undef PARAM_RECORD_END
+  PARAMS_NUM_RECORDS
+} paramsrec_t;
+
+/**
+ * @brief   First page of each record, PARAMS_PAGE_<record>.
+ * @details Each record starts after the pages reserved by the previous
+ *          one, the enumeration does the sum at compile time.
+ */
+enum {
+#define PARAM_RECORD_BEGIN(rec, pages)                                      \
+  PARAMS_PAGE_##rec, PARAMS_LAST_##rec = PARAMS_PAGE_##rec + (pages) - 1,
+#define PARAM_FIELD(rec, name, type, def, since)
+#define PARAM_RECORD_END(rec)
+#include "paramsdef.h"
+#undef PARAM_RECORD_BEGIN
+#undef PARAM_FIELD
+#undef PARAM_RECORD_END
+  PARAMS_NUM_PAGES
+};
+
+/**
+ * @brief   RAM copy of all the records.
+ */
+typedef struct {
+#define PARAM_RECORD_BEGIN(rec, pages) params_##rec##_t rec;
+#define PARAM_FIELD(rec, name, type, def, since)
+#define PARAM_RECORD_END(rec)
+#include "paramsdef.h"
+#undef PARAM_RECORD_BEGIN
+#undef PARAM_FIELD
+#undef PARAM_RECORD_END
+} params_t;
+
+/*===========================================================================*/
+/* Module macros.                                                            */
+/*===========================================================================*/
+
+/**
+ * @brief   EEPROM address of a record.
+ */
+#define PARAMS_ADDR(rec)                                                    \
+  (PARAMS_BASE + (uint32_t)PARAMS_PAGE_##rec * PARAMS_PAGE_SIZE)
+
+/*===========================================================================*/
+/* External declarations.                                                    */
+/*===========================================================================*/
+
+#if !defined(__DOXYGEN__)
+extern params_t params;
+extern uint32_t params_dirty;
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+  msg_t paramsStart(AT25Driver *eepp);
+  msg_t paramsCommit(void);
+  void paramsLoadDefaults(void);
+  bool paramsSetByName(const char *name, const char *value);
+  void paramsDump(BaseSequentialStream *chp);
+#ifdef __cplusplus
+}
+#endif
+
+/*===========================================================================*/
+/* Module inline functions.                                                  */
+/*===========================================================================*/
+
+/*
+ * Typed accessors, param_get_<name>() and param_set_<name>().
+ */
+#define PARAM_RECORD_BEGIN(rec, pages)
+#define PARAM_FIELD(rec, name, type, def, since)                            \
+  static inline type param_get_##name(void) {                               \
+    return params.rec.name;                                                 \
+  }                                                                         \
+  static inline void param_set_##name(type value) {                         \
+    params.rec.name = value;                                                \
+    params_dirty |= 1U << PARAMS_REC_##rec;                                 \
+  }
+#define PARAM_RECORD_END(rec)
+#include "paramsdef.h"
+#undef PARAM_RECORD_BEGIN
+#undef PARAM_FIELD
+#undef PARAM_RECORD_END
+
+#endif /* _PARAMS_H_ */
+
+/** @} */
@@ -0,0 +1,42 @@
+/*
+    ChibiOS - Copyright (C) 2006..2015 Giovanni Di Sirio
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+/*
+ * EEPROM parameters layout, expanded by params.h and params.c.
+ *
+ * PARAM_RECORD_BEGIN(record, pages) starts a record, the fields up to
+ * PARAM_RECORD_END(record) are stored together in the given number of
+ * EEPROM pages and written back by a single commit. Group the fields that
+ * are updated together. Records are placed in list order, append new ones
+ * at the end. The pages reserved by a record leave room for new fields
+ * without moving the following records.
+ *
+ * PARAM_FIELD(record, name, type, default, version) declares an integer
+ * field. "version" is the layout version that introduced it, new fields
+ * are appended at the end of their record with the current
+ * PARAMS_VERSION. A record stored by an older layout gets the default
+ * value of its newer fields when loaded.
+ */
+
+PARAM_RECORD_BEGIN(calib, 1)
+PARAM_FIELD(calib, adc_offset, int16_t, 0, 1)
+PARAM_FIELD(calib, adc_gain, uint16_t, 4096, 1)
+PARAM_FIELD(calib, vref_mv, uint16_t, 3300, 1)
+PARAM_RECORD_END(calib)
+
+PARAM_RECORD_BEGIN(comm, 1)
+PARAM_FIELD(comm, serial_baud, uint32_t, 38400, 1)
+PARAM_RECORD_END(comm)
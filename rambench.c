@@ -0,0 +1,164 @@
+/*
+    ChibiOS - Copyright (C) 2006..2015 Giovanni Di Sirio
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+/**
+ * @file    rambench.c
+ * @brief   Flash versus RAM execution benchmark code.
+ * @details The same code is built twice, once in flash and once in the
+ *          execute-from-RAM area. The interrupt latency is the number of
+ *          cycles between pending an unused vector and the first statement
+ *          of its handler, the throughput is measured on a bitwise CRC32
+ *          kernel, branchy code being the most sensitive to fetch stalls.
+ *
+ * @addtogroup RAMFUNC
+ * @{
+ */
+
+#include "ch.h"
+#include "hal.h"
+#include "chprintf.h"
+
+#include "ramfunc.h"
+#include "rambench.h"
+
+/*===========================================================================*/
+/* Module local definitions.                                                 */
+/*===========================================================================*/
+
+#define FLASH_IRQ           EXTI0_IRQn
+#define RAM_IRQ             EXTI1_IRQn
+
+/*===========================================================================*/
+/* Module local variables.                                                   */
+/*===========================================================================*/
+
+static volatile rtcnt_t irq_entry;
+static uint8_t bench_data[RAMBENCH_BYTES];
+
+/*===========================================================================*/
+/* Module local functions.                                                   */
+/*===========================================================================*/
+
+static inline __attribute__((always_inline))
+uint32_t crc_kernel(const uint8_t *p, size_t n) {
+  uint32_t crc = 0xFFFFFFFF;
+
+  while (n-- > 0) {
+    unsigned i;
+
+    crc ^= *p++;
+    for (i = 0; i < 8; i++)
+      crc = (crc & 1) ? (crc >> 1) ^ 0xEDB88320 : crc >> 1;
+  }
+  return ~crc;
+}
+
+static uint32_t crc_flash(const uint8_t *p, size_t n) {
+
+  return crc_kernel(p, n);
+}
+
+RAMFUNC static uint32_t crc_ram(const uint8_t *p, size_t n) {
+
+  return crc_kernel(p, n);
+}
+
+/*
+ * EXTI0 handler in flash.
+ */
+OSAL_IRQ_HANDLER(Vector58) {
+
+  OSAL_IRQ_PROLOGUE();
+  irq_entry = chSysGetRealtimeCounterX();
+  OSAL_IRQ_EPILOGUE();
+}
+
+/*
+ * EXTI1 handler in RAM.
+ */
+RAMFUNC OSAL_IRQ_HANDLER(Vector5C) {
+
+  OSAL_IRQ_PROLOGUE();
+  irq_entry = chSysGetRealtimeCounterX();
+  OSAL_IRQ_EPILOGUE();
+}
+
+static void irq_latency(IRQn_Type irq, rtcnt_t *minp, rtcnt_t *avgp) {
+  rtcnt_t start, dt, min = (rtcnt_t)-1, sum = 0;
+  unsigned i;
+
+  nvicEnableVector(irq, RAMBENCH_IRQ_PRIORITY);
+  for (i = 0; i < RAMBENCH_IRQ_RUNS; i++) {
+    irq_entry = 0;
+    start = chSysGetRealtimeCounterX();
+    NVIC->ISPR[(uint32_t)irq >> 5] = 1U << ((uint32_t)irq & 31);
+    while (irq_entry == 0)
+      ;
+    dt = irq_entry - start;
+    if (dt < min)
+      min = dt;
+    sum += dt;
+  }
+  nvicDisableVector(irq);
+  *minp = min;
+  *avgp = sum / RAMBENCH_IRQ_RUNS;
+}
+
+static rtcnt_t time_kernel(uint32_t (*kernel)(const uint8_t *, size_t)) {
+  rtcnt_t start, cycles;
+
+  chSysLock();
+  start = chSysGetRealtimeCounterX();
+  (void)kernel(bench_data, sizeof bench_data);
+  cycles = chSysGetRealtimeCounterX() - start;
+  chSysUnlock();
+  return cycles;
+}
+
+/*===========================================================================*/
+/* Module exported functions.                                                */
+/*===========================================================================*/
+
+/**
+ * @brief   Runs the flash versus RAM benchmark.
+ *
+ * @param[in] chp       stream where the results are printed
+ */
+void rambenchRun(BaseSequentialStream *chp) {
+  rtcnt_t min, avg, cycles;
+  size_t i;
+
+  for (i = 0; i < sizeof bench_data; i++)
+    bench_data[i] = (uint8_t)((i * 2654435761U) >> 24);
+
+  chprintf(chp, "ramfunc area    : %u bytes\r\n", ramfuncSize());
+
+  irq_latency(FLASH_IRQ, &min, &avg);
+  chprintf(chp, "irq flash       : %lu min, %lu avg cycles\r\n", min, avg);
+  irq_latency(RAM_IRQ, &min, &avg);
+  chprintf(chp, "irq ram         : %lu min, %lu avg cycles\r\n", min, avg);
+
+  cycles = time_kernel(crc_flash);
+  chprintf(chp, "crc32 flash     : %lu cycles, %lu.%02lu cycles/byte\r\n",
+           cycles, cycles / RAMBENCH_BYTES,
+           ((cycles % RAMBENCH_BYTES) * 100) / RAMBENCH_BYTES);
+  cycles = time_kernel(crc_ram);
+  chprintf(chp, "crc32 ram       : %lu cycles, %lu.%02lu cycles/byte\r\n",
+           cycles, cycles / RAMBENCH_BYTES,
+           ((cycles % RAMBENCH_BYTES) * 100) / RAMBENCH_BYTES);
+}
+
+/** @} */
@@ -0,0 +1,63 @@
+/*
+    ChibiOS - Copyright (C) 2006..2015 Giovanni Di Sirio
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+/**
+ * @file    rambench.h
+ * @brief   Flash versus RAM execution benchmark header.
+ *
+ * @addtogroup RAMFUNC
+ * @{
+ */
+
+#ifndef _RAMBENCH_H_
+#define _RAMBENCH_H_
+
+/**
+ * @brief   Number of interrupt latency samples.
+ */
+#if !defined(RAMBENCH_IRQ_RUNS) || defined(__DOXYGEN__)
+#define RAMBENCH_IRQ_RUNS           16
+#endif
+
+/**
+ * @brief   Bytes processed per kernel run.
+ */
+#if !defined(RAMBENCH_BYTES) || defined(__DOXYGEN__)
+#define RAMBENCH_BYTES              1024
+#endif
+
+/**
+ * @brief   Priority of the benchmark interrupts.
+ */
+#if !defined(RAMBENCH_IRQ_PRIORITY) || defined(__DOXYGEN__)
+#define RAMBENCH_IRQ_PRIORITY       4
+#endif
+
+#if HAL_USE_EXT
+#error "the benchmark uses the EXTI0 and EXTI1 vectors"
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+  void rambenchRun(BaseSequentialStream *chp);
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _RAMBENCH_H_ */
+
+/** @} */
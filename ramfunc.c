@@ -0,0 +1,71 @@
+/*
+    ChibiOS - Copyright (C) 2006..2015 Giovanni Di Sirio
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+/**
+ * @file    ramfunc.c
+ * @brief   Execute-from-RAM support code.
+ *
+ * @addtogroup RAMFUNC
+ * @{
+ */
+
+#include "ch.h"
+#include "hal.h"
+
+#include "ramfunc.h"
+
+/*===========================================================================*/
+/* Module local variables.                                                   */
+/*===========================================================================*/
+
+/*
+ * Symbols defined by the linker script.
+ */
+extern uint32_t __ramfunc_load__[];
+extern uint32_t __ramfunc_start__[];
+extern uint32_t __ramfunc_end__[];
+
+/*===========================================================================*/
+/* Module exported functions.                                                */
+/*===========================================================================*/
+
+/**
+ * @brief   Late initialization code.
+ * @details Copies the execute-from-RAM area image from flash, it runs after
+ *          the data and BSS initialization and before the interrupts are
+ *          enabled.
+ */
+void __late_init(void) {
+  const uint32_t *src = __ramfunc_load__;
+  uint32_t *dst = __ramfunc_start__;
+
+  while (dst < __ramfunc_end__)
+    *dst++ = *src++;
+}
+
+/**
+ * @brief   Returns the size of the execute-from-RAM area.
+ *
+ * @return              The size in bytes.
+ *
+ * @api
+ */
+size_t ramfuncSize(void) {
+
+  return (size_t)((uint8_t *)__ramfunc_end__ - (uint8_t *)__ramfunc_start__);
+}
+
+/** @} */
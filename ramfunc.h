@@ -0,0 +1,54 @@
+/*
+    ChibiOS - Copyright (C) 2006..2015 Giovanni Di Sirio
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+/**
+ * @file    ramfunc.h
+ * @brief   Execute-from-RAM support header.
+ *
+ * @addtogroup RAMFUNC
+ * @{
+ */
+
+#ifndef _RAMFUNC_H_
+#define _RAMFUNC_H_
+
+/*===========================================================================*/
+/* Module macros.                                                            */
+/*===========================================================================*/
+
+/**
+ * @brief   Places a function in the execute-from-RAM area.
+ * @details The function runs from SRAM without flash wait states, calls
+ *          between the two areas go through long branches.
+ * @note    Requires the STM32F107xC_ramfunc.ld linker script.
+ */
+#define RAMFUNC     __attribute__((section(".ramfunc"), noinline, long_call))
+
+/*===========================================================================*/
+/* External declarations.                                                    */
+/*===========================================================================*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+  size_t ramfuncSize(void);
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _RAMFUNC_H_ */
+
+/** @} */
@@ -0,0 +1,236 @@
+/*
+    ChibiOS - Copyright (C) 2006..2015 Giovanni Di Sirio
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+/**
+ * @file    schedtrace.c
+ * @brief   Scheduler trace recorder code.
+ * @details The context switch hook records every switch of a capture
+ *          with the realtime counter, the threads involved, the state the
+ *          outgoing thread is left in and the interrupts served since the
+ *          previous switch. The export is replayed on the host by
+ *          tools/sched_replay.py with other priorities or time quantum.
+ *
+ * @addtogroup SCHEDTRACE
+ * @{
+ */
+
+#include "ch.h"
+#include "hal.h"
+#include "chprintf.h"
+
+#include "schedtrace.h"
+#include "clock.h"
+#include "dsp.h"
+#include "ramfunc.h"
+
+/*===========================================================================*/
+/* Module local definitions.                                                 */
+/*===========================================================================*/
+
+/**
+ * @brief   Thread slot.
+ */
+typedef struct {
+  thread_t              *tp;                /**< @brief Only compared, the
+                                                 thread may have exited.    */
+  const char            *name;              /**< @brief Taken on the first
+                                                 switch out, once the thread
+                                                 has named itself.          */
+  tprio_t               prio;               /**< @brief Base priority.      */
+} schedtrace_thread_t;
+
+/*===========================================================================*/
+/* Module exported variables.                                                */
+/*===========================================================================*/
+
+/**
+ * @brief   Non-zero while a capture records, tested by the hook macro.
+ */
+unsigned schedtrace_armed;
+
+/*===========================================================================*/
+/* Module local variables.                                                   */
+/*===========================================================================*/
+
+static schedtrace_event_t schedtrace_buf[SCHEDTRACE_SIZE];
+static unsigned schedtrace_count;
+static schedtrace_thread_t schedtrace_threads[SCHEDTRACE_THREADS];
+static unsigned schedtrace_nthreads;
+static uint32_t schedtrace_hz;
+#if CH_DBG_STATISTICS
+static ucnt_t schedtrace_irqs;
+#endif
+
+/*===========================================================================*/
+/* Module local functions.                                                   */
+/*===========================================================================*/
+
+/*
+ * Slot of a thread, assigned on its first switch. The slot index cached in
+ * the thread is checked against the slot owner, a new capture or a thread
+ * created at the address of an exited one gets a new slot.
+ */
+RAMFUNC static uint8_t slot_of(thread_t *tp) {
+  unsigned id = tp->p_traceid;
+
+  if ((id < schedtrace_nthreads) && (schedtrace_threads[id].tp == tp))
+    return (uint8_t)id;
+  if (schedtrace_nthreads >= SCHEDTRACE_THREADS)
+    return SCHEDTRACE_OTHER;
+  id = schedtrace_nthreads++;
+  schedtrace_threads[id].tp   = tp;
+  schedtrace_threads[id].name = tp->p_name;
+#if CH_CFG_USE_MUTEXES
+  schedtrace_threads[id].prio = tp->p_realprio;
+#else
+  schedtrace_threads[id].prio = tp->p_prio;
+#endif
+  tp->p_traceid = (uint8_t)id;
+  return (uint8_t)id;
+}
+
+/*===========================================================================*/
+/* Module exported functions.                                                */
+/*===========================================================================*/
+
+/**
+ * @brief   Records a context switch.
+ * @note    Called by CH_CFG_CONTEXT_SWITCH_HOOK() while a capture is
+ *          armed, from the kernel lock.
+ *
+ * @param[in] ntp       the thread switched in
+ * @param[in] otp       the thread switched out
+ *
+ * @notapi
+ */
+RAMFUNC void schedtraceSwitchHook(thread_t *ntp, thread_t *otp) {
+  schedtrace_event_t *ep;
+#if CH_DBG_STATISTICS
+  ucnt_t irqs;
+#endif
+
+  if (schedtrace_count >= SCHEDTRACE_SIZE) {
+    schedtrace_armed = 0;
+    return;
+  }
+  ep = &schedtrace_buf[schedtrace_count++];
+  ep->time  = chSysGetRealtimeCounterX();
+  ep->next  = slot_of(ntp);
+  ep->prev  = slot_of(otp);
+  ep->state = (uint8_t)otp->p_state;
+#if CH_DBG_STATISTICS
+  irqs = ch.kernel_stats.n_irq - schedtrace_irqs;
+  schedtrace_irqs = ch.kernel_stats.n_irq;
+  ep->irqs = irqs > 0xFFU ? 0xFFU : (uint8_t)irqs;
+#else
+  ep->irqs = 0;
+#endif
+  if ((ep->prev != SCHEDTRACE_OTHER) &&
+      (schedtrace_threads[ep->prev].name == NULL))
+    schedtrace_threads[ep->prev].name = otp->p_name;
+}
+
+/**
+ * @brief   Starts a new capture.
+ * @details The previous capture is discarded, the capture stops by
+ *          itself once @p SCHEDTRACE_SIZE switches are recorded.
+ *
+ * @api
+ */
+void schedtraceStart(void) {
+
+  chSysLock();
+  schedtrace_count    = 0;
+  schedtrace_nthreads = 0;
+  schedtrace_hz       = clockGetCurrentProfile()->hclk;
+#if CH_DBG_STATISTICS
+  schedtrace_irqs     = ch.kernel_stats.n_irq;
+#endif
+  schedtrace_armed    = 1;
+  chSysUnlock();
+}
+
+/**
+ * @brief   Stops the capture, the recorded events are kept.
+ *
+ * @api
+ */
+void schedtraceStop(void) {
+
+  chSysLock();
+  schedtrace_armed = 0;
+  chSysUnlock();
+}
+
+/**
+ * @brief   Returns the capture status.
+ *
+ * @param[out] stp      the status
+ *
+ * @api
+ */
+void schedtraceGetStatus(schedtrace_status_t *stp) {
+
+  chSysLock();
+  stp->events  = schedtrace_count;
+  stp->threads = schedtrace_nthreads;
+  stp->running = schedtrace_armed != 0;
+  stp->span    = schedtrace_count > 1 ?
+                 schedtrace_buf[schedtrace_count - 1].time -
+                 schedtrace_buf[0].time : 0;
+  chSysUnlock();
+}
+
+/**
+ * @brief   Writes the capture in binary form.
+ * @details A "SCHEDTRACE <version> <events> <record size> <counter Hz>"
+ *          line, a "THREADS" line listing the slots as "<id>:<name>:<prio>",
+ *          the records and an "END <crc>" line with the CRC-32 of the
+ *          records. The capture is stopped first.
+ * @note    The counter frequency is the core clock when the capture
+ *          started, switching the clock profile during a capture makes the
+ *          times meaningless.
+ *
+ * @param[in] chp       the output stream
+ *
+ * @api
+ */
+void schedtraceExport(BaseSequentialStream *chp) {
+  unsigned count, nthreads, i;
+  uint32_t crc = 0;
+
+  schedtraceStop();
+  chSysLock();
+  count    = schedtrace_count;
+  nthreads = schedtrace_nthreads;
+  chSysUnlock();
+
+  chprintf(chp, "SCHEDTRACE %u %u %u %lu\r\nTHREADS",
+           SCHEDTRACE_EXPORT_VERSION, count,
+           (unsigned)sizeof (schedtrace_event_t), schedtrace_hz);
+  for (i = 0; i < nthreads; i++)
+    chprintf(chp, " %u:%s:%u", i,
+             schedtrace_threads[i].name != NULL ?
+             schedtrace_threads[i].name : "-",
+             (unsigned)schedtrace_threads[i].prio);
+  chprintf(chp, "\r\n");
+  crc = dspCrc32(crc, schedtrace_buf, count * sizeof (schedtrace_event_t));
+  chSequentialStreamWrite(chp, (const uint8_t *)schedtrace_buf,
+                          count * sizeof (schedtrace_event_t));
+  chprintf(chp, "\r\nEND %08lx\r\n", crc);
+}
+
+/** @} */
@@ -0,0 +1,129 @@
+/*
+    ChibiOS - Copyright (C) 2006..2015 Giovanni Di Sirio
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+/**
+ * @file    schedtrace.h
+ * @brief   Scheduler trace recorder header.
+ *
+ * @addtogroup SCHEDTRACE
+ * @{
+ */
+
+#ifndef _SCHEDTRACE_H_
+#define _SCHEDTRACE_H_
+
+/*===========================================================================*/
+/* Module constants.                                                         */
+/*===========================================================================*/
+
+/**
+ * @brief   Version of the binary export format.
+ */
+#define SCHEDTRACE_EXPORT_VERSION   1
+
+/**
+ * @brief   Thread identifier of the threads left without a slot.
+ */
+#define SCHEDTRACE_OTHER            0xFF
+
+/*===========================================================================*/
+/* Module pre-compile time settings.                                         */
+/*===========================================================================*/
+
+/**
+ * @brief   Number of context switches recorded by a capture.
+ * @details The capture stops when the buffer is full, so that it covers
+ *          a contiguous window from its start.
+ */
+#if !defined(SCHEDTRACE_SIZE) || defined(__DOXYGEN__)
+#define SCHEDTRACE_SIZE             512
+#endif
+
+/**
+ * @brief   Number of thread slots.
+ * @details Threads are given a slot on their first context switch, the
+ *          following ones are recorded as @p SCHEDTRACE_OTHER.
+ */
+#if !defined(SCHEDTRACE_THREADS) || defined(__DOXYGEN__)
+#define SCHEDTRACE_THREADS          16
+#endif
+
+/*===========================================================================*/
+/* Derived constants and error checks.                                       */
+/*===========================================================================*/
+
+#if !CH_CFG_USE_REGISTRY
+#error "the scheduler trace requires the registry for the thread names"
+#endif
+
+#if (SCHEDTRACE_THREADS < 2) || (SCHEDTRACE_THREADS >= SCHEDTRACE_OTHER)
+#error "invalid SCHEDTRACE_THREADS value"
+#endif
+
+/*===========================================================================*/
+/* Module data structures and types.                                         */
+/*===========================================================================*/
+
+/**
+ * @brief   Context switch record.
+ */
+typedef struct {
+  uint32_t              time;               /**< @brief Realtime counter.   */
+  uint8_t               next;               /**< @brief Thread switched in. */
+  uint8_t               prev;               /**< @brief Thread switched out.*/
+  uint8_t               state;              /**< @brief State of the thread
+                                                 switched out, ready if it
+                                                 was preempted.             */
+  uint8_t               irqs;               /**< @brief Interrupts since the
+                                                 previous switch, saturated,
+                                                 zero without
+                                                 CH_DBG_STATISTICS.         */
+} schedtrace_event_t;
+
+/**
+ * @brief   Capture status.
+ */
+typedef struct {
+  unsigned              events;             /**< @brief Events recorded.    */
+  unsigned              threads;            /**< @brief Slots in use.       */
+  bool                  running;            /**< @brief Capture armed.      */
+  uint32_t              span;               /**< @brief Cycles between the
+                                                 first and last events.     */
+} schedtrace_status_t;
+
+/*===========================================================================*/
+/* External declarations.                                                    */
+/*===========================================================================*/
+
+#if !defined(__DOXYGEN__)
+extern unsigned schedtrace_armed;
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+  void schedtraceStart(void);
+  void schedtraceStop(void);
+  void schedtraceGetStatus(schedtrace_status_t *stp);
+  void schedtraceExport(BaseSequentialStream *chp);
+  void schedtraceSwitchHook(thread_t *ntp, thread_t *otp);
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _SCHEDTRACE_H_ */
+
+/** @} */
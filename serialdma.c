@@ -0,0 +1,425 @@
+/*
+    ChibiOS - Copyright (C) 2006..2015 Giovanni Di Sirio
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+/**
+ * @file    serialdma.c
+ * @brief   USART2 serial driver with DMA reception code.
+ * @details The driver replaces the ChibiOS serial driver on USART2. With
+ *          one interrupt per received byte and a 16 bytes input queue the
+ *          stock driver loses data as soon as the consumer is a few
+ *          milliseconds late, pasted lines and bulk uploads at high rates
+ *          overrun it.
+ *          Here a circular DMA transfer stores the bytes into a larger
+ *          ring that is the buffer of the input queue. The queue write
+ *          pointer and counter are advanced from the DMA position on the
+ *          half transfer, the transfer complete and the USART idle line
+ *          interrupts, so a burst costs at most a few interrupts whatever
+ *          its length and a short one is handed over as soon as the line
+ *          goes idle.
+ *
+ * @addtogroup SERIALDMA
+ * @{
+ */
+
+#include "ch.h"
+#include "hal.h"
+
+#include "serialdma.h"
+#include "clock.h"
+#include "ramfunc.h"
+
+/*===========================================================================*/
+/* Driver local definitions.                                                 */
+/*===========================================================================*/
+
+#define SDMA_USART2_RX_DMA_STREAM   STM32_DMA1_STREAM6
+
+#define SDMA_RX_ERRORS              (USART_SR_ORE | USART_SR_NE |           \
+                                     USART_SR_FE | USART_SR_PE)
+
+/*===========================================================================*/
+/* Driver exported variables.                                                */
+/*===========================================================================*/
+
+/**
+ * @brief   USART2 serial driver identifier.
+ */
+SerialDMADriver SDD2;
+
+/*===========================================================================*/
+/* Driver local variables and types.                                         */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Driver local functions.                                                   */
+/*===========================================================================*/
+
+static size_t write(void *ip, const uint8_t *bp, size_t n) {
+
+  return oqWriteTimeout(&((SerialDMADriver *)ip)->oqueue, bp,
+                        n, TIME_INFINITE);
+}
+
+static size_t read(void *ip, uint8_t *bp, size_t n) {
+
+  return iqReadTimeout(&((SerialDMADriver *)ip)->iqueue, bp,
+                       n, TIME_INFINITE);
+}
+
+static msg_t put(void *ip, uint8_t b) {
+
+  return oqPutTimeout(&((SerialDMADriver *)ip)->oqueue, b, TIME_INFINITE);
+}
+
+static msg_t get(void *ip) {
+
+  return iqGetTimeout(&((SerialDMADriver *)ip)->iqueue, TIME_INFINITE);
+}
+
+static msg_t putt(void *ip, uint8_t b, systime_t timeout) {
+
+  return oqPutTimeout(&((SerialDMADriver *)ip)->oqueue, b, timeout);
+}
+
+static msg_t gett(void *ip, systime_t timeout) {
+
+  return iqGetTimeout(&((SerialDMADriver *)ip)->iqueue, timeout);
+}
+
+static size_t writet(void *ip, const uint8_t *bp, size_t n,
+                     systime_t timeout) {
+
+  return oqWriteTimeout(&((SerialDMADriver *)ip)->oqueue, bp, n, timeout);
+}
+
+static size_t readt(void *ip, uint8_t *bp, size_t n, systime_t timeout) {
+
+  return iqReadTimeout(&((SerialDMADriver *)ip)->iqueue, bp, n, timeout);
+}
+
+static const struct SerialDMADriverVMT vmt = {
+  write, read, put, get,
+  putt, gett, writet, readt
+};
+
+/*
+ * Output queue notification, the transmitter interrupt drains the queue.
+ */
+static void onotify(io_queue_t *qp) {
+  SerialDMADriver *sdp = qp->q_link;
+
+  sdp->usart->CR1 |= USART_CR1_TXEIE;
+}
+
+static uint32_t brr_of(uint32_t speed) {
+
+  return (clockGetCurrentProfile()->pclk1 + speed / 2) / speed;
+}
+
+/*
+ * Accounts the bytes written by the DMA since the previous call into the
+ * input queue. A consumer lapped by the DMA lost the oldest bytes, the
+ * newest half of the ring is kept because the DMA may already be
+ * overwriting the byte after the write position.
+ * Note, an exact multiple of the ring size received between two calls is
+ * not seen, the half transfer interrupts make it impossible unless the
+ * interrupt is masked for that long.
+ */
+static void serve_rx_i(SerialDMADriver *sdp) {
+  input_queue_t *iqp = &sdp->iqueue;
+  size_t pos, n;
+
+  pos = SERIALDMA_RX_BUFFER_SIZE -
+        (size_t)dmaStreamGetTransactionSize(sdp->dmarx);
+  if (pos >= SERIALDMA_RX_BUFFER_SIZE)
+    pos = 0;
+  n = (pos + SERIALDMA_RX_BUFFER_SIZE - sdp->rxpos) %
+      SERIALDMA_RX_BUFFER_SIZE;
+  if (n == 0)
+    return;
+  sdp->rxpos = pos;
+  sdp->stats.rx_bytes += n;
+
+  iqp->q_counter += n;
+  if (iqp->q_counter > SERIALDMA_RX_BUFFER_SIZE) {
+    sdp->stats.rx_lost += iqp->q_counter - SERIALDMA_RX_BUFFER_SIZE / 2;
+    iqp->q_counter = SERIALDMA_RX_BUFFER_SIZE / 2;
+    iqp->q_rdptr = iqp->q_buffer +
+                   (pos + SERIALDMA_RX_BUFFER_SIZE / 2) %
+                   SERIALDMA_RX_BUFFER_SIZE;
+    chnAddFlagsI(sdp, SDMA_OVERRUN_ERROR);
+  }
+  iqp->q_wrptr = iqp->q_buffer + pos;
+  if (iqp->q_counter > sdp->stats.rx_peak)
+    sdp->stats.rx_peak = (uint16_t)iqp->q_counter;
+
+  osalThreadDequeueAllI(&iqp->q_waiting, Q_OK);
+  chnAddFlagsI(sdp, CHN_INPUT_AVAILABLE);
+}
+
+/*
+ * Receive DMA interrupt, half and full ring.
+ */
+static RAMFUNC void serve_rx_dma(void *p, uint32_t flags) {
+  SerialDMADriver *sdp = p;
+
+  osalSysLockFromISR();
+  if ((flags & STM32_DMA_ISR_TEIF) != 0)
+    osalSysHalt("DMA failure");
+  serve_rx_i(sdp);
+  osalSysUnlockFromISR();
+}
+
+/*
+ * USART interrupt, reception errors, idle line and transmission.
+ */
+static RAMFUNC void serve_interrupt(SerialDMADriver *sdp) {
+  USART_TypeDef *u = sdp->usart;
+  uint32_t sr = u->SR;
+  uint32_t cr1 = u->CR1;
+
+  /* The error and idle flags are cleared by the SR read followed by a DR
+     read, the byte in error has already been taken by the DMA.*/
+  if ((sr & (SDMA_RX_ERRORS | USART_SR_IDLE)) != 0) {
+    eventflags_t errors = 0;
+
+    (void)u->DR;
+    osalSysLockFromISR();
+    if (sr & USART_SR_ORE) {
+      sdp->stats.overruns++;
+      errors |= SDMA_OVERRUN_ERROR;
+    }
+    if (sr & USART_SR_FE) {
+      sdp->stats.framing++;
+      errors |= SDMA_FRAMING_ERROR;
+    }
+    if (sr & USART_SR_NE) {
+      sdp->stats.noise++;
+      errors |= SDMA_NOISE_ERROR;
+    }
+    if (sr & USART_SR_PE) {
+      sdp->stats.parity++;
+      errors |= SDMA_PARITY_ERROR;
+    }
+    if (errors != 0)
+      chnAddFlagsI(sdp, errors);
+    if (sr & USART_SR_IDLE) {
+      sdp->stats.rx_idle++;
+      serve_rx_i(sdp);
+    }
+    osalSysUnlockFromISR();
+  }
+
+  /* Transmission buffer empty.*/
+  if ((cr1 & USART_CR1_TXEIE) && (sr & USART_SR_TXE)) {
+    msg_t b;
+
+    osalSysLockFromISR();
+    b = oqGetI(&sdp->oqueue);
+    if (b < Q_OK) {
+      chnAddFlagsI(sdp, CHN_OUTPUT_EMPTY);
+      cr1 = (cr1 & ~USART_CR1_TXEIE) | USART_CR1_TCIE;
+      u->CR1 = cr1;
+    }
+    else
+      u->DR = b;
+    osalSysUnlockFromISR();
+  }
+
+  /* Physical transmission end.*/
+  else if ((cr1 & USART_CR1_TCIE) && (sr & USART_SR_TC)) {
+    osalSysLockFromISR();
+    if (oqIsEmptyI(&sdp->oqueue))
+      chnAddFlagsI(sdp, CHN_TRANSMISSION_END);
+    u->CR1 = cr1 & ~USART_CR1_TCIE;
+    u->SR = ~USART_SR_TC;
+    osalSysUnlockFromISR();
+  }
+}
+
+/*===========================================================================*/
+/* Driver interrupt handlers.                                                */
+/*===========================================================================*/
+
+/**
+ * @brief   USART2 IRQ handler.
+ *
+ * @isr
+ */
+OSAL_IRQ_HANDLER(STM32_USART2_HANDLER) {
+
+  OSAL_IRQ_PROLOGUE();
+
+  serve_interrupt(&SDD2);
+
+  OSAL_IRQ_EPILOGUE();
+}
+
+/*===========================================================================*/
+/* Driver exported functions.                                                */
+/*===========================================================================*/
+
+/**
+ * @brief   Driver initialization.
+ *
+ * @init
+ */
+void sdmaInit(void) {
+  SerialDMADriver *sdp = &SDD2;
+
+  sdp->vmt = &vmt;
+  osalEventObjectInit(&sdp->event);
+  sdp->state = SDMA_STOP;
+  iqObjectInit(&sdp->iqueue, sdp->ib, SERIALDMA_RX_BUFFER_SIZE, NULL, sdp);
+  oqObjectInit(&sdp->oqueue, sdp->ob, SERIALDMA_TX_BUFFER_SIZE, onotify, sdp);
+  sdp->usart = USART2;
+  sdp->dmarx = SDMA_USART2_RX_DMA_STREAM;
+  sdp->rxpos = 0;
+}
+
+/**
+ * @brief   Configures and starts the driver.
+ *
+ * @param[in] sdp       pointer to a @p SerialDMADriver object
+ * @param[in] config    the driver configuration
+ *
+ * @api
+ */
+void sdmaStart(SerialDMADriver *sdp, const SerialDMAConfig *config) {
+  USART_TypeDef *u = sdp->usart;
+  bool b;
+
+  osalDbgCheck((sdp != NULL) && (config != NULL));
+
+  osalSysLock();
+  osalDbgAssert((sdp->state == SDMA_STOP) || (sdp->state == SDMA_READY),
+                "invalid state");
+  if (sdp->state == SDMA_STOP) {
+    b = dmaStreamAllocate(sdp->dmarx, SERIALDMA_IRQ_PRIORITY,
+                          serve_rx_dma, sdp);
+    osalDbgAssert(!b, "stream already allocated");
+    rccEnableUSART2(FALSE);
+    nvicEnableVector(STM32_USART2_NUMBER, SERIALDMA_IRQ_PRIORITY);
+  }
+  dmaStreamDisable(sdp->dmarx);
+  iqResetI(&sdp->iqueue);
+  sdp->rxpos = 0;
+
+  u->CR1 = 0;
+  u->BRR = brr_of(config->speed);
+  u->CR2 = config->cr2;
+  u->CR3 = config->cr3 | USART_CR3_DMAR | USART_CR3_EIE;
+  (void)u->SR;
+  (void)u->DR;
+
+  dmaStreamSetPeripheral(sdp->dmarx, &u->DR);
+  dmaStreamSetMemory0(sdp->dmarx, sdp->ib);
+  dmaStreamSetTransactionSize(sdp->dmarx, SERIALDMA_RX_BUFFER_SIZE);
+  dmaStreamSetMode(sdp->dmarx,
+                   STM32_DMA_CR_PL(SERIALDMA_DMA_PRIORITY) |
+                   STM32_DMA_CR_DIR_P2M | STM32_DMA_CR_MINC |
+                   STM32_DMA_CR_PSIZE_BYTE | STM32_DMA_CR_MSIZE_BYTE |
+                   STM32_DMA_CR_CIRC | STM32_DMA_CR_HTIE |
+                   STM32_DMA_CR_TCIE | STM32_DMA_CR_TEIE);
+  dmaStreamEnable(sdp->dmarx);
+
+  u->CR1 = config->cr1 | USART_CR1_UE | USART_CR1_PEIE | USART_CR1_IDLEIE |
+           USART_CR1_TE | USART_CR1_RE;
+  sdp->state = SDMA_READY;
+  osalSysUnlock();
+}
+
+/**
+ * @brief   Stops the driver.
+ * @details Any thread waiting on the driver's queues is awakened with
+ *          the message @p Q_RESET.
+ *
+ * @param[in] sdp       pointer to a @p SerialDMADriver object
+ *
+ * @api
+ */
+void sdmaStop(SerialDMADriver *sdp) {
+
+  osalDbgCheck(sdp != NULL);
+
+  osalSysLock();
+  osalDbgAssert((sdp->state == SDMA_STOP) || (sdp->state == SDMA_READY),
+                "invalid state");
+  if (sdp->state == SDMA_READY) {
+    sdp->usart->CR1 = 0;
+    sdp->usart->CR2 = 0;
+    sdp->usart->CR3 = 0;
+    dmaStreamDisable(sdp->dmarx);
+    dmaStreamRelease(sdp->dmarx);
+    nvicDisableVector(STM32_USART2_NUMBER);
+    rccDisableUSART2(FALSE);
+  }
+  sdp->state = SDMA_STOP;
+  oqResetI(&sdp->oqueue);
+  iqResetI(&sdp->iqueue);
+  osalOsRescheduleS();
+  osalSysUnlock();
+}
+
+/**
+ * @brief   Changes the bit rate.
+ * @note    The characters in flight are garbled, the caller waits for the
+ *          transmission end first.
+ *
+ * @param[in] sdp       pointer to a @p SerialDMADriver object
+ * @param[in] speed     the new bit rate
+ *
+ * @api
+ */
+void sdmaSetSpeed(SerialDMADriver *sdp, uint32_t speed) {
+
+  osalDbgCheck((sdp != NULL) && (speed > 0));
+  osalDbgAssert(sdp->state == SDMA_READY, "not ready");
+
+  sdp->usart->BRR = brr_of(speed);
+}
+
+/**
+ * @brief   Returns a copy of the reception counters.
+ *
+ * @param[in] sdp       pointer to a @p SerialDMADriver object
+ * @param[out] stp      the counters
+ *
+ * @api
+ */
+void sdmaGetStats(SerialDMADriver *sdp, sdma_stats_t *stp) {
+
+  osalSysLock();
+  *stp = sdp->stats;
+  osalSysUnlock();
+}
+
+/**
+ * @brief   Clears the reception counters.
+ *
+ * @param[in] sdp       pointer to a @p SerialDMADriver object
+ *
+ * @api
+ */
+void sdmaResetStats(SerialDMADriver *sdp) {
+  static const sdma_stats_t zero = {0, 0, 0, 0, 0, 0, 0, 0};
+
+  osalSysLock();
+  sdp->stats = zero;
+  osalSysUnlock();
+}
+
+/** @} */
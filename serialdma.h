@@ -0,0 +1,218 @@
+/*
+    ChibiOS - Copyright (C) 2006..2015 Giovanni Di Sirio
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+/**
+ * @file    serialdma.h
+ * @brief   USART2 serial driver with DMA reception header.
+ *
+ * @addtogroup SERIALDMA
+ * @{
+ */
+
+#ifndef _SERIALDMA_H_
+#define _SERIALDMA_H_
+
+/*===========================================================================*/
+/* Driver constants.                                                         */
+/*===========================================================================*/
+
+/**
+ * @name    Serial status flags
+ * @note    Same values as the flags of the ChibiOS serial driver.
+ * @{
+ */
+#define SDMA_PARITY_ERROR           32      /**< @brief Parity.             */
+#define SDMA_FRAMING_ERROR          64      /**< @brief Framing.            */
+#define SDMA_OVERRUN_ERROR          128     /**< @brief Overflow.           */
+#define SDMA_NOISE_ERROR            256     /**< @brief Line noise.         */
+/** @} */
+
+/*===========================================================================*/
+/* Driver pre-compile time settings.                                         */
+/*===========================================================================*/
+
+/**
+ * @brief   Size of the DMA receive ring, also the input queue size.
+ * @details The ring is serviced on each half transfer and on each idle
+ *          line, the consumer must drain half of it within the time
+ *          needed to receive the other half.
+ */
+#if !defined(SERIALDMA_RX_BUFFER_SIZE) || defined(__DOXYGEN__)
+#define SERIALDMA_RX_BUFFER_SIZE    512
+#endif
+
+/**
+ * @brief   Size of the output queue.
+ */
+#if !defined(SERIALDMA_TX_BUFFER_SIZE) || defined(__DOXYGEN__)
+#define SERIALDMA_TX_BUFFER_SIZE    64
+#endif
+
+/**
+ * @brief   USART2 interrupt priority.
+ */
+#if !defined(SERIALDMA_IRQ_PRIORITY) || defined(__DOXYGEN__)
+#define SERIALDMA_IRQ_PRIORITY      12
+#endif
+
+/**
+ * @brief   DMA priority of the receive transfer.
+ * @note    DMA1 channel 6 is reserved by the driver.
+ */
+#if !defined(SERIALDMA_DMA_PRIORITY) || defined(__DOXYGEN__)
+#define SERIALDMA_DMA_PRIORITY      1
+#endif
+
+/*===========================================================================*/
+/* Derived constants and error checks.                                       */
+/*===========================================================================*/
+
+#if HAL_USE_SERIAL && STM32_SERIAL_USE_USART2
+#error "USART2 is assigned to the ChibiOS serial driver"
+#endif
+
+#if (SERIALDMA_RX_BUFFER_SIZE < 16) || (SERIALDMA_RX_BUFFER_SIZE > 65535) ||  \
+    ((SERIALDMA_RX_BUFFER_SIZE % 2) != 0)
+#error "invalid SERIALDMA_RX_BUFFER_SIZE value"
+#endif
+
+/*===========================================================================*/
+/* Driver data structures and types.                                         */
+/*===========================================================================*/
+
+/**
+ * @brief   Driver state machine possible states.
+ */
+typedef enum {
+  SDMA_UNINIT = 0,                  /**< Not initialized.                   */
+  SDMA_STOP = 1,                    /**< Stopped.                           */
+  SDMA_READY = 2                    /**< Ready.                             */
+} sdmastate_t;
+
+/**
+ * @brief   Driver configuration structure.
+ * @note    The driver adds the receive, transmit, DMA and interrupt enable
+ *          bits to the control registers.
+ */
+typedef struct {
+  uint32_t              speed;              /**< @brief Bit rate.           */
+  uint16_t              cr1;                /**< @brief CR1 initialization. */
+  uint16_t              cr2;                /**< @brief CR2 initialization. */
+  uint16_t              cr3;                /**< @brief CR3 initialization. */
+} SerialDMAConfig;
+
+/**
+ * @brief   Reception counters.
+ */
+typedef struct {
+  uint32_t              rx_bytes;           /**< @brief Bytes received.     */
+  uint32_t              rx_idle;            /**< @brief Idle line events,
+                                                 one per received burst.    */
+  uint32_t              rx_lost;            /**< @brief Bytes overwritten in
+                                                 the ring before being
+                                                 read.                      */
+  uint32_t              overruns;           /**< @brief USART overruns, the
+                                                 DMA was late.              */
+  uint32_t              framing;            /**< @brief Framing errors.     */
+  uint32_t              noise;              /**< @brief Noise errors.       */
+  uint32_t              parity;             /**< @brief Parity errors.      */
+  uint16_t              rx_peak;            /**< @brief Highest input queue
+                                                 level.                     */
+} sdma_stats_t;
+
+/**
+ * @brief   @p SerialDMADriver specific data.
+ */
+#define _serial_dma_driver_data                                             \
+  _base_asynchronous_channel_data                                           \
+  /* Driver state.*/                                                        \
+  sdmastate_t               state;                                          \
+  /* Input queue, its buffer is the DMA receive ring.*/                     \
+  input_queue_t             iqueue;                                         \
+  /* Output queue.*/                                                        \
+  output_queue_t            oqueue;                                         \
+  /* Receive ring.*/                                                        \
+  uint8_t                   ib[SERIALDMA_RX_BUFFER_SIZE];                   \
+  /* Output circular buffer.*/                                              \
+  uint8_t                   ob[SERIALDMA_TX_BUFFER_SIZE];                   \
+  /* Pointer to the USART registers block.*/                                \
+  USART_TypeDef             *usart;                                         \
+  /* Receive DMA stream.*/                                                  \
+  const stm32_dma_stream_t  *dmarx;                                         \
+  /* Ring offset of the next byte not yet accounted.*/                      \
+  size_t                    rxpos;                                          \
+  /* Reception counters.*/                                                  \
+  sdma_stats_t              stats;
+
+/**
+ * @brief   @p SerialDMADriver specific methods.
+ */
+#define _serial_dma_driver_methods                                          \
+  _base_asynchronous_channel_methods
+
+/**
+ * @extends BaseAsynchronousChannelVMT
+ *
+ * @brief   @p SerialDMADriver virtual methods table.
+ */
+struct SerialDMADriverVMT {
+  _serial_dma_driver_methods
+};
+
+/**
+ * @extends BaseAsynchronousChannel
+ *
+ * @brief   Serial driver receiving by DMA.
+ * @details The received bytes are written by a circular DMA transfer
+ *          directly into the buffer of the input queue, the queue
+ *          counters are advanced in bursts on the half and full transfer
+ *          interrupts and on the USART idle line interrupt instead of one
+ *          interrupt per byte. Transmission is interrupt driven.
+ */
+typedef struct {
+  /** @brief Virtual Methods Table.*/
+  const struct SerialDMADriverVMT *vmt;
+  _serial_dma_driver_data
+} SerialDMADriver;
+
+/*===========================================================================*/
+/* Driver macros.                                                            */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* External declarations.                                                    */
+/*===========================================================================*/
+
+#if !defined(__DOXYGEN__)
+extern SerialDMADriver SDD2;
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+  void sdmaInit(void);
+  void sdmaStart(SerialDMADriver *sdp, const SerialDMAConfig *config);
+  void sdmaStop(SerialDMADriver *sdp);
+  void sdmaSetSpeed(SerialDMADriver *sdp, uint32_t speed);
+  void sdmaGetStats(SerialDMADriver *sdp, sdma_stats_t *stp);
+  void sdmaResetStats(SerialDMADriver *sdp);
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _SERIALDMA_H_ */
+
+/** @} */
@@ -0,0 +1,1114 @@
+/*
+    ChibiOS - Copyright (C) 2006..2015 Giovanni Di Sirio
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+/**
+ * @file    shell.c
+ * @brief   Simple CLI shell code.
+ *
+ * @addtogroup SHELL
+ * @{
+ */
+
+#include <string.h>
+
+#include "ch.h"
+#include "hal.h"
+#include "shell.h"
+#include "chprintf.h"
+
+/*===========================================================================*/
+/* Module local definitions.                                                 */
+/*===========================================================================*/
+
+#define FNV_OFFSET_BASIS    2166136261U
+#define FNV_PRIME           16777619U
+
+#define SHELL_CMD_OK        0
+#define SHELL_CMD_EMPTY     1
+#define SHELL_CMD_ERROR     2
+#define SHELL_CMD_EXIT      3
+
+/* Escape sequence progress of the line editor.*/
+#define SHELL_ESC_NONE      0
+#define SHELL_ESC_START     1
+#define SHELL_ESC_CSI       2
+#define SHELL_ESC_SS3       3
+
+/* Server event signalled on session opening and end of execution.*/
+#define SHELL_SERVER_EVENT  EVENT_MASK(SHELL_MAX_SESSIONS)
+
+#define SHELL_LONG_WA_SIZE  THD_WORKING_AREA_SIZE(SHELL_LONG_STACK_SIZE)
+
+/*===========================================================================*/
+/* Module exported variables.                                                */
+/*===========================================================================*/
+
+/**
+ * @brief   Shell termination event source.
+ */
+event_source_t shell_terminated;
+
+/*===========================================================================*/
+/* Module local variables.                                                   */
+/*===========================================================================*/
+
+static THD_WORKING_AREA(shell_server_wa, SHELL_SERVER_STACK_SIZE);
+static THD_WORKING_AREA(shell_worker_wa[SHELL_WORKERS],
+                        SHELL_WORKER_STACK_SIZE);
+
+static thread_t *shell_server_tp;
+static ShellSession *shell_sessions[SHELL_MAX_SESSIONS];
+
+/* Execution queue of the pool workers, a session has at most one line
+   queued so posting never waits.*/
+static msg_t shell_jobs_buf[SHELL_MAX_SESSIONS];
+static MAILBOX_DECL(shell_jobs, shell_jobs_buf, SHELL_MAX_SESSIONS);
+
+/* Server statistics, lines executed by the pool and by long command
+   threads, longest wait of a line for a worker.*/
+static uint32_t shell_pool_jobs;
+static uint32_t shell_long_jobs;
+static systime_t shell_wait_max;
+
+/*===========================================================================*/
+/* Module local functions.                                                   */
+/*===========================================================================*/
+
+/*
+ * Splits the next argument off the line, in place. Single or double quotes
+ * group blanks into an argument, the quotes are squeezed out by moving the
+ * argument characters down within the line buffer.
+ */
+static char *parse_arguments(char *str, char **saveptr) {
+  char *p, *dst, *arg;
+  char quote;
+
+  p = (str != NULL) ? str : *saveptr;
+  while ((*p == ' ') || (*p == '\t'))
+    p++;
+  if (*p == '\0') {
+    *saveptr = p;
+    return NULL;
+  }
+
+  arg = dst = p;
+  quote = '\0';
+  while (*p != '\0') {
+    char c = *p++;
+    if (quote != '\0') {
+      if (c == quote) {
+        quote = '\0';
+        continue;
+      }
+    }
+    else if ((c == '"') || (c == '\'')) {
+      quote = c;
+      continue;
+    }
+    else if ((c == ' ') || (c == '\t'))
+      break;
+    *dst++ = c;
+  }
+  *dst = '\0';
+  *saveptr = p;
+  return arg;
+}
+
+static void usage(BaseSequentialStream *chp, char *p) {
+
+  chprintf(chp, "Usage: %s\r\n", p);
+}
+
+static void list_commands(BaseSequentialStream *chp, const ShellCommand *scp) {
+
+  while (scp->sc_name != NULL) {
+    chprintf(chp, "%s ", scp->sc_name);
+    scp++;
+  }
+}
+
+static msg_t cmd_info(BaseSequentialStream *chp, int argc, char *argv[]) {
+
+  (void)argv;
+  if (argc > 0) {
+    usage(chp, "info");
+    return MSG_RESET;
+  }
+
+  chprintf(chp, "Kernel:       %s\r\n", CH_KERNEL_VERSION);
+#ifdef PORT_COMPILER_NAME
+  chprintf(chp, "Compiler:     %s\r\n", PORT_COMPILER_NAME);
+#endif
+  chprintf(chp, "Architecture: %s\r\n", PORT_ARCHITECTURE_NAME);
+#ifdef PORT_CORE_VARIANT_NAME
+  chprintf(chp, "Core Variant: %s\r\n", PORT_CORE_VARIANT_NAME);
+#endif
+#ifdef PORT_INFO
+  chprintf(chp, "Port Info:    %s\r\n", PORT_INFO);
+#endif
+#ifdef PLATFORM_NAME
+  chprintf(chp, "Platform:     %s\r\n", PLATFORM_NAME);
+#endif
+#ifdef BOARD_NAME
+  chprintf(chp, "Board:        %s\r\n", BOARD_NAME);
+#endif
+#ifdef __DATE__
+#ifdef __TIME__
+  chprintf(chp, "Build time:   %s%s%s\r\n", __DATE__, " - ", __TIME__);
+#endif
+#endif
+  return MSG_OK;
+}
+
+static msg_t cmd_systime(BaseSequentialStream *chp, int argc, char *argv[]) {
+
+  (void)argv;
+  if (argc > 0) {
+    usage(chp, "systime");
+    return MSG_RESET;
+  }
+  chprintf(chp, "%lu\r\n", (unsigned long)chVTGetSystemTime());
+  return MSG_OK;
+}
+
+static msg_t cmd_sessions(BaseSequentialStream *chp, int argc, char *argv[]) {
+  static const char *states[] = {"closed", "opening", "reading", "running",
+                                 "done"};
+  unsigned i;
+
+  (void)argv;
+  if (argc > 0) {
+    usage(chp, "sessions");
+    return MSG_RESET;
+  }
+  chprintf(chp, "slot channel  state\r\n");
+  for (i = 0; i < SHELL_MAX_SESSIONS; i++) {
+    ShellSession *ssp = shell_sessions[i];
+
+    if (ssp != NULL)
+      chprintf(chp, "%4u %08lx %s%s\r\n", i,
+               (uint32_t)ssp->ss_config->sc_channel,
+               states[ssp->ss_state],
+               ssp->ss_thread != NULL ? ", own thread" : "");
+  }
+  chprintf(chp, "%lu pool lines, %lu long lines, worst wait %lu ms\r\n",
+           shell_pool_jobs, shell_long_jobs,
+           (uint32_t)ST2MS(shell_wait_max));
+  return MSG_OK;
+}
+
+/**
+ * @brief   Array of the default commands.
+ */
+static const ShellCommand local_commands[] = {
+  {"info", cmd_info, 0},
+  {"systime", cmd_systime, 0},
+  {"sessions", cmd_sessions, 0},
+  {NULL, NULL, 0}
+};
+
+static const ShellCommand *find_linear(const ShellCommand *scp,
+                                       const char *name) {
+
+  while (scp->sc_name != NULL) {
+    if (strcmp(scp->sc_name, name) == 0)
+      return scp;
+    scp++;
+  }
+  return NULL;
+}
+
+static const ShellCommand *find_hashed(const ShellHashTable *shp,
+                                       const char *name) {
+  const ShellCommand *scp;
+  unsigned bucket, slot;
+
+  bucket = shellHash(name, 0) % shp->sh_nbuckets;
+  slot = shellHash(name, shp->sh_disp[bucket]) & shp->sh_mask;
+  if (shp->sh_slots[slot] == SHELL_HASH_EMPTY)
+    return NULL;
+
+  /* A perfect hash only separates the known names, an unknown name still
+     lands on some slot and must be compared.*/
+  scp = &shp->sh_commands[shp->sh_slots[slot] - 1];
+  if (strcmp(scp->sc_name, name) != 0)
+    return NULL;
+  return scp;
+}
+
+static const ShellCommand *find_entry(const ShellConfig *scp,
+                                      const char *name) {
+  const ShellCommand *cmdp;
+
+  cmdp = find_linear(local_commands, name);
+  if (cmdp != NULL)
+    return cmdp;
+  if (scp->sc_hash != NULL)
+    return find_hashed(scp->sc_hash, name);
+  if (scp->sc_commands != NULL)
+    return find_linear(scp->sc_commands, name);
+  return NULL;
+}
+
+/*
+ * Line editor echo, a NULL stream means echo disabled. The wait for output
+ * space is bounded, the server thread echoes for all the sessions.
+ */
+static void echo_char(BaseSequentialStream *chp, char c) {
+
+  if (chp != NULL)
+    (void)chnPutTimeout((BaseChannel *)chp, c, SHELL_ECHO_TIMEOUT);
+}
+
+static void echo_string(BaseSequentialStream *chp, const char *s) {
+
+  while (*s != '\0')
+    echo_char(chp, *s++);
+}
+
+#if SHELL_HISTORY_DEPTH > 0
+/*
+ * Replaces the line being edited with another string on the terminal.
+ */
+static void replace_line(BaseSequentialStream *chp, ShellEditor *sep,
+                         const char *s) {
+
+  while (sep->se_pos > 0) {
+    echo_char(chp, 8);
+    echo_char(chp, 0x20);
+    echo_char(chp, 8);
+    sep->se_pos--;
+  }
+  while ((*s != '\0') && (sep->se_pos < sep->se_size - 1)) {
+    echo_char(chp, *s);
+    sep->se_line[sep->se_pos++] = *s++;
+  }
+}
+
+static void history_add(ShellHistory *shp, const char *line) {
+
+  if (*line == '\0')
+    return;
+  strncpy(shp->sh_lines[shp->sh_head], line, SHELL_MAX_LINE_LENGTH - 1);
+  shp->sh_lines[shp->sh_head][SHELL_MAX_LINE_LENGTH - 1] = '\0';
+  shp->sh_head = (shp->sh_head + 1) % SHELL_HISTORY_DEPTH;
+  if (shp->sh_count < SHELL_HISTORY_DEPTH)
+    shp->sh_count++;
+}
+
+/*
+ * Returns the history entry @p age lines back, one being the last line.
+ */
+static const char *history_get(ShellHistory *shp, unsigned age) {
+
+  return shp->sh_lines[(shp->sh_head + SHELL_HISTORY_DEPTH - age) %
+                       SHELL_HISTORY_DEPTH];
+}
+#endif /* SHELL_HISTORY_DEPTH > 0 */
+
+static void editor_init(ShellEditor *sep, char *line, unsigned size) {
+
+  sep->se_line = line;
+  sep->se_size = size;
+  sep->se_pos = 0;
+  sep->se_escape = SHELL_ESC_NONE;
+  sep->se_overflow = false;
+#if SHELL_HISTORY_DEPTH > 0
+  sep->se_age = 0;
+#endif
+}
+
+/*
+ * Line editor, processes one input character. The up/down arrow keys
+ * recall the lines of the history, if any, a completed line is added to it.
+ * A line longer than the buffer is returned empty with @p se_overflow set,
+ * none of its commands is executed.
+ */
+static int editor_feed(ShellEditor *sep, ShellHistory *shp,
+                       BaseSequentialStream *echo, char c) {
+
+  /* Escape sequences are consumed whole: ESC [ parameters final (CSI),
+     ESC O final (SS3) or ESC and a single character. A control character
+     aborts the sequence and is processed. The final bytes A and B are the
+     VT100 up and down arrow keys.*/
+  if ((sep->se_escape != SHELL_ESC_NONE) && ((unsigned char)c >= 0x20)) {
+    if (sep->se_escape == SHELL_ESC_START) {
+      sep->se_escape = (c == '[') ? SHELL_ESC_CSI :
+                       (c == 'O') ? SHELL_ESC_SS3 : SHELL_ESC_NONE;
+      return SHELL_INPUT_PENDING;
+    }
+    if ((sep->se_escape == SHELL_ESC_CSI) && ((unsigned char)c < 0x40))
+      return SHELL_INPUT_PENDING;
+    sep->se_escape = SHELL_ESC_NONE;
+#if SHELL_HISTORY_DEPTH > 0
+    if (shp == NULL)
+      return SHELL_INPUT_PENDING;
+    if ((c == 'A') && (sep->se_age < shp->sh_count)) {
+      sep->se_age++;
+      replace_line(echo, sep, history_get(shp, sep->se_age));
+    }
+    else if ((c == 'B') && (sep->se_age > 0)) {
+      sep->se_age--;
+      replace_line(echo, sep,
+                   sep->se_age > 0 ? history_get(shp, sep->se_age) : "");
+    }
+#else
+    (void)shp;
+#endif
+    return SHELL_INPUT_PENDING;
+  }
+  sep->se_escape = SHELL_ESC_NONE;
+  if (c == 27) {
+    sep->se_escape = SHELL_ESC_START;
+    return SHELL_INPUT_PENDING;
+  }
+  if (c == 4) {
+    echo_string(echo, "^D");
+    return SHELL_INPUT_EOF;
+  }
+  if ((c == 8) || (c == 127)) {
+    if (sep->se_pos > 0) {
+      echo_char(echo, c);
+      echo_char(echo, 0x20);
+      echo_char(echo, c);
+      sep->se_pos--;
+    }
+    return SHELL_INPUT_PENDING;
+  }
+  if (c == '\r') {
+    echo_string(echo, "\r\n");
+    if (sep->se_overflow)
+      sep->se_pos = 0;
+    sep->se_line[sep->se_pos] = 0;
+#if SHELL_HISTORY_DEPTH > 0
+    if (shp != NULL)
+      history_add(shp, sep->se_line);
+#endif
+    return SHELL_INPUT_LINE;
+  }
+  if (c >= 0x20) {
+    if (sep->se_pos < sep->se_size - 1) {
+      echo_char(echo, c);
+      sep->se_line[sep->se_pos++] = c;
+    }
+    else
+      sep->se_overflow = true;
+  }
+  return SHELL_INPUT_PENDING;
+}
+
+/*
+ * Splits the next command off a batch, in place. Commands are separated by
+ * semicolons or line ends outside of quotes.
+ */
+static char *parse_commands(char *str, char **saveptr) {
+  char *p, *cmd;
+  char quote;
+
+  p = (str != NULL) ? str : *saveptr;
+  if (p == NULL)
+    return NULL;
+
+  cmd = p;
+  quote = '\0';
+  while (*p != '\0') {
+    if (quote != '\0') {
+      if (*p == quote)
+        quote = '\0';
+    }
+    else if ((*p == '"') || (*p == '\'')) {
+      quote = *p;
+    }
+    else if ((*p == ';') || (*p == '\n') || (*p == '\r')) {
+      *p = '\0';
+      *saveptr = p + 1;
+      return cmd;
+    }
+    p++;
+  }
+  *saveptr = NULL;
+  return cmd;
+}
+
+/*
+ * Executes a single command line, built-in commands included.
+ */
+static int exec_command(ShellSession *ssp, char *line) {
+  const ShellConfig *scfg = ssp->ss_config;
+  BaseSequentialStream *chp = scfg->sc_channel;
+  char *lp, *cmd, *tokp;
+  char *args[SHELL_MAX_ARGUMENTS + 1];
+  shellcmd_t fn;
+  int n;
+
+  cmd = parse_arguments(line, &tokp);
+  if (cmd == NULL)
+    return SHELL_CMD_EMPTY;
+  n = 0;
+  while ((lp = parse_arguments(NULL, &tokp)) != NULL) {
+    if (n >= SHELL_MAX_ARGUMENTS) {
+      chprintf(chp, "too many arguments\r\n");
+      return SHELL_CMD_ERROR;
+    }
+    args[n++] = lp;
+  }
+  args[n] = NULL;
+
+  if (strcmp(cmd, "exit") == 0) {
+    if (n > 0) {
+      usage(chp, "exit");
+      return SHELL_CMD_ERROR;
+    }
+    return SHELL_CMD_EXIT;
+  }
+  if (strcmp(cmd, "help") == 0) {
+    if (n > 0) {
+      usage(chp, "help");
+      return SHELL_CMD_ERROR;
+    }
+    chprintf(chp, "Commands: help exit quiet ");
+    list_commands(chp, local_commands);
+    if (scfg->sc_commands != NULL)
+      list_commands(chp, scfg->sc_commands);
+    chprintf(chp, "\r\n");
+    return SHELL_CMD_OK;
+  }
+  if (strcmp(cmd, "quiet") == 0) {
+    if ((n != 1) ||
+        ((strcmp(args[0], "on") != 0) && (strcmp(args[0], "off") != 0))) {
+      usage(chp, "quiet on|off");
+      return SHELL_CMD_ERROR;
+    }
+    ssp->ss_quiet = strcmp(args[0], "on") == 0;
+    return SHELL_CMD_OK;
+  }
+  fn = shellFindCommand(scfg, cmd);
+  if (fn == NULL) {
+    chprintf(chp, "%s", cmd);
+    chprintf(chp, " ?\r\n");
+    return SHELL_CMD_ERROR;
+  }
+  return fn(chp, n, args) == MSG_OK ? SHELL_CMD_OK : SHELL_CMD_ERROR;
+}
+
+/*
+ * Executes the session line, returns true when the line ended the session.
+ */
+static bool run_line(ShellSession *ssp) {
+  BaseSequentialStream *chp = ssp->ss_config->sc_channel;
+  ShellBatchStatus status;
+
+  /* A truncated batch could run half of its commands, it is rejected
+     whole and counted as one failed command.*/
+  if (ssp->ss_editor.se_overflow) {
+    chprintf(chp, "line too long, %u characters max\r\n",
+             SHELL_MAX_LINE_LENGTH - 1);
+    if (ssp->ss_quiet)
+      chprintf(chp, "ERR 0/1\r\n");
+    return false;
+  }
+
+  shellExecScript(ssp, ssp->ss_line, &status);
+  if (status.sb_exit)
+    return true;
+
+  /* A single interactive command speaks for itself, batches and machine
+     clients get one status line for the whole line.*/
+  if (ssp->ss_quiet || (status.sb_commands > 1))
+    chprintf(chp, "%s %u/%u\r\n", status.sb_failed > 0 ? "ERR" : "OK",
+             status.sb_commands - status.sb_failed, status.sb_commands);
+  return false;
+}
+
+/*
+ * Checks whether a line holds a long command, the line is left untouched.
+ */
+static bool line_is_long(const ShellConfig *scp, const char *line) {
+  char name[SHELL_MAX_LINE_LENGTH];
+  const ShellCommand *cmdp;
+  unsigned n;
+  char quote;
+
+  while (*line != '\0') {
+    while ((*line == ' ') || (*line == '\t') || (*line == ';'))
+      line++;
+    n = 0;
+    while ((*line != '\0') && (*line != ' ') && (*line != '\t') &&
+           (*line != ';') && (n < sizeof(name) - 1))
+      name[n++] = *line++;
+    name[n] = '\0';
+    cmdp = find_entry(scp, name);
+    if ((cmdp != NULL) && ((cmdp->sc_flags & SHELL_FLAG_LONG) != 0))
+      return true;
+
+    /* Skips the arguments, up to the next command.*/
+    quote = '\0';
+    while (*line != '\0') {
+      char c = *line++;
+      if (quote != '\0') {
+        if (c == quote)
+          quote = '\0';
+      }
+      else if ((c == '"') || (c == '\''))
+        quote = c;
+      else if (c == ';')
+        break;
+    }
+  }
+  return false;
+}
+
+/*
+ * Executes a line of a served session and hands the session back to the
+ * server. A listener on the channel is registered for the execution time,
+ * the commands detect key presses with shellInterrupted().
+ */
+static void run_job(ShellSession *ssp) {
+  BaseAsynchronousChannel *acp;
+  event_listener_t el;
+  systime_t wait;
+
+  acp = (BaseAsynchronousChannel *)ssp->ss_config->sc_channel;
+  wait = chVTTimeElapsedSinceX(ssp->ss_queued);
+  if (wait > shell_wait_max)
+    shell_wait_max = wait;
+  (void)chEvtGetAndClearEvents(SHELL_INPUT_EVENT);
+  chEvtRegisterMaskWithFlags(chnGetEventSource(acp), &el,
+                             SHELL_INPUT_EVENT, CHN_INPUT_AVAILABLE);
+  ssp->ss_exit = run_line(ssp);
+  if (!ssp->ss_exit && !ssp->ss_quiet)
+    chprintf((BaseSequentialStream *)acp, "ch> ");
+  chEvtUnregister(chnGetEventSource(acp), &el);
+
+  chSysLock();
+  ssp->ss_state = SHELL_SESSION_DONE;
+  chEvtSignalI(shell_server_tp, SHELL_SERVER_EVENT);
+  chSchRescheduleS();
+  chSysUnlock();
+}
+
+/**
+ * @brief   Pool worker, executes the queued lines one after the other.
+ */
+static THD_FUNCTION(shell_worker, p) {
+
+  (void)p;
+  chRegSetThreadName("shellw");
+  while (true) {
+    msg_t msg;
+
+    if (chMBFetch(&shell_jobs, &msg, TIME_INFINITE) == MSG_OK)
+      run_job((ShellSession *)msg);
+  }
+}
+
+#if (CH_CFG_USE_HEAP && CH_CFG_USE_DYNAMIC) || defined(__DOXYGEN__)
+/**
+ * @brief   Dedicated thread of a line holding a long command.
+ */
+static THD_FUNCTION(shell_long, p) {
+
+  chRegSetThreadName("shelll");
+  run_job(p);
+}
+#endif
+
+/*
+ * Hands a completed line to a long command thread or to the pool.
+ */
+static void dispatch(ShellSession *ssp) {
+
+  ssp->ss_state = SHELL_SESSION_RUNNING;
+  ssp->ss_thread = NULL;
+  ssp->ss_queued = chVTGetSystemTimeX();
+#if CH_CFG_USE_HEAP && CH_CFG_USE_DYNAMIC
+  /* Without heap memory the line waits for a pool worker.*/
+  if (line_is_long(ssp->ss_config, ssp->ss_line))
+    ssp->ss_thread = chThdCreateFromHeap(NULL, SHELL_LONG_WA_SIZE,
+                                         chThdGetPriorityX(), shell_long,
+                                         ssp);
+  if (ssp->ss_thread != NULL) {
+    shell_long_jobs++;
+    return;
+  }
+#endif
+  shell_pool_jobs++;
+  (void)chMBPost(&shell_jobs, (msg_t)ssp, TIME_INFINITE);
+}
+
+static void close_session(ShellSession *ssp) {
+
+  chEvtUnregister(chnGetEventSource(
+                    (BaseAsynchronousChannel *)ssp->ss_config->sc_channel),
+                  &ssp->ss_input);
+  chSysLock();
+  shell_sessions[ssp->ss_index] = NULL;
+  ssp->ss_state = SHELL_SESSION_CLOSED;
+  chEvtBroadcastI(&shell_terminated);
+  chSchRescheduleS();
+  chSysUnlock();
+}
+
+/*
+ * Consumes the input of a reading session, a connection change on a USB
+ * channel ends the session like a reset of its queues.
+ */
+static void serve_input(ShellSession *ssp) {
+  int input = SHELL_INPUT_EOF;
+
+  if ((chEvtGetAndClearFlags(&ssp->ss_input) &
+       (CHN_CONNECTED | CHN_DISCONNECTED)) == 0)
+    input = shellFeedInput(ssp);
+  if (input == SHELL_INPUT_LINE)
+    dispatch(ssp);
+  else if (input == SHELL_INPUT_EOF) {
+    echo_string(ssp->ss_config->sc_channel, "\r\nlogout");
+    close_session(ssp);
+  }
+}
+
+/**
+ * @brief   Shell server, runs the line editors of all the sessions.
+ * @details Session @p i signals its channel events with @p EVENT_MASK(i),
+ *          openings and completed executions with @p SHELL_SERVER_EVENT.
+ */
+static THD_FUNCTION(shell_server, p) {
+
+  (void)p;
+  chRegSetThreadName("shell");
+  while (true) {
+    eventmask_t events = chEvtWaitAny(ALL_EVENTS);
+    unsigned i;
+
+    for (i = 0; i < SHELL_MAX_SESSIONS; i++) {
+      ShellSession *ssp = shell_sessions[i];
+      BaseSequentialStream *chp;
+
+      if (ssp == NULL)
+        continue;
+      chp = ssp->ss_config->sc_channel;
+      switch (ssp->ss_state) {
+      case SHELL_SESSION_OPENING:
+        chEvtRegisterMaskWithFlags(chnGetEventSource(
+                                     (BaseAsynchronousChannel *)chp),
+                                   &ssp->ss_input, EVENT_MASK(i),
+                                   CHN_INPUT_AVAILABLE | CHN_CONNECTED |
+                                   CHN_DISCONNECTED);
+        echo_string(chp, "\r\nChibiOS/RT Shell\r\nch> ");
+        ssp->ss_state = SHELL_SESSION_READING;
+        editor_init(&ssp->ss_editor, ssp->ss_line, sizeof(ssp->ss_line));
+        serve_input(ssp);
+        break;
+      case SHELL_SESSION_DONE:
+        if (ssp->ss_thread != NULL) {
+          (void)chThdWait(ssp->ss_thread);
+          ssp->ss_thread = NULL;
+        }
+        if (ssp->ss_exit) {
+          close_session(ssp);
+          break;
+        }
+        ssp->ss_state = SHELL_SESSION_READING;
+        editor_init(&ssp->ss_editor, ssp->ss_line, sizeof(ssp->ss_line));
+        serve_input(ssp);
+        break;
+      case SHELL_SESSION_READING:
+        if ((events & EVENT_MASK(i)) != 0)
+          serve_input(ssp);
+        break;
+      default:
+        break;
+      }
+    }
+  }
+}
+
+/**
+ * @brief   Shell thread function.
+ *
+ * @param[in] p         pointer to a @p BaseSequentialStream object
+ */
+static THD_FUNCTION(shell_thread, p) {
+  ShellSession session;
+  BaseSequentialStream *chp;
+  int input;
+
+  chRegSetThreadName("shell");
+  session.ss_config = p;
+  session.ss_history.sh_head = 0;
+  session.ss_history.sh_count = 0;
+  session.ss_quiet = false;
+  chp = session.ss_config->sc_channel;
+
+  /* The thread sleeps until the channel signals input, whatever was
+     received is consumed at once. A connection change on a USB channel
+     ends the session like a reset of its queues.*/
+  chEvtRegisterMaskWithFlags(chnGetEventSource(
+                               (BaseAsynchronousChannel *)chp),
+                             &session.ss_input, SHELL_INPUT_EVENT,
+                             CHN_INPUT_AVAILABLE | CHN_CONNECTED |
+                             CHN_DISCONNECTED);
+  chprintf(chp, "\r\nChibiOS/RT Shell\r\n");
+  while (true) {
+    if (!session.ss_quiet)
+      chprintf(chp, "ch> ");
+    editor_init(&session.ss_editor, session.ss_line,
+                sizeof(session.ss_line));
+    while ((input = shellFeedInput(&session)) == SHELL_INPUT_PENDING) {
+      chEvtWaitAny(SHELL_INPUT_EVENT);
+      if ((chEvtGetAndClearFlags(&session.ss_input) &
+           (CHN_CONNECTED | CHN_DISCONNECTED)) != 0) {
+        input = SHELL_INPUT_EOF;
+        break;
+      }
+    }
+    if (input == SHELL_INPUT_EOF) {
+      chprintf(chp, "\r\nlogout");
+      break;
+    }
+    if (run_line(&session))
+      break;
+  }
+  chEvtUnregister(chnGetEventSource((BaseAsynchronousChannel *)chp),
+                  &session.ss_input);
+  shellExit(MSG_OK);
+}
+
+/*===========================================================================*/
+/* Module exported functions.                                                */
+/*===========================================================================*/
+
+/**
+ * @brief   Shell manager initialization.
+ *
+ * @api
+ */
+void shellInit(void) {
+
+  chEvtObjectInit(&shell_terminated);
+}
+
+/**
+ * @brief   Terminates the shell.
+ * @note    Must be invoked from the command handlers.
+ * @note    Does not return.
+ *
+ * @param[in] msg       shell exit code
+ *
+ * @api
+ */
+void shellExit(msg_t msg) {
+
+  /* Atomically broadcasting the event source and terminating the thread,
+     there is not a chSysUnlock() because the thread terminates upon return.*/
+  chSysLock();
+  chEvtBroadcastI(&shell_terminated);
+  chThdExitS(msg);
+}
+
+/**
+ * @brief   Spawns a new shell.
+ * @pre     @p CH_CFG_USE_HEAP and @p CH_CFG_USE_DYNAMIC must be enabled.
+ *
+ * @param[in] scp       pointer to a @p ShellConfig object
+ * @param[in] size      size of the shell working area to be allocated
+ * @param[in] prio      priority level for the new shell
+ * @return              A pointer to the shell thread.
+ * @retval NULL         thread creation failed because memory allocation.
+ *
+ * @api
+ */
+#if CH_CFG_USE_HEAP && CH_CFG_USE_DYNAMIC
+thread_t *shellCreate(const ShellConfig *scp, size_t size, tprio_t prio) {
+
+  return chThdCreateFromHeap(NULL, size, prio, shell_thread, (void *)scp);
+}
+#endif
+
+/**
+ * @brief   Create statically allocated shell thread.
+ *
+ * @param[in] scp       pointer to a @p ShellConfig object
+ * @param[in] wsp       pointer to a working area dedicated to the shell thread stack
+ * @param[in] size      size of the shell working area
+ * @param[in] prio      priority level for the new shell
+ * @return              A pointer to the shell thread.
+ *
+ * @api
+ */
+thread_t *shellCreateStatic(const ShellConfig *scp, void *wsp,
+                            size_t size, tprio_t prio) {
+
+  return chThdCreateStatic(wsp, size, prio, shell_thread, (void *)scp);
+}
+
+/**
+ * @brief   Starts the shell server and its pool workers.
+ * @details The server runs the line editors of all the open sessions, the
+ *          completed lines are executed by the @p SHELL_WORKERS pool
+ *          workers, or by a thread allocated from the heap when they hold
+ *          a command flagged @p SHELL_FLAG_LONG.
+ *
+ * @param[in] prio      priority level of the server and the workers
+ *
+ * @api
+ */
+void shellServerStart(tprio_t prio) {
+  unsigned i;
+
+  chDbgAssert(shell_server_tp == NULL, "already started");
+
+  for (i = 0; i < SHELL_WORKERS; i++)
+    (void)chThdCreateStatic(shell_worker_wa[i], sizeof(shell_worker_wa[i]),
+                            prio, shell_worker, NULL);
+  shell_server_tp = chThdCreateStatic(shell_server_wa, sizeof(shell_server_wa),
+                                      prio, shell_server, NULL);
+}
+
+/**
+ * @brief   Opens a shell session on the server.
+ * @details The session is served until CTRL-D, @p exit or a reset of its
+ *          channel, it is then closed and @p shell_terminated broadcast.
+ * @pre     The server must have been started with @p shellServerStart().
+ *
+ * @param[out] ssp      pointer to a closed @p ShellSession object
+ * @param[in] scp       pointer to a @p ShellConfig object, its channel must
+ *                      be a @p BaseAsynchronousChannel
+ * @return              The operation status.
+ * @retval MSG_OK       the session is open.
+ * @retval MSG_RESET    @p SHELL_MAX_SESSIONS sessions are already open.
+ *
+ * @api
+ */
+msg_t shellOpen(ShellSession *ssp, const ShellConfig *scp) {
+  unsigned i;
+
+  chDbgCheck((ssp != NULL) && (scp != NULL));
+  chDbgAssert(shell_server_tp != NULL, "server not started");
+  chDbgAssert(shellIsClosed(ssp), "session open");
+
+  ssp->ss_config = scp;
+  ssp->ss_history.sh_head = 0;
+  ssp->ss_history.sh_count = 0;
+  ssp->ss_quiet = false;
+  ssp->ss_thread = NULL;
+  ssp->ss_exit = false;
+
+  chSysLock();
+  for (i = 0; i < SHELL_MAX_SESSIONS; i++) {
+    if (shell_sessions[i] == NULL)
+      break;
+  }
+  if (i >= SHELL_MAX_SESSIONS) {
+    chSysUnlock();
+    return MSG_RESET;
+  }
+  ssp->ss_index = i;
+  ssp->ss_state = SHELL_SESSION_OPENING;
+  shell_sessions[i] = ssp;
+  chEvtSignalI(shell_server_tp, SHELL_SERVER_EVENT);
+  chSchRescheduleS();
+  chSysUnlock();
+  return MSG_OK;
+}
+
+/**
+ * @brief   Reads a whole line from the input channel.
+ * @details The up/down arrow keys recall the lines stored in the session
+ *          history, the line returned is added to the history before being
+ *          tokenized by the caller. Nothing is echoed in quiet mode. A line
+ *          longer than the buffer is reported and returned empty.
+ *
+ * @param[in] chp       pointer to a @p BaseSequentialStream object
+ * @param[in] line      pointer to the line buffer
+ * @param[in] size      buffer maximum length
+ * @param[in] ssp       pointer to a @p ShellSession object or @p NULL
+ * @return              The operation status.
+ * @retval true         the channel was reset or CTRL-D pressed.
+ * @retval false        operation successful.
+ *
+ * @api
+ */
+bool shellGetLine(BaseSequentialStream *chp, char *line,
+                  unsigned size, ShellSession *ssp) {
+  ShellEditor editor;
+  BaseSequentialStream *echo;
+  ShellHistory *shp;
+
+  echo = ((ssp != NULL) && ssp->ss_quiet) ? NULL : chp;
+  shp = (ssp != NULL) ? &ssp->ss_history : NULL;
+  editor_init(&editor, line, size);
+  while (true) {
+    char c;
+    int input;
+
+    if (chSequentialStreamRead(chp, (uint8_t *)&c, 1) == 0)
+      return true;
+    input = editor_feed(&editor, shp, echo, c);
+    if ((input == SHELL_INPUT_LINE) && editor.se_overflow)
+      chprintf(chp, "line too long, %u characters max\r\n", size - 1);
+    if (input != SHELL_INPUT_PENDING)
+      return input == SHELL_INPUT_EOF;
+  }
+}
+
+/**
+ * @brief   Feeds the available input to the session line editor.
+ * @details Consumes the characters already received by the session channel
+ *          without blocking, up to the end of a line. The caller waits on
+ *          the @p ss_input listener when the line is still incomplete.
+ *
+ * @param[in] ssp       pointer to a @p ShellSession object
+ * @return              The input status.
+ * @retval SHELL_INPUT_PENDING  no more input, the line is incomplete.
+ * @retval SHELL_INPUT_LINE     a line is ready in @p ss_line.
+ * @retval SHELL_INPUT_EOF      the channel was reset or CTRL-D pressed.
+ *
+ * @api
+ */
+int shellFeedInput(ShellSession *ssp) {
+  BaseSequentialStream *chp = ssp->ss_config->sc_channel;
+  BaseSequentialStream *echo = ssp->ss_quiet ? NULL : chp;
+
+  while (true) {
+    msg_t c;
+    int input;
+
+    c = chnGetTimeout((BaseChannel *)chp, TIME_IMMEDIATE);
+    if (c == Q_TIMEOUT)
+      return SHELL_INPUT_PENDING;
+    if (c < 0)
+      return SHELL_INPUT_EOF;
+    input = editor_feed(&ssp->ss_editor, &ssp->ss_history, echo, (char)c);
+    if (input != SHELL_INPUT_PENDING)
+      return input;
+  }
+}
+
+/**
+ * @brief   Checks whether a key was pressed while a command is running.
+ * @details Long running commands call it between steps, it costs an events
+ *          mask test until the channel signals input. The characters then
+ *          received are discarded, a lone line feed left over from a CR LF
+ *          terminal does not count as a key.
+ * @note    Must be invoked from the command handlers.
+ *
+ * @param[in] chp       the command channel
+ * @return              The interruption status.
+ * @retval true         a key was pressed or the channel was reset.
+ * @retval false        no input.
+ *
+ * @api
+ */
+bool shellInterrupted(BaseSequentialStream *chp) {
+  bool key = false;
+  msg_t c;
+
+  if (chEvtGetAndClearEvents(SHELL_INPUT_EVENT) == 0)
+    return false;
+  while ((c = chnGetTimeout((BaseChannel *)chp, TIME_IMMEDIATE)) !=
+         Q_TIMEOUT) {
+    if (c != '\n')
+      key = true;
+    if (c < 0)
+      break;
+  }
+  return key;
+}
+
+/**
+ * @brief   Executes a batch of commands back to back.
+ * @details Commands are separated by semicolons or line ends, a stored
+ *          script can be run as well as a single input line. No prompt is
+ *          printed between the commands, execution stops at @p exit.
+ *          A command fails when it is unknown, when a built-in command is
+ *          misused or when the handler does not return @p MSG_OK, a usage
+ *          line or an operation that did not complete.
+ * @note    The script buffer is modified in place.
+ *
+ * @param[in] ssp       pointer to the @p ShellSession executing the batch
+ * @param[in] script    the commands, a NUL-terminated string
+ * @param[out] sbp      pointer to the combined status of the batch
+ *
+ * @api
+ */
+void shellExecScript(ShellSession *ssp, char *script, ShellBatchStatus *sbp) {
+  char *cmd, *savep;
+
+  sbp->sb_commands = 0;
+  sbp->sb_failed = 0;
+  sbp->sb_exit = false;
+  cmd = parse_commands(script, &savep);
+  while (cmd != NULL) {
+    switch (exec_command(ssp, cmd)) {
+    case SHELL_CMD_EMPTY:
+      break;
+    case SHELL_CMD_EXIT:
+      sbp->sb_exit = true;
+      return;
+    case SHELL_CMD_ERROR:
+      sbp->sb_failed++;
+      /* Falls through.*/
+    default:
+      sbp->sb_commands++;
+    }
+    cmd = parse_commands(NULL, &savep);
+  }
+}
+
+/**
+ * @brief   Hash function shared with the table generator.
+ * @details FNV-1a over the name, the seed is folded into the offset basis.
+ *          The result is XOR-folded, the low bits of a plain FNV-1a only
+ *          depend on the low bits of the seed.
+ *
+ * @param[in] name      command name
+ * @param[in] seed      hash seed
+ * @return              The 32 bits hash value.
+ *
+ * @api
+ */
+uint32_t shellHash(const char *name, uint32_t seed) {
+  uint32_t h = FNV_OFFSET_BASIS ^ seed;
+
+  while (*name != '\0') {
+    h ^= (uint8_t)*name++;
+    h *= FNV_PRIME;
+  }
+  return h ^ (h >> 16);
+}
+
+/**
+ * @brief   Looks up a command by name.
+ * @details The shell built-in commands are searched first, then the
+ *          configured commands through their hash index if present or by
+ *          a linear scan otherwise.
+ *
+ * @param[in] scp       pointer to a @p ShellConfig object
+ * @param[in] name      command name
+ * @return              The command function.
+ * @retval NULL         unknown command.
+ *
+ * @api
+ */
+shellcmd_t shellFindCommand(const ShellConfig *scp, const char *name) {
+  const ShellCommand *cmdp;
+
+  cmdp = find_entry(scp, name);
+  return cmdp != NULL ? cmdp->sc_function : NULL;
+}
+
+/** @} */
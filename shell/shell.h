@@ -0,0 +1,354 @@
+/*
+    ChibiOS - Copyright (C) 2006..2015 Giovanni Di Sirio
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+/**
+ * @file    shell.h
+ * @brief   Simple CLI shell header.
+ *
+ * @addtogroup SHELL
+ * @{
+ */
+
+#ifndef _SHELL_H_
+#define _SHELL_H_
+
+/*===========================================================================*/
+/* Module constants.                                                         */
+/*===========================================================================*/
+
+/**
+ * @brief   Marker of an unused slot in a @p ShellHashTable.
+ */
+#define SHELL_HASH_EMPTY            0
+
+/**
+ * @name    Input status
+ * @{
+ */
+#define SHELL_INPUT_PENDING         0       /**< @brief Line incomplete.    */
+#define SHELL_INPUT_LINE            1       /**< @brief Line completed.     */
+#define SHELL_INPUT_EOF             2       /**< @brief CTRL-D pressed or
+                                                 channel reset.             */
+/** @} */
+
+/**
+ * @name    Session states
+ * @{
+ */
+#define SHELL_SESSION_CLOSED        0       /**< @brief Not served.         */
+#define SHELL_SESSION_OPENING       1       /**< @brief Queued to the
+                                                 server.                    */
+#define SHELL_SESSION_READING       2       /**< @brief Line being edited.  */
+#define SHELL_SESSION_RUNNING       3       /**< @brief Line being executed
+                                                 by a worker.               */
+#define SHELL_SESSION_DONE          4       /**< @brief Execution finished,
+                                                 back to the server.        */
+/** @} */
+
+/**
+ * @brief   Command flag, the command runs for seconds or until a key press.
+ * @details A line holding such a command is executed by a thread of its
+ *          own instead of occupying a pool worker.
+ */
+#define SHELL_FLAG_LONG             1
+
+/*===========================================================================*/
+/* Module pre-compile time settings.                                         */
+/*===========================================================================*/
+
+/**
+ * @brief   Shell maximum input line length.
+ * @details Includes the terminator, a longer line is rejected whole.
+ */
+#if !defined(SHELL_MAX_LINE_LENGTH) || defined(__DOXYGEN__)
+#define SHELL_MAX_LINE_LENGTH       64
+#endif
+
+/**
+ * @brief   Shell maximum arguments per command.
+ */
+#if !defined(SHELL_MAX_ARGUMENTS) || defined(__DOXYGEN__)
+#define SHELL_MAX_ARGUMENTS         4
+#endif
+
+/**
+ * @brief   Number of previous lines kept by the line editor.
+ * @note    Each entry takes @p SHELL_MAX_LINE_LENGTH bytes of each
+ *          session object, zero disables the history.
+ */
+#if !defined(SHELL_HISTORY_DEPTH) || defined(__DOXYGEN__)
+#define SHELL_HISTORY_DEPTH         4
+#endif
+
+/**
+ * @brief   Event mask of the session channel listener.
+ * @note    Commands running in the shell thread must not use it for their
+ *          own listeners.
+ */
+#if !defined(SHELL_INPUT_EVENT) || defined(__DOXYGEN__)
+#define SHELL_INPUT_EVENT           EVENT_MASK(0)
+#endif
+
+/**
+ * @brief   Maximum number of sessions served at once by the shell server.
+ */
+#if !defined(SHELL_MAX_SESSIONS) || defined(__DOXYGEN__)
+#define SHELL_MAX_SESSIONS          4
+#endif
+
+/**
+ * @brief   Number of pool workers executing the command lines.
+ */
+#if !defined(SHELL_WORKERS) || defined(__DOXYGEN__)
+#define SHELL_WORKERS               1
+#endif
+
+/**
+ * @brief   Stack of the server thread, it only runs the line editors.
+ */
+#if !defined(SHELL_SERVER_STACK_SIZE) || defined(__DOXYGEN__)
+#define SHELL_SERVER_STACK_SIZE     512
+#endif
+
+/**
+ * @brief   Stack of each pool worker.
+ */
+#if !defined(SHELL_WORKER_STACK_SIZE) || defined(__DOXYGEN__)
+#define SHELL_WORKER_STACK_SIZE     2048
+#endif
+
+/**
+ * @brief   Stack of the threads allocated from the heap for long commands.
+ */
+#if !defined(SHELL_LONG_STACK_SIZE) || defined(__DOXYGEN__)
+#define SHELL_LONG_STACK_SIZE       2048
+#endif
+
+/**
+ * @brief   Longest wait of the server for output space on a channel.
+ * @details Echo and messages written by the server are dropped past it, a
+ *          host not reading its port cannot stall the other sessions.
+ */
+#if !defined(SHELL_ECHO_TIMEOUT) || defined(__DOXYGEN__)
+#define SHELL_ECHO_TIMEOUT          MS2ST(100)
+#endif
+
+/*===========================================================================*/
+/* Derived constants and error checks.                                       */
+/*===========================================================================*/
+
+#if (SHELL_MAX_SESSIONS < 1) || (SHELL_MAX_SESSIONS > 30)
+#error "SHELL_MAX_SESSIONS must be within 1 and 30"
+#endif
+
+#if SHELL_WORKERS < 1
+#error "SHELL_WORKERS must be at least 1"
+#endif
+
+/*===========================================================================*/
+/* Module data structures and types.                                         */
+/*===========================================================================*/
+
+/**
+ * @brief   Command handler function type.
+ * @details The handler returns @p MSG_OK on success, any other value, a
+ *          usage error or a failed operation, counts the command as failed
+ *          in the status of its batch.
+ */
+typedef msg_t (*shellcmd_t)(BaseSequentialStream *chp, int argc, char *argv[]);
+
+/**
+ * @brief   Custom command entry type.
+ */
+typedef struct {
+  const char            *sc_name;           /**< @brief Command name.       */
+  shellcmd_t            sc_function;        /**< @brief Command function.   */
+  unsigned              sc_flags;           /**< @brief Command flags.      */
+} ShellCommand;
+
+/**
+ * @brief   Perfect hash index over a commands array.
+ * @details The tables are generated at build time by @p shellhash.py, a
+ *          name is looked up with two hash evaluations and a single
+ *          @p strcmp() whatever the number of commands.
+ */
+typedef struct {
+  /**
+   * @brief   Indexed commands array, in the generator input order.
+   */
+  const ShellCommand    *sh_commands;
+  /**
+   * @brief   Per-bucket hash seeds.
+   */
+  const uint8_t         *sh_disp;
+  /**
+   * @brief   Slot to command map, entries are indexes plus one.
+   */
+  const uint8_t         *sh_slots;
+  /**
+   * @brief   Number of buckets in @p sh_disp.
+   */
+  uint16_t              sh_nbuckets;
+  /**
+   * @brief   Slots mask, the number of slots is a power of two.
+   */
+  uint16_t              sh_mask;
+} ShellHashTable;
+
+/**
+ * @brief   Shell descriptor type.
+ */
+typedef struct {
+  BaseSequentialStream  *sc_channel;        /**< @brief I/O channel associated
+                                                 to the shell.              */
+  const ShellCommand    *sc_commands;       /**< @brief Shell extra commands
+                                                 table.                     */
+  const ShellHashTable  *sc_hash;           /**< @brief Optional perfect
+                                                 hash of @p sc_commands.    */
+} ShellConfig;
+
+/**
+ * @brief   Line editor history buffer.
+ */
+typedef struct {
+#if (SHELL_HISTORY_DEPTH > 0) || defined(__DOXYGEN__)
+  char                  sh_lines[SHELL_HISTORY_DEPTH][SHELL_MAX_LINE_LENGTH];
+#endif
+  unsigned              sh_head;            /**< @brief Next entry to be
+                                                 written.                   */
+  unsigned              sh_count;           /**< @brief Stored entries.     */
+} ShellHistory;
+
+/**
+ * @brief   Line editor state, a line is assembled one character at a time.
+ */
+typedef struct {
+  char                  *se_line;           /**< @brief Line buffer.        */
+  unsigned              se_size;            /**< @brief Buffer size.        */
+  unsigned              se_pos;             /**< @brief Characters in the
+                                                 line.                      */
+#if (SHELL_HISTORY_DEPTH > 0) || defined(__DOXYGEN__)
+  unsigned              se_age;             /**< @brief History entry shown,
+                                                 zero for a new line.       */
+#endif
+  unsigned              se_escape;          /**< @brief Escape sequence
+                                                 progress.                  */
+  bool                  se_overflow;        /**< @brief Characters dropped,
+                                                 the line is rejected.      */
+} ShellEditor;
+
+/**
+ * @brief   Shell session state.
+ * @details The session channel must be a @p BaseAsynchronousChannel, its
+ *          input is consumed when the channel event source signals it. A
+ *          session is either run by a shell thread of its own or opened on
+ *          the shell server, which serves all its sessions with a single
+ *          thread and executes their lines on a pool of workers.
+ */
+typedef struct {
+  const ShellConfig     *ss_config;         /**< @brief Shell configuration.*/
+  ShellHistory          ss_history;         /**< @brief Line editor history.*/
+  ShellEditor           ss_editor;          /**< @brief Line being edited.  */
+  char                  ss_line[SHELL_MAX_LINE_LENGTH];
+  event_listener_t      ss_input;           /**< @brief Channel listener.   */
+  bool                  ss_quiet;           /**< @brief No prompt and echo,
+                                                 one status line per input
+                                                 line.                      */
+  unsigned              ss_state;           /**< @brief Server state.       */
+  unsigned              ss_index;           /**< @brief Server slot.        */
+  thread_t              *ss_thread;         /**< @brief Long command thread
+                                                 or @p NULL.                */
+  bool                  ss_exit;            /**< @brief Ended by @p exit.   */
+  systime_t             ss_queued;          /**< @brief Time the line was
+                                                 completed.                 */
+} ShellSession;
+
+/**
+ * @brief   Combined status of a commands batch.
+ */
+typedef struct {
+  unsigned              sb_commands;        /**< @brief Commands executed.  */
+  unsigned              sb_failed;          /**< @brief Unknown commands and
+                                                 commands not returning
+                                                 @p MSG_OK.                 */
+  bool                  sb_exit;            /**< @brief Batch stopped by
+                                                 @p exit.                   */
+} ShellBatchStatus;
+
+/*===========================================================================*/
+/* Module macros.                                                            */
+/*===========================================================================*/
+
+/**
+ * @brief   Defines a @p ShellHashTable from generated initializers.
+ * @details The generated header provides @p SHELL_HASH_BUCKETS,
+ *          @p SHELL_HASH_SLOTS, @p SHELL_HASH_DISP_INIT and
+ *          @p SHELL_HASH_SLOTS_INIT for the commands list it was built from.
+ *
+ * @param[in] name      name of the table object
+ * @param[in] commands  the commands array the hash was generated for
+ */
+#define SHELL_HASH_TABLE(name, commands)                                    \
+  static const uint8_t name##_disp[SHELL_HASH_BUCKETS] =                    \
+    SHELL_HASH_DISP_INIT;                                                   \
+  static const uint8_t name##_slots[SHELL_HASH_SLOTS] =                     \
+    SHELL_HASH_SLOTS_INIT;                                                  \
+  static const ShellHashTable name = {                                      \
+    commands, name##_disp, name##_slots,                                    \
+    SHELL_HASH_BUCKETS, SHELL_HASH_SLOTS - 1                                \
+  }
+
+/**
+ * @brief   Checks whether a session is out of the server.
+ * @details A closed session can be opened again.
+ *
+ * @param[in] ssp       pointer to a @p ShellSession object
+ * @return              The session status.
+ */
+#define shellIsClosed(ssp) ((ssp)->ss_state == SHELL_SESSION_CLOSED)
+
+/*===========================================================================*/
+/* External declarations.                                                    */
+/*===========================================================================*/
+
+#if !defined(__DOXYGEN__)
+extern event_source_t shell_terminated;
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+  void shellInit(void);
+  void shellExit(msg_t msg);
+  thread_t *shellCreate(const ShellConfig *scp, size_t size, tprio_t prio);
+  thread_t *shellCreateStatic(const ShellConfig *scp, void *wsp,
+                              size_t size, tprio_t prio);
+  void shellServerStart(tprio_t prio);
+  msg_t shellOpen(ShellSession *ssp, const ShellConfig *scp);
+  bool shellGetLine(BaseSequentialStream *chp, char *line,
+                    unsigned size, ShellSession *ssp);
+  int shellFeedInput(ShellSession *ssp);
+  bool shellInterrupted(BaseSequentialStream *chp);
+  void shellExecScript(ShellSession *ssp, char *script, ShellBatchStatus *sbp);
+  uint32_t shellHash(const char *name, uint32_t seed);
+  shellcmd_t shellFindCommand(const ShellConfig *scp, const char *name);
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _SHELL_H_ */
+
+/** @} */
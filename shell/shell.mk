@@ -0,0 +1,8 @@
+# List of the project shell files.
+SHELLSRC = ./shell/shell.c
+
+# Required include directories
+SHELLINC = ./shell/
+
+# Perfect hash table generator for the shell commands list.
+SHELLGEN = ./shell/shellhash.py
@@ -0,0 +1,111 @@
+#!/usr/bin/env python3
+#
+# Generates the perfect hash index of a shell commands list.
+#
+# The input is an X-macro list of SHELL_COMMAND(name, function) entries,
+# SHELL_LONG_COMMAND entries included,
+# the output is a header defining the SHELL_HASH_* initializers used by the
+# SHELL_HASH_TABLE() macro in shell.h. The hash must match shellHash() in
+# shell.c: FNV-1a 32 bits with the seed XORed into the offset basis and
+# the result XOR-folded so that the low bits used as slot index depend on
+# the whole seed.
+#
+# Usage: shellhash.py <commands list> <output header>
+#
+
+import os
+import re
+import sys
+
+FNV_OFFSET_BASIS = 2166136261
+FNV_PRIME = 16777619
+
+MAX_COMMANDS = 254
+MAX_SEED = 255
+
+
+def shell_hash(name, seed):
+    h = FNV_OFFSET_BASIS ^ seed
+    for c in name.encode('ascii'):
+        h ^= c
+        h = (h * FNV_PRIME) & 0xFFFFFFFF
+    return h ^ (h >> 16)
+
+
+def build(names):
+    """Hash and displace: the names are split in buckets by the seed zero
+    hash, then each bucket, largest first, is given the first seed that
+    places all its names in free slots."""
+    nbuckets = max(1, (len(names) + 3) // 4)
+    nslots = 1
+    while nslots < len(names):
+        nslots *= 2
+
+    while True:
+        buckets = [[] for _ in range(nbuckets)]
+        for index, name in enumerate(names):
+            buckets[shell_hash(name, 0) % nbuckets].append(index)
+        order = sorted(range(nbuckets), key=lambda b: -len(buckets[b]))
+
+        disp = [0] * nbuckets
+        slots = [0] * nslots
+        for b in order:
+            if not buckets[b]:
+                continue
+            for seed in range(1, MAX_SEED + 1):
+                taken = [shell_hash(names[i], seed) & (nslots - 1)
+                         for i in buckets[b]]
+                if len(set(taken)) == len(taken) and \
+                   all(slots[t] == 0 for t in taken):
+                    break
+            else:
+                break
+            disp[b] = seed
+            for i, t in zip(buckets[b], taken):
+                slots[t] = i + 1
+        else:
+            return disp, slots
+        nslots *= 2
+
+
+def initializer(values):
+    lines = []
+    for i in range(0, len(values), 12):
+        lines.append(', '.join('%3d' % v for v in values[i:i + 12]))
+    return '{%s}' % (', \\\n   '.join(lines))
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.exit('usage: shellhash.py <commands list> <output header>')
+
+    text = open(sys.argv[1]).read()
+    text = re.sub(r'/\*.*?\*/', '', text, flags=re.S)
+    names = re.findall(r'^\s*SHELL_(?:LONG_)?COMMAND\s*\(\s*(\w+)\s*,',
+                       text, re.M)
+    if not names:
+        sys.exit('%s: no SHELL_COMMAND entries' % sys.argv[1])
+    if len(names) > MAX_COMMANDS:
+        sys.exit('%s: more than %d commands' % (sys.argv[1], MAX_COMMANDS))
+    if len(set(names)) != len(names):
+        sys.exit('%s: duplicated command names' % sys.argv[1])
+
+    disp, slots = build(names)
+    guard = '_%s_' % re.sub(r'\W', '_',
+                            os.path.basename(sys.argv[2])).upper()
+    with open(sys.argv[2], 'w') as f:
+        f.write('/*\n'
+                ' * Generated by shellhash.py from %s, do not edit.\n'
+                ' */\n\n' % os.path.basename(sys.argv[1]))
+        f.write('#ifndef %s\n#define %s\n\n' % (guard, guard))
+        f.write('#define SHELL_HASH_BUCKETS      %d\n' % len(disp))
+        f.write('#define SHELL_HASH_SLOTS        %d\n\n' % len(slots))
+        f.write('#define SHELL_HASH_DISP_INIT                                '
+                '                \\\n  %s\n\n' % initializer(disp))
+        f.write('#define SHELL_HASH_SLOTS_INIT                               '
+                '                \\\n  %s\n\n' % initializer(slots))
+        f.write('#endif /* %s */\n' % guard)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,43 @@
+/*
+    ChibiOS - Copyright (C) 2006..2015 Giovanni Di Sirio
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+/*
+ * Application shell commands list, one SHELL_COMMAND(name, function) entry
+ * per command, SHELL_LONG_COMMAND(name, function) for the commands running
+ * for seconds, they are given a thread of their own by the shell server.
+ * The list is expanded into the commands array in main.c and
+ * shellcmds_hash.h is regenerated from it by the Makefile, keep one entry
+ * per line.
+ */
+
+SHELL_COMMAND(mem, cmd_mem)
+SHELL_COMMAND(threads, cmd_threads)
+SHELL_LONG_COMMAND(test, cmd_test)
+SHELL_LONG_COMMAND(write, cmd_write)
+SHELL_LONG_COMMAND(status, cmd_status)
+SHELL_COMMAND(adc, cmd_adc)
+SHELL_LONG_COMMAND(dsp, cmd_dsp)
+SHELL_LONG_COMMAND(log, cmd_log)
+SHELL_COMMAND(clock, cmd_clock)
+SHELL_LONG_COMMAND(ram, cmd_ram)
+SHELL_COMMAND(cpp, cmd_cpp)
+SHELL_LONG_COMMAND(spi, cmd_spi)
+SHELL_LONG_COMMAND(eeprom, cmd_eeprom)
+SHELL_COMMAND(wear, cmd_wear)
+SHELL_COMMAND(param, cmd_param)
+SHELL_COMMAND(metrics, cmd_metrics)
+SHELL_COMMAND(trace, cmd_trace)
+SHELL_LONG_COMMAND(serial, cmd_serial)
@@ -0,0 +1,19 @@
+/*
+ * Generated by shellhash.py from shellcmds.h, do not edit.
+ */
+
+#ifndef _SHELLCMDS_HASH_H_
+#define _SHELLCMDS_HASH_H_
+
+#define SHELL_HASH_BUCKETS      5
+#define SHELL_HASH_SLOTS        32
+
+#define SHELL_HASH_DISP_INIT                                                \
+  {  2,   2,   3,   3,   9}
+
+#define SHELL_HASH_SLOTS_INIT                                               \
+  {  6,   0,   5,   0,   0,   4,  11,   3,   0,  16,   0,  18, \
+     0,   0,  14,   0,   0,   0,  13,   7,   0,  12,  10,   0, \
+    15,  17,   1,   9,   0,   2,   8,   0}
+
+#endif /* _SHELLCMDS_HASH_H_ */
@@ -0,0 +1,232 @@
+/*
+    ChibiOS - Copyright (C) 2006..2015 Giovanni Di Sirio
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+
+/**
+ * @file    spibus.c
+ * @brief   Shared SPI bus manager code.
+ * @details The bus ownership is the SPI driver mutex, waiting clients are
+ *          queued by priority and the owner inherits the priority of the
+ *          highest waiting one. The clients keep the bus for bounded
+ *          transfers only, the time spent waiting for the bus and holding
+ *          it is recorded per client.
+ *
+ * @addtogroup SPIBUS
+ * @{
+ */
+
+#include "ch.h"
+#include "hal.h"
+#include "chprintf.h"
+
+#include "spibus.h"
+#include "clock.h"
+
+/*===========================================================================*/
+/* Driver local definitions.                                                 */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Driver local functions.                                                   */
+/*===========================================================================*/
+
+static uint32_t cycles_to_us(rtcnt_t cycles) {
+
+  return cycles / (clockGetCurrentProfile()->hclk / 1000000);
+}
+
+static void hist_add(uint32_t *hist, uint32_t us) {
+  uint32_t limit = SPIBUS_HIST_BASE_US;
+  unsigned bin = 0;
+
+  while ((us >= limit) && (bin < SPIBUS_HIST_BINS - 1)) {
+    limit <<= 1;
+    bin++;
+  }
+  hist[bin]++;
+}
+
+static void hist_print(BaseSequentialStream *chp, const char *name,
+                       const uint32_t *hist) {
+  unsigned i;
+
+  chprintf(chp, "  %-6s", name);
+  for (i = 0; i < SPIBUS_HIST_BINS; i++)
+    chprintf(chp, " %6lu", hist[i]);
+  chprintf(chp, "\r\n");
+}
+
+static void client_reset(SPIBusClient *clp) {
+  unsigned i;
+
+  clp->transactions = 0;
+  clp->wait_max     = 0;
+  clp->hold_max     = 0;
+  for (i = 0; i < SPIBUS_HIST_BINS; i++) {
+    clp->wait_hist[i] = 0;
+    clp->hold_hist[i] = 0;
+  }
+}
+
+/*===========================================================================*/
+/* Driver exported functions.                                                */
+/*===========================================================================*/
+
+/**
+ * @brief   Initializes a bus.
+ *
+ * @param[out] busp     pointer to the @p SPIBus object
+ * @param[in] spip      pointer to the SPI driver of the bus
+ *
+ * @init
+ */
+void spibusObjectInit(SPIBus *busp, SPIDriver *spip) {
+
+  busp->spip     = spip;
+  busp->clients  = NULL;
+  busp->acquired = 0;
+  busp->busy_us  = 0;
+  busp->since    = chVTGetSystemTimeX();
+}
+
+/**
+ * @brief   Attaches a client to a bus.
+ * @note    A client already attached is only reconfigured.
+ *
+ * @param[out] clp      pointer to the @p SPIBusClient object
+ * @param[in] busp      pointer to the @p SPIBus object
+ * @param[in] name      client name
+ * @param[in] config    SPI configuration of the device
+ *
+ * @api
+ */
+void spibusClientInit(SPIBusClient *clp, SPIBus *busp, const char *name,
+                      const SPIConfig *config) {
+  SPIBusClient *p;
+
+  osalDbgCheck((clp != NULL) && (busp != NULL) && (config != NULL));
+
+  spiAcquireBus(busp->spip);
+  clp->name   = name;
+  clp->config = config;
+  for (p = busp->clients; p != NULL; p = p->next) {
+    if (p == clp)
+      break;
+  }
+  if (p == NULL) {
+    client_reset(clp);
+    clp->busp     = busp;
+    clp->next     = busp->clients;
+    busp->clients = clp;
+  }
+  spiReleaseBus(busp->spip);
+}
+
+/**
+ * @brief   Gains the bus ownership.
+ * @details The SPI driver is started with the client configuration.
+ *
+ * @param[in] clp       pointer to the @p SPIBusClient object
+ *
+ * @api
+ */
+void spibusAcquire(SPIBusClient *clp) {
+  SPIBus *busp = clp->busp;
+  rtcnt_t start = chSysGetRealtimeCounterX();
+  uint32_t us;
+
+  spiAcquireBus(busp->spip);
+  busp->acquired = chSysGetRealtimeCounterX();
+  us = cycles_to_us(busp->acquired - start);
+  hist_add(clp->wait_hist, us);
+  if (us > clp->wait_max)
+    clp->wait_max = us;
+  clp->transactions++;
+  spiStart(busp->spip, clp->config);
+}
+
+/**
+ * @brief   Releases the bus ownership.
+ *
+ * @param[in] clp       pointer to the @p SPIBusClient object
+ *
+ * @api
+ */
+void spibusRelease(SPIBusClient *clp) {
+  SPIBus *busp = clp->busp;
+  uint32_t us;
+
+  us = cycles_to_us(chSysGetRealtimeCounterX() - busp->acquired);
+  hist_add(clp->hold_hist, us);
+  if (us > clp->hold_max)
+    clp->hold_max = us;
+  busp->busy_us += us;
+  spiReleaseBus(busp->spip);
+}
+
+/**
+ * @brief   Clears the statistics of a bus and of its clients.
+ *
+ * @param[in] busp      pointer to the @p SPIBus object
+ *
+ * @api
+ */
+void spibusResetStats(SPIBus *busp) {
+  SPIBusClient *clp;
+
+  spiAcquireBus(busp->spip);
+  for (clp = busp->clients; clp != NULL; clp = clp->next)
+    client_reset(clp);
+  busp->busy_us = 0;
+  busp->since   = chVTGetSystemTimeX();
+  spiReleaseBus(busp->spip);
+}
+
+/**
+ * @brief   Prints the bus occupancy and the histograms of the clients.
+ * @note    The figures are read without owning the bus, the output would
+ *          otherwise delay the clients.
+ *
+ * @param[in] chp       pointer to the output stream
+ * @param[in] busp      pointer to the @p SPIBus object
+ *
+ * @api
+ */
+void spibusDump(BaseSequentialStream *chp, SPIBus *busp) {
+  SPIBusClient *clp;
+  uint32_t ms, limit;
+  unsigned i;
+
+  ms = ST2MS(chVTTimeElapsedSinceX(busp->since));
+  chprintf(chp, "bus busy %lu us in %lu ms, %lu.%lu%%\r\n",
+           busp->busy_us, ms,
+           ms > 0 ? busp->busy_us / (ms * 10) : 0,
+           ms > 0 ? (busp->busy_us / ms) % 10 : 0);
+  for (clp = busp->clients; clp != NULL; clp = clp->next) {
+    chprintf(chp, "%s: %lu transactions, wait max %lu us, hold max %lu us\r\n",
+             clp->name, clp->transactions, clp->wait_max, clp->hold_max);
+    chprintf(chp, "  %-6s", "us <");
+    for (i = 0, limit = SPIBUS_HIST_BASE_US; i < SPIBUS_HIST_BINS - 1; i++) {
+      chprintf(chp, " %6lu", limit);
+      limit <<= 1;
+    }
+    chprintf(chp, "   more\r\n");
+    hist_print(chp, "wait", clp->wait_hist);
+    hist_print(chp, "hold", clp->hold_hist);
+  }
+}
+
+/** @} */
@@ -0,0 +1,186 @@
+/*
+    ChibiOS - Copyright (C) 2006..2015 Giovanni Di Sirio
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+/**
+ * @file    spibus.h
+ * @brief   Shared SPI bus manager header.
+ *
+ * @addtogroup SPIBUS
+ * @{
+ */
+
+#ifndef _SPIBUS_H_
+#define _SPIBUS_H_
+
+/*===========================================================================*/
+/* Driver constants.                                                         */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Driver pre-compile time settings.                                         */
+/*===========================================================================*/
+
+/**
+ * @brief   Largest transfer performed in a single bus ownership.
+ * @details Longer transfers are split by the device drivers, the bus is
+ *          released between the chunks so that a higher priority client
+ *          waits at most one chunk.
+ */
+#if !defined(SPIBUS_CHUNK_SIZE) || defined(__DOXYGEN__)
+#define SPIBUS_CHUNK_SIZE           64
+#endif
+
+/**
+ * @brief   Number of bins of the wait and hold time histograms.
+ */
+#if !defined(SPIBUS_HIST_BINS) || defined(__DOXYGEN__)
+#define SPIBUS_HIST_BINS            10
+#endif
+
+/**
+ * @brief   Upper bound of the first histogram bin in microseconds.
+ * @details Each following bin doubles the bound, the last one collects
+ *          everything above.
+ */
+#if !defined(SPIBUS_HIST_BASE_US) || defined(__DOXYGEN__)
+#define SPIBUS_HIST_BASE_US         16
+#endif
+
+/*===========================================================================*/
+/* Derived constants and error checks.                                       */
+/*===========================================================================*/
+
+#if !HAL_USE_SPI || !SPI_USE_MUTUAL_EXCLUSION
+#error "the SPI bus manager requires HAL_USE_SPI and SPI_USE_MUTUAL_EXCLUSION"
+#endif
+
+#if !CH_CFG_USE_MUTEXES
+#error "the SPI bus manager requires CH_CFG_USE_MUTEXES"
+#endif
+
+#if SPIBUS_CHUNK_SIZE < 1
+#error "invalid SPIBUS_CHUNK_SIZE value"
+#endif
+
+/*===========================================================================*/
+/* Driver data structures and types.                                         */
+/*===========================================================================*/
+
+/**
+ * @brief   Type of a bus client.
+ */
+typedef struct SPIBusClient SPIBusClient;
+
+/**
+ * @brief   Shared SPI bus structure.
+ */
+typedef struct {
+  /**
+   * @brief   SPI driver of the bus.
+   */
+  SPIDriver             *spip;
+  /**
+   * @brief   List of the registered clients.
+   */
+  SPIBusClient          *clients;
+  /**
+   * @brief   Realtime counter value when the current owner took the bus.
+   */
+  rtcnt_t               acquired;
+  /**
+   * @brief   Total bus ownership time in microseconds.
+   */
+  uint32_t              busy_us;
+  /**
+   * @brief   Start of the statistics period.
+   */
+  systime_t             since;
+} SPIBus;
+
+/**
+ * @brief   Bus client structure, one per device and chip select.
+ */
+struct SPIBusClient {
+  /**
+   * @brief   Next client of the same bus.
+   */
+  SPIBusClient          *next;
+  /**
+   * @brief   Bus the client is attached to.
+   */
+  SPIBus                *busp;
+  /**
+   * @brief   Client name.
+   */
+  const char            *name;
+  /**
+   * @brief   SPI configuration of the device.
+   */
+  const SPIConfig       *config;
+  /**
+   * @brief   Number of bus ownerships.
+   */
+  uint32_t              transactions;
+  /**
+   * @brief   Longest wait for the bus in microseconds.
+   */
+  uint32_t              wait_max;
+  /**
+   * @brief   Longest bus ownership in microseconds.
+   */
+  uint32_t              hold_max;
+  /**
+   * @brief   Histogram of the waits for the bus.
+   */
+  uint32_t              wait_hist[SPIBUS_HIST_BINS];
+  /**
+   * @brief   Histogram of the bus ownerships.
+   */
+  uint32_t              hold_hist[SPIBUS_HIST_BINS];
+};
+
+/*===========================================================================*/
+/* Driver macros.                                                            */
+/*===========================================================================*/
+
+/**
+ * @brief   SPI driver of a client.
+ *
+ * @param[in] clp       pointer to the @p SPIBusClient object
+ */
+#define spibusGetDriver(clp) ((clp)->busp->spip)
+
+/*===========================================================================*/
+/* External declarations.                                                    */
+/*===========================================================================*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+  void spibusObjectInit(SPIBus *busp, SPIDriver *spip);
+  void spibusClientInit(SPIBusClient *clp, SPIBus *busp, const char *name,
+                        const SPIConfig *config);
+  void spibusAcquire(SPIBusClient *clp);
+  void spibusRelease(SPIBusClient *clp);
+  void spibusResetStats(SPIBus *busp);
+  void spibusDump(BaseSequentialStream *chp, SPIBus *busp);
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _SPIBUS_H_ */
+
+/** @} */
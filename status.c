@@ -0,0 +1,320 @@
+/*
+    ChibiOS - Copyright (C) 2006..2015 Giovanni Di Sirio
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+/**
+ * @file    status.c
+ * @brief   Status LED indicator code.
+ * @details The system state is shown as a blink pattern on the status LED.
+ *          A single virtual timer drives the LED, it is armed for the
+ *          length of the current run of identical pattern steps so the
+ *          callback only runs on the LED edges.
+ *          With @p STATUS_USE_DMA the pattern is instead expanded into a
+ *          table of GPIOC BSRR words that a TIM6-paced circular DMA
+ *          transfer writes one per step.
+ *
+ * @addtogroup STATUS
+ * @{
+ */
+
+#include "ch.h"
+#include "hal.h"
+
+#include "status.h"
+
+/*===========================================================================*/
+/* Module local definitions.                                                 */
+/*===========================================================================*/
+
+#define STATUS_STEPS        16
+
+#define STATUS_DMA_STREAM   STM32_DMA2_STREAM3
+
+/* TIM6 counts at 10kHz, one update event per pattern step.*/
+#define STATUS_TIM_CLOCK    10000
+
+/*===========================================================================*/
+/* Module exported variables.                                                */
+/*===========================================================================*/
+
+/**
+ * @brief   State change event source, the changed flags are broadcast.
+ */
+event_source_t status_changed;
+
+/*===========================================================================*/
+/* Module local types.                                                       */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Module local variables.                                                   */
+/*===========================================================================*/
+
+/*
+ * Blink patterns, bit N set means the LED is lit during step N. Index zero
+ * is the heartbeat shown when no flag is raised, then one pattern per flag.
+ */
+static const uint16_t patterns[] = {
+  0x0F0F,                               /* Heartbeat, 500 ms.               */
+  0x00FF,                               /* CAN link, 1 s.                   */
+  0x3333,                               /* USB active, 250 ms.              */
+  0x5555,                               /* EEPROM busy, 125 ms flicker.     */
+  0x0015                                /* Fault, three blinks and pause.   */
+};
+
+static statusflags_t status_flags;
+static uint16_t status_pattern;
+static uint32_t status_wakeups;
+#if STATUS_USE_DMA
+static uint32_t status_bsrr[STATUS_STEPS];
+#else
+static virtual_timer_t status_vt;
+static unsigned status_step;
+#endif
+
+/*===========================================================================*/
+/* Module local functions.                                                   */
+/*===========================================================================*/
+
+static uint16_t select_pattern(statusflags_t flags) {
+  unsigned i = 0;
+
+  while (flags != 0) {
+    flags >>= 1;
+    i++;
+  }
+  chDbgAssert(i < sizeof patterns / sizeof patterns[0], "unknown flag");
+  return patterns[i];
+}
+
+#if STATUS_USE_DMA
+/*
+ * Expands the pattern into BSRR words, the transfer in progress picks the
+ * new words up on its next step.
+ */
+static void status_update_i(void) {
+  unsigned i;
+
+  for (i = 0; i < STATUS_STEPS; i++) {
+    if ((status_pattern >> i) & 1U)
+      status_bsrr[i] = 1U << (GPIOC_LED_STATUS1 + 16);
+    else
+      status_bsrr[i] = 1U << GPIOC_LED_STATUS1;
+  }
+  status_wakeups++;
+}
+
+static void status_dma_start(void) {
+  bool b;
+
+  b = dmaStreamAllocate(STATUS_DMA_STREAM, 0, NULL, NULL);
+  osalDbgAssert(!b, "stream already allocated");
+  dmaStreamSetPeripheral(STATUS_DMA_STREAM, &GPIOC->BSRR);
+  dmaStreamSetMemory0(STATUS_DMA_STREAM, status_bsrr);
+  dmaStreamSetTransactionSize(STATUS_DMA_STREAM, STATUS_STEPS);
+  dmaStreamSetMode(STATUS_DMA_STREAM,
+                   STM32_DMA_CR_PL(STATUS_DMA_PRIORITY) |
+                   STM32_DMA_CR_DIR_M2P | STM32_DMA_CR_MINC |
+                   STM32_DMA_CR_PSIZE_WORD | STM32_DMA_CR_MSIZE_WORD |
+                   STM32_DMA_CR_CIRC);
+  dmaStreamEnable(STATUS_DMA_STREAM);
+
+  rccEnableAPB1(RCC_APB1ENR_TIM6EN, FALSE);
+  TIM6->CR1  = 0;
+  TIM6->PSC  = (STM32_TIMCLK1 / STATUS_TIM_CLOCK) - 1;
+  TIM6->ARR  = (STATUS_STEP_MS * (STATUS_TIM_CLOCK / 1000)) - 1;
+  TIM6->EGR  = TIM_EGR_UG;
+  TIM6->SR   = 0;
+  TIM6->DIER = TIM_DIER_UDE;
+  TIM6->CR1  = TIM_CR1_CEN;
+}
+#else /* !STATUS_USE_DMA */
+static void status_cb(void *p);
+
+/*
+ * Drives the LED for the current step and sleeps until the pattern changes
+ * level, a constant pattern wakes up once per period.
+ */
+static void status_update_i(void) {
+  unsigned n;
+  bool on;
+
+  on = ((status_pattern >> status_step) & 1U) != 0U;
+  if (on)
+    palClearPad(GPIOC, GPIOC_LED_STATUS1);
+  else
+    palSetPad(GPIOC, GPIOC_LED_STATUS1);
+
+  n = 1;
+  while ((n < STATUS_STEPS) &&
+         ((((status_pattern >> ((status_step + n) % STATUS_STEPS)) & 1U)
+           != 0U) == on))
+    n++;
+  status_step = (status_step + n) % STATUS_STEPS;
+  status_wakeups++;
+  chVTSetI(&status_vt, MS2ST(STATUS_STEP_MS * n), status_cb, NULL);
+}
+
+static void status_cb(void *p) {
+
+  (void)p;
+  chSysLockFromISR();
+  status_update_i();
+  chSysUnlockFromISR();
+}
+#endif /* !STATUS_USE_DMA */
+
+static void status_change_i(statusflags_t flags) {
+  statusflags_t changed = flags ^ status_flags;
+  uint16_t pattern;
+
+  if (changed == 0)
+    return;
+  status_flags = flags;
+  pattern = select_pattern(flags);
+  if (pattern != status_pattern) {
+    status_pattern = pattern;
+#if !STATUS_USE_DMA
+    status_step = 0;
+#endif
+    status_update_i();
+  }
+  chEvtBroadcastFlagsI(&status_changed, changed);
+}
+
+/*===========================================================================*/
+/* Module exported functions.                                                */
+/*===========================================================================*/
+
+/**
+ * @brief   Starts the status indicator with no flags raised.
+ *
+ * @init
+ */
+void statusInit(void) {
+
+  chEvtObjectInit(&status_changed);
+  status_flags = 0;
+  status_pattern = patterns[0];
+  status_wakeups = 0;
+#if STATUS_USE_DMA
+  status_update_i();
+  status_dma_start();
+#else
+  chVTObjectInit(&status_vt);
+  status_step = 0;
+  chSysLock();
+  status_update_i();
+  chSysUnlock();
+#endif
+}
+
+/**
+ * @brief   Raises system state flags.
+ *
+ * @param[in] flags     flags to be raised
+ *
+ * @iclass
+ */
+void statusSetI(statusflags_t flags) {
+
+  chDbgCheckClassI();
+
+  status_change_i(status_flags | flags);
+}
+
+/**
+ * @brief   Clears system state flags.
+ *
+ * @param[in] flags     flags to be cleared
+ *
+ * @iclass
+ */
+void statusClearI(statusflags_t flags) {
+
+  chDbgCheckClassI();
+
+  status_change_i(status_flags & ~flags);
+}
+
+/**
+ * @brief   Raises system state flags.
+ *
+ * @param[in] flags     flags to be raised
+ *
+ * @api
+ */
+void statusSet(statusflags_t flags) {
+
+  chSysLock();
+  statusSetI(flags);
+  chSchRescheduleS();
+  chSysUnlock();
+}
+
+/**
+ * @brief   Clears system state flags.
+ *
+ * @param[in] flags     flags to be cleared
+ *
+ * @api
+ */
+void statusClear(statusflags_t flags) {
+
+  chSysLock();
+  statusClearI(flags);
+  chSchRescheduleS();
+  chSysUnlock();
+}
+
+/**
+ * @brief   Returns the raised system state flags.
+ *
+ * @return              The current flags.
+ *
+ * @xclass
+ */
+statusflags_t statusGetFlags(void) {
+
+  return status_flags;
+}
+
+/**
+ * @brief   Returns the blink pattern being displayed.
+ * @details Bit N is set when the LED is lit during step N.
+ *
+ * @return              The pattern.
+ *
+ * @xclass
+ */
+uint16_t statusGetPattern(void) {
+
+  return status_pattern;
+}
+
+/**
+ * @brief   Returns the number of times the CPU updated the LED so far.
+ * @note    With @p STATUS_USE_DMA only pattern changes are counted.
+ *
+ * @return              The updates counter.
+ *
+ * @xclass
+ */
+uint32_t statusGetWakeups(void) {
+
+  return status_wakeups;
+}
+
+/** @} */
@@ -0,0 +1,126 @@
+/*
+    ChibiOS - Copyright (C) 2006..2015 Giovanni Di Sirio
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+/**
+ * @file    status.h
+ * @brief   Status LED indicator header.
+ *
+ * @addtogroup STATUS
+ * @{
+ */
+
+#ifndef _STATUS_H_
+#define _STATUS_H_
+
+/*===========================================================================*/
+/* Module constants.                                                         */
+/*===========================================================================*/
+
+/**
+ * @name    System state flags
+ * @note    Listed by increasing display priority, the LED shows the
+ *          pattern of the highest flag raised.
+ * @{
+ */
+#define STATUS_CAN_LINK             (1U << 0)   /**< CAN bus active.        */
+#define STATUS_USB_ACTIVE           (1U << 1)   /**< USB host configured.   */
+#define STATUS_EEPROM_BUSY          (1U << 2)   /**< EEPROM write cycle.    */
+#define STATUS_FAULT                (1U << 3)   /**< Unrecovered error.     */
+/** @} */
+
+/*===========================================================================*/
+/* Module pre-compile time settings.                                         */
+/*===========================================================================*/
+
+/**
+ * @brief   Duration of a pattern step in milliseconds.
+ * @note    A pattern is 16 steps long.
+ */
+#if !defined(STATUS_STEP_MS) || defined(__DOXYGEN__)
+#define STATUS_STEP_MS              125
+#endif
+
+/**
+ * @brief   Pattern generation by DMA instead of the virtual timer.
+ * @details When enabled TIM6 update events trigger a circular DMA transfer
+ *          of precomputed BSRR words to GPIOC, the CPU is only involved
+ *          when the state flags change. TIM6 and DMA2 channel 3 are
+ *          reserved by the status LED.
+ * @note    PC0 is not a timer output on the STM32F107 so the LED cannot be
+ *          driven by a PWM channel directly.
+ */
+#if !defined(STATUS_USE_DMA) || defined(__DOXYGEN__)
+#define STATUS_USE_DMA              TRUE
+#endif
+
+/**
+ * @brief   DMA priority of the pattern transfer.
+ */
+#if !defined(STATUS_DMA_PRIORITY) || defined(__DOXYGEN__)
+#define STATUS_DMA_PRIORITY         0
+#endif
+
+/*===========================================================================*/
+/* Derived constants and error checks.                                       */
+/*===========================================================================*/
+
+#if STATUS_USE_DMA && !STM32_HAS_DMA2
+#error "STATUS_USE_DMA requires DMA2"
+#endif
+
+#if STATUS_USE_DMA && ((STATUS_STEP_MS * 10) > 65536)
+#error "STATUS_STEP_MS too large for the TIM6 period"
+#endif
+
+/*===========================================================================*/
+/* Module data structures and types.                                         */
+/*===========================================================================*/
+
+/**
+ * @brief   Type of a set of system state flags.
+ */
+typedef uint32_t statusflags_t;
+
+/*===========================================================================*/
+/* Module macros.                                                            */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* External declarations.                                                    */
+/*===========================================================================*/
+
+#if !defined(__DOXYGEN__)
+extern event_source_t status_changed;
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+  void statusInit(void);
+  void statusSetI(statusflags_t flags);
+  void statusClearI(statusflags_t flags);
+  void statusSet(statusflags_t flags);
+  void statusClear(statusflags_t flags);
+  statusflags_t statusGetFlags(void);
+  uint16_t statusGetPattern(void);
+  uint32_t statusGetWakeups(void);
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _STATUS_H_ */
+
+/** @} */
@@ -0,0 +1,98 @@
+#!/usr/bin/env python3
+#
+# Read throughput model of the AT25xxx read-ahead window.
+#
+# Replays the at25Read() policy for a scan of fixed size records: a read
+# shorter than the window and starting where the previous one ended
+# refills the window with one READ instruction, reads inside the window
+# are copies from RAM, anything else is a direct READ. Each READ costs the
+# software overhead of the bus and the chip select plus the 3 bytes of
+# instruction and address at the SPI clock.
+#
+# Usage: at25_read_model.py [--records 4,8,16,32] [--windows 0,32,64]
+#                           [--bytes N] [--chunk N] [--sck HZ]
+#                           [--overhead US] [--call US]
+#
+
+import argparse
+
+
+class Model:
+
+    def __init__(self, window, size, args):
+        self.window = window
+        self.size = size
+        self.args = args
+        self.ra_addr = 0
+        self.ra_len = 0
+        self.next = 0
+        self.hits = 0
+        self.misses = 0
+        self.time = 0.0
+
+    def transaction(self, n):
+        self.time += self.args.overhead * 1e-6 + (3 + n) * 8.0 / self.args.sck
+
+    def holds(self, addr):
+        return self.ra_addr <= addr < self.ra_addr + self.ra_len
+
+    def read(self, addr, n):
+        self.time += self.args.call * 1e-6
+        accessed = False
+        while n > 0:
+            chunk = min(n, self.args.chunk)
+            if self.window and not self.holds(addr) and \
+               addr == self.next and n < self.window:
+                self.ra_addr = addr
+                self.ra_len = min(self.window, self.size - addr)
+                self.transaction(self.ra_len)
+                accessed = True
+            if self.window and self.holds(addr):
+                chunk = min(chunk, self.ra_addr + self.ra_len - addr)
+            else:
+                self.transaction(chunk)
+                accessed = True
+            self.next = addr + chunk
+            addr += chunk
+            n -= chunk
+        if accessed:
+            self.misses += 1
+        else:
+            self.hits += 1
+
+
+def main():
+    ap = argparse.ArgumentParser(description='AT25xxx read-ahead model.')
+    ap.add_argument('--records', default='4,8,16,32',
+                    help='comma separated record sizes')
+    ap.add_argument('--windows', default='0,32,64',
+                    help='comma separated read-ahead window sizes')
+    ap.add_argument('--bytes', type=int, default=4096,
+                    help='bytes scanned')
+    ap.add_argument('--chunk', type=int, default=64,
+                    help='largest transfer per bus ownership')
+    ap.add_argument('--sck', type=float, default=2250000, help='SPI clock')
+    ap.add_argument('--overhead', type=float, default=15.0,
+                    help='per READ software and chip select overhead in us')
+    ap.add_argument('--call', type=float, default=2.0,
+                    help='per at25Read() call overhead in us')
+    args = ap.parse_args()
+
+    windows = [int(w) for w in args.windows.split(',')]
+    print('%6s %6s %10s %8s %8s %8s' %
+          ('record', 'window', 'bytes/s', 'hits', 'misses', 'speedup'))
+    for record in [int(r) for r in args.records.split(',')]:
+        base = None
+        for window in windows:
+            m = Model(window, args.bytes, args)
+            for addr in range(0, args.bytes - record + 1, record):
+                m.read(addr, record)
+            rate = args.bytes / m.time
+            if base is None:
+                base = rate
+            print('%6d %6d %10.0f %8d %8d %7.2fx' %
+                  (record, window, rate, m.hits, m.misses, rate / base))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,85 @@
+#!/usr/bin/env python3
+#
+# Write throughput model of an AT25xxx array.
+#
+# Replays the page programs issued by at25arrayWrite() against simulated
+# devices: a page program owns the bus for the WREN and WRITE instructions,
+# then the device is busy for the write cycle. An access to a busy device
+# polls the status register once per system tick, as the driver does, the
+# other devices keep being programmed meanwhile.
+#
+# Usage: at25_stripe_model.py [--chips 1,2,4] [--bytes N] [--size N]
+#                             [--page N] [--sck HZ] [--twc MS] [--tick MS]
+#                             [--overhead US]
+#
+
+import argparse
+
+
+def transfer(nbytes, args):
+    """Bus time in seconds of an instruction of nbytes bytes."""
+    return args.overhead * 1e-6 + nbytes * 8.0 / args.sck
+
+
+def simulate(chips, striped, args):
+    """Seconds spent writing args.bytes bytes, from the first page program
+    to the end of the last write cycle."""
+    ready = [0.0] * chips
+    dev_pages = args.size // args.page
+    t = 0.0
+    pages = args.bytes // args.page
+    for page in range(pages):
+        dev = page % chips if striped else min(page // dev_pages, chips - 1)
+        while True:
+            t += transfer(2, args)          # RDSR poll
+            if t >= ready[dev]:
+                break
+            t += args.tick * 1e-3
+        t += transfer(1, args)              # WREN
+        t += transfer(3 + args.page, args)  # WRITE
+        ready[dev] = t + args.twc * 1e-3
+    # at25arraySync()
+    for dev in range(chips):
+        while True:
+            t += transfer(2, args)
+            if t >= ready[dev]:
+                break
+            t += args.tick * 1e-3
+    return t
+
+
+def main():
+    ap = argparse.ArgumentParser(description='AT25xxx array write model.')
+    ap.add_argument('--chips', default='1,2,4',
+                    help='comma separated device counts')
+    ap.add_argument('--bytes', type=int, default=4096,
+                    help='bytes written sequentially')
+    ap.add_argument('--size', type=int, default=4096,
+                    help='capacity of each device')
+    ap.add_argument('--page', type=int, default=32, help='page size')
+    ap.add_argument('--sck', type=float, default=2250000, help='SPI clock')
+    ap.add_argument('--twc', type=float, default=5.0,
+                    help='write cycle time in ms')
+    ap.add_argument('--tick', type=float, default=1.0,
+                    help='status poll interval in ms')
+    ap.add_argument('--overhead', type=float, default=10.0,
+                    help='per instruction software overhead in us')
+    args = ap.parse_args()
+
+    base = None
+    print('%5s %-8s %10s %10s %8s' %
+          ('chips', 'mode', 'ms', 'bytes/s', 'speedup'))
+    for chips in [int(c) for c in args.chips.split(',')]:
+        for striped in (False, True):
+            if chips == 1 and striped:
+                continue
+            t = simulate(chips, striped, args)
+            if base is None:
+                base = t
+            print('%5d %-8s %10.1f %10.0f %7.2fx' %
+                  (chips, 'striped' if striped else 'linear', t * 1e3,
+                   args.bytes / t, base / t))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,97 @@
+#!/usr/bin/env python3
+#
+# Page programs of configuration update traces with and without the
+# AT25xxx read-compare write avoidance.
+#
+# Each trace rewrites a whole configuration block after every update, as
+# an application saving its settings structure does. Without the compare
+# every page of the block is programmed, with it only the pages whose
+# content changed are, at the cost of one READ per page.
+#
+# Usage: at25_write_trace.py [--updates N] [--page N] [--seed N]
+#                            [--twc MS] [--read US]
+#
+
+import argparse
+import random
+import struct
+
+
+def trace_field(rng, updates):
+    """256 bytes settings block, one 32 bits field changed per save."""
+    block = bytearray(256)
+    for _ in range(updates):
+        field = rng.randrange(64)
+        block[field * 4:field * 4 + 4] = struct.pack('<I',
+                                                     rng.getrandbits(32))
+        yield bytes(block)
+
+
+def trace_periodic(rng, updates):
+    """256 bytes settings block saved periodically, changed once in ten
+    saves."""
+    block = bytearray(256)
+    for _ in range(updates):
+        if rng.randrange(10) == 0:
+            field = rng.randrange(64)
+            block[field * 4:field * 4 + 4] = struct.pack(
+                '<I', rng.getrandbits(32))
+        yield bytes(block)
+
+
+def trace_counters(rng, updates):
+    """64 bytes of sixteen 32 bits event counters, one incremented per
+    save."""
+    counters = [0] * 16
+    for _ in range(updates):
+        counters[min(int(rng.expovariate(0.5)), 15)] += 1
+        yield struct.pack('<16I', *counters)
+
+
+TRACES = (('field update', trace_field),
+          ('periodic save', trace_periodic),
+          ('counters', trace_counters))
+
+
+def replay(blocks, page):
+    """(programs without compare, programs with compare, reads)."""
+    device = None
+    plain = compared = reads = 0
+    for block in blocks:
+        if device is None:
+            device = bytearray(len(block))
+        for off in range(0, len(block), page):
+            plain += 1
+            reads += 1
+            if device[off:off + page] != block[off:off + page]:
+                compared += 1
+                device[off:off + page] = block[off:off + page]
+    return plain, compared, reads
+
+
+def main():
+    ap = argparse.ArgumentParser(description='AT25xxx write avoidance.')
+    ap.add_argument('--updates', type=int, default=1000,
+                    help='saves per trace')
+    ap.add_argument('--page', type=int, default=32, help='page size')
+    ap.add_argument('--seed', type=int, default=1)
+    ap.add_argument('--twc', type=float, default=5.0,
+                    help='write cycle time in ms')
+    ap.add_argument('--read', type=float, default=160.0,
+                    help='page READ time in us')
+    args = ap.parse_args()
+
+    print('%-14s %9s %9s %8s %10s %10s' %
+          ('trace', 'programs', 'compare', 'saved', 'ms', 'compare ms'))
+    for name, trace in TRACES:
+        rng = random.Random(args.seed)
+        plain, compared, reads = replay(trace(rng, args.updates), args.page)
+        t_plain = plain * args.twc
+        t_comp = compared * args.twc + reads * args.read * 1e-3
+        print('%-14s %9d %9d %7.1f%% %10.0f %10.0f' %
+              (name, plain, compared, 100.0 * (plain - compared) / plain,
+               t_plain, t_comp))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,460 @@
+#!/usr/bin/env python3
+#
+# Host client of the EEPROM image transfer ("eeprom load" and
+# "eeprom dump").
+#
+# load sends an image with the windowed protocol of eeimage.c: one page per
+# frame (SOH, sequence, length, payload, CRC-32), up to the announced
+# window of frames ahead of the acknowledgements, a resend from the
+# sequence of a NAK or from the oldest unacknowledged frame after a
+# silence, then EOT and the CRC-32 of the image, checked by the board
+# against a read back. dump receives an image and checks its CRCs. The
+# shell is put in quiet mode first so that nothing but the transfer and
+# the command report is sent back. The end to end time is measured on the
+# host and printed along with the report of the board.
+#
+# --sim runs the client against a simulated board on a pty: the shell, a
+# Python re-implementation of the protocol of eeimage.c and an AT25 device
+# with its write cycle, the upload is paced at --baud. It tests the client
+# and the protocol, not the firmware code. --corrupt damages a byte in
+# about that fraction of the received frames to exercise the resends.
+#
+# Usage: eeimage.py load <image> (--port <tty> | --sim) [--baud N]
+#                   [--base N]
+#        eeimage.py dump <output> (--port <tty> | --sim) [--baud N]
+#                   [--base N] [--size N]
+#        sim options: [--device-size N] [--page N] [--cycle-ms N]
+#                     [--corrupt P] [--seed N]
+#
+
+import argparse
+import os
+import random
+import select
+import struct
+import sys
+import termios
+import threading
+import time
+import tty
+import zlib
+
+SOH, EOT, ACK, NAK, CAN = 0x01, 0x04, 0x06, 0x15, 0x18
+
+REASONS = {1: 'timeout', 2: 'device error', 3: 'verify failed',
+           4: 'cancelled', 5: 'too many errors'}
+
+# Silence after which the unacknowledged frames are sent again.
+RESEND_TIMEOUT = 2.0
+MAX_RESENDS = 10
+
+# 8N1, ten bit times per byte.
+BITS_PER_BYTE = 10
+
+SPEEDS = {rate: getattr(termios, 'B%d' % rate)
+          for rate in (9600, 19200, 38400, 57600, 115200, 230400, 460800,
+                       921600)
+          if hasattr(termios, 'B%d' % rate)}
+
+
+class TransferError(Exception):
+    pass
+
+
+class Link:
+    """Buffered reads of lines and binary records on a file descriptor."""
+
+    def __init__(self, fd):
+        self.fd = fd
+        self.buf = bytearray()
+
+    def fill(self, timeout):
+        ready, _, _ = select.select([self.fd], [], [], timeout)
+        if not ready:
+            return False
+        data = os.read(self.fd, 4096)
+        if not data:
+            raise TransferError('link closed')
+        self.buf.extend(data)
+        return True
+
+    def read(self, n, timeout):
+        deadline = time.monotonic() + timeout
+        while len(self.buf) < n:
+            left = deadline - time.monotonic()
+            if left <= 0 or not self.fill(left):
+                return None
+        data = bytes(self.buf[:n])
+        del self.buf[:n]
+        return data
+
+    def line(self, timeout):
+        deadline = time.monotonic() + timeout
+        while b'\n' not in self.buf:
+            left = deadline - time.monotonic()
+            if left <= 0 or not self.fill(left):
+                raise TransferError('no answer, got %r' % bytes(self.buf))
+        line, _, rest = bytes(self.buf).partition(b'\n')
+        self.buf = bytearray(rest)
+        return line.strip(b'\r\0').decode('ascii', 'replace')
+
+    def lines_until(self, words, timeout=5.0):
+        lines = []
+        while True:
+            line = self.line(timeout)
+            if line:
+                lines.append(line)
+            if line.split(' ', 1)[0] in words:
+                return lines
+
+    def need(self, n, timeout=5.0):
+        data = self.read(n, timeout)
+        if data is None:
+            raise TransferError('link stalled')
+        return data
+
+    def write(self, data):
+        os.write(self.fd, data)
+
+
+def frame(seq, data):
+    hdr = bytes((seq & 0xFF, len(data)))
+    return bytes((SOH,)) + hdr + data + \
+        struct.pack('<I', zlib.crc32(data, zlib.crc32(hdr)))
+
+
+def start(link, line, word):
+    link.write(b'\rquiet on\r')
+    link.lines_until(('OK',))
+    link.write(line.encode('ascii') + b'\r')
+    lines = link.lines_until((word, 'OK', 'ERR'))
+    if not lines[-1].startswith(word):
+        raise TransferError('%s: %s' % (line, ' | '.join(lines)))
+    return [int(f) for f in lines[-1].split()[1:]]
+
+
+def finish(link):
+    lines = link.lines_until(('OK', 'ERR'), 15.0)
+    link.write(b'quiet off\r')
+    return lines[:-1]
+
+
+def load(link, image, base):
+    _, _, page, window = start(link, 'eeprom load %d %d' %
+                               (base, len(image)), 'LOAD')
+    frames = [image[i:i + page] for i in range(0, len(image), page)]
+    acked = sent = resends = 0
+    while acked < len(frames):
+        while sent < len(frames) and sent - acked < window:
+            link.write(frame(sent, frames[sent]))
+            sent += 1
+        reply = link.read(2, RESEND_TIMEOUT)
+        if reply is None:
+            resends += 1
+            if resends > MAX_RESENDS:
+                link.write(bytes((CAN, CAN)))
+                raise TransferError('board silent')
+            sent = acked
+            continue
+        code, seq = reply
+        delta = (seq - acked) & 0xFF
+        if code == ACK and delta < sent - acked:
+            acked += delta + 1
+            resends = 0
+        elif code == NAK and delta <= sent - acked:
+            acked += delta
+            sent = acked
+        elif code == CAN:
+            raise TransferError('aborted, ' + REASONS.get(seq, str(seq)))
+    # The end of image is sent again when the board, scanning for a frame
+    # start, took it for payload and asks for more.
+    eot = bytes((EOT,)) + struct.pack('<I', zlib.crc32(image))
+    link.write(eot)
+    while True:
+        reply = link.read(2, 15.0)
+        if reply is None:
+            raise TransferError('no final acknowledgement')
+        if reply[0] == CAN:
+            raise TransferError('aborted, ' +
+                                REASONS.get(reply[1], str(reply[1])))
+        if reply[0] == NAK and reply[1] == len(frames) & 0xFF:
+            link.write(eot)
+        if reply[0] == ACK and reply[1] == (len(frames) - 1) & 0xFF:
+            return finish(link)
+
+
+def dump(link, base, size):
+    args = 'eeprom dump' if size is None else \
+        'eeprom dump %d %d' % (base, size)
+    _, size, page = start(link, args, 'DUMP')
+    image = bytearray()
+    seq = 0
+    while True:
+        c = link.read(1, 5.0)
+        if c is None:
+            raise TransferError('dump stalled at %d bytes' % len(image))
+        if c[0] == CAN:
+            reason = link.read(1, 1.0) or b'\0'
+            raise TransferError('aborted, ' +
+                                REASONS.get(reason[0], str(reason[0])))
+        if c[0] == EOT:
+            crc = struct.unpack('<I', link.need(4))[0]
+            if crc != zlib.crc32(bytes(image)) or len(image) != size:
+                raise TransferError('image CRC mismatch')
+            return bytes(image), finish(link)
+        if c[0] != SOH:
+            raise TransferError('unexpected byte %02x' % c[0])
+        hdr = link.need(2)
+        data = link.need(hdr[1])
+        crc = struct.unpack('<I', link.need(4))[0]
+        if hdr[0] != seq & 0xFF or hdr[1] > page or \
+                crc != zlib.crc32(data, zlib.crc32(hdr)):
+            raise TransferError('bad frame %d' % seq)
+        image.extend(data)
+        seq += 1
+
+
+class SimBoard(threading.Thread):
+    """Shell and image transfer of the board on the master side of a pty,
+    the received bytes cost their line time and each page program starts
+    a write cycle waited for by the next access."""
+
+    def __init__(self, fd, args):
+        super().__init__(daemon=True)
+        self.link = Link(fd)
+        self.byte_time = BITS_PER_BYTE / args.baud
+        self.size = args.device_size
+        self.page = args.page
+        self.cycle = args.cycle_ms / 1000.0
+        self.corrupt = args.corrupt
+        self.rand = random.Random(args.seed)
+        self.mem = bytearray(b'\xff' * self.size)
+        self.busy_until = 0.0
+        self.quiet = False
+        self.window = 8
+        self.timeout = 1.0
+        self.retries = 10
+
+    # Link with the line time of each byte and the injected damage.
+    def recv(self, n, timeout):
+        data = self.link.read(n, timeout)
+        if data is not None:
+            time.sleep(n * self.byte_time)
+            if self.corrupt and self.rand.random() < self.corrupt * n / 40:
+                i = self.rand.randrange(n)
+                data = data[:i] + bytes((data[i] ^ 0x5A,)) + data[i + 1:]
+        return data
+
+    def send(self, data):
+        self.link.write(data)
+
+    def wait_ready(self):
+        delay = self.busy_until - time.monotonic()
+        if delay > 0:
+            time.sleep(delay)
+
+    def program(self, addr, data):
+        self.wait_ready()
+        self.mem[addr:addr + len(data)] = data
+        self.busy_until = time.monotonic() + self.cycle
+
+    def run(self):
+        while True:
+            line = b''
+            while not line.endswith(b'\r'):
+                c = self.link.read(1, 3600.0)
+                if c is None:
+                    return
+                line += c
+            words = line.decode('ascii', 'replace').split()
+            if not words:
+                continue
+            if words == ['quiet', 'on']:
+                self.quiet = True
+            elif words == ['quiet', 'off']:
+                self.quiet = False
+                continue
+            elif words[:2] == ['eeprom', 'load'] and len(words) == 4:
+                self.load(int(words[2], 0), int(words[3], 0))
+            elif words[:2] == ['eeprom', 'dump']:
+                base, size = (int(words[2], 0), int(words[3], 0)) \
+                    if len(words) == 4 else (0, self.size)
+                self.dump(base, size)
+            self.send(b'OK 1/1\r\n')
+
+    def report(self, text):
+        self.send(text.encode('ascii') + b'\r\n')
+
+    def load(self, base, size):
+        page = self.page
+        frames = (size + page - 1) // page
+        if size == 0 or base % page or base + size > self.size:
+            self.report('invalid or protected range')
+            return
+        self.report('LOAD %d %d %d %d' % (base, size, page, self.window))
+        index = errors = naks = bad = dropped = cans = 0
+        resync = False
+        t0 = time.monotonic()
+        while True:
+            expected = index & 0xFF
+            if errors > self.retries:
+                self.send(bytes((CAN, 5)))
+                self.report('\r\naborted, too many errors')
+                return
+            c = self.recv(1, self.timeout)
+            if c is None:
+                if cans >= 2:
+                    self.report('\r\naborted, cancelled')
+                    return
+                errors += 1
+                naks += 1
+                resync = False
+                cans = 0
+                self.send(bytes((NAK, expected)))
+                continue
+            c = c[0]
+            if c == CAN:
+                cans += 1
+                if cans >= 2 and not resync:
+                    self.report('\r\naborted, cancelled')
+                    return
+                continue
+            cans = 0
+            if c == EOT and resync:
+                continue
+            if c == EOT:
+                crc = self.recv(4, self.timeout)
+                if index < frames or crc is None:
+                    naks += 1
+                    self.send(bytes((NAK, expected)))
+                    errors += 1
+                    continue
+                self.wait_ready()
+                if zlib.crc32(bytes(self.mem[base:base + size])) != \
+                        struct.unpack('<I', crc)[0]:
+                    self.send(bytes((CAN, 3)))
+                    self.report('\r\naborted, verify failed')
+                    return
+                self.send(bytes((ACK, (index - 1) & 0xFF)))
+                break
+            if c != SOH:
+                resync = True
+                continue
+            hdr = self.recv(2, self.timeout)
+            data = crc = None
+            if hdr is not None and hdr[1] <= page:
+                data = self.recv(hdr[1], self.timeout)
+                crc = self.recv(4, self.timeout)
+            length = page if index + 1 < frames else size - index * page
+            if crc is None or \
+                    struct.unpack('<I', crc)[0] != \
+                    zlib.crc32(data, zlib.crc32(hdr)) or \
+                    (hdr[0] == expected and
+                     (index >= frames or hdr[1] != length)):
+                bad += 1
+                errors += 1
+                resync = True
+                if dropped % self.window == 0:
+                    naks += 1
+                    self.send(bytes((NAK, expected)))
+                dropped += 1
+                continue
+            resync = False
+            if hdr[0] != expected:
+                if 1 <= (expected - hdr[0]) & 0xFF <= self.window:
+                    self.send(bytes((ACK, (expected - 1) & 0xFF)))
+                else:
+                    if dropped % self.window == 0:
+                        naks += 1
+                        self.send(bytes((NAK, expected)))
+                    dropped += 1
+                continue
+            self.program(base + index * page, data)
+            self.send(bytes((ACK, expected)))
+            index += 1
+            errors = 0
+            dropped = 0
+        ms = int((time.monotonic() - t0) * 1000)
+        self.report('\r\nloaded %d bytes in %d ms, %d bytes/s' %
+                    (size, ms, size * 1000 // ms if ms else 0))
+        self.report('naks %d, bad frames %d' % (naks, bad))
+
+    def dump(self, base, size):
+        self.report('DUMP %d %d %d' % (base, size, self.page))
+        for seq, off in enumerate(range(0, size, self.page)):
+            data = bytes(self.mem[base + off:
+                                  base + min(off + self.page, size)])
+            self.send(frame(seq, data))
+        self.send(bytes((EOT,)) +
+                  struct.pack('<I', zlib.crc32(self.mem[base:base + size])))
+        self.report('\r\ndumped %d bytes' % size)
+
+
+def open_port(args):
+    if args.sim:
+        master, slave = os.openpty()
+        tty.setraw(master)
+        tty.setraw(slave)
+        SimBoard(master, args).start()
+        return slave
+    if args.baud not in SPEEDS:
+        sys.exit('%d baud not supported by the host' % args.baud)
+    fd = os.open(args.port, os.O_RDWR | os.O_NOCTTY)
+    attr = termios.tcgetattr(fd)
+    attr[0] = attr[1] = attr[3] = 0
+    attr[2] = termios.CS8 | termios.CREAD | termios.CLOCAL
+    attr[4] = attr[5] = SPEEDS[args.baud]
+    attr[6][termios.VMIN] = 0
+    attr[6][termios.VTIME] = 0
+    termios.tcsetattr(fd, termios.TCSANOW, attr)
+    termios.tcflush(fd, termios.TCIOFLUSH)
+    return fd
+
+
+def main():
+    ap = argparse.ArgumentParser(description='EEPROM image transfer.')
+    ap.add_argument('action', choices=('load', 'dump'))
+    ap.add_argument('file', help='image to load or dump output')
+    where = ap.add_mutually_exclusive_group(required=True)
+    where.add_argument('--port', help='tty of the shell')
+    where.add_argument('--sim', action='store_true',
+                       help='simulated board on a pty')
+    ap.add_argument('--baud', type=int, default=38400,
+                    help='rate of the port, or of the simulated link')
+    ap.add_argument('--base', type=lambda v: int(v, 0), default=0,
+                    help='first EEPROM address')
+    ap.add_argument('--size', type=lambda v: int(v, 0),
+                    help='dump size, the whole device by default')
+    ap.add_argument('--device-size', type=int, default=4096)
+    ap.add_argument('--page', type=int, default=32)
+    ap.add_argument('--cycle-ms', type=float, default=5.0,
+                    help='simulated write cycle')
+    ap.add_argument('--corrupt', type=float, default=0.0,
+                    help='simulated fraction of damaged frames')
+    ap.add_argument('--seed', type=int, default=1)
+    args = ap.parse_args()
+    if args.action == 'dump' and args.base and args.size is None:
+        sys.exit('--base requires --size')
+
+    link = Link(open_port(args))
+    t0 = time.monotonic()
+    try:
+        if args.action == 'load':
+            image = open(args.file, 'rb').read()
+            report = load(link, image, args.base)
+            size = len(image)
+        else:
+            image, report = dump(link, args.base, args.size)
+            open(args.file, 'wb').write(image)
+            size = len(image)
+    except TransferError as e:
+        sys.exit('%s: %s' % (args.action, e))
+    elapsed = time.monotonic() - t0
+    for line in report:
+        print('board: ' + line)
+    print('%s %d bytes in %.2f s end to end, %d bytes/s' %
+          (args.action, size, elapsed, size / elapsed))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,102 @@
+#!/usr/bin/env python3
+#
+# Decoder of the "metrics export" binary dump.
+#
+# The capture is the raw output of the command on the shell channel, as
+# saved by a terminal logging to a file: a "METRICS <version> <samples>
+# <record size> <period ms>" line, a "THREADS <names>" line, the records
+# and an "END <crc>" line. The records are checked against the CRC-32 and
+# written as CSV, the time is in system ticks, the load is in permille and
+# the per-thread columns in percent of the CPU. The heap columns of a sample
+# without the heap valid flag are left empty. --summary prints the minimum,
+# average and maximum of each column instead.
+#
+# Usage: metrics_decode.py <capture> [--output <csv>] [--summary]
+#
+
+import argparse
+import struct
+import sys
+import zlib
+
+VERSION = 2
+HEADER = struct.Struct('<IHHHHBBBBHHB')
+FIELDS = ['time', 'core_free', 'heap_free', 'heap_frags', 'load',
+          'acq_dropped', 'acq_errors', 'sd_in', 'sd_out', 'usb_in',
+          'usb_out']
+FLAGS = len(FIELDS)
+HEAP_VALID = 0x01
+
+
+def read_line(data, pos):
+    end = data.index(b'\r\n', pos)
+    return data[pos:end].decode('ascii'), end + 2
+
+
+def decode(data):
+    """(thread names, rows) of the first export found in the capture."""
+    pos = data.find(b'METRICS ')
+    if pos < 0:
+        sys.exit('no METRICS header in the capture')
+    header, pos = read_line(data, pos)
+    fields = header.split()
+    if len(fields) != 5 or int(fields[1]) != VERSION:
+        sys.exit('unsupported header "%s"' % header)
+    count, size, period = int(fields[2]), int(fields[3]), int(fields[4])
+    threads, pos = read_line(data, pos)
+    names = threads.split()[1:]
+    if HEADER.size + len(names) > size:
+        sys.exit('record size %d too small for %d threads' %
+                 (size, len(names)))
+
+    records = data[pos:pos + count * size]
+    if len(records) != count * size:
+        sys.exit('capture truncated, %d of %d records' %
+                 (len(records) // size, count))
+    trailer, _ = read_line(data, pos + count * size + 2)
+    if not trailer.startswith('END ') or \
+       int(trailer[4:], 16) != zlib.crc32(records):
+        sys.exit('CRC mismatch, the capture is corrupted')
+
+    rows = []
+    for i in range(count):
+        rec = records[i * size:(i + 1) * size]
+        values = list(HEADER.unpack_from(rec))
+        flags = values.pop(FLAGS)
+        if not flags & HEAP_VALID:
+            values[FIELDS.index('heap_free')] = None
+            values[FIELDS.index('heap_frags')] = None
+        values += list(rec[HEADER.size:HEADER.size + len(names)])
+        rows.append(values)
+    return period, names, rows
+
+
+def main():
+    ap = argparse.ArgumentParser(description='Metrics export decoder.')
+    ap.add_argument('capture', help='captured shell output')
+    ap.add_argument('--output', help='CSV file, standard output otherwise')
+    ap.add_argument('--summary', action='store_true',
+                    help='print min/avg/max of each column')
+    args = ap.parse_args()
+
+    period, names, rows = decode(open(args.capture, 'rb').read())
+    columns = FIELDS + ['cpu_' + n for n in names]
+    if args.summary:
+        print('%d samples, %d ms period' % (len(rows), period))
+        print('%-16s %8s %8s %8s' % ('', 'min', 'avg', 'max'))
+        for c, name in enumerate(columns[1:], 1):
+            values = [r[c] for r in rows if r[c] is not None]
+            if values:
+                print('%-16s %8d %8d %8d' % (name, min(values),
+                                             sum(values) // len(values),
+                                             max(values)))
+        return
+
+    out = open(args.output, 'w') if args.output else sys.stdout
+    out.write(','.join(columns) + '\n')
+    for r in rows:
+        out.write(','.join('' if v is None else str(v) for v in r) + '\n')
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,74 @@
+#!/usr/bin/env python3
+#
+# Post-link check of the execute-from-RAM placement.
+#
+# The linker script selects the hot functions by input section name. A
+# pattern naming a function that the compiler inlined, or that LTO renamed,
+# silently matches nothing and the function stays in flash. Each function
+# given here must exist in the image, possibly with a compiler suffix
+# (.lto_priv.N, .constprop.N, .isra.N, .part.N), and lie between
+# __ramfunc_start__ and __ramfunc_end__.
+#
+# Usage: ramfunc_check.py --elf <elf> [--nm <tool>] <function>...
+#
+
+import argparse
+import re
+import subprocess
+import sys
+
+RE_SUFFIX = re.compile(r'^(.+?)(?:\.(?:lto_priv|constprop|isra|part)'
+                       r'(?:\.\d+)?)+$')
+
+
+def read_symbols(nm, elf):
+    """Maps each symbol name, without compiler suffix, to its addresses."""
+    out = subprocess.run([nm, elf], check=True, capture_output=True,
+                         text=True).stdout
+    symbols = {}
+    for line in out.splitlines():
+        fields = line.split()
+        if len(fields) != 3:
+            continue
+        addr, _, name = fields
+        m = RE_SUFFIX.match(name)
+        if m:
+            name = m.group(1)
+        # Thumb bit.
+        symbols.setdefault(name, []).append(int(addr, 16) & ~1)
+    return symbols
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__)
+    ap.add_argument('--elf', required=True)
+    ap.add_argument('--nm', default='arm-none-eabi-nm')
+    ap.add_argument('functions', nargs='+')
+    args = ap.parse_args()
+
+    symbols = read_symbols(args.nm, args.elf)
+    try:
+        start = symbols['__ramfunc_start__'][0]
+        end = symbols['__ramfunc_end__'][0]
+    except KeyError:
+        sys.exit('%s: no execute-from-RAM area' % args.elf)
+
+    failed = 0
+    for func in args.functions:
+        addrs = symbols.get(func)
+        if not addrs:
+            print('ramfunc: %s not found, inlined into its callers?' % func)
+            failed += 1
+        for addr in addrs or []:
+            if not start <= addr < end:
+                print('ramfunc: %s at 0x%08x, outside 0x%08x-0x%08x'
+                      % (func, addr, start, end))
+                failed += 1
+    if failed:
+        sys.exit(1)
+    print('ramfunc: %d functions in 0x%08x-0x%08x (%d bytes)'
+          % (len(args.functions), start, end, end - start))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,422 @@
+#!/usr/bin/env python3
+#
+# Scheduler trace replay and timing regression check.
+#
+# The workload is read from the raw output of "trace export", as saved by
+# a terminal logging to a file, or generated with --synthetic. A capture
+# lists every context switch with the realtime counter, the threads and
+# the state of the outgoing thread. It is cut into activations: a thread
+# is released, runs, possibly preempted, and ends its activation when it
+# is switched out waiting (sleep, semaphore, queue, event). The demand of
+# an activation is its running time, the interrupts served meanwhile
+# included. A release is exact when the thread preempts another one or
+# leaves idle, as the interrupts waking the threads do; when the thread
+# starts after another one waits, its release is taken at the start of
+# the busy period, no earlier than its previous wait. Threads are only
+# accounted after their first wait in the capture.
+#
+# The replay runs the activations on a fixed priority preemptive
+# scheduler in virtual time: equal priorities run in release order, a
+# preempted thread resumes first among its peers and, with a non-zero
+# time quantum, a thread that used its quantum yields to a ready peer at
+# the next tick. Releases are replayed as recorded, the waits of a thread
+# on another one are not modelled. The same workload and options give
+# the same results, the replay of an unchanged configuration reproduces
+# the recorded response times.
+#
+# An activation misses its deadline (--deadline, default the next release
+# of the thread) when it completes later. --limit sets thresholds on the
+# replayed response time percentiles or on the misses, the exit status is
+# 1 if one is exceeded.
+#
+# Usage: sched_replay.py (--capture <file> | --synthetic) [--chconf <file>]
+#                        [--prio NAME=N]... [--quantum TICKS]
+#                        [--tick-hz HZ] [--switch-cycles N]
+#                        [--deadline NAME=US]... [--limit NAME:STAT=N]...
+#                        [--duration S] [--seed N] [--hclk HZ]
+#
+
+import argparse
+import collections
+import os
+import random
+import re
+import struct
+import sys
+import zlib
+
+VERSION = 1
+EVENT = struct.Struct('<IBBBB')
+OTHER = 0xFF
+IDLE = 'idle'
+
+# ChibiOS/RT thread states, only READY is a preemption.
+STATE_READY = 0
+STATES = ['READY', 'CURRENT', 'WTSTART', 'SUSPENDED', 'QUEUED', 'WTSEM',
+          'WTMTX', 'WTCOND', 'SLEEPING', 'WTEXIT', 'WTOREVT', 'WTANDEVT',
+          'SNDMSGQ', 'SNDMSG', 'WTMSG', 'FINAL']
+
+STATS = ('p50', 'p90', 'p99', 'max', 'misses')
+
+Activation = collections.namedtuple('Activation',
+                                    'thread release demand response')
+
+
+def read_line(data, pos):
+    end = data.index(b'\r\n', pos)
+    return data[pos:end].decode('ascii'), end + 2
+
+
+def read_capture(path):
+    """(counter Hz, {id: (name, prio)}, events) of the first export found
+    in the capture, events are (time, next, prev, state, irqs)."""
+    data = open(path, 'rb').read()
+    pos = data.find(b'SCHEDTRACE ')
+    if pos < 0:
+        sys.exit('%s: no SCHEDTRACE header' % path)
+    header, pos = read_line(data, pos)
+    fields = header.split()
+    version, count, size, hz = (int(f) for f in fields[1:5])
+    if version != VERSION or size != EVENT.size:
+        sys.exit('%s: format %d with %d bytes records not supported' %
+                 (path, version, size))
+    line, pos = read_line(data, pos)
+    if not line.startswith('THREADS'):
+        sys.exit('%s: no THREADS line' % path)
+    threads = {}
+    for item in line.split()[1:]:
+        tid, name, prio = item.split(':')
+        threads[int(tid)] = (name, int(prio))
+    threads[OTHER] = ('other', 0)
+
+    raw = data[pos:pos + count * size]
+    if len(raw) != count * size:
+        sys.exit('%s: capture truncated' % path)
+    trailer, _ = read_line(data, pos + count * size + 2)
+    if trailer.split() != ['END', '%08x' % zlib.crc32(raw)]:
+        sys.exit('%s: CRC mismatch, the capture is damaged' % path)
+
+    events = []
+    now = 0
+    last = None
+    for time, nxt, prev, state, irqs in EVENT.iter_unpack(raw):
+        if last is not None:
+            now += (time - last) & 0xFFFFFFFF
+        last = time
+        events.append((now, nxt, prev, state, irqs))
+    return hz, threads, events
+
+
+def cut_activations(threads, events):
+    """(activations, irqs, span, names to priorities) of a capture."""
+    names = {tid: name for tid, (name, _) in threads.items()}
+    prios = {name: prio for name, prio in threads.values()}
+    waited = {}            # thread to its last wait time
+    active = {}            # thread to [release, demand]
+    acts = []
+    busy_start = None
+    irqs = 0
+    for i, (t, nxt, prev, state, n) in enumerate(events):
+        prev_name, next_name = names[prev], names[nxt]
+        if i > 0:
+            irqs += n
+            ran = t - events[i - 1][0]
+            if prev_name in active:
+                active[prev_name][1] += ran
+        if prev_name == IDLE:
+            busy_start = t
+        elif state != STATE_READY:
+            act = active.pop(prev_name, None)
+            if act is not None:
+                acts.append(Activation(prev_name, act[0], act[1],
+                                       t - act[0]))
+            waited[prev_name] = t
+        if next_name == IDLE or next_name in active or \
+           next_name not in waited:
+            continue
+        if prev_name == IDLE or state == STATE_READY:
+            release = t
+        else:
+            release = max(waited[next_name],
+                          busy_start if busy_start is not None else 0)
+        active[next_name] = [release, 0]
+    span = events[-1][0] - events[0][0] if events else 0
+    return acts, irqs, span, prios
+
+
+def synthetic(duration, hclk, seed):
+    """Activations of the board threads: the acquisition released by the
+    ADC DMA, the shell by the serial line, the main thread by the metrics
+    sampler, the data logger by its period."""
+    rng = random.Random(seed)
+    us = hclk // 1000000
+    end = int(duration * hclk)
+    acts = []
+
+    def periodic(name, period_us, demand_us, jitter):
+        t = rng.randrange(period_us * us)
+        while t < end:
+            d = demand_us * (1.0 + rng.uniform(-jitter, jitter))
+            acts.append(Activation(name, t, int(d * us), None))
+            t += period_us * us
+
+    periodic('acquire', 5460, 350, 0.1)
+    periodic('main', 1000000, 200, 0.2)
+    periodic('datalog', 1000000, 1500, 0.3)
+    t = 0
+    while True:
+        t += int(rng.expovariate(1.0 / 200000) * us)
+        if t >= end:
+            break
+        acts.append(Activation('shell', t,
+                               int(rng.uniform(500, 5000) * us), None))
+    acts.sort(key=lambda a: a.release)
+    prios = {'acquire': 129, 'shell': 128, 'main': 128, 'datalog': 127}
+    return acts, 0, end, prios
+
+
+def replay(acts, prios, quantum, tick, switch):
+    """Completion time of each activation on the modelled scheduler."""
+    pending = collections.defaultdict(collections.deque)
+    ready = collections.defaultdict(collections.deque)
+    left = {}
+    done = [None] * len(acts)
+    order = sorted(range(len(acts)), key=lambda k: acts[k].release)
+    now = 0
+    nxt = 0
+    current = None
+    last_run = None
+    slice_start = 0
+
+    def queued(name):
+        return name == current or name in ready[prios[name]]
+
+    def release_until(t):
+        nonlocal nxt, current
+        while nxt < len(order) and acts[order[nxt]].release <= t:
+            k = order[nxt]
+            name = acts[k].thread
+            nxt += 1
+            if not pending[name]:
+                left[name] = acts[k].demand
+            pending[name].append(k)
+            if queued(name):
+                continue
+            if current is not None and prios[name] > prios[current]:
+                ready[prios[current]].appendleft(current)
+                current = None
+            ready[prios[name]].append(name)
+
+    def pick():
+        for prio in sorted((p for p in ready if ready[p]), reverse=True):
+            return ready[prio].popleft()
+        return None
+
+    while nxt < len(order) or current is not None or \
+            any(ready[p] for p in ready):
+        release_until(now)
+        if current is None:
+            current = pick()
+            if current is None:
+                now = acts[order[nxt]].release
+                continue
+            if current != last_run:
+                now += switch
+                last_run = current
+            slice_start = now
+        stop = now + left[current]
+        if nxt < len(order):
+            stop = min(stop, acts[order[nxt]].release)
+        peer = quantum > 0 and bool(ready[prios[current]])
+        if peer:
+            expiry = slice_start + quantum * tick
+            stop = min(stop, max(now, (expiry + tick - 1) // tick * tick))
+        left[current] -= stop - now
+        now = stop
+        if left[current] <= 0:
+            k = pending[current].popleft()
+            done[k] = now
+            if pending[current]:
+                left[current] = acts[pending[current][0]].demand
+            else:
+                current = None
+            continue
+        if peer and now >= slice_start + quantum * tick:
+            ready[prios[current]].append(current)
+            current = None
+    return done
+
+
+def percentile(values, p):
+    """Nearest rank percentile."""
+    if not values:
+        return 0
+    values = sorted(values)
+    return values[min(len(values) - 1, max(0, -(-len(values) * p // 100) - 1))]
+
+
+def summarize(acts, done, deadlines, us):
+    """Per thread statistics in microseconds."""
+    by_thread = collections.defaultdict(list)
+    for k, act in enumerate(acts):
+        by_thread[act.thread].append(k)
+    result = {}
+    for name, ks in by_thread.items():
+        ks.sort(key=lambda k: acts[k].release)
+        replayed, recorded, misses = [], [], 0
+        for i, k in enumerate(ks):
+            response = done[k] - acts[k].release
+            replayed.append(response / us)
+            if acts[k].response is not None:
+                recorded.append(acts[k].response / us)
+            if name in deadlines:
+                late = response > deadlines[name] * us
+            else:
+                late = i + 1 < len(ks) and \
+                    done[k] > acts[ks[i + 1]].release
+            misses += late
+        demand = [acts[k].demand / us for k in ks]
+        result[name] = {
+            'acts': len(ks), 'demand': sum(demand),
+            'demand_max': max(demand), 'recorded': recorded,
+            'replayed': replayed, 'misses': misses}
+    return result
+
+
+def read_chconf(path):
+    """CH_CFG_TIME_QUANTUM and CH_CFG_ST_FREQUENCY of a chconf.h."""
+    text = open(path).read()
+    values = {}
+    for key in ('CH_CFG_TIME_QUANTUM', 'CH_CFG_ST_FREQUENCY'):
+        m = re.search(r'^#define\s+%s\s+(\d+)' % key, text, re.M)
+        if m:
+            values[key] = int(m.group(1))
+    return values
+
+
+def parse_pairs(specs, convert):
+    pairs = {}
+    for spec in specs:
+        name, _, value = spec.partition('=')
+        if not value:
+            sys.exit('bad option value "%s"' % spec)
+        pairs[name] = convert(value)
+    return pairs
+
+
+def check_limits(stats, limits):
+    """Lines of the exceeded limits."""
+    failures = []
+    for spec in limits:
+        target, _, value = spec.partition('=')
+        name, _, stat = target.partition(':')
+        if stat not in STATS or not value:
+            sys.exit('bad limit "%s", NAME:STAT=N with STAT one of %s' %
+                     (spec, ' '.join(STATS)))
+        names = sorted(stats) if name == '*' else [name]
+        for n in names:
+            if n not in stats:
+                failures.append('%s: no activation' % spec)
+                continue
+            s = stats[n]
+            if stat == 'misses':
+                got = s['misses']
+            elif stat == 'max':
+                got = max(s['replayed'])
+            else:
+                got = percentile(s['replayed'], int(stat[1:]))
+            if got > float(value):
+                failures.append('%s %s %.0f over %s' % (n, stat, got, value))
+    return failures
+
+
+def main():
+    ap = argparse.ArgumentParser(description='Scheduler trace replay.')
+    src = ap.add_mutually_exclusive_group(required=True)
+    src.add_argument('--capture', help='"trace export" capture')
+    src.add_argument('--synthetic', action='store_true',
+                     help='generated workload of the board threads')
+    ap.add_argument('--chconf', default=os.path.join(
+        os.path.dirname(os.path.abspath(__file__)), '..', 'chconf.h'),
+                    help='kernel configuration giving the defaults')
+    ap.add_argument('--prio', action='append', default=[],
+                    metavar='NAME=N', help='thread priority override')
+    ap.add_argument('--quantum', type=int,
+                    help='time quantum in ticks, 0 disables round robin')
+    ap.add_argument('--tick-hz', type=int, help='system tick frequency')
+    ap.add_argument('--switch-cycles', type=int, default=0,
+                    help='added cost of a context switch, the recorded '
+                         'demand already includes it')
+    ap.add_argument('--deadline', action='append', default=[],
+                    metavar='NAME=US', help='relative deadline')
+    ap.add_argument('--limit', action='append', default=[],
+                    metavar='NAME:STAT=N',
+                    help='threshold on p50, p90, p99, max (us) or misses, '
+                         'NAME * for all threads')
+    ap.add_argument('--duration', type=float, default=10.0,
+                    help='seconds of synthetic workload')
+    ap.add_argument('--seed', type=int, default=1,
+                    help='synthetic workload seed')
+    ap.add_argument('--hclk', type=int, default=72000000,
+                    help='core clock of the synthetic workload')
+    args = ap.parse_args()
+
+    conf = read_chconf(args.chconf) if os.path.exists(args.chconf) else {}
+    quantum = args.quantum if args.quantum is not None else \
+        conf.get('CH_CFG_TIME_QUANTUM', 0)
+    tick_hz = args.tick_hz or conf.get('CH_CFG_ST_FREQUENCY', 1000)
+
+    if args.capture:
+        hz, threads, events = read_capture(args.capture)
+        acts, irqs, span, prios = cut_activations(threads, events)
+        source = '%s, %d switches' % (args.capture, len(events))
+    else:
+        hz = args.hclk
+        acts, irqs, span, prios = synthetic(args.duration, hz, args.seed)
+        source = 'synthetic, seed %d' % args.seed
+    if not acts:
+        sys.exit('no complete activation in the workload')
+    us = hz / 1e6
+
+    changed = parse_pairs(args.prio, int)
+    for name in changed:
+        if name not in prios:
+            sys.exit('unknown thread "%s"' % name)
+    prios.update(changed)
+    deadlines = parse_pairs(args.deadline, float)
+
+    done = replay(acts, prios, quantum, hz // tick_hz, args.switch_cycles)
+    stats = summarize(acts, done, deadlines, us)
+
+    print('workload: %s, %.1f ms, %d activations, %d interrupts, %.0f MHz' %
+          (source, span / us / 1000, len(acts), irqs, hz / 1e6))
+    print('replay: quantum %d ticks at %d Hz, switch %d cycles%s' %
+          (quantum, tick_hz, args.switch_cycles,
+           ''.join(', %s=%d' % p for p in sorted(changed.items()))))
+    print('%-10s %4s %5s %5s %7s | %-27s | %-27s %6s' %
+          ('thread', 'prio', 'acts', 'cpu%', 'max us',
+           'recorded p50/p90/p99/max us', 'replayed p50/p90/p99/max us',
+           'misses'))
+
+    def row(values):
+        if not values:
+            return '%27s' % '-'
+        return '%6.0f %6.0f %6.0f %6.0f' % tuple(
+            [percentile(values, p) for p in (50, 90, 99)] + [max(values)])
+
+    for name in sorted(stats, key=lambda n: (-prios[n], n)):
+        s = stats[name]
+        print('%-10s %4d %5d %5.1f %7.0f | %s | %s %6d' %
+              (name, prios[name], s['acts'],
+               100.0 * s['demand'] * us / span if span else 0.0,
+               s['demand_max'], row(s['recorded']), row(s['replayed']),
+               s['misses']))
+
+    failures = check_limits(stats, args.limit)
+    for line in failures:
+        print('FAIL ' + line)
+    sys.exit(1 if failures else 0)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,235 @@
+#!/usr/bin/env python3
+#
+# Receive throughput benchmark of the USART2 shell.
+#
+# With --port the shell is switched to each rate in turn ("serial baud"),
+# then "serial sink" checks a pattern stream written by the host at full
+# line speed and reports the bytes received, the time and the bytes lost
+# or overrun. The port may be any tty: a USB-serial adapter wired to the
+# board or a pty bridged to a simulator. The shell is put in quiet mode so
+# every command is answered by its output and an "OK n/m" status line.
+#
+# --loopback runs the same stream through a host tty whose TX and RX are
+# bridged, it checks that the adapter itself sustains the rates.
+#
+# --model computes, for the stock driver (one interrupt per byte, 16 bytes
+# queue) and for the DMA ring, the interrupt rate, its CPU cost and the
+# longest consumer stall survived without loss at each rate.
+#
+# Usage: serial_rx_bench.py --port <tty> [--initial-baud N] [--size N]
+#                           [--baud N...]
+#        serial_rx_bench.py --loopback <tty> [--size N] [--baud N...]
+#        serial_rx_bench.py --model [--ring N] [--write-size N]
+#                           [--isr-cycles N] [--hclk HZ] [--baud N...]
+#
+
+import argparse
+import os
+import select
+import sys
+import termios
+import threading
+import time
+
+DEFAULT_RATES = [115200, 460800, 921600]
+
+# 8N1, ten bit times per byte.
+BITS_PER_BYTE = 10
+
+# Stock ChibiOS serial driver input queue.
+STOCK_QUEUE = 16
+
+# DMA ring services, half and full transfer.
+RING_SERVICES = 2
+
+SPEEDS = {rate: getattr(termios, 'B%d' % rate)
+          for rate in (9600, 19200, 38400, 57600, 115200, 230400, 460800,
+                       500000, 576000, 921600, 1000000)
+          if hasattr(termios, 'B%d' % rate)}
+
+
+def pattern(n):
+    """Stream checked by "serial sink", see SINK_BYTE()."""
+    return bytes(((i ^ (i >> 8)) & 0xFF) for i in range(n))
+
+
+def open_tty(path, rate):
+    fd = os.open(path, os.O_RDWR | os.O_NOCTTY)
+    set_speed(fd, rate)
+    return fd
+
+
+def set_speed(fd, rate):
+    if rate not in SPEEDS:
+        sys.exit('%d baud not supported by the host' % rate)
+    attr = termios.tcgetattr(fd)
+    attr[0] = 0                                     # iflag
+    attr[1] = 0                                     # oflag
+    attr[2] = termios.CS8 | termios.CREAD | termios.CLOCAL
+    attr[3] = 0                                     # lflag
+    attr[4] = attr[5] = SPEEDS[rate]
+    attr[6][termios.VMIN] = 0
+    attr[6][termios.VTIME] = 0
+    termios.tcsetattr(fd, termios.TCSADRAIN, attr)
+    termios.tcflush(fd, termios.TCIOFLUSH)
+
+
+def read_lines(fd, until, timeout):
+    """Lines received until one starting with a word of until."""
+    data = b''
+    lines = []
+    deadline = time.monotonic() + timeout
+    while time.monotonic() < deadline:
+        ready, _, _ = select.select([fd], [], [], 0.1)
+        if not ready:
+            continue
+        data += os.read(fd, 4096)
+        while b'\n' in data:
+            line, data = data.split(b'\n', 1)
+            line = line.strip(b'\r').decode('ascii', 'replace')
+            if line:
+                lines.append(line)
+            if line.split(' ', 1)[0] in until:
+                return lines
+    raise TimeoutError('no answer, got %r' % lines)
+
+
+def command(fd, line, timeout=5.0):
+    os.write(fd, line.encode('ascii') + b'\r')
+    lines = read_lines(fd, ('OK', 'ERR'), timeout)
+    if lines[-1].startswith('ERR'):
+        raise RuntimeError('%s: %s' % (line, ' | '.join(lines)))
+    return lines[:-1]
+
+
+def switch_baud(fd, rate):
+    """The status line of "serial baud" is sent at the new rate, it is
+    discarded and a stats command resynchronizes the session."""
+    os.write(fd, b'serial baud %d\r' % rate)
+    lines = read_lines(fd, ('%d' % rate, 'ERR'), 5.0)
+    if lines[-1].startswith('ERR'):
+        raise RuntimeError('serial baud %d refused' % rate)
+    set_speed(fd, rate)
+    time.sleep(0.2)
+    termios.tcflush(fd, termios.TCIFLUSH)
+    command(fd, 'serial')
+
+
+def bench_port(args):
+    fd = open_tty(args.port, args.initial_baud)
+    results = []
+    try:
+        os.write(fd, b'\rquiet on\r')
+        read_lines(fd, ('OK',), 2.0)
+        current = args.initial_baud
+        for rate in args.baud:
+            switch_baud(fd, rate)
+            current = rate
+            os.write(fd, b'serial sink %d\r' % args.size)
+            read_lines(fd, ('ready',), 5.0)
+            start = time.monotonic()
+            os.write(fd, pattern(args.size))
+            termios.tcdrain(fd)
+            host = time.monotonic() - start
+            lines = read_lines(fd, ('OK', 'ERR'), 10.0)
+            results.append((rate, host, lines[:-1]))
+        if current != args.initial_baud:
+            switch_baud(fd, args.initial_baud)
+        os.write(fd, b'quiet off\r')
+    finally:
+        os.close(fd)
+
+    for rate, host, lines in results:
+        line_rate = rate / BITS_PER_BYTE
+        print('%7d baud, line %6d bytes/s, host wrote in %.2f s' %
+              (rate, line_rate, host))
+        for line in lines:
+            print('    ' + line)
+
+
+def bench_loopback(args):
+    for rate in args.baud:
+        fd = open_tty(args.loopback, rate)
+        data = pattern(args.size)
+        received = bytearray()
+
+        def reader():
+            deadline = time.monotonic() + 2.0 + \
+                args.size * BITS_PER_BYTE * 2.0 / rate
+            while len(received) < args.size and \
+                    time.monotonic() < deadline:
+                ready, _, _ = select.select([fd], [], [], 0.1)
+                if ready:
+                    received.extend(os.read(fd, 4096))
+
+        t = threading.Thread(target=reader)
+        t.start()
+        start = time.monotonic()
+        os.write(fd, data)
+        t.join()
+        elapsed = time.monotonic() - start
+        os.close(fd)
+        bad = sum(1 for a, b in zip(received, data) if a != b)
+        print('%7d baud: %d/%d bytes in %.2f s, %d bytes/s, %d differ' %
+              (rate, len(received), args.size, elapsed,
+               len(received) / elapsed if elapsed > 0 else 0, bad))
+
+
+def model(args):
+    print('ring %d bytes, host writes of %d bytes, %d cycles per interrupt '
+          'at %.0f MHz' % (args.ring, args.write_size, args.isr_cycles,
+                           args.hclk / 1e6))
+    print('%8s %9s | %10s %6s %8s | %10s %6s %8s' %
+          ('baud', 'bytes/s', 'stock irq', 'cpu', 'stall', 'dma irq',
+           'cpu', 'stall'))
+    for rate in args.baud:
+        bps = rate / BITS_PER_BYTE
+        stock_irq = bps
+        # Half/full ring services plus one idle line per host write, at
+        # most one per byte.
+        dma_irq = min(bps, RING_SERVICES * bps / args.ring +
+                      bps / args.write_size)
+        # A queue overruns once the consumer is away for the time needed
+        # to fill it, the ring keeps its newest half on a lap.
+        stock_stall = STOCK_QUEUE / bps
+        dma_stall = args.ring / bps
+        print('%8d %9d | %10d %5.1f%% %6.2fms | %10d %5.2f%% %6.2fms' %
+              (rate, bps, stock_irq,
+               100.0 * stock_irq * args.isr_cycles / args.hclk,
+               stock_stall * 1e3, dma_irq,
+               100.0 * dma_irq * args.isr_cycles / args.hclk,
+               dma_stall * 1e3))
+
+
+def main():
+    ap = argparse.ArgumentParser(description='Serial receive benchmark.')
+    mode = ap.add_mutually_exclusive_group(required=True)
+    mode.add_argument('--port', help='tty of the serial shell')
+    mode.add_argument('--loopback', help='host tty with TX wired to RX')
+    mode.add_argument('--model', action='store_true',
+                      help='computed figures, no hardware')
+    ap.add_argument('--baud', type=int, nargs='+', default=DEFAULT_RATES,
+                    help='rates tested')
+    ap.add_argument('--initial-baud', type=int, default=38400,
+                    help='rate of the shell when the test starts')
+    ap.add_argument('--size', type=int, default=65536,
+                    help='bytes streamed at each rate')
+    ap.add_argument('--ring', type=int, default=512,
+                    help='SERIALDMA_RX_BUFFER_SIZE')
+    ap.add_argument('--write-size', type=int, default=4096,
+                    help='bytes per host write, one idle line each')
+    ap.add_argument('--isr-cycles', type=int, default=150,
+                    help='cost of one receive interrupt')
+    ap.add_argument('--hclk', type=float, default=72e6, help='CPU clock')
+    args = ap.parse_args()
+
+    if args.model:
+        model(args)
+    elif args.loopback:
+        bench_loopback(args)
+    else:
+        bench_port(args)
+
+
+if __name__ == '__main__':
+    main()
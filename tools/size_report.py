@@ -0,0 +1,270 @@
+#!/usr/bin/env python3
+#
+# Flash/RAM budget report of a linked image.
+#
+# The GNU ld map file attributes every input section to its object file,
+# objects are grouped in modules by their source file names given on the
+# command line, anything else is accounted to "main" and archive members
+# to "libc". Output sections with a load address (.data, .ramfunc) use
+# both flash and RAM. The image must be linked without LTO, otherwise the
+# sections belong to the LTO partitions instead of the original objects.
+#
+# Usage: size_report.py --map <map> --elf <elf> [--nm <nm>] [--su <dir>]
+#                       [--module name=source...]... [--top N]
+#                       [--baseline <json>] [--save]
+#
+
+import argparse
+import json
+import os
+import re
+import subprocess
+import sys
+
+DEFAULT_MODULE = 'main'
+LIBRARY_MODULE = 'libc'
+
+# Output sections that are not allocations of the application.
+FREE_SECTIONS = ('.heap',)
+
+RE_REGION = re.compile(r'^(\S+)\s+0x([0-9a-fA-F]+)\s+0x([0-9a-fA-F]+)')
+RE_OUTPUT = re.compile(r'^(\S+)\s+0x([0-9a-fA-F]+)\s+0x([0-9a-fA-F]+)'
+                       r'(\s+load address 0x[0-9a-fA-F]+)?')
+RE_INPUT = re.compile(r'^ (\S+)\s+0x([0-9a-fA-F]+)\s+0x([0-9a-fA-F]+)\s+(\S.*)$')
+RE_INPUT_NAME = re.compile(r'^ (\S+)$')
+RE_INPUT_CONT = re.compile(r'^\s+0x([0-9a-fA-F]+)\s+0x([0-9a-fA-F]+)\s+(\S.*)$')
+RE_FILL = re.compile(r'^ \*fill\*\s+0x([0-9a-fA-F]+)\s+0x([0-9a-fA-F]+)')
+RE_ARCHIVE = re.compile(r'^(.*\.a)\((.*)\)$')
+
+
+def parse_regions(lines):
+    """Memory regions from the "Memory Configuration" table."""
+    regions = []
+    inside = False
+    for line in lines:
+        if line.startswith('Memory Configuration'):
+            inside = True
+            continue
+        if inside and line.startswith('Linker script and memory map'):
+            break
+        m = RE_REGION.match(line) if inside else None
+        if m and m.group(1) != '*default*':
+            regions.append((m.group(1), int(m.group(2), 16),
+                            int(m.group(3), 16)))
+    return regions
+
+
+def region_kind(regions, addr):
+    """'flash', 'ram' or None for an address."""
+    for name, origin, length in regions:
+        if origin <= addr < origin + length:
+            if name.startswith('flash'):
+                return 'flash'
+            if name.startswith('ram'):
+                return 'ram'
+    return None
+
+
+def parse_sections(lines, regions):
+    """Yields (output section, object, kinds, size) for each input section,
+    kinds is the set of memories the section uses."""
+    inside = False
+    output = None
+    kinds = set()
+    pending = None
+    for line in lines:
+        if line.startswith('Linker script and memory map'):
+            inside = True
+            continue
+        if not inside:
+            continue
+        if line.startswith('Cross Reference Table') or \
+           line.startswith('OUTPUT('):
+            break
+
+        m = RE_OUTPUT.match(line)
+        if m and not line.startswith(' '):
+            output = m.group(1)
+            kind = region_kind(regions, int(m.group(2), 16))
+            kinds = set()
+            if kind is not None and output not in FREE_SECTIONS:
+                kinds.add(kind)
+                if m.group(4):
+                    kinds.add('flash')
+            pending = None
+            continue
+        if not kinds:
+            continue
+
+        m = RE_FILL.match(line)
+        if m:
+            yield output, None, kinds, int(m.group(2), 16)
+            pending = None
+            continue
+        m = RE_INPUT.match(line)
+        if m:
+            yield output, m.group(4).strip(), kinds, int(m.group(3), 16)
+            pending = None
+            continue
+        m = RE_INPUT_NAME.match(line)
+        if m:
+            pending = m.group(1)
+            continue
+        m = RE_INPUT_CONT.match(line)
+        if m and pending is not None:
+            yield output, m.group(3).strip(), kinds, int(m.group(2), 16)
+            pending = None
+
+
+def module_of(obj, modules):
+    if obj is None:
+        return 'fill'
+    if RE_ARCHIVE.match(obj):
+        return LIBRARY_MODULE
+    stem = os.path.splitext(os.path.basename(obj))[0]
+    return modules.get(stem, DEFAULT_MODULE)
+
+
+def parse_modules(specs):
+    """name=source... specs to a source stem to module name dictionary."""
+    modules = {}
+    for spec in specs:
+        name, _, sources = spec.partition('=')
+        for src in sources.split():
+            modules[os.path.splitext(os.path.basename(src))[0]] = name
+    return modules
+
+
+def read_symbols(nm, elf, regions):
+    """(size, name, kind) of the sized symbols, largest first."""
+    out = subprocess.run([nm, '--print-size', '--size-sort', '--radix=x',
+                          elf], check=True, stdout=subprocess.PIPE,
+                         universal_newlines=True).stdout
+    symbols = []
+    for line in out.splitlines():
+        fields = line.split()
+        if len(fields) != 4:
+            continue
+        addr, size, _, name = fields
+        kind = region_kind(regions, int(addr, 16))
+        if kind is not None:
+            symbols.append((int(size, 16), name, kind))
+    symbols.sort(reverse=True)
+    return symbols
+
+
+def read_stack_usage(sudir):
+    """(bytes, function, qualifiers, file) from the .su files."""
+    frames = []
+    for root, _, files in os.walk(sudir):
+        for fname in files:
+            if not fname.endswith('.su'):
+                continue
+            for line in open(os.path.join(root, fname)):
+                fields = line.rstrip('\n').split('\t')
+                if len(fields) != 3:
+                    continue
+                func = fields[0].rsplit(':', 1)[-1]
+                frames.append((int(fields[1]), func, fields[2],
+                               os.path.splitext(fname)[0]))
+    frames.sort(reverse=True)
+    return frames
+
+
+def delta(value, base):
+    if base is None:
+        return ''
+    d = value - base
+    return '  %+d' % d if d else '  ='
+
+
+def main():
+    ap = argparse.ArgumentParser(description='Flash/RAM budget report.')
+    ap.add_argument('--map', required=True, help='linker map file')
+    ap.add_argument('--elf', help='linked image, for the symbols')
+    ap.add_argument('--nm', default='arm-none-eabi-nm', help='nm tool')
+    ap.add_argument('--su', help='directory of the -fstack-usage files')
+    ap.add_argument('--module', action='append', default=[],
+                    metavar='NAME=SOURCES', help='module source files')
+    ap.add_argument('--top', type=int, default=20,
+                    help='number of symbols and frames listed')
+    ap.add_argument('--baseline', help='baseline JSON file')
+    ap.add_argument('--save', action='store_true',
+                    help='store the report as the new baseline')
+    args = ap.parse_args()
+
+    lines = open(args.map).read().splitlines()
+    regions = parse_regions(lines)
+    if not regions:
+        sys.exit('%s: no memory configuration' % args.map)
+    modules = parse_modules(args.module)
+
+    usage = {}
+    for _, obj, kinds, size in parse_sections(lines, regions):
+        entry = usage.setdefault(module_of(obj, modules),
+                                 {'flash': 0, 'ram': 0})
+        for kind in kinds:
+            entry[kind] += size
+
+    capacity = {'flash': 0, 'ram': 0}
+    for _, origin, length in regions:
+        kind = region_kind(regions, origin)
+        if kind is not None:
+            capacity[kind] += length
+
+    base = None
+    if args.baseline and not args.save and os.path.exists(args.baseline):
+        base = json.load(open(args.baseline))
+
+    def base_of(module, kind):
+        if base is None:
+            return None
+        return base['modules'].get(module, {}).get(kind, 0)
+
+    print('%-10s %8s %8s' % ('module', 'flash', 'ram'))
+    totals = {'flash': 0, 'ram': 0}
+    for module in sorted(usage, key=lambda m: -usage[m]['flash']):
+        u = usage[module]
+        print('%-10s %8d %8d%s%s' % (module, u['flash'], u['ram'],
+                                     delta(u['flash'],
+                                           base_of(module, 'flash')),
+                                     delta(u['ram'], base_of(module, 'ram'))))
+        totals['flash'] += u['flash']
+        totals['ram'] += u['ram']
+    if base is not None:
+        for module in sorted(set(base['modules']) - set(usage)):
+            print('%-10s %8s %8s  (removed)' % (module, '-', '-'))
+    for kind in ('flash', 'ram'):
+        cap = capacity[kind]
+        print('%-10s %8d / %d bytes, %.1f%% used%s' %
+              ('total ' + kind, totals[kind], cap,
+               100.0 * totals[kind] / cap if cap else 0.0,
+               delta(totals[kind],
+                     base['totals'][kind] if base is not None else None)))
+    if args.baseline and not args.save and base is None:
+        print('no baseline in %s, run "make size-baseline"' % args.baseline)
+
+    if args.elf:
+        print('\ntop %d symbols' % args.top)
+        for size, name, kind in read_symbols(args.nm, args.elf,
+                                             regions)[:args.top]:
+            print('%8d %-5s %s' % (size, kind, name))
+
+    if args.su:
+        print('\ntop %d stack frames' % args.top)
+        for size, func, qual, obj in read_stack_usage(args.su)[:args.top]:
+            print('%8d %-10s %s (%s, %s)' % (size, module_of(obj, modules),
+                                             func, obj, qual))
+
+    if args.save:
+        if not args.baseline:
+            sys.exit('--save requires --baseline')
+        with open(args.baseline, 'w') as f:
+            json.dump({'modules': usage, 'totals': totals}, f, indent=2,
+                      sort_keys=True)
+            f.write('\n')
+        print('\nbaseline saved to %s' % args.baseline)
+
+
+if __name__ == '__main__':
+    main()
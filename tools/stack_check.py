@@ -0,0 +1,385 @@
+#!/usr/bin/env python3
+#
+# Worst-case stack usage of the thread entries and interrupt handlers.
+#
+# The frame of each function comes from the -fstack-usage .su files, the
+# call graph from the disassembly of the linked image. The worst case of an
+# entry is its deepest path, recursion is cut at the first repeated
+# function, once per path: a function on a call cycle is evaluated again
+# for each set of cycle members above it. Indirect calls are resolved only
+# for the callers listed with --indirect, the results of entries reaching
+# other indirect calls are lower bounds and marked so.
+#
+# The thread working areas are read from the sources: THD_WORKING_AREA()
+# declarations started by chThdCreateStatic(), THD_WORKING_AREA_SIZE()
+# macros passed to chThdCreateFromHeap() or to the thread creation
+# wrappers given with --wrapper. The declared size is the application
+# stack, the port overhead is added by the THD_WORKING_AREA macros.
+#
+# Usage: stack_check.py --elf <elf> --su <dir> --sources <files>
+#                       [--objdump <tool>] [--wrapper func=entry]...
+#                       [--indirect caller=regex]... [--process-stack N]
+#                       [--exceptions-stack N] [--isr-nesting N]
+#
+
+import argparse
+import os
+import re
+import subprocess
+import sys
+
+# Exception frame stacked on each interrupt entry.
+EXCEPTION_FRAME = 32
+
+RE_FUNC = re.compile(r'^[0-9a-f]+ <([^>]+)>:$')
+RE_CALL = re.compile(r'^\s*[0-9a-f]+:\s+(?:[0-9a-f]{4} ?)+\s+'
+                     r'(bl|b\.w|b|blx)(?:\.n|\.w)?\s+[0-9a-f]+ <([^>]+)>')
+RE_ICALL = re.compile(r'^\s*[0-9a-f]+:\s+(?:[0-9a-f]{4} ?)+\s+'
+                      r'(blx|bx)\s+(r\d+|ip)\b')
+RE_VENEER = re.compile(r'^__(.+)_veneer$')
+
+RE_DEFINE = re.compile(r'^\s*#\s*define\s+(\w+)\s+(.+?)\s*(?:/\*.*)?$',
+                       re.M)
+RE_WA_DECL = re.compile(r'THD_WORKING_AREA\s*\(\s*(\w+)(?:\[[^]]*\])?\s*,'
+                        r'\s*([^)]+)\)')
+RE_WA_SIZE = re.compile(r'^THD_WORKING_AREA_SIZE\s*\(\s*(.+)\s*\)$')
+RE_CREATE_STATIC = re.compile(r'chThdCreateStatic\s*\(\s*(\w+)(?:\[\w*\])?\s*,'
+                              r'[^,]+,[^,]+,\s*(\w+)\s*,')
+RE_CREATE_HEAP = re.compile(r'chThdCreateFromHeap\s*\(\s*[^,]+,\s*(\w+)\s*,'
+                            r'[^,]+,\s*(\w+)\s*,')
+
+
+def plain_name(name):
+    """Qualified name of a C++ function without its return type and
+    parameters, as printed by both the .su files and objdump -C, C names
+    are unchanged."""
+    name = name.replace('(anonymous namespace)', '{anonymous}')
+    name = name.split('(', 1)[0].strip()
+    return name.split()[-1] if name else name
+
+
+def read_frames(sudir):
+    """Function name to (frame bytes, dynamic) from the .su files, static
+    functions sharing a name take the largest frame."""
+    frames = {}
+    for root, _, files in os.walk(sudir):
+        for fname in files:
+            if not fname.endswith('.su'):
+                continue
+            for line in open(os.path.join(root, fname)):
+                fields = line.rstrip('\n').split('\t')
+                if len(fields) != 3:
+                    continue
+                func = plain_name(fields[0].split(':', 3)[-1])
+                size = int(fields[1])
+                dynamic = 'dynamic' in fields[2]
+                old = frames.get(func, (0, False))
+                frames[func] = (max(size, old[0]), dynamic or old[1])
+    return frames
+
+
+def read_callgraph(objdump, elf):
+    """Function name to (callees, indirect call count)."""
+    out = subprocess.run([objdump, '-d', '-C', elf], check=True,
+                         stdout=subprocess.PIPE,
+                         universal_newlines=True).stdout
+    graph = {}
+    current = None
+    for line in out.splitlines():
+        m = RE_FUNC.match(line)
+        if m:
+            current = plain_name(m.group(1))
+            graph.setdefault(current, [set(), 0])
+            continue
+        if current is None:
+            continue
+        m = RE_CALL.match(line)
+        if m:
+            target = m.group(2)
+            if '+0x' in target:
+                continue
+            target = plain_name(target)
+            if target == current:
+                continue
+            v = RE_VENEER.match(target)
+            if v:
+                target = v.group(1)
+            graph[current][0].add(target)
+            continue
+        m = RE_ICALL.match(line)
+        if m and not (m.group(1) == 'bx' and m.group(2) == 'lr'):
+            graph[current][1] += 1
+    # Veneers forward to their target.
+    for name in list(graph):
+        v = RE_VENEER.match(name)
+        if v:
+            graph[name][0].add(v.group(1))
+    return graph
+
+
+def resolve_indirect(graph, specs):
+    """Adds the callees of the --indirect caller=regex specs, the resolved
+    callers have their indirect calls cleared."""
+    for spec in specs:
+        caller, _, pattern = spec.partition('=')
+        regex = re.compile(pattern)
+        if caller not in graph:
+            continue
+        for name in graph:
+            if regex.fullmatch(name):
+                graph[caller][0].add(name)
+        graph[caller][1] = 0
+
+
+def cycles(graph):
+    """Function name to the set of functions sharing a call cycle with it,
+    for the functions on a cycle (Tarjan, iterative)."""
+    index, low, onstack, stack, result = {}, {}, set(), [], {}
+    counter = 0
+    for root in graph:
+        if root in index:
+            continue
+        work = [(root, iter(sorted(graph[root][0])))]
+        index[root] = low[root] = counter
+        counter += 1
+        stack.append(root)
+        onstack.add(root)
+        while work:
+            func, callees = work[-1]
+            for callee in callees:
+                if callee not in graph:
+                    continue
+                if callee not in index:
+                    index[callee] = low[callee] = counter
+                    counter += 1
+                    stack.append(callee)
+                    onstack.add(callee)
+                    work.append((callee, iter(sorted(graph[callee][0]))))
+                    break
+                if callee in onstack:
+                    low[func] = min(low[func], index[callee])
+            else:
+                work.pop()
+                if work:
+                    caller = work[-1][0]
+                    low[caller] = min(low[caller], low[func])
+                if low[func] == index[func]:
+                    component = set()
+                    while True:
+                        member = stack.pop()
+                        onstack.discard(member)
+                        component.add(member)
+                        if member == func:
+                            break
+                    if len(component) > 1:
+                        for member in component:
+                            result[member] = component
+    return result
+
+
+def worst_path(entry, graph, frames, cyclic):
+    """(bytes, path, unknown functions, unresolved indirect) of the deepest
+    path from an entry.
+
+    The deepest path of a function on a call cycle depends on the callers
+    above it, the cycle members among them are cut. Its result is kept for
+    that set of callers only, the other functions are computed once."""
+    memo = {}
+
+    def visit(func, stack):
+        key = (func, frozenset(stack & cyclic.get(func, set())))
+        if key in memo:
+            return memo[key]
+        frame = frames.get(func, (0, False))[0]
+        unknown = set() if func in frames else {func}
+        callees, indirect = graph.get(func, (set(), 0))
+        best, best_path = 0, []
+        unresolved = indirect > 0
+        for callee in sorted(callees):
+            if callee in stack:
+                continue
+            size, path, unk, unres = visit(callee, stack | {callee})
+            unknown |= unk
+            unresolved |= unres
+            if size > best:
+                best, best_path = size, path
+        result = (frame + best, [func] + best_path, unknown, unresolved)
+        memo[key] = result
+        return result
+
+    return visit(entry, {entry})
+
+
+def eval_size(expr, defines, depth=0):
+    """Integer value of a size expression made of literals and macros."""
+    expr = expr.strip()
+    m = RE_WA_SIZE.match(expr)
+    if m:
+        return eval_size(m.group(1), defines, depth)
+    if depth > 8:
+        return None
+    tokens = re.split(r'(\W)', expr)
+    out = []
+    for tok in tokens:
+        if re.fullmatch(r'[A-Za-z_]\w*', tok):
+            if tok not in defines:
+                return None
+            value = eval_size(defines[tok], defines, depth + 1)
+            if value is None:
+                return None
+            tok = str(value)
+        out.append(re.sub(r'(?<=\d)[uUlL]+', '', tok))
+    try:
+        return int(eval(''.join(out), {'__builtins__': {}}))
+    except Exception:
+        return None
+
+
+def read_threads(sources, wrappers):
+    """(entry, declared stack, where) of the threads found in the sources."""
+    texts = {}
+    defines = {}
+    for src in sources:
+        if not os.path.exists(src):
+            continue
+        text = open(src).read()
+        texts[src] = text
+        for name, value in RE_DEFINE.findall(text):
+            defines.setdefault(name, value)
+    for src in sources:
+        hdr = os.path.splitext(src)[0] + '.h'
+        if os.path.exists(hdr):
+            for name, value in RE_DEFINE.findall(open(hdr).read()):
+                defines.setdefault(name, value)
+
+    threads = []
+    for src, text in texts.items():
+        was = dict(RE_WA_DECL.findall(text))
+        for wa, entry in RE_CREATE_STATIC.findall(text):
+            if wa in was:
+                threads.append((entry, eval_size(was[wa], defines),
+                                os.path.basename(src)))
+        for size, entry in RE_CREATE_HEAP.findall(text):
+            threads.append((entry, eval_size(size, defines),
+                            os.path.basename(src)))
+        for wrapper, entry in wrappers:
+            regex = re.compile(r'\b%s\s*\(\s*[^,]+,\s*(\w+)\s*,' %
+                               re.escape(wrapper))
+            for size in regex.findall(text):
+                threads.append((entry, eval_size(size, defines),
+                                os.path.basename(src)))
+    unique = {}
+    for entry, size, where in threads:
+        if entry not in unique or (size or 0) > (unique[entry][0] or 0):
+            unique[entry] = (size, where)
+    return [(e, s, w) for e, (s, w) in sorted(unique.items())]
+
+
+def status_of(declared, worst, unresolved, slack):
+    if declared is None:
+        return 'size unknown'
+    if worst > declared:
+        return 'UNDER-PROVISIONED'
+    if declared - worst > max(slack, declared // 4) and not unresolved:
+        return 'over-provisioned'
+    return 'ok'
+
+
+def main():
+    ap = argparse.ArgumentParser(description='Worst-case stack usage.')
+    ap.add_argument('--elf', required=True, help='linked image')
+    ap.add_argument('--su', required=True,
+                    help='directory of the -fstack-usage files')
+    ap.add_argument('--sources', required=True,
+                    help='C sources holding the thread definitions')
+    ap.add_argument('--objdump', default='arm-none-eabi-objdump')
+    ap.add_argument('--wrapper', action='append', default=[],
+                    metavar='FUNC=ENTRY',
+                    help='thread creation wrapper taking the size second')
+    ap.add_argument('--indirect', action='append', default=[],
+                    metavar='CALLER=REGEX',
+                    help='functions reachable from the indirect calls of '
+                         'a caller')
+    ap.add_argument('--process-stack', type=lambda v: int(v, 0),
+                    help='main() stack size')
+    ap.add_argument('--exceptions-stack', type=lambda v: int(v, 0),
+                    help='interrupts stack size')
+    ap.add_argument('--isr-nesting', type=int, default=3,
+                    help='interrupt nesting levels accounted')
+    ap.add_argument('--slack', type=int, default=128,
+                    help='margin in bytes tolerated before flagging an '
+                         'area as over-provisioned')
+    ap.add_argument('-v', '--verbose', action='store_true',
+                    help='print the worst path of every entry')
+    args = ap.parse_args()
+
+    frames = read_frames(args.su)
+    if not frames:
+        sys.exit('%s: no .su files, build with -fstack-usage' % args.su)
+    graph = read_callgraph(args.objdump, args.elf)
+    resolve_indirect(graph, args.indirect)
+    cyclic = cycles(graph)
+    wrappers = [tuple(w.split('=', 1)) for w in args.wrapper]
+    threads = read_threads(args.sources.split(), wrappers)
+    if args.process_stack is not None:
+        threads.append(('main', args.process_stack, 'process stack'))
+
+    failed = False
+    lower_bounds = False
+    unknown_all = set()
+    print('%-20s %-14s %8s %8s %8s  %s' %
+          ('entry', 'defined in', 'declared', 'worst', 'margin', 'status'))
+    for entry, declared, where in threads:
+        if entry not in graph:
+            print('%-20s %-14s %8s %8s %8s  not linked' %
+                  (entry, where, declared, '-', '-'))
+            continue
+        worst, path, unknown, unresolved = worst_path(entry, graph, frames,
+                                                      cyclic)
+        unknown_all |= unknown
+        lower_bounds |= unresolved
+        status = status_of(declared, worst, unresolved, args.slack)
+        failed |= status == 'UNDER-PROVISIONED'
+        print('%-20s %-14s %8s %7d%s %8s  %s' %
+              (entry, where, declared if declared is not None else '?',
+               worst, '+' if unresolved else ' ',
+               declared - worst if declared is not None else '-', status))
+        if args.verbose or status != 'ok':
+            print('    ' + ' > '.join(path))
+
+    isrs = []
+    for name in graph:
+        if re.fullmatch(r'Vector[0-9A-F]+|\w+_Handler', name):
+            worst, path, unknown, unresolved = worst_path(name, graph,
+                                                          frames, cyclic)
+            unknown_all |= unknown
+            lower_bounds |= unresolved
+            isrs.append((worst + EXCEPTION_FRAME, name, unresolved, path))
+    isrs.sort(reverse=True)
+    if isrs:
+        print('\n%-20s %8s' % ('interrupt', 'worst'))
+        for worst, name, unresolved, path in isrs[:args.isr_nesting + 2]:
+            print('%-20s %7d%s' % (name, worst, '+' if unresolved else ' '))
+            if args.verbose:
+                print('    ' + ' > '.join(path))
+        nested = sum(w for w, _, _, _ in isrs[:args.isr_nesting])
+        print('%d nested interrupts: %d bytes' % (args.isr_nesting, nested))
+        if args.exceptions_stack is not None:
+            status = status_of(args.exceptions_stack, nested, False,
+                               args.slack)
+            failed |= status == 'UNDER-PROVISIONED'
+            print('exceptions stack %d bytes, margin %d, %s' %
+                  (args.exceptions_stack, args.exceptions_stack - nested,
+                   status))
+
+    if unknown_all:
+        print('\nno stack information, counted as zero: ' +
+              ' '.join(sorted(unknown_all)))
+    if lower_bounds:
+        print('"+" marks lower bounds, the path reaches unresolved indirect '
+              'calls')
+    sys.exit(1 if failed else 0)
+
+
+if __name__ == '__main__':
+    main()
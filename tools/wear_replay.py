@@ -0,0 +1,168 @@
+#!/usr/bin/env python3
+#
+# EEPROM wear model, replays write traces and reports the program count
+# distribution over the pages and the projected lifetime.
+#
+# A trace is a text file with one write per line, "<seconds> <address>
+# <length>", numbers in C notation, "#" starts a comment. Writes are split
+# on page boundaries like at25Write() does, every page touched is one
+# program. The wear counters store of wear.c is modelled as well: after
+# every --flush programs the counters record is written alternately to
+# two slots, only the record pages whose content changed are programmed.
+# --synthetic datalog generates the pattern of the data logger instead of
+# reading a trace.
+#
+# Usage: wear_replay.py (--trace <file> | --synthetic datalog)
+#                       [--size N] [--page N] [--rated N] [--flush N]
+#                       [--wear-base N] [--granule N] [--duration DAYS]
+#                       [--commit S] [--top N]
+#
+
+import argparse
+import struct
+import sys
+import zlib
+
+RECORD_HEADER = 16
+
+
+def read_trace(path):
+    """(seconds, address, length) of the trace lines."""
+    for line in open(path):
+        line = line.split('#', 1)[0].split()
+        if not line:
+            continue
+        if len(line) != 3:
+            sys.exit('%s: bad line "%s"' % (path, ' '.join(line)))
+        yield float(line[0]), int(line[1], 0), int(line[2], 0)
+
+
+def datalog_trace(days, commit, pages=64, window=0x8000, page=32):
+    """Data logger: one data page per commit after the header page, the
+    header is rewritten when the oldest valid sequence number moves, at
+    half the sequence window."""
+    t = 0.0
+    seq = 0
+    first = 0
+    end = days * 86400.0
+    while t < end:
+        t += commit
+        yield t, (seq % pages + 1) * page, page
+        if (seq - first) & 0xFFFF >= window // 2:
+            first = (seq + 1 - pages) & 0xFFFF
+            yield t, 0, 12
+        seq = (seq + 1) & 0xFFFF
+
+
+class Wear:
+
+    def __init__(self, args):
+        self.args = args
+        self.npages = args.size // args.page
+        self.counts = [0] * self.npages
+        self.since_flush = 0
+        self.slot = 0
+        self.seq = 0
+        rec = RECORD_HEADER + 2 * 128
+        self.slot_size = -(-rec // args.page) * args.page
+        self.stored = [bytes(self.slot_size), bytes(self.slot_size)]
+
+    def program(self, addr, n):
+        while n > 0:
+            chunk = min(n, self.args.page - addr % self.args.page)
+            self.counts[addr // self.args.page] += 1
+            self.since_flush += 1
+            addr += chunk
+            n -= chunk
+        if self.args.flush and self.since_flush >= self.args.flush:
+            self.flush()
+
+    def flush(self):
+        g = self.args.granule
+        units = [min((c + g - 1) // g, 0xFFFF) for c in self.counts]
+        units += [0] * (128 - len(units))
+        self.seq = (self.seq + 1) & 0xFFFF
+        counts = struct.pack('<128H', *units)
+        record = struct.pack('<IHHHHI', 0x52414557, self.seq, self.npages,
+                             g, 0, zlib.crc32(counts)) + counts
+        record = record.ljust(self.slot_size, b'\0')
+        old = self.stored[self.slot]
+        base = self.args.wear_base + self.slot * self.slot_size
+        self.since_flush = 0
+        page = self.args.page
+        for off in range(0, self.slot_size, page):
+            if record[off:off + page] != old[off:off + page]:
+                self.counts[(base + off) // page] += 1
+        self.stored[self.slot] = record
+        self.slot ^= 1
+
+
+def main():
+    ap = argparse.ArgumentParser(description='EEPROM wear replay.')
+    src = ap.add_mutually_exclusive_group(required=True)
+    src.add_argument('--trace', help='write trace file')
+    src.add_argument('--synthetic', choices=['datalog'],
+                     help='generated write pattern')
+    ap.add_argument('--size', type=lambda v: int(v, 0), default=4096)
+    ap.add_argument('--page', type=int, default=32)
+    ap.add_argument('--rated', type=int, default=1000000,
+                    help='rated write cycles per page')
+    ap.add_argument('--flush', type=int, default=256,
+                    help='programs between counter stores, 0 disables')
+    ap.add_argument('--wear-base', type=lambda v: int(v, 0), default=0x900)
+    ap.add_argument('--granule', type=int, default=32)
+    ap.add_argument('--duration', type=float, default=30.0,
+                    help='synthetic trace length in days')
+    ap.add_argument('--commit', type=float, default=60.0,
+                    help='synthetic data logger commit interval in seconds')
+    ap.add_argument('--top', type=int, default=8)
+    args = ap.parse_args()
+
+    if args.trace:
+        trace = read_trace(args.trace)
+    else:
+        trace = datalog_trace(args.duration, args.commit, page=args.page)
+
+    wear = Wear(args)
+    start = end = None
+    for t, addr, n in trace:
+        if addr + n > args.size:
+            sys.exit('write %#x+%d outside the device' % (addr, n))
+        start = t if start is None else start
+        end = t
+        wear.program(addr, n)
+    if start is None:
+        sys.exit('empty trace')
+    seconds = max(end - start, 1.0)
+
+    counts = wear.counts
+    total = sum(counts)
+    used = [c for c in counts if c > 0]
+    print('%.1f days, %d programs on %d/%d pages, average %.0f, max %d' %
+          (seconds / 86400, total, len(used), len(counts),
+           total / len(counts), max(counts)))
+
+    print('\nprograms        pages')
+    bounds = [0, 1, 10, 100, 1000, 10000, 100000, 1000000]
+    for lo, hi in zip(bounds, bounds[1:] + [None]):
+        n = sum(1 for c in counts if c >= lo and (hi is None or c < hi))
+        label = '%d' % lo if hi == lo + 1 else \
+                '%d-%s' % (lo, hi - 1 if hi else '')
+        print('%-14s %6d' % (label, n))
+
+    print('\npage  programs  lifetime days')
+    order = sorted(range(len(counts)), key=lambda p: -counts[p])
+    for p in order[:args.top]:
+        if counts[p] == 0:
+            break
+        life = args.rated * seconds / counts[p] / 86400
+        print('%4d  %8d  %13.0f' % (p, counts[p], life))
+    hottest = order[0]
+    if counts[hottest]:
+        print('\ndevice lifetime %.1f years (page %d)' %
+              (args.rated * seconds / counts[hottest] / 86400 / 365,
+               hottest))
+
+
+if __name__ == '__main__':
+    main()
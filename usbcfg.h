@@ -0,0 +1,40 @@
+/*
+    ChibiOS - Copyright (C) 2006..2015 Giovanni Di Sirio
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+#ifndef _USBCFG_H_
+#define _USBCFG_H_
+
+/*
+ * Endpoints assignment.
+ */
+#define USBD1_DATA_REQUEST_EP           1
+#define USBD1_DATA_AVAILABLE_EP         1
+#define USBD1_INTERRUPT_REQUEST_EP      2
+
+/*
+ * Number of max-size packets buffered in the TX FIFO of the bulk IN
+ * endpoint, two packets give a double-buffered endpoint so that the next
+ * packet is already loaded while the host is fetching the current one.
+ */
+#define USBD1_DATA_IN_MULTIPLIER        2
+
+extern const USBConfig usbcfg;
+extern const SerialUSBConfig serusbcfg;
+extern SerialUSBDriver SDU1;
+
+#endif  /* _USBCFG_H_ */
+
+/** @} */
@@ -0,0 +1,332 @@
+/*
+    ChibiOS - Copyright (C) 2006..2015 Giovanni Di Sirio
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+
+/**
+ * @file    wear.c
+ * @brief   EEPROM wear tracking code.
+ * @details The EEPROM driver counts the programs of each page in RAM, the
+ *          counters are stored in a reserved region after a batch of
+ *          programs or after a time interval, alternately in two copies
+ *          so that an interrupted store leaves the previous one valid.
+ *          The stored counters are coarse and rounded up, a store only
+ *          programs the pages of the record whose content changed.
+ *
+ * @addtogroup WEAR
+ * @{
+ */
+
+#include <stddef.h>
+#include <string.h>
+
+#include "ch.h"
+#include "hal.h"
+#include "chprintf.h"
+
+#include "wear.h"
+#include "dsp.h"
+
+/*===========================================================================*/
+/* Module local definitions.                                                 */
+/*===========================================================================*/
+
+#define WEAR_MAGIC                  0x52414557      /* "WEAR" */
+
+/* Lifetime of a page not programmed since boot.*/
+#define WEAR_NO_PROJECTION          0xFFFFFFFFU
+
+/**
+ * @brief   Stored counters record.
+ */
+typedef struct {
+  uint32_t              magic;
+  uint16_t              seq;                /**< @brief Store sequence.     */
+  uint16_t              pages;              /**< @brief Tracked pages.      */
+  uint16_t              granule;            /**< @brief Programs per unit.  */
+  uint16_t              reserved;
+  uint32_t              crc;                /**< @brief CRC-32 of the
+                                                 record, this field
+                                                 excluded.                  */
+  uint16_t              counts[WEAR_MAX_PAGES];
+} wear_record_t;
+
+/*===========================================================================*/
+/* Module local variables.                                                   */
+/*===========================================================================*/
+
+static AT25Driver *wear_eepp;
+static MUTEX_DECL(wear_mtx);
+static wear_record_t wear_rec;
+static uint32_t wear_counts[WEAR_MAX_PAGES];
+static uint32_t wear_boot[WEAR_MAX_PAGES];
+static unsigned wear_pages;
+static uint32_t wear_slot_size;
+static unsigned wear_next_slot;
+static uint32_t wear_stored_total;
+static systime_t wear_stored_time;
+static uint64_t wear_uptime;
+static systime_t wear_uptime_last;
+
+/*===========================================================================*/
+/* Module local functions.                                                   */
+/*===========================================================================*/
+
+static uint32_t record_crc(const wear_record_t *rp) {
+
+  return dspCrc32(dspCrc32(0, rp, offsetof(wear_record_t, crc)),
+                  rp->counts, sizeof rp->counts);
+}
+
+/*
+ * Reads a copy of the record into the record buffer, returns true if it
+ * is valid for the device.
+ */
+static bool load_slot(unsigned slot) {
+
+  if (at25Read(wear_eepp, WEAR_BASE + slot * wear_slot_size,
+               (uint8_t *)&wear_rec, sizeof wear_rec) != MSG_OK)
+    return false;
+  return (wear_rec.magic == WEAR_MAGIC) && (wear_rec.pages == wear_pages) &&
+         (wear_rec.granule == WEAR_GRANULE) &&
+         (wear_rec.crc == record_crc(&wear_rec));
+}
+
+static uint32_t total_programs(void) {
+  uint32_t total = 0;
+  unsigned i;
+
+  for (i = 0; i < wear_pages; i++)
+    total += wear_counts[i];
+  return total;
+}
+
+/*
+ * Seconds since the tracking start. The system time wraps, the elapsed
+ * ticks are accumulated at each call, wearPoll() calls it well within a
+ * wrap period.
+ */
+static uint64_t uptime_seconds(void) {
+  systime_t now;
+
+  chMtxLock(&wear_mtx);
+  now = chVTGetSystemTimeX();
+  wear_uptime += (systime_t)(now - wear_uptime_last);
+  wear_uptime_last = now;
+  chMtxUnlock(&wear_mtx);
+  return wear_uptime / CH_CFG_ST_FREQUENCY;
+}
+
+/*
+ * Days left before a page reaches the rated cycles at its program rate
+ * since boot.
+ */
+static uint32_t lifetime_days(unsigned page, uint64_t uptime) {
+  uint32_t programs = wear_counts[page] - wear_boot[page];
+  uint64_t left;
+
+  if (programs == 0)
+    return WEAR_NO_PROJECTION;
+  left = wear_counts[page] < WEAR_RATED_CYCLES ?
+         WEAR_RATED_CYCLES - wear_counts[page] : 0;
+  left = (left * uptime) / ((uint64_t)programs * 86400);
+  return left < WEAR_NO_PROJECTION ? (uint32_t)left : WEAR_NO_PROJECTION - 1;
+}
+
+/*===========================================================================*/
+/* Module exported functions.                                                */
+/*===========================================================================*/
+
+/**
+ * @brief   Loads the stored counters and starts tracking a device.
+ * @pre     The device has been started and its block protection set.
+ *
+ * @param[in] eepp      the EEPROM driver
+ * @return              The operation status.
+ * @retval MSG_OK       if the tracking is started, the counters start from
+ *                      zero if no valid copy is stored.
+ * @retval MSG_RESET    if the device has too many pages or the region
+ *                      does not fit below the protected blocks.
+ *
+ * @api
+ */
+msg_t wearStart(AT25Driver *eepp) {
+  uint32_t ps = at25GetPageSize(eepp);
+  uint16_t seq0;
+  bool valid0;
+  unsigned i;
+
+  wear_pages     = at25GetSize(eepp) / ps;
+  wear_slot_size = ((sizeof wear_rec + ps - 1) / ps) * ps;
+  if ((wear_pages > WEAR_MAX_PAGES) || (WEAR_BASE % ps != 0) ||
+      (WEAR_BASE + 2 * wear_slot_size > at25GetProtectedBase(eepp)))
+    return MSG_RESET;
+
+  /* The newest valid copy is loaded, the next store goes to the other.*/
+  wear_eepp = eepp;
+  valid0 = load_slot(0);
+  seq0   = wear_rec.seq;
+  if (load_slot(1) && (!valid0 || ((int16_t)(wear_rec.seq - seq0) > 0)))
+    wear_next_slot = 0;
+  else if (valid0 && load_slot(0))
+    wear_next_slot = 1;
+  else {
+    memset(&wear_rec, 0, sizeof wear_rec);
+    wear_rec.seq   = 0xFFFF;
+    wear_next_slot = 0;
+  }
+
+  for (i = 0; i < wear_pages; i++) {
+    wear_counts[i] = (uint32_t)wear_rec.counts[i] * WEAR_GRANULE;
+    wear_boot[i]   = wear_counts[i];
+  }
+  wear_stored_total = total_programs();
+  wear_stored_time  = chVTGetSystemTimeX();
+  wear_uptime       = 0;
+  wear_uptime_last  = wear_stored_time;
+  at25SetWearCounters(eepp, wear_counts);
+  return MSG_OK;
+}
+
+/**
+ * @brief   Stores the counters.
+ *
+ * @return              The operation status.
+ * @retval MSG_RESET    if the tracking is not started.
+ *
+ * @api
+ */
+msg_t wearFlush(void) {
+  uint32_t units;
+  unsigned i;
+  msg_t msg;
+
+  if (wear_eepp == NULL)
+    return MSG_RESET;
+
+  chMtxLock(&wear_mtx);
+  wear_rec.magic    = WEAR_MAGIC;
+  wear_rec.seq++;
+  wear_rec.pages    = (uint16_t)wear_pages;
+  wear_rec.granule  = WEAR_GRANULE;
+  wear_rec.reserved = 0;
+  for (i = 0; i < WEAR_MAX_PAGES; i++) {
+    units = 0;
+    if (i < wear_pages)
+      units = (wear_counts[i] + WEAR_GRANULE - 1) / WEAR_GRANULE;
+    wear_rec.counts[i] = units > 0xFFFF ? 0xFFFF : (uint16_t)units;
+  }
+  wear_rec.crc = record_crc(&wear_rec);
+  msg = at25Write(wear_eepp, WEAR_BASE + wear_next_slot * wear_slot_size,
+                  (const uint8_t *)&wear_rec, sizeof wear_rec);
+  if (msg == MSG_OK) {
+    wear_next_slot ^= 1;
+    wear_stored_total = total_programs();
+    wear_stored_time  = chVTGetSystemTimeX();
+  }
+  chMtxUnlock(&wear_mtx);
+  return msg;
+}
+
+/**
+ * @brief   Stores the counters if the store policy requires it.
+ * @details A store happens after @p WEAR_FLUSH_PROGRAMS programs or after
+ *          @p WEAR_FLUSH_INTERVAL_S seconds with at least one program.
+ *
+ * @api
+ */
+void wearPoll(void) {
+  uint32_t programs;
+
+  if (wear_eepp == NULL)
+    return;
+
+  (void)uptime_seconds();
+  programs = total_programs() - wear_stored_total;
+  if ((programs >= WEAR_FLUSH_PROGRAMS) ||
+      ((programs > 0) && (chVTTimeElapsedSinceX(wear_stored_time) >=
+                          S2ST(WEAR_FLUSH_INTERVAL_S))))
+    (void)wearFlush();
+}
+
+/**
+ * @brief   Prints the hottest pages and the projected lifetime.
+ * @details The projection assumes the program rate since boot continues,
+ *          the device lifetime is the shortest page lifetime.
+ *
+ * @param[in] chp       the output stream
+ *
+ * @api
+ */
+void wearDump(BaseSequentialStream *chp) {
+  unsigned hot[WEAR_HOT_PAGES];
+  uint64_t uptime;
+  uint32_t total = 0, max = 0, life, min_life = WEAR_NO_PROJECTION;
+  unsigned i, j, k, nhot = 0, min_page = 0;
+
+  if (wear_eepp == NULL) {
+    chprintf(chp, "wear tracking not started\r\n");
+    return;
+  }
+
+  /* Insertion of each page in the sorted list of the hottest ones.*/
+  for (i = 0; i < wear_pages; i++) {
+    total += wear_counts[i];
+    if (wear_counts[i] > max)
+      max = wear_counts[i];
+    for (k = 0; k < nhot; k++) {
+      if (wear_counts[i] > wear_counts[hot[k]])
+        break;
+    }
+    if (k < WEAR_HOT_PAGES) {
+      if (nhot < WEAR_HOT_PAGES)
+        nhot++;
+      for (j = nhot - 1; j > k; j--)
+        hot[j] = hot[j - 1];
+      hot[k] = i;
+    }
+  }
+
+  uptime = uptime_seconds();
+  chprintf(chp, "%u pages, %lu programs, average %lu, max %lu, rated %lu\r\n",
+           wear_pages, total, total / wear_pages, max,
+           (uint32_t)WEAR_RATED_CYCLES);
+  chprintf(chp, "page  programs  since boot  lifetime days\r\n");
+  for (k = 0; k < nhot; k++) {
+    i = hot[k];
+    life = lifetime_days(i, uptime);
+    chprintf(chp, "%4u  %8lu  %10lu  ", i, wear_counts[i],
+             wear_counts[i] - wear_boot[i]);
+    if (life != WEAR_NO_PROJECTION)
+      chprintf(chp, "%lu\r\n", life);
+    else
+      chprintf(chp, "-\r\n");
+  }
+
+  for (i = 0; i < wear_pages; i++) {
+    life = lifetime_days(i, uptime);
+    if (life < min_life) {
+      min_life = life;
+      min_page = i;
+    }
+  }
+  if (min_life != WEAR_NO_PROJECTION)
+    chprintf(chp, "device lifetime %lu days at the current rate (page %u)\r\n",
+             min_life, min_page);
+  else
+    chprintf(chp, "no programs since boot, no projection\r\n");
+}
+
+/** @} */
@@ -0,0 +1,130 @@
+/*
+    ChibiOS - Copyright (C) 2006..2015 Giovanni Di Sirio
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+*/
+
+
+/**
+ * @file    wear.h
+ * @brief   EEPROM wear tracking header.
+ *
+ * @addtogroup WEAR
+ * @{
+ */
+
+#ifndef _WEAR_H_
+#define _WEAR_H_
+
+#include "at25xxx.h"
+
+/*===========================================================================*/
+/* Module constants.                                                         */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Module pre-compile time settings.                                         */
+/*===========================================================================*/
+
+/**
+ * @brief   EEPROM address of the counters region, page aligned.
+ * @details The region holds two copies of the counters record, written
+ *          alternately.
+ */
+#if !defined(WEAR_BASE) || defined(__DOXYGEN__)
+#define WEAR_BASE                   0x0900
+#endif
+
+/**
+ * @brief   Largest number of tracked pages.
+ */
+#if !defined(WEAR_MAX_PAGES) || defined(__DOXYGEN__)
+#define WEAR_MAX_PAGES              128
+#endif
+
+/**
+ * @brief   Page programs per stored counter unit.
+ * @details The counters are stored as 16 bits multiples of this value,
+ *          rounded up so that the stored figures never underestimate.
+ */
+#if !defined(WEAR_GRANULE) || defined(__DOXYGEN__)
+#define WEAR_GRANULE                32
+#endif
+
+/**
+ * @brief   Page programs between two stores of the counters.
+ */
+#if !defined(WEAR_FLUSH_PROGRAMS) || defined(__DOXYGEN__)
+#define WEAR_FLUSH_PROGRAMS         256
+#endif
+
+/**
+ * @brief   Longest interval in seconds between two stores of changed
+ *          counters.
+ */
+#if !defined(WEAR_FLUSH_INTERVAL_S) || defined(__DOXYGEN__)
+#define WEAR_FLUSH_INTERVAL_S       3600
+#endif
+
+/**
+ * @brief   Rated write cycles of a page.
+ */
+#if !defined(WEAR_RATED_CYCLES) || defined(__DOXYGEN__)
+#define WEAR_RATED_CYCLES           1000000
+#endif
+
+/**
+ * @brief   Number of pages listed by @p wearDump().
+ */
+#if !defined(WEAR_HOT_PAGES) || defined(__DOXYGEN__)
+#define WEAR_HOT_PAGES              8
+#endif
+
+/*===========================================================================*/
+/* Derived constants and error checks.                                       */
+/*===========================================================================*/
+
+#if WEAR_GRANULE < 1
+#error "invalid WEAR_GRANULE value"
+#endif
+
+#if WEAR_RATED_CYCLES / WEAR_GRANULE > 0xFFFF
+#error "WEAR_GRANULE too small for WEAR_RATED_CYCLES"
+#endif
+
+/*===========================================================================*/
+/* Module data structures and types.                                         */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Module macros.                                                            */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* External declarations.                                                    */
+/*===========================================================================*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+  msg_t wearStart(AT25Driver *eepp);
+  msg_t wearFlush(void);
+  void wearPoll(void);
+  void wearDump(BaseSequentialStream *chp);
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _WEAR_H_ */
+
+/** @} */